@@ -35,6 +35,8 @@ namespace nanoflann {
             index->buildIndex();
         }
         ~KDTreeAdaptor() {delete index;}
+        /// Refit the tree after the points of the matrix moved (same number of points)
+        inline void refit() { index->refitIndex(); }
         const MatrixType& m_data_matrix;
         /// Query for the num_closest closest points to a given point (entered as query_point[0:dim-1]).
         inline void query(const num_t *query_point, const size_t num_closest, IndexType *out_indices, num_t *out_distances_sq) const {
@@ -54,6 +56,18 @@ namespace nanoflann {
 			query(query_point, 1, &out_indices, &out_distances_sq);
 			return out_indices;
 		}
+		/// Same as closest() but the search starts bounded by the distance to the point 'hint'
+		/// (any valid index, typically the previous answer for a query that moved a little).
+		/// The result is still the exact closest point.
+		inline IndexType closest(const num_t *query_point, IndexType hint) const {
+			IndexType out_indices;
+			num_t out_distances_sq;
+			nanoflann::KNNResultSet<num_t,IndexType> resultSet(1);
+			resultSet.init(&out_indices, &out_distances_sq);
+			resultSet.addPoint(kdtree_distance(query_point, hint, m_data_matrix.rows()), hint);
+			index->findNeighbors(resultSet, query_point, nanoflann::SearchParams());
+			return out_indices;
+		}
 
         /// Query for the closest points to a given point (entered as query_point[0:dim-1]).
         //inline IndexType closest(const num_t *query_point) const {
@@ -310,17 +324,24 @@ namespace SICP {
     }
     template<>
     inline float shrinkage<0>(float, float, float, float s) {return s;}
+    /// Thresholds of the shrinkage operator, they only depend on mu and p
+    inline void shrink_thresholds(float mu, float p, float& Ba, float& ha) {
+        Ba = std::pow((float)(2.0/mu)*(1.0-p), (float)1.0/(2.0-p));
+        ha = Ba + (p/mu)*(double)std::pow((double)Ba, (double)(p-1.0) );
+    }
+    /// Scale factor applied to a vector of norm n
+    template<unsigned int I>
+    inline float shrink_factor(float n, float mu, float p, float Ba, float ha) {
+        return n > ha ? shrinkage<I>(mu, n, p, (Ba/n + 1.0)/2.0) : 0.0f;
+    }
     /// 3D Shrinkage for point-to-point
     template<unsigned int I>
     inline void shrink(Eigen::Matrix3Xf& Q, float mu, float p) {
-        float Ba = std::pow((float)(2.0/mu)*(1.0-p), (float)1.0/(2.0-p));
-        float ha = Ba + (p/mu)*(double)std::pow((double)Ba, (double)(p-1.0) );
+        float Ba, ha;
+        shrink_thresholds(mu, p, Ba, ha);
         #pragma omp parallel for
         for(int i=0; i<Q.cols(); ++i) {
-            float n = Q.col(i).norm();
-            float w = 0.0;
-            if(n > ha) w = shrinkage<I>(mu, n, p, (Ba/n + 1.0)/2.0);
-            Q.col(i) *= w;
+            Q.col(i) *= shrink_factor<I>(Q.col(i).norm(), mu, p, Ba, ha);
         }
     }
     /// 1D Shrinkage for point-to-plane
@@ -336,62 +357,193 @@ namespace SICP {
             y(i) *= s;
         }
     }
+    /// Sparse ICP session, registers a sequence of sources against the same target.
+    /// The kd-tree of the target is built once and the ADMM buffers are kept between
+    /// calls (only reallocated when the number of source points changes).
+    /// Closest point queries start from the correspondences found by the previous call
+    /// (vtx_map), which bounds the kd-tree search, the result is still the exact closest point.
+    /// Shrinkage, rigid motion and stopping criteria are evaluated in parallel over the points.
+    class Session {
+    public:
+        typedef nanoflann::KDTreeAdaptor<Eigen::Matrix3Xf, 3, nanoflann::metric_L2_Simple> KDTree;
+        /// @param Target (one 3D point per column), copied
+        template <typename Derived>
+        Session(const Eigen::MatrixBase<Derived>& Y) : kdtree(NULL) { set_target(Y); }
+        ~Session() { delete kdtree; }
+        /// Replace the target and rebuild its kd-tree
+        template <typename Derived>
+        void set_target(const Eigen::MatrixBase<Derived>& Y) {
+            delete kdtree;
+            target = Y.template cast<float>();
+            kdtree = new KDTree(target);
+        }
+        const Eigen::Matrix3Xf& get_target() const { return target; }
+        /// Sparse ICP with point to point
+        /// @param Source (one 3D point per column), moved onto the target
+        /// @param Closest target point of every source point (1 x N). Values in [0, target size)
+        ///        are used as a starting guess, the final correspondences are written back
+        /// @param Parameters
+        template <typename Derived1, typename Derived2>
+        void point_to_point(Eigen::MatrixBase<Derived1>& X,
+                            Eigen::MatrixBase<Derived2>& vtx_map,
+                            Parameters par = Parameters()) {
+            const int n = X.cols();
+            if(Q.cols() != n) {
+                Q.resize(3, n); Z.resize(3, n); C.resize(3, n); U.resize(3, n);
+                Xo1.resize(3, n); Xo2.resize(3, n);
+            }
+            C.setZero();
+            Xo1 = X;
+            Xo2 = X;
+            /// ICP
+            for(int icp=0; icp<par.max_icp; ++icp) {
+                /// Find closest point
+                const int nb_target = target.cols();
+                #pragma omp parallel for
+                for(int i=0; i<n; ++i) {
+                    int hint = (int)vtx_map(0,i);
+                    int mp = (hint >= 0 && hint < nb_target) ? kdtree->closest(X.col(i).data(), hint)
+                                                             : kdtree->closest(X.col(i).data());
+                    Q.col(i) = target.col(mp);
+                    vtx_map(0,i) = mp;
+                }
+                /// Computer rotation and translation
+                float mu = par.mu;
+                for(int outer=0; outer<par.max_outer; ++outer) {
+                    float dual = 0.0;
+                    for(int inner=0; inner<par.max_inner; ++inner) {
+                        /// Z update (shrinkage) and U = Q+Z-C/mu
+                        float Ba, ha;
+                        shrink_thresholds(mu, par.p, Ba, ha);
+                        #pragma omp parallel for
+                        for(int i=0; i<n; ++i) {
+                            Eigen::Vector3f c = C.col(i)/mu;
+                            Eigen::Vector3f z = X.col(i)-Q.col(i)+c;
+                            z *= shrink_factor<3>(z.norm(), mu, par.p, Ba, ha);
+                            Z.col(i) = z;
+                            U.col(i) = Q.col(i)+z-c;
+                        }
+                        /// Rotation and translation update
+                        dual = rigid_motion(X);
+                        if(dual < par.stop) break;
+                    }
+                    /// C update (lagrange multipliers), P = X-Q-Z
+                    float primal = 0.0;
+                    #pragma omp parallel
+                    {
+                        float local = 0.0;
+                        #pragma omp for
+                        for(int i=0; i<n; ++i) {
+                            Eigen::Vector3f P = X.col(i)-Q.col(i)-Z.col(i);
+                            if(!par.use_penalty) C.col(i) += mu*P;
+                            local = std::max(local, P.norm());
+                        }
+                        #pragma omp critical
+                        primal = std::max(primal, local);
+                    }
+                    /// mu update (penalty)
+                    if(mu < par.max_mu) mu *= par.alpha;
+                    /// Stopping criteria
+                    if(primal < par.stop && dual < par.stop) break;
+                }
+                /// Stopping criteria
+                float stop = 0.0;
+                #pragma omp parallel
+                {
+                    float local = 0.0;
+                    #pragma omp for
+                    for(int i=0; i<n; ++i) {
+                        local = std::max(local, (X.col(i)-Xo2.col(i)).norm());
+                        Xo2.col(i) = X.col(i);
+                    }
+                    #pragma omp critical
+                    stop = std::max(stop, local);
+                }
+                if(stop < par.stop) break;
+            }
+        }
+    private:
+        Session(const Session&);
+        Session& operator=(const Session&);
+        /// Same result as RigidMotionEstimator::point_to_point(X, U) (rotate about the mean of X,
+        /// then move onto the mean of U). Returns the largest displacement since the previous
+        /// call and stores X in Xo1.
+        template <typename Derived1>
+        float rigid_motion(Eigen::MatrixBase<Derived1>& X) {
+            const int n = X.cols();
+            /// Means
+            Eigen::Vector3d X_sum = Eigen::Vector3d::Zero(), U_sum = Eigen::Vector3d::Zero();
+            #pragma omp parallel
+            {
+                Eigen::Vector3d x_local = Eigen::Vector3d::Zero(), u_local = Eigen::Vector3d::Zero();
+                #pragma omp for
+                for(int i=0; i<n; ++i) {
+                    x_local += X.col(i).template cast<double>();
+                    u_local += U.col(i).template cast<double>();
+                }
+                #pragma omp critical
+                {
+                    X_sum += x_local;
+                    U_sum += u_local;
+                }
+            }
+            const Eigen::Vector3f X_mean = (X_sum/n).cast<float>();
+            const Eigen::Vector3f U_mean = (U_sum/n).cast<float>();
+            /// Cross covariance of the de-meaned points
+            Eigen::Matrix3d sigma_sum = Eigen::Matrix3d::Zero();
+            #pragma omp parallel
+            {
+                Eigen::Matrix3d local = Eigen::Matrix3d::Zero();
+                #pragma omp for
+                for(int i=0; i<n; ++i) {
+                    local += ((X.col(i)-X_mean)*(U.col(i)-U_mean).transpose()).template cast<double>();
+                }
+                #pragma omp critical
+                sigma_sum += local;
+            }
+            Eigen::Matrix3f sigma = sigma_sum.cast<float>();
+            Eigen::JacobiSVD<Eigen::Matrix3f> svd(sigma, Eigen::ComputeFullU | Eigen::ComputeFullV);
+            Eigen::Matrix3f R;
+            if(svd.matrixU().determinant()*svd.matrixV().determinant() < 0.0) {
+                Eigen::Vector3f S = Eigen::Vector3f::Ones(); S(2) = -1.0;
+                R.noalias() = svd.matrixV()*S.asDiagonal()*svd.matrixU().transpose();
+            } else {
+                R.noalias() = svd.matrixV()*svd.matrixU().transpose();
+            }
+            /// Apply rotation, move onto U and measure the displacement
+            float dual = 0.0;
+            #pragma omp parallel
+            {
+                float local = 0.0;
+                #pragma omp for
+                for(int i=0; i<n; ++i) {
+                    Eigen::Vector3f x = R*(X.col(i)-X_mean) + U_mean;
+                    X.col(i) = x;
+                    local = std::max(local, (x-Xo1.col(i)).norm());
+                    Xo1.col(i) = x;
+                }
+                #pragma omp critical
+                dual = std::max(dual, local);
+            }
+            return dual;
+        }
+        Eigen::Matrix3Xf target;
+        KDTree* kdtree;
+        /// Buffers
+        Eigen::Matrix3Xf Q, Z, C, U, Xo1, Xo2;
+    };
     /// Sparse ICP with point to point
     /// @param Source (one 3D point per column)
     /// @param Target (one 3D point per column)
     /// @param Parameters
+    /// @note builds a Session for a single call, keep a Session to register several sources
     template <typename Derived1, typename Derived2,typename Derived3>
     void point_to_point(Eigen::MatrixBase<Derived1>& X,
                         Eigen::MatrixBase<Derived2>& Y,
 						Eigen::MatrixBase<Derived3>& vtx_map,
                         Parameters par = Parameters()) {
-        /// Build kd-tree
-        nanoflann::KDTreeAdaptor<Eigen::MatrixBase<Derived2>, 3, nanoflann::metric_L2_Simple> kdtree(Y);
-        /// Buffers
-        Eigen::Matrix3Xf Q = Eigen::Matrix3Xf::Zero(3, X.cols());
-        Eigen::Matrix3Xf Z = Eigen::Matrix3Xf::Zero(3, X.cols());
-        Eigen::Matrix3Xf C = Eigen::Matrix3Xf::Zero(3, X.cols());
-        Eigen::Matrix3Xf Xo1 = X;
-        Eigen::Matrix3Xf Xo2 = X;
-        /// ICP
-        for(int icp=0; icp<par.max_icp; ++icp) {
-            /// Find closest point
-            #pragma omp parallel for
-            for(int i=0; i<X.cols(); ++i) {
-				unsigned int mp = kdtree.closest(X.col(i).data());
-                Q.col(i) = Y.col(mp/*kdtree.closest(X.col(i).data())*/);
-				vtx_map(0,i) = mp;
-            }
-            /// Computer rotation and translation
-            float mu = par.mu;
-            for(int outer=0; outer<par.max_outer; ++outer) {
-                float dual = 0.0;
-                for(int inner=0; inner<par.max_inner; ++inner) {
-                    /// Z update (shrinkage)
-                    Z = X-Q+C/mu;
-                    shrink<3>(Z, mu, par.p);
-                    /// Rotation and translation update
-                    Eigen::Matrix3Xf U = Q+Z-C/mu;
-                    RigidMotionEstimator::point_to_point(X, U);
-                    /// Stopping criteria
-                    dual = (X-Xo1).colwise().norm().maxCoeff();
-                    Xo1 = X;
-                    if(dual < par.stop) break;
-                }
-                /// C update (lagrange multipliers)
-                Eigen::Matrix3Xf P = X-Q-Z;
-                if(!par.use_penalty) C.noalias() += mu*P;
-                /// mu update (penalty)
-                if(mu < par.max_mu) mu *= par.alpha;
-                /// Stopping criteria
-                double primal = P.colwise().norm().maxCoeff();
-                if(primal < par.stop && dual < par.stop) break;
-            }
-            /// Stopping criteria
-            double stop = (X-Xo2).colwise().norm().maxCoeff();
-            Xo2 = X;
-            if(stop < par.stop) break;
-        }
+        Session session(Y);
+        session.point_to_point(X, vtx_map, par);
     }
 
 
@@ -400,58 +552,15 @@ namespace SICP {
 	/// @param Source (one 3D point per column)
 	/// @param Target (one 3D point per column)
 	/// @param Parameters
+	/// @note point_w_point() and point_to_point() estimate the same rigid motion
+	///       (uniform weights), both run a one-shot Session
 	template <typename Derived1, typename Derived2,typename Derived3>
 	void point_w_point(Eigen::MatrixBase<Derived1>& X,
 		Eigen::MatrixBase<Derived2>& Y,
 		Eigen::MatrixBase<Derived3>& vtx_map,
 		Parameters par = Parameters()) {
-			/// Build kd-tree
-			nanoflann::KDTreeAdaptor<Eigen::MatrixBase<Derived2>, 3, nanoflann::metric_L2_Simple> kdtree(Y);
-			/// Buffers
-			Eigen::Matrix3Xf Q = Eigen::Matrix3Xf::Zero(3, X.cols());
-			Eigen::Matrix3Xf Z = Eigen::Matrix3Xf::Zero(3, X.cols());
-			Eigen::Matrix3Xf C = Eigen::Matrix3Xf::Zero(3, X.cols());
-			Eigen::Matrix3Xf Xo1 = X;
-			Eigen::Matrix3Xf Xo2 = X;
-			/// ICP
-			for(int icp=0; icp<par.max_icp; ++icp) {
-				/// Find closest point
-#pragma omp parallel for
-				for(int i=0; i<X.cols(); ++i) {
-					unsigned int mp = kdtree.closest(X.col(i).data());
-					Q.col(i) = Y.col(mp/*kdtree.closest(X.col(i).data())*/);
-					vtx_map(0,i) = mp;
-				}
-				/// Computer rotation and translation
-				float mu = par.mu;
-				for(int outer=0; outer<par.max_outer; ++outer) {
-					float dual = 0.0;
-					for(int inner=0; inner<par.max_inner; ++inner) {
-						/// Z update (shrinkage)
-						Z = X-Q+C/mu;
-						shrink<3>(Z, mu, par.p);
-						/// Rotation and translation update
-						Eigen::Matrix3Xf U = Q+Z-C/mu;
-						RigidMotionEstimator::point_w_point(X, U);
-						/// Stopping criteria
-						dual = (X-Xo1).colwise().norm().maxCoeff();
-						Xo1 = X;
-						if(dual < par.stop) break;
-					}
-					/// C update (lagrange multipliers)
-					Eigen::Matrix3Xf P = X-Q-Z;
-					if(!par.use_penalty) C.noalias() += mu*P;
-					/// mu update (penalty)
-					if(mu < par.max_mu) mu *= par.alpha;
-					/// Stopping criteria
-					double primal = P.colwise().norm().maxCoeff();
-					if(primal < par.stop && dual < par.stop) break;
-				}
-				/// Stopping criteria
-				double stop = (X-Xo2).colwise().norm().maxCoeff();
-				Xo2 = X;
-				if(stop < par.stop) break;
-			}
+			Session session(Y);
+			session.point_to_point(X, vtx_map, par);
 	}
 
     /// Sparse ICP with point to plane
@@ -6,6 +6,7 @@
 #include <queue>
 #include <algorithm>
 #include <memory>
+#include "linkage_bitset.h"
 
 using namespace std;
 /*
@@ -59,31 +60,7 @@ protected:
 	typedef		double		PSDistanceType;
 	typedef		typename Point2LineDistance::DistanceType		P2LDistanceType;
 
-	struct PS
-	{
-		//Store Index
-		set<IndexType>		which_lines;
-		set<IndexType>		which_points;
-		bool				is_valid;
-		int					node_idx;
-	};
-
-	struct heap_node
-	{
-		heap_node(shared_ptr<PS>& pp1, shared_ptr<PS>& pp2 ):ps1(pp1),ps2(pp2){}
-
-		weak_ptr<PS>		ps1;
-		weak_ptr<PS>		ps2;
-		PSDistanceType	dist;
-	};
-
-	struct greater_than{
-		bool operator()(const heap_node& lhs, const heap_node& rhs )
-		{
-			return lhs.dist > rhs.dist;
-		}
-
-	};
+	friend class linkage::NNLinkage<J_LinkageAdapter>;
 
 public:
 	J_LinkageAdapter( std::vector<Point>& points, std::vector<Line>& lines, std::vector<int>& labels,
@@ -96,82 +73,18 @@ public:
 		ps_init();
 
 		/** PS Merge Procedure **/
-
-		//Construct min-heap
-		std::priority_queue< heap_node, std::vector<heap_node>,greater_than >	min_heap;
-		IndexType		pn= ps_set_.size();
-		for ( IndexType i=0; i < pn; i++ )
-		{
-			for ( IndexType j = i+1; j <pn; j++ )
-			{
-				heap_node	node( ps_set_[i], ps_set_[j] );
-				node.dist = ps_distance( *(ps_set_[i]), *(ps_set_[j]) );
-				if (node.dist==1.)
-				{
-					continue;
-				}
-				min_heap.push( node );
-			}
-		}
-
-		//Begin merge
-		while ( !min_heap.empty() )
-		{
-			heap_node min_node = min_heap.top();
-			min_heap.pop();
-			if (min_node.ps1.expired() || min_node.ps2.expired() )
-			{
-				continue;
-			}
-			if ( min_node.dist > 1. - 1./point_set_.size() )
-			{
-				break;
-			}
-			shared_ptr<PS> ps1 = min_node.ps1.lock();
-			shared_ptr<PS> ps2 = min_node.ps2.lock();
-
-
-			ps_merge( *ps1, *ps2 );
-
-
-			vector< shared_ptr<PS> >::iterator new_ps_iter = ps_set_.end() - 1;
-			for (vector< shared_ptr<PS> >::iterator iter = ps_set_.begin();
-				iter != new_ps_iter; )
-			{
-
-				if (  (*iter)->is_valid ==false )
-				{
-					iter = ps_set_.erase( iter );
-					new_ps_iter = ps_set_.end() - 1;
-				}
-				else
-				{
-					heap_node	node( *iter, *new_ps_iter );
-					node.dist = ps_distance( *(*iter), *(*new_ps_iter) );
-					if (node.dist==1.)
-					{
-						++iter;
-						continue;
-					}
-					min_heap.push( node );
-					++iter;
-				}
-			}
-
-		}
+		linkage::NNLinkage<J_LinkageAdapter>	merger( *this );
+		merger.compute( 1. - 1./point_set_.size() );
 
 		//Store the final label
-		IndexType i=0;
-		for (vector< shared_ptr<PS> >::iterator ps_iter = ps_set_.begin();
-			ps_iter != ps_set_.end();
-			++ps_iter,++i)
+		int label = 0;
+		for ( int ps = 0; ps < cluster_count(); ++ps )
 		{
-			for ( set<IndexType>::iterator p_idx_iter = (*ps_iter)->which_points.begin();
-				p_idx_iter != (*ps_iter)->which_points.end();
-				++p_idx_iter)
-			{
-				label_set_[ *p_idx_iter ] = i;
-			}
+			if ( !merger.is_active(ps) )
+				continue;
+			for ( int p_idx = first_point_[ps]; p_idx != -1; p_idx = next_point_[p_idx] )
+				label_set_[ p_idx ] = label;
+			++label;
 		}
 
 
@@ -179,108 +92,59 @@ public:
 
 protected:
 
-	//Init PS set
+	//Init PS set, one PS per point
 	inline void ps_init()
 	{
-		ps_set_.clear();
-		int point_idx =0 ;
-		for (vector<Point>::iterator p_iter = point_set_.begin(); p_iter!=point_set_.end(); p_iter++, point_idx++ )
+		const int pn = (int)point_set_.size();
+		const int ln = (int)line_set_.size();
+		which_lines_.resize( pn, ln );
+		line_count_.assign( pn, 0 );
+		first_point_.resize( pn );
+		last_point_.resize( pn );
+		next_point_.assign( pn, -1 );
+
+		#pragma omp parallel for
+		for ( int point_idx = 0; point_idx < pn; ++point_idx )
 		{
-			ps_set_.push_back( shared_ptr<PS>(new PS) );
-			PS& ps = *( ps_set_.back() );
-			int line_idx = 0;
-			for(vector<Line>::iterator l_iter = line_set_.begin() ; l_iter!=line_set_.end(); l_iter++,line_idx++)
+			Point2LineDistance	dist_func = p2l_dist_func_;
+			for ( int line_idx = 0; line_idx < ln; ++line_idx )
 			{
-				if( p2l_dist_func_(*p_iter, *l_iter) < p2l_dist_func_.lamda)
-					ps.which_lines.insert( line_idx );
+				if( dist_func(point_set_[point_idx], line_set_[line_idx]) < dist_func.lamda)
+					which_lines_.set( point_idx, line_idx );
 			}
-			ps.is_valid = true;
-			ps.which_points.insert(point_idx);
+			line_count_[point_idx] = which_lines_.count( point_idx );
+			first_point_[point_idx] = point_idx;
+			last_point_[point_idx] = point_idx;
 		}
-		Logger<< "ps size" <<ps_set_[0]->which_lines.size()<<endl;
+		if ( pn > 0 )
+			Logger<< "ps size" <<line_count_[0]<<endl;
 	}
 
-	//Compute Distance between PS
-	PSDistanceType	ps_distance( const PS& ps1, const PS& ps2 )
-	{
-		set<IndexType>::iterator first1  = ps1.which_lines.begin();
-		set<IndexType>::iterator last1 = ps1.which_lines.end();
-		set<IndexType>::iterator first2 = ps2.which_lines.begin();
-		set<IndexType>::iterator last2 = ps2.which_lines.end();
-
-		int intersection_count = 0;
-
-		//Count Intersection Part
-		while (first1!=last1 && first2!=last2)
-		{
-			if ( *first1 < *first2 )++first1;
-			else if ( *first1 > *first2 )++first2;
-			else
-			{
-				intersection_count++;
-				++first1;++first2;
-			}
-		}
+	int cluster_count() const { return (int)line_count_.size(); }
 
+	//Compute Jaccard distance between PS
+	PSDistanceType	cluster_distance( int ps1, int ps2 ) const
+	{
+		int intersection_count = which_lines_.and_count( ps1, ps2 );
 		if ( intersection_count==0 )
 		{
 			return 1.;
 		}
 
-		int union_count = (ps1.which_lines.size() + ps2.which_lines.size() ) - intersection_count;
+		int union_count = ( line_count_[ps1] + line_count_[ps2] ) - intersection_count;
 
 		double res = 1. - ( double(intersection_count) /double( union_count) );
 		return res;
 	}
 
-	//Merge two PS
-	void ps_merge( PS& ps1, PS& ps2  )
+	//Merge ps2 into ps1: keep the common lines, chain the points
+	void cluster_merge( int ps1, int ps2 )
 	{
+		which_lines_.intersect( ps1, ps2 );
+		line_count_[ps1] = which_lines_.count( ps1 );
 
-		//merge line set
-		set<IndexType>::iterator first1  = ps1.which_lines.begin();
-		set<IndexType>::iterator last1 = ps1.which_lines.end();
-		set<IndexType>::iterator first2 = ps2.which_lines.begin();
-		set<IndexType>::iterator last2 = ps2.which_lines.end();
-
-		ps_set_.push_back( shared_ptr<PS>(new PS) );
-		PS& ps3 = *( ps_set_.back() );
-
-		while (first1!=last1 && first2!=last2)
-		{
-			if ( *first1 < *first2 )++first1;
-			else if ( *first1 > *first2 )++first2;
-			else
-			{
-				ps3.which_lines.insert( *first1 );
-				++first1;++first2;
-			}
-		}
-
-		//merge point set
-		first1  = ps1.which_points.begin();
-		last1 = ps1.which_points.end();
-		first2 = ps2.which_points.begin();
-		last2 = ps2.which_points.end();
-
-		while (first1!=last1)
-		{
-			ps3.which_points.insert( *first1 );
-			++first1;
-		}
-
-		while (first2 != last2 )
-		{
-			ps3.which_points.insert( *first2 );
-			++first2;
-		}
-
-		ps3.is_valid = true;
-		ps1.is_valid = false;
-		ps2.is_valid = false;
-
-
-
+		next_point_[ last_point_[ps1] ] = first_point_[ps2];
+		last_point_[ps1] = last_point_[ps2];
 	}
 
 
@@ -289,9 +153,14 @@ protected:
 	vector< Point >&							point_set_;
 	vector< Line >&							line_set_;
 	vector<	int	>&							label_set_;
-	vector<shared_ptr<PS>>			ps_set_;
 	Point2LineDistance						p2l_dist_func_;
 
+	linkage::PackedBitsets					which_lines_;	// preference set of every PS
+	vector<int>								line_count_;
+	vector<int>								first_point_;	// points of a PS, linked through next_point_
+	vector<int>								last_point_;
+	vector<int>								next_point_;
+
 };
 
-#endif
+#endif
\ No newline at end of file
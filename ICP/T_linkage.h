@@ -1,112 +1,15 @@
 #ifndef _T_LINKAGE_H
 #define _T_LINKAGE_H
 
-#include <unordered_map>
-#include <set>
 #include <vector>
 #include <queue>
 #include <algorithm>
 #include <memory>
+#include <cmath>
+#include "linkage_bitset.h"
 
 using namespace std;
 
-template<class T>
-struct sparse_vec
-{
-	typedef size_t Index;
-	set<Index> indices_;
-	unordered_map<Index, T> vals_;
-
-
-	const T& operator[](const Index index) const 
-	{
-		if (indices_.find(index)==indices_.end())
-		{
-			return 0.;
-		}
-		return vals_[index];
-	}
-
-	T& operator[](Index index)
-	{
-		if (indices_.find(index)==indices_.end())
-		{
-			indices_.insert(index);
-			vals_[index] = 0.;
-		}
-		return vals_[index];
-	}
-
-	T dot(  sparse_vec& rhs )
-	{
-		set<Index>::iterator lhs_iter,rhs_iter,lhs_end,rhs_end;
-		lhs_iter = indices_.begin();
-		rhs_iter = rhs.indices_.begin();
-		lhs_end = indices_.end();
-		rhs_end = rhs.indices_.end();
-
-		T sum = 0.;
-
-		while (lhs_iter!=lhs_end && rhs_iter!=rhs_end)
-		{
-			if ( *lhs_iter == *rhs_iter )
-			{
-				sum += vals_[*lhs_iter] * rhs.vals_[*rhs_iter];
-				lhs_iter++;
-				rhs_iter++;
-			}
-			else
-			{
-				*lhs_iter < *rhs_iter? lhs_iter++ : rhs_iter++;
-			}
-
-		}
-
-		return sum;
-
-	}
-
-	T sq_norm()
-	{
-		T s = 0.;
-		for ( unordered_map<Index,T>::iterator iter = vals_.begin();
-			iter != vals_.end(); iter++)
-		{
-			s += (*iter).second * (*iter).second;
-		}
-		return s;
-	}
-
-	void min(sparse_vec&  a, sparse_vec& b)
-	{
-		set<Index>::iterator lhs_iter,rhs_iter,lhs_end,rhs_end;
-		lhs_iter = a.indices_.begin();
-		rhs_iter = b.indices_.begin();
-		lhs_end = a.indices_.end();
-		rhs_end = b.indices_.end();
-
-
-		while (lhs_iter!=lhs_end && rhs_iter!=rhs_end)
-		{
-			if ( *lhs_iter == *rhs_iter )
-			{
-				indices_.insert(*lhs_iter);
-				T s1 = a.vals_[*lhs_iter];
-				T s2 = b.vals_[*rhs_iter];
-				vals_[*lhs_iter] = s1<s2?s1:s2;
-				++lhs_iter;++rhs_iter;
-			}
-			else
-			{
-				*lhs_iter < *rhs_iter? lhs_iter++ : rhs_iter++;
-			}
-
-		}
-
-	}
-
-};
-
 template< class  Point, class Line, class Point2LineDistance >
 class T_LinkageAdapter{
 
@@ -115,30 +18,15 @@ protected:
 	typedef		double		PSDistanceType;
 	typedef		typename Point2LineDistance::DistanceType		P2LDistanceType;
 
-	struct PF
+	// Non zero entry of a preference function, entries are sorted by line
+	struct PhiEntry
 	{
-		sparse_vec<P2LDistanceType>		phi;
-		set<IndexType>		which_points;
-		bool				is_valid;
-		int					node_idx;
+		PhiEntry( int l, P2LDistanceType v ):line(l),val(v){}
+		int					line;
+		P2LDistanceType		val;
 	};
 
-	struct heap_node
-	{
-		heap_node(shared_ptr<PF>& pp1, shared_ptr<PF>& pp2 ):pf1(pp1),pf2(pp2){}
-
-		weak_ptr<PF>		pf1;
-		weak_ptr<PF>		pf2;
-		PSDistanceType	dist;
-	};
-
-	struct greater_than{
-		bool operator()(const heap_node& lhs, const heap_node& rhs )
-		{
-			return lhs.dist > rhs.dist;
-		}
-
-	};
+	friend class linkage::NNLinkage<T_LinkageAdapter>;
 
 public:
 	T_LinkageAdapter( std::vector<Point>& points, std::vector<Line>& lines, std::vector<int>& labels,
@@ -150,163 +38,143 @@ public:
 	{
 		pf_init();
 
-		/** PS Merge Procedure **/
-
-		//Construct min-heap
-		std::priority_queue< heap_node, std::vector<heap_node>,greater_than >	min_heap;
-		IndexType		pn= pf_set_.size();
-		for ( IndexType i=0; i < pn; i++ )
-		{
-			for ( IndexType j = i+1; j <pn; j++ )
-			{
-				heap_node	node( pf_set_[i], pf_set_[j] );
-				node.dist = pf_distance( *(pf_set_[i]), *(pf_set_[j]) );
-				if (node.dist==1.)
-				{
-					continue;
-				}
-				min_heap.push( node );
-			}
-		}
+		/** PF Merge Procedure **/
+		linkage::NNLinkage<T_LinkageAdapter>	merger( *this );
+		merger.compute( 1. );
 
-		//Begin merge
-		while ( !min_heap.empty() )
+		//Store the final label
+		int label = 0;
+		for ( int pf = 0; pf < cluster_count(); ++pf )
 		{
-			heap_node min_node = min_heap.top();
-			if(min_node.dist==1.)break;
-			min_heap.pop();
-			if (min_node.pf1.expired() || min_node.pf2.expired() )
-			{
+			if ( !merger.is_active(pf) )
 				continue;
-			}
-
-			shared_ptr<PF> pf1 = min_node.pf1.lock();
-			shared_ptr<PF> pf2 = min_node.pf2.lock();
+			for ( int p_idx = first_point_[pf]; p_idx != -1; p_idx = next_point_[p_idx] )
+				label_set_[ p_idx ] = label;
+			++label;
+		}
 
 
-			pf_merge( *pf1, *pf2 );
+	}
 
+protected:
 
-			vector< shared_ptr<PF> >::iterator new_ps_iter = pf_set_.end() - 1;
-			for (vector< shared_ptr<PF> >::iterator iter = pf_set_.begin();
-				iter != new_ps_iter; )
+	//Init PF set, one PF per point
+	inline void pf_init()
+	{
+		const int pn = (int)point_set_.size();
+		const int ln = (int)line_set_.size();
+		support_.resize( pn, ln );
+		rank_.assign( (size_t)pn * support_.nb_words(), 0 );
+		phi_.assign( pn, vector<PhiEntry>() );
+		sq_norm_.assign( pn, 0. );
+		first_point_.resize( pn );
+		last_point_.resize( pn );
+		next_point_.assign( pn, -1 );
+
+		#pragma omp parallel for
+		for ( int point_idx = 0; point_idx < pn; ++point_idx )
+		{
+			Point2LineDistance	dist_func = p2l_dist_func_;
+			P2LDistanceType inv_tau = dist_func.lamda;
+			vector<PhiEntry>& phi = phi_[point_idx];
+			for ( int line_idx = 0; line_idx < ln; ++line_idx )
 			{
-
-				if (  (*iter)->is_valid ==false )
-				{
-					iter = pf_set_.erase( iter );
-					new_ps_iter = pf_set_.end() - 1;
-				}
-				else
+				P2LDistanceType p2l_dist = dist_func(point_set_[point_idx], line_set_[line_idx]);
+				if(  p2l_dist < 5*dist_func.lamda)
 				{
-					heap_node	node( *iter, *new_ps_iter );
-					node.dist = pf_distance( *(*iter), *(*new_ps_iter) );
-					if (node.dist==1.)
-					{
-						++iter;
-						continue;
-					}
-					min_heap.push( node );
-					++iter;
+					phi.push_back( PhiEntry( line_idx, exp( -p2l_dist*inv_tau ) ) );
+					support_.set( point_idx, line_idx );
 				}
 			}
-
+			sq_norm_[point_idx] = sq_norm( phi );
+			support_.prefix_count( point_idx, rank_row(point_idx) );
+			first_point_[point_idx] = point_idx;
+			last_point_[point_idx] = point_idx;
 		}
 
-		//Store the final label
-		IndexType i=0;
-		for (vector< shared_ptr<PF> >::iterator pf_iter = pf_set_.begin();
-			pf_iter != pf_set_.end();
-			++pf_iter,++i)
+		if ( pn > 0 )
 		{
-			for ( set<IndexType>::iterator p_idx_iter = (*pf_iter)->which_points.begin();
-				p_idx_iter != (*pf_iter)->which_points.end();
-				++p_idx_iter)
-			{
-				label_set_[ *p_idx_iter ] = i;
-			}
+			Logger<<"pf 0 size:"<<phi_[0].size()<<std::endl;
 		}
+	}
 
+	int cluster_count() const { return (int)phi_.size(); }
 
+	//Compute Tanimoto distance between PF
+	PSDistanceType	cluster_distance( int p, int q ) const
+	{
+		P2LDistanceType pq_dot = dot( p, q );
+		// disjoint supports (or two empty PF)
+		if ( pq_dot == 0. )
+			return 1.;
+		return 1. - pq_dot / ( sq_norm_[p] + sq_norm_[q] - pq_dot );
 	}
 
-protected:
-
-	//Init PS set
-	inline void pf_init()
+	//Merge pf2 into pf1: element-wise min over the common lines, chain the points
+	void cluster_merge( int pf1, int pf2 )
 	{
-		pf_set_.clear();
-		int point_idx =0 ;
-		for (vector<Point>::iterator p_iter = point_set_.begin(); p_iter!=point_set_.end(); p_iter++, point_idx++ )
+		vector<PhiEntry>& a = phi_[pf1];
+		const vector<PhiEntry>& b = phi_[pf2];
+		size_t out = 0, i = 0, j = 0;
+		while ( i < a.size() && j < b.size() )
 		{
-
-
-			pf_set_.push_back( shared_ptr<PF>(new PF) );
-			PF& pf = *( pf_set_.back() );
-			int line_idx = 0;
-			P2LDistanceType inv_tau = p2l_dist_func_.lamda;
-			for(vector<Line>::iterator l_iter = line_set_.begin() ; l_iter!=line_set_.end(); l_iter++,line_idx++)
+			if ( a[i].line == b[j].line )
 			{
-				P2LDistanceType p2l_dist = p2l_dist_func_(*p_iter, *l_iter);
-				if(  p2l_dist < 5*p2l_dist_func_.lamda)
-					pf.phi[ line_idx ] = exp( -p2l_dist*inv_tau );
+				a[out].line = a[i].line;
+				a[out].val = a[i].val < b[j].val ? a[i].val : b[j].val;
+				++out; ++i; ++j;
 			}
-			pf.is_valid = true;
-			pf.which_points.insert(point_idx);
-
-			if ( point_idx==0 )
+			else
 			{
-				Logger<<"pf 0 size:"<<pf_set_[0]->phi.indices_.size()<<std::endl;
+				a[i].line < b[j].line ? ++i : ++j;
 			}
 		}
-
-		
+		a.resize( out, PhiEntry(0, 0.) );
+		vector<PhiEntry>().swap( phi_[pf2] );
+		support_.intersect( pf1, pf2 );
+		support_.prefix_count( pf1, rank_row(pf1) );
+		sq_norm_[pf1] = sq_norm( a );
+
+		next_point_[ last_point_[pf1] ] = first_point_[pf2];
+		last_point_[pf1] = last_point_[pf2];
 	}
 
-	//Compute Distance between PF
-	PSDistanceType	pf_distance( PF& p,  PF& q )
+	// Only visits the common lines: the support bitsets give them directly and the rank of
+	// a line in the support is its position in phi_
+	P2LDistanceType dot( int p, int q ) const
 	{
-		if(p.phi.indices_.empty()&&q.phi.indices_.empty())
-			return 1.;
-		P2LDistanceType pq_dot = p.phi.dot( q.phi );
-		return 1. - pq_dot / ( p.phi.sq_norm() + q.phi.sq_norm() - pq_dot );
-	}
-
-	//Merge two PF
-	void pf_merge( PF& pf1, PF& pf2  )
-	{
-
-		pf_set_.push_back( shared_ptr<PF>(new PF) );
-		PF& pf3 = *( pf_set_.back() );
-
-		//merge phi
-		pf3.phi.min(pf1.phi, pf2.phi);
-
-		//merge point set
-		set<IndexType>::iterator first1,last1,first2, last2;
-		first1  = pf1.which_points.begin();
-		last1 = pf1.which_points.end();
-		first2 = pf2.which_points.begin();
-		last2 = pf2.which_points.end();
-
-		while (first1!=last1)
+		const int nb_words = support_.nb_words();
+		const linkage::Word* sp = support_.row(p);
+		const linkage::Word* sq = support_.row(q);
+		const int* rp = rank_row(p);
+		const int* rq = rank_row(q);
+		const vector<PhiEntry>& phi_p = phi_[p];
+		const vector<PhiEntry>& phi_q = phi_[q];
+		P2LDistanceType sum = 0.;
+		for ( int w = 0; w < nb_words; ++w )
 		{
-			pf3.which_points.insert( *first1 );
-			++first1;
-		}
-
-		while (first2 != last2 )
-		{
-			pf3.which_points.insert( *first2 );
-			++first2;
+			linkage::Word common = sp[w] & sq[w];
+			while ( common )
+			{
+				const linkage::Word bit = common & (~common + 1);
+				const linkage::Word below = bit - 1;
+				sum += phi_p[ rp[w] + linkage::popcount( sp[w] & below ) ].val *
+					   phi_q[ rq[w] + linkage::popcount( sq[w] & below ) ].val;
+				common ^= bit;
+			}
 		}
+		return sum;
+	}
 
-		pf3.is_valid = true;
-		pf1.is_valid = false;
-		pf2.is_valid = false;
-
-
+	int*		rank_row( int pf )			{ return rank_.empty() ? NULL : &rank_[ (size_t)pf * support_.nb_words() ]; }
+	const int*	rank_row( int pf ) const	{ return rank_.empty() ? NULL : &rank_[ (size_t)pf * support_.nb_words() ]; }
 
+	static P2LDistanceType sq_norm( const vector<PhiEntry>& a )
+	{
+		P2LDistanceType s = 0.;
+		for ( size_t i = 0; i < a.size(); ++i )
+			s += a[i].val * a[i].val;
+		return s;
 	}
 
 
@@ -315,9 +183,16 @@ protected:
 	vector< Point >&							point_set_;
 	vector< Line >&							line_set_;
 	vector<	int	>&							label_set_;
-	vector<shared_ptr<PF>>			pf_set_;
 	Point2LineDistance						p2l_dist_func_;
 
+	vector< vector<PhiEntry> >				phi_;		// preference function of every PF
+	linkage::PackedBitsets					support_;	// non zero lines of phi_
+	vector<int>								rank_;		// support_.prefix_count() of every PF
+	vector<P2LDistanceType>					sq_norm_;
+	vector<int>								first_point_;	// points of a PF, linked through next_point_
+	vector<int>								last_point_;
+	vector<int>								next_point_;
+
 };
 
 #endif
\ No newline at end of file
@@ -890,6 +890,17 @@ namespace nanoflann
 			root_node = divideTree(0, m_size, root_bbox );   // construct the tree
 		}
 
+		/**
+		 * Refits the bounds of the tree to points that moved since buildIndex()
+		 * (same count, same indices). The tree structure is kept: queries stay exact,
+		 * they only get slower as the points drift away from the original layout.
+		 */
+		void refitIndex()
+		{
+			if (!root_node) return;
+			refitTree(root_node, root_bbox);
+		}
+
 		/**
 		 *  Returns size of index.
 		 */
@@ -1105,6 +1116,40 @@ namespace nanoflann
 			return node;
 		}
 
+		/**
+		 * Recomputes divlow/divhigh of the subtree from the current point positions,
+		 * returns its bounding box in bbox (which must already have the right size).
+		 */
+		void refitTree(NodePtr node, BoundingBox& bbox)
+		{
+			if ( node->child1 == NULL && node->child2 == NULL ) {
+				for (int i=0; i<(DIM>0 ? DIM : dim); ++i) {
+					bbox[i].low = dataset_get(vind[node->lr.left],i);
+					bbox[i].high = dataset_get(vind[node->lr.left],i);
+				}
+				for (IndexType k=node->lr.left+1; k<node->lr.right; ++k) {
+					for (int i=0; i<(DIM>0 ? DIM : dim); ++i) {
+						if (bbox[i].low>dataset_get(vind[k],i)) bbox[i].low=dataset_get(vind[k],i);
+						if (bbox[i].high<dataset_get(vind[k],i)) bbox[i].high=dataset_get(vind[k],i);
+					}
+				}
+				return;
+			}
+			BoundingBox left_bbox(bbox);
+			BoundingBox right_bbox(bbox);
+			refitTree(node->child1, left_bbox);
+			refitTree(node->child2, right_bbox);
+
+			// after a refit the two children may overlap (divlow > divhigh), see searchLevel()
+			const int cutfeat = node->sub.divfeat;
+			node->sub.divlow = left_bbox[cutfeat].high;
+			node->sub.divhigh = right_bbox[cutfeat].low;
+			for (int i=0; i<(DIM>0 ? DIM : dim); ++i) {
+				bbox[i].low = std::min(left_bbox[i].low, right_bbox[i].low);
+				bbox[i].high = std::max(left_bbox[i].high, right_bbox[i].high);
+			}
+		}
+
 		void computeMinMax(IndexType* ind, IndexType count, int element, ElementType& min_elem, ElementType& max_elem)
 		{
 			min_elem = dataset_get(ind[0],element);
@@ -1291,15 +1336,17 @@ namespace nanoflann
 			NodePtr bestChild;
 			NodePtr otherChild;
 			DistanceType cut_dist;
+			// a query inside the other child's range (only possible for overlapping
+			// children, after refitIndex()) gets no lower bound from the cut
 			if ((diff1+diff2)<0) {
 				bestChild = node->child1;
 				otherChild = node->child2;
-				cut_dist = distance.accum_dist(val, node->sub.divhigh, idx);
+				cut_dist = diff2<0 ? distance.accum_dist(val, node->sub.divhigh, idx) : 0;
 			}
 			else {
 				bestChild = node->child2;
 				otherChild = node->child1;
-				cut_dist = distance.accum_dist( val, node->sub.divlow, idx);
+				cut_dist = diff1>0 ? distance.accum_dist( val, node->sub.divlow, idx) : 0;
 			}
 
 			/* Call recursively to search next level down. */
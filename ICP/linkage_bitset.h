@@ -0,0 +1,316 @@
+#ifndef _LINKAGE_BITSET_H
+#define _LINKAGE_BITSET_H
+
+#include <vector>
+#include <queue>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+	Building blocks shared by J_LinkageAdapter and T_LinkageAdapter.
+
+	PackedBitsets: one fixed size bitset per cluster (one bit per model), all stored in a
+	single buffer. Intersections are counted with popcount over 64 bits words.
+
+	NNLinkage: agglomerative merge driver. Instead of pushing every pair of clusters in a
+	heap (O(n^2) memory) each cluster keeps its K nearest neighbours, and the heap holds
+	one candidate (the nearest one) per cluster. After a merge every cluster updates the
+	distance to the new cluster in its list; a cluster whose list ran empty only knows a
+	lower bound and rescans when that bound reaches the top of the heap.
+	The merged cluster reuses the slot of the first one, so no cluster is ever moved.
+
+	The policy given to NNLinkage must provide:
+
+		int		cluster_count() const;				// number of initial clusters
+		double	cluster_distance(int i, int j) const;	// symmetric, in [0,1], 1 means never merge
+		void	cluster_merge(int i, int j);		// merge j into i
+
+	cluster_distance() is called from several threads at once.
+*/
+namespace linkage {
+
+	typedef unsigned long long Word;
+
+	inline int popcount(Word w)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		return (int)__popcnt64(w);
+#elif defined(_MSC_VER)
+		return (int)( __popcnt( (unsigned int)w ) + __popcnt( (unsigned int)(w >> 32) ) );
+#else
+		return __builtin_popcountll(w);
+#endif
+	}
+
+	class PackedBitsets
+	{
+	public:
+		PackedBitsets():nb_words_(0){}
+
+		void resize( int nb_sets, int nb_bits )
+		{
+			nb_words_ = (nb_bits + 63) / 64;
+			words_.assign( (size_t)nb_sets * nb_words_, 0 );
+		}
+
+		void set( int s, int bit ) { row(s)[bit >> 6] |= Word(1) << (bit & 63); }
+
+		int count( int s ) const
+		{
+			const Word* a = row(s);
+			int c = 0;
+			for ( int w = 0; w < nb_words_; ++w )
+				c += popcount( a[w] );
+			return c;
+		}
+
+		// |s1 & s2|
+		int and_count( int s1, int s2 ) const
+		{
+			const Word* a = row(s1);
+			const Word* b = row(s2);
+			int c = 0;
+			int w = 0;
+			for ( ; w + 1 < nb_words_; w += 2 )
+				c += popcount( a[w] & b[w] ) + popcount( a[w+1] & b[w+1] );
+			for ( ; w < nb_words_; ++w )
+				c += popcount( a[w] & b[w] );
+			return c;
+		}
+
+		// s1 &= s2
+		void intersect( int s1, int s2 )
+		{
+			Word* a = row(s1);
+			const Word* b = row(s2);
+			for ( int w = 0; w < nb_words_; ++w )
+				a[w] &= b[w];
+		}
+
+		// prefix[w] = number of bits of s set before word w
+		void prefix_count( int s, int* prefix ) const
+		{
+			const Word* a = row(s);
+			int c = 0;
+			for ( int w = 0; w < nb_words_; ++w )
+			{
+				prefix[w] = c;
+				c += popcount( a[w] );
+			}
+		}
+
+		int			nb_words() const	{ return nb_words_; }
+		Word*		row( int s )		{ return &words_[ (size_t)s * nb_words_ ]; }
+		const Word*	row( int s ) const	{ return &words_[ (size_t)s * nb_words_ ]; }
+
+	private:
+		int					nb_words_;
+		std::vector<Word>	words_;
+	};
+
+	template<class Policy>
+	class NNLinkage
+	{
+		struct Candidate
+		{
+			Candidate( double d, int c, int v ):dist(d),cluster(c),version(v){}
+			double	dist;
+			int		cluster;
+			int		version;	// stale once the cluster's nearest neighbour changed
+		};
+
+		struct greater_than{
+			bool operator()(const Candidate& lhs, const Candidate& rhs ) const
+			{
+				return lhs.dist > rhs.dist;
+			}
+		};
+
+	public:
+		/// Nearest neighbours remembered per cluster
+		static const int K = 8;
+
+		NNLinkage( Policy& policy ):policy_(policy){}
+
+		// Merge the closest pair of clusters while their distance is below 1 and not above max_dist
+		void compute( double max_dist )
+		{
+			const int n = policy_.cluster_count();
+			active_.assign( n, 1 );
+			version_.assign( n, 0 );
+			cand_id_.assign( (size_t)n * K, -1 );
+			cand_dist_.assign( (size_t)n * K, 1. );
+			cand_size_.assign( n, 0 );
+			bound_.assign( n, 1. );
+			std::vector<double>	dist_to_merged( n, 1. );
+			std::vector<char>	changed( n, 0 );
+
+			#pragma omp parallel for schedule(dynamic, 16)
+			for ( int i = 0; i < n; ++i )
+				rescan( i, NULL );
+
+			std::priority_queue< Candidate, std::vector<Candidate>, greater_than >	min_heap;
+			for ( int i = 0; i < n; ++i )
+				if ( key(i) < 1. )
+					min_heap.push( Candidate( key(i), i, version_[i] ) );
+
+			while ( !min_heap.empty() )
+			{
+				Candidate top = min_heap.top();
+				min_heap.pop();
+				if ( !active_[top.cluster] || version_[top.cluster] != top.version )
+					continue;
+				if ( top.dist > max_dist )
+					break;
+				if ( cand_size_[top.cluster] == 0 )
+				{
+					// only a lower bound was known
+					const int c = top.cluster;
+					rescan( c, NULL );
+					++version_[c];
+					if ( key(c) < 1. )
+						min_heap.push( Candidate( key(c), c, version_[c] ) );
+					continue;
+				}
+
+				const int a = top.cluster;
+				const int b = cand_id_[ (size_t)a * K ];
+				policy_.cluster_merge( a, b );
+				active_[b] = 0;
+				++version_[b];
+
+				// 'a' changed and 'b' is gone: refresh both entries in every candidate list
+				#pragma omp parallel for schedule(dynamic, 64)
+				for ( int c = 0; c < n; ++c )
+				{
+					changed[c] = 0;
+					dist_to_merged[c] = 1.;
+					if ( !active_[c] || c == a )
+						continue;
+					const double	old_key = key(c);
+					const int		old_nn = cand_size_[c] ? cand_id_[ (size_t)c * K ] : -1;
+					remove( c, a );
+					remove( c, b );
+					const double d = policy_.cluster_distance( c, a );
+					dist_to_merged[c] = d;
+					insert( c, a, d );
+					const int new_nn = cand_size_[c] ? cand_id_[ (size_t)c * K ] : -1;
+					changed[c] = ( key(c) != old_key || new_nn != old_nn );
+				}
+
+				rescan( a, &dist_to_merged[0] );
+				changed[a] = 1;
+
+				for ( int c = 0; c < n; ++c )
+				{
+					if ( !changed[c] )
+						continue;
+					++version_[c];
+					if ( key(c) < 1. )
+						min_heap.push( Candidate( key(c), c, version_[c] ) );
+				}
+			}
+		}
+
+		// Clusters still alive after compute()
+		bool is_active( int i ) const { return active_[i] != 0; }
+
+	private:
+		// Distance to the nearest neighbour, or a lower bound of it when the list is empty
+		double key( int c ) const { return cand_size_[c] ? cand_dist_[ (size_t)c * K ] : bound_[c]; }
+
+		// Keep the K closest clusters, every other active cluster is at least bound_[c] away.
+		// 'dist' (optional) already holds the distance from c to every cluster
+		void rescan( int c, const double* dist )
+		{
+			int*	ids = &cand_id_[ (size_t)c * K ];
+			double*	ds = &cand_dist_[ (size_t)c * K ];
+			int		size = 0;
+			double	bound = 1.;
+			const int n = (int)active_.size();
+			for ( int j = 0; j < n; ++j )
+			{
+				if ( j == c || !active_[j] )
+					continue;
+				const double d = dist ? dist[j] : policy_.cluster_distance( c, j );
+				if ( d >= bound )
+					continue;
+				if ( size == K )
+				{
+					// the farthest candidate leaves the list and becomes the bound
+					bound = ds[K-1];
+					--size;
+					if ( d >= bound )
+						continue;
+				}
+				int k = size++;
+				for ( ; k > 0 && ds[k-1] > d; --k )
+				{
+					ds[k] = ds[k-1];
+					ids[k] = ids[k-1];
+				}
+				ds[k] = d;
+				ids[k] = j;
+			}
+			cand_size_[c] = size;
+			bound_[c] = bound;
+		}
+
+		void remove( int c, int j )
+		{
+			int*	ids = &cand_id_[ (size_t)c * K ];
+			double*	ds = &cand_dist_[ (size_t)c * K ];
+			int&	size = cand_size_[c];
+			for ( int k = 0; k < size; ++k )
+			{
+				if ( ids[k] != j )
+					continue;
+				for ( ; k + 1 < size; ++k )
+				{
+					ds[k] = ds[k+1];
+					ids[k] = ids[k+1];
+				}
+				--size;
+				return;
+			}
+		}
+
+		// j can only enter the list if it is closer than every cluster left out of it
+		void insert( int c, int j, double d )
+		{
+			int*	ids = &cand_id_[ (size_t)c * K ];
+			double*	ds = &cand_dist_[ (size_t)c * K ];
+			int&	size = cand_size_[c];
+			double&	bound = bound_[c];
+			if ( d >= bound )
+				return;
+			if ( size == K )
+			{
+				bound = ds[K-1];
+				--size;
+				if ( d >= bound )
+					return;
+			}
+			int k = size++;
+			for ( ; k > 0 && ds[k-1] > d; --k )
+			{
+				ds[k] = ds[k-1];
+				ids[k] = ids[k-1];
+			}
+			ds[k] = d;
+			ids[k] = j;
+		}
+
+		Policy&					policy_;
+		std::vector<char>		active_;
+		std::vector<int>		version_;
+		std::vector<int>		cand_id_;	// K nearest neighbours of every cluster, sorted by distance
+		std::vector<double>		cand_dist_;
+		std::vector<int>		cand_size_;
+		std::vector<double>		bound_;		// lower bound of the distance to the clusters out of the list
+	};
+
+}
+
+#endif
@@ -11,7 +11,13 @@
 #include "videoediting\BunnyMesh.h"
 
 #include <iostream>
+#include <algorithm>
 #include <QMatrix4x4>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
 namespace videoEditting
 {
 	std::set<int> g_constrainted_nodes;
@@ -23,8 +29,6 @@ namespace videoEditting
 	std::vector<QVector3D>     g_translations;
 	std::vector<QQuaternion>   g_rotations;
 	std::set<int>            g_pose_key_frame;
-	std::vector<std::vector<QVector3D> > g_simulated_vertices;
-	std::vector<std::vector<QVector3D> > g_simulated_normals;
 	std::vector<std::vector<QVector2D> > g_tracked_textures;
 	std::vector<std::vector<int> >		 g_tracked_isVisiable;  
 	std::vector<std::vector<int> >		 g_simulated_isVisiable;
@@ -47,6 +51,197 @@ namespace videoEditting
 			}
 		}
 	}
+
+	SimulationCache g_simulation_cache;
+
+	SimulationCache::SimulationCache()
+		: m_nb_frames(0), m_nb_nodes(0), m_frame_size(0), m_baked(0), m_ring_capacity(0),
+		m_chunk_frames(0), m_write_chunk_id(-1), m_write_chunk_count(0), m_read_chunk_id(-1)
+	{
+	}
+
+	SimulationCache::~SimulationCache()
+	{
+		clear();
+	}
+
+	bool SimulationCache::reset(int nb_frames, int nb_nodes, int ring_capacity, const QString& cache_dir, int chunk_frames)
+	{
+		clear();
+		QMutexLocker lock(&m_mutex);
+		m_nb_frames = std::max(nb_frames, 0);
+		m_nb_nodes = nb_nodes;
+		m_frame_size = nb_nodes * 6;
+		m_ring_capacity = std::max(1, std::min(ring_capacity, m_nb_frames));
+		m_ring.assign((size_t)m_ring_capacity * m_frame_size, 0.0f);
+		m_ring_frame.assign(m_ring_capacity, -1);
+		if (!cache_dir.isEmpty())
+		{
+			if (!QDir().mkpath(cache_dir))
+				return false;
+			m_cache_dir = cache_dir;
+			m_chunk_frames = std::max(1, chunk_frames);
+			m_write_chunk.resize((size_t)m_chunk_frames * m_frame_size);
+			m_chunk_on_disk.assign((m_nb_frames + m_chunk_frames - 1) / m_chunk_frames, 0);
+		}
+		return true;
+	}
+
+	void SimulationCache::clear()
+	{
+		QMutexLocker lock(&m_mutex);
+		for (int c = 0; c < (int)m_chunk_on_disk.size(); ++c)
+		{
+			if (m_chunk_on_disk[c])
+				QFile::remove(chunkPath(c));
+		}
+		m_nb_frames = m_nb_nodes = m_frame_size = 0;
+		m_baked.store(0);
+		m_ring_capacity = 0;
+		std::vector<float>().swap(m_ring);
+		m_ring_frame.clear();
+		m_cache_dir.clear();
+		m_chunk_frames = 0;
+		std::vector<float>().swap(m_write_chunk);
+		m_write_chunk_id = -1;
+		m_write_chunk_count = 0;
+		m_chunk_on_disk.clear();
+		std::vector<float>().swap(m_read_chunk);
+		m_read_chunk_id = -1;
+	}
+
+	void SimulationCache::putFrame(int frame, const float* data)
+	{
+		QMutexLocker lock(&m_mutex);
+		if (frame < 0 || frame >= m_nb_frames)
+			return;
+
+		const int slot = frame % m_ring_capacity;
+		std::copy(data, data + m_frame_size, m_ring.begin() + (size_t)slot * m_frame_size);
+		m_ring_frame[slot] = frame;
+
+		if (isDiskBacked())
+		{
+			const int chunk = frame / m_chunk_frames;
+			if (chunk != m_write_chunk_id)
+			{
+				writeChunk();
+				m_write_chunk_id = chunk;
+				m_write_chunk_count = 0;
+			}
+			const int local = frame - chunk * m_chunk_frames;
+			std::copy(data, data + m_frame_size, m_write_chunk.begin() + (size_t)local * m_frame_size);
+			m_write_chunk_count = std::max(m_write_chunk_count, local + 1);
+			// the last chunk may be shorter
+			if (m_write_chunk_count == std::min(m_chunk_frames, m_nb_frames - chunk * m_chunk_frames))
+				writeChunk();
+		}
+		if (frame >= m_baked.load())
+			m_baked.store(frame + 1);
+	}
+
+	void SimulationCache::flush()
+	{
+		QMutexLocker lock(&m_mutex);
+		writeChunk();
+	}
+
+	QString SimulationCache::chunkPath(int chunk) const
+	{
+		return m_cache_dir + QString("/sim_chunk_%1.bin").arg(chunk, 4, 10, QChar('0'));
+	}
+
+	bool SimulationCache::writeChunk()
+	{
+		if (!isDiskBacked() || m_write_chunk_id < 0 || m_write_chunk_count <= m_chunk_on_disk[m_write_chunk_id])
+			return true;
+
+		QFile file(chunkPath(m_write_chunk_id));
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			std::cout << "can't write simulation cache " << file.fileName().toStdString() << std::endl;
+			return false;
+		}
+		const int header[4] = { 0x434D4953 /*SIMC*/, m_nb_nodes, m_write_chunk_id * m_chunk_frames, m_write_chunk_count };
+		const qint64 bytes = (qint64)m_write_chunk_count * m_frame_size * sizeof(float);
+		bool ok = file.write((const char*)header, sizeof(header)) == sizeof(header);
+		ok = ok && file.write((const char*)&m_write_chunk[0], bytes) == bytes;
+		file.close();
+		if (ok)
+			m_chunk_on_disk[m_write_chunk_id] = m_write_chunk_count;
+		if (m_read_chunk_id == m_write_chunk_id)
+			m_read_chunk_id = -1;
+		return ok;
+	}
+
+	bool SimulationCache::readChunk(int chunk)
+	{
+		if (chunk < 0 || chunk >= (int)m_chunk_on_disk.size() || !m_chunk_on_disk[chunk])
+			return false;
+
+		QFile file(chunkPath(chunk));
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
+		int header[4];
+		if (file.read((char*)header, sizeof(header)) != sizeof(header) ||
+			header[0] != 0x434D4953 || header[1] != m_nb_nodes || header[3] <= 0 || header[3] > m_chunk_frames)
+			return false;
+		m_read_chunk.resize((size_t)m_chunk_frames * m_frame_size);
+		const qint64 bytes = (qint64)header[3] * m_frame_size * sizeof(float);
+		if (file.read((char*)&m_read_chunk[0], bytes) != bytes)
+			return false;
+		m_read_chunk_id = chunk;
+		return true;
+	}
+
+	const float* SimulationCache::findFrame(int frame)
+	{
+		if (frame < 0 || frame >= m_baked.load())
+			return NULL;
+		const int slot = frame % m_ring_capacity;
+		if (m_ring_frame[slot] == frame)
+			return &m_ring[(size_t)slot * m_frame_size];
+		if (!isDiskBacked())
+			return NULL;
+
+		const int chunk = frame / m_chunk_frames;
+		const int local = frame - chunk * m_chunk_frames;
+		if (chunk == m_write_chunk_id && local < m_write_chunk_count)
+			return &m_write_chunk[(size_t)local * m_frame_size];
+		if (local >= m_chunk_on_disk[chunk])
+			return NULL;
+		if (chunk != m_read_chunk_id && !readChunk(chunk))
+			return NULL;
+		return &m_read_chunk[(size_t)local * m_frame_size];
+	}
+
+	bool SimulationCache::getFrame(int frame, std::vector<QVector3D>& vertices, std::vector<QVector3D>& normals)
+	{
+		QMutexLocker lock(&m_mutex);
+		const float* data = findFrame(frame);
+		if (!data)
+			return false;
+		vertices.resize(m_nb_nodes);
+		normals.resize(m_nb_nodes);
+		for (int i = 0; i < m_nb_nodes; ++i, data += 6)
+		{
+			vertices[i] = QVector3D(data[0], data[1], data[2]);
+			normals[i] = QVector3D(data[3], data[4], data[5]);
+		}
+		return true;
+	}
+
+	bool SimulationCache::getNormals(int frame, std::vector<QVector3D>& normals)
+	{
+		QMutexLocker lock(&m_mutex);
+		const float* data = findFrame(frame);
+		if (!data)
+			return false;
+		normals.resize(m_nb_nodes);
+		for (int i = 0; i < m_nb_nodes; ++i, data += 6)
+			normals[i] = QVector3D(data[3], data[4], data[5]);
+		return true;
+	}
 }
 
 using namespace videoEditting;
@@ -116,11 +311,20 @@ void pickingPreTickCallback(btDynamicsWorld *world, btScalar timeStep)
 
 
 
-BulletInterface::BulletInterface():isWorldSetup(false),pSoftBody(NULL)
+BulletInterface::BulletInterface():isWorldSetup(false),pSoftBody(NULL),pBakeThread(NULL),cancelBake(0),nextFrame(0),bakeTimeStep(0.0f)
 {
 
 }
 
+BulletInterface::~BulletInterface()
+{
+	pause_simulate();
+	delete pBakeThread;
+	// the chunk files go away with bakeTempDir
+	if (bakeTempDir && g_simulation_cache.cacheDir() == bakeTempDir->path())
+		g_simulation_cache.clear();
+}
+
 
 btRigidBody* BulletInterface::localCreateRigidBody(float mass, const btTransform& startTransform, btCollisionShape* shape)
 {
@@ -328,126 +532,155 @@ void BulletInterface::setUpWorld()
 	isWorldSetup = true;
 }
 
-void BulletInterface::begin_simulate()
+/// Runs BulletInterface::bake_frames(), progress and cancellation go through
+/// the cache and BulletInterface::cancelBake so no signal is needed.
+class SimulationBakeThread : public QThread
 {
-
-	static int test_count = 0;
+public:
+	SimulationBakeThread(BulletInterface* owner) : m_owner(owner) {}
+protected:
+	void run() { m_owner->bake_frames(); }
+private:
+	BulletInterface* m_owner;
+};
+
+/// Bytes of baked frames kept in memory, larger bakes stream to chunk files
+static const size_t s_ring_budget = 256u << 20;
+/// Bytes of a chunk file
+static const size_t s_chunk_budget = 32u << 20;
+
+void BulletInterface::begin_simulate(const QString& cache_dir)
+{
+	pause_simulate();
 	if (!isWorldSetup)
 	{
 		setUpWorld();
-		
 	}
-	if (pWorld)
-	{
-		g_simulated_vertices.clear();
-		g_simulated_vertices.resize(g_total_frame);
-		g_simulated_normals.clear();
-		g_simulated_normals.resize(g_total_frame);
+	if (!pWorld || !pWorld->getSoftBodyArray().size() || g_total_frame <= 0)
+		return;
 
-		if (g_simulated_vertices.size() > 0 && g_simulated_normals.size() > 0)
+	btSoftBody*  pBody = (btSoftBody*)pWorld->getSoftBodyArray()[0];
+	const int nb_nodes = pBody->m_nodes.size();
+	const size_t frame_bytes = std::max<size_t>(1, (size_t)nb_nodes * 6 * sizeof(float));
+
+	int ring_frames = (int)std::min<size_t>(g_total_frame, std::max<size_t>(1, s_ring_budget / frame_bytes));
+	QString dir;
+	int chunk_frames = 0;
+	if (ring_frames < g_total_frame)
+	{
+		if (cache_dir.isEmpty())
 		{
-			for (int i = 0; i < pWorld->getSoftBodyArray().size(); i++)
+			// unique per process, so that two instances never share chunk files
+			if (!bakeTempDir || !bakeTempDir->isValid())
+				bakeTempDir.reset(new QTemporaryDir(QDir::temp().filePath("pcm_simulation_cache-XXXXXX")));
+			if (!bakeTempDir->isValid())
 			{
-				// get the body
-				btSoftBody*  pBody = (btSoftBody*)pWorld->getSoftBodyArray()[i];
-				pBody->updateNormals();
-				// is it possible to render?
-				//					if (pWorld->getDebugDrawer() && !(pWorld->getDebugDrawer()->getDebugMode() & (btIDebugDraw::DBG_DrawWireframe))) {
-				// draw it
-				//					btSoftBodyHelpers::Draw(pBody, pWorld->getDebugDrawer(), pWorld->getDrawFlags());
-				for (int j = 0; j < pBody->m_nodes.size(); ++j)
-				{
-					const btSoftBody::Node&	n = pBody->m_nodes[j];
-					const btVector3& vertex = n.m_x;
-					const btVector3& normal = n.m_n;
-					g_simulated_vertices[0].push_back(QVector3D(vertex.x(), vertex.y(), vertex.z()));
-					g_simulated_normals[0].push_back(QVector3D(normal.x(), normal.y(), normal.z()));
-				}
-				break;
+				std::cout << "can't create a temporary directory for the simulation cache" << std::endl;
+				return;
 			}
+			dir = bakeTempDir->path();
 		}
+		else
+			dir = cache_dir;
+		chunk_frames = (int)std::min<size_t>(64, std::max<size_t>(1, s_chunk_budget / frame_bytes));
+		ring_frames = std::min(ring_frames, chunk_frames);
+	}
+	if (!g_simulation_cache.reset(g_total_frame, nb_nodes, ring_frames, dir, chunk_frames))
+	{
+		std::cout << "can't create simulation cache in " << dir.toStdString() << std::endl;
+		return;
+	}
 
+	bakeConstraints = g_position_constraint;
+	bakeConstraints.resize(g_total_frame);
+	bakeTimeStep = g_time_step;
+	frameBuffer.resize((size_t)nb_nodes * 6);
 
-		for (int cur_frameid = 1; cur_frameid < g_total_frame; ++cur_frameid)
-		{
-			btSoftBody*  pBody = (btSoftBody*)pWorld->getSoftBodyArray()[0];
-			// prevent the picked object from falling asleep
-			pBody->setActivationState(DISABLE_DEACTIVATION);
-/*			
-			for (auto bitr = g_position_constraint[cur_frameid].begin(); bitr != g_position_constraint[cur_frameid].end(); ++bitr)
-			{
-				int vertx_idx = bitr->first;
-				QVector3D pos = bitr->second;
-				for (size_t i = 0; i < pRidgidBody.size(); i++)
-				{
-					pRidgidBody[i]->getWorldTransform().setOrigin( btVector3(pos.x(), pos.y(), pos.z()));
-				}
-				//pBody->setMass(vertx_idx, 1);
-			}
-		
+	// frame 0 is the rest pose
+	pBody->updateNormals();
+	copy_frame(pBody);
+	g_simulation_cache.putFrame(0, frameBuffer.data());
+	nextFrame = 1;
 
-*/			QVector3D constraint_center;
-			for (auto bitr = g_position_constraint[cur_frameid].begin(); bitr != g_position_constraint[cur_frameid].end(); ++bitr)
-			{
-				//int vertx_idx = bitr->first;
-				//QVector3D& vec = bitr->second;
-				//constraint_center += vec;
-				int vtx_id = bitr->first;
-				QVector3D pos = bitr->second;
-//				pBody->setMass(vtx_id, 0);
-				btVector3 prev = pBody->m_nodes[vtx_id].m_x;
-				btVector3 target = btVector3(pos.x(), pos.y(), pos.z());
-				btVector3 velocity = (target - prev)/ g_time_step;
-//				pBody->m_nodes[vtx_id].m_x = btVector3(pos.x(), pos.y(), pos.z());
-		//		pBody->m_nodes[vtx_id].m_v += velocity;
-				pBody->m_nodes[vtx_id].m_x = target;
+	continue_simulate();
+}
 
-			}
-			constraint_center /= g_position_constraint.size();
-			btTransform startTransform;
-			startTransform.setIdentity();
-			startTransform.setOrigin(btVector3(constraint_center.x(), constraint_center.y(), constraint_center.z()));
+void BulletInterface::pause_simulate()
+{
+	if (pBakeThread)
+	{
+		cancelBake.store(1);
+		pBakeThread->wait();
+	}
+}
 
-			for (size_t i = 0; i < pRidgidBody.size(); i++)
-			{
-				pRidgidBody[i]->setWorldTransform(startTransform);
-			}
-			
+void BulletInterface::continue_simulate()
+{
+	if (!pWorld || isSimulating() || nextFrame >= (int)bakeConstraints.size())
+		return;
+	cancelBake.store(0);
+	if (!pBakeThread)
+		pBakeThread = new SimulationBakeThread(this);
+	pBakeThread->start();
+}
 
-			//test 
-//			pBody->setMass(446, 0);
-//			pBody->m_nodes[50].m_v += btVector3(10.1, 1.f, 0.1);
+void BulletInterface::cancel_simulate()
+{
+	pause_simulate();
+	g_simulation_cache.clear();
+	bakeConstraints.clear();
+	nextFrame = 0;
+}
 
-			float tmp_time_step = g_time_step;
-			pWorld->stepSimulation(g_time_step);
-//			g_current_frame++;
+bool BulletInterface::isSimulating() const
+{
+	return pBakeThread && pBakeThread->isRunning();
+}
 
+void BulletInterface::copy_frame(btSoftBody* pBody)
+{
+	float* dst = frameBuffer.data();
+	for (int j = 0; j < pBody->m_nodes.size(); ++j, dst += 6)
+	{
+		const btSoftBody::Node&	n = pBody->m_nodes[j];
+		const btVector3& vertex = n.m_x;
+		const btVector3& normal = n.m_n;
+		dst[0] = vertex.x(); dst[1] = vertex.y(); dst[2] = vertex.z();
+		dst[3] = normal.x(); dst[4] = normal.y(); dst[5] = normal.z();
+	}
+}
 
-			for (int i = 0; i < pWorld->getSoftBodyArray().size(); i++)
-			{
-				// get the body
-				btSoftBody*  pBody = (btSoftBody*)pWorld->getSoftBodyArray()[i];
-				// is it possible to render?
-//					if (pWorld->getDebugDrawer() && !(pWorld->getDebugDrawer()->getDebugMode() & (btIDebugDraw::DBG_DrawWireframe))) {
-				// draw it
-//					btSoftBodyHelpers::Draw(pBody, pWorld->getDebugDrawer(), pWorld->getDrawFlags());
-				g_simulated_vertices[cur_frameid].clear();
-				g_simulated_normals[cur_frameid].clear();
-				for (int j = 0; j < pBody->m_nodes.size(); ++j)
-				{
-					const btSoftBody::Node&	n = pBody->m_nodes[j];
-					const btVector3& vertex = n.m_x;
-					const btVector3& normal = n.m_n;
-					g_simulated_vertices[cur_frameid].push_back(QVector3D(vertex.x(), vertex.y(), vertex.z()));
-					g_simulated_normals[cur_frameid].push_back(QVector3D(normal.x(), normal.y(), normal.z()));
-				}
-			}
+void BulletInterface::bake_frames()
+{
+	btSoftBody*  pBody = (btSoftBody*)pWorld->getSoftBodyArray()[0];
+	const int nb_frames = (int)bakeConstraints.size();
+	for (; nextFrame < nb_frames && !cancelBake.load(); ++nextFrame)
+	{
+		// prevent the picked object from falling asleep
+		pBody->setActivationState(DISABLE_DEACTIVATION);
 
+		QVector3D constraint_center;
+		const std::unordered_map<int, QVector3D>& constraints = bakeConstraints[nextFrame];
+		for (auto bitr = constraints.begin(); bitr != constraints.end(); ++bitr)
+		{
+			int vtx_id = bitr->first;
+			QVector3D pos = bitr->second;
+			pBody->m_nodes[vtx_id].m_x = btVector3(pos.x(), pos.y(), pos.z());
 		}
+		constraint_center /= nb_frames;
+		btTransform startTransform;
+		startTransform.setIdentity();
+		startTransform.setOrigin(btVector3(constraint_center.x(), constraint_center.y(), constraint_center.z()));
 
+		for (int i = 0; i < pRidgidBody.size(); i++)
+		{
+			pRidgidBody[i]->setWorldTransform(startTransform);
+		}
 
+		pWorld->stepSimulation(bakeTimeStep);
 
-
+		copy_frame(pBody);
+		g_simulation_cache.putFrame(nextFrame, frameBuffer.data());
 	}
-
+	g_simulation_cache.flush();
 }
@@ -5,157 +5,47 @@
 #include "GlobalObject.h"
 #include "paint_canvas.h"
 #include <fstream>
+#include <algorithm>
+#include <cfloat>
 using namespace std;
-int KDNode::max_depth = 5 ;
-KDNode::KDNode(Sample& _smp):smp_(_smp)
+namespace
 {
+	const int DEBUG_CUBE_DEPTH = 7;
 
-
-
-}
-
-KDNode* KDNode::build(std::vector<TriangleType*>& tris, int depth)
-{
-	KDNode* node = new KDNode(smp_);
-	node->triangles_ = tris;
-	node->left = NULL;
-	node->right = NULL;
-	node->bbox = Box();
-	if (tris.size()==0)
-		return node;
-	if (tris.size() == 1)
-	{
-		node->bbox = tris[0]->get_bounding_box();
-		node->left = new KDNode(smp_);
-		node->right = new KDNode(smp_);
-		node->left->triangles_ = vector<TriangleType*>();
-		node->right->triangles_ = vector<TriangleType*>();
-		return node;
-	}
-	pcm::Vec3 midpt = pcm::Vec3(0.0f, 0.0f, 0.0f);
-	for (int i = 0; i < tris.size(); ++i)
-	{
-		TriangleType* p_tri = tris[i];
-		int i0 = p_tri->get_i_vertex(0);
-		int i1 = p_tri->get_i_vertex(1);
-		int i2 = p_tri->get_i_vertex(2);
-		pcm::PointType& p1 = smp_[i0].get_position();
-		pcm::PointType& p2 = smp_[i1].get_position();
-		pcm::PointType& p3 = smp_[i2].get_position();
-		node->bbox.expand(p1);
-		node->bbox.expand(p2);
-		node->bbox.expand(p3);
-		midpt += p_tri->get_midpoint();
-	}
-	if (depth >= max_depth)
-		return node;
-	midpt /= tris.size();
-	vector<TriangleType*> left_tris;
-	vector<TriangleType*> right_tris;
-	int axis = node->bbox.longest_axis();
-	for (int i = 0; i < tris.size(); ++i)
-	{
-		switch (axis)
-		{
-		case 0:
-			midpt.x() >= tris[i]->get_midpoint().x() ? right_tris.push_back(tris[i]) :
-				left_tris.push_back(tris[i]);
-			break;
-		case 1:
-			midpt.y() >= tris[i]->get_midpoint().y() ? right_tris.push_back(tris[i]) :
-				left_tris.push_back(tris[i]);
-			break;
-		case 2:
-			midpt.z() >= tris[i]->get_midpoint().z() ? right_tris.push_back(tris[i]) :
-				left_tris.push_back(tris[i]);
-			break;
-		}
-	}
-	if (left_tris.size() == 0 && right_tris.size() > 0) left_tris = right_tris;
-	if (right_tris.size() == 0 && left_tris.size() > 0) right_tris = left_tris ;
-	int matches = 0;
-	for (int i = 0; i < left_tris.size(); ++i)
-	{
-		for (int j = 0; j < right_tris.size(); ++j)
-		{
-			if (left_tris[i] == right_tris[j])
-				matches++;
-
-		}
-	}
-	if ((float)matches / left_tris.size() < 0.5 && (float)matches / right_tris.size() < 0.5)
+	// Moller-Trumbore, same conditions as TriangleType::hit(): u, v >= 0, u + v <= 1, 0 < t < max_t
+	inline bool intersect_triangle(const float* tri, const float* o, const float* d, float max_t, float& t, float& u, float& v)
 	{
-		node->left = build(left_tris, depth + 1);
-		node->right = build(right_tris, depth + 1);
-	}
-	else
-	{//stop subdivision
-		node->left = new KDNode(smp_);
-		node->right = new KDNode(smp_);
-		node->left->triangles_ = vector<TriangleType*>();
-		node->right->triangles_ = vector<TriangleType*>();
-
+		const float* p0 = tri;
+		const float* e1 = tri + 3;
+		const float* e2 = tri + 6;
+		float pvec[3] = { d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0] };
+		float det = e1[0]*pvec[0] + e1[1]*pvec[1] + e1[2]*pvec[2];
+		if (det > -1e-12f && det < 1e-12f)
+			return false;
+		float inv_det = 1.0f / det;
+		float tvec[3] = { o[0] - p0[0], o[1] - p0[1], o[2] - p0[2] };
+		u = (tvec[0]*pvec[0] + tvec[1]*pvec[1] + tvec[2]*pvec[2]) * inv_det;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		float qvec[3] = { tvec[1]*e1[2] - tvec[2]*e1[1], tvec[2]*e1[0] - tvec[0]*e1[2], tvec[0]*e1[1] - tvec[1]*e1[0] };
+		v = (d[0]*qvec[0] + d[1]*qvec[1] + d[2]*qvec[2]) * inv_det;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+		t = (e2[0]*qvec[0] + e2[1]*qvec[1] + e2[2]*qvec[2]) * inv_det;
+		return t > 0.0f && t < max_t;
 	}
-	return node;
 
-}
-Box& KDNode::get_bounding_box()
-{
-
-	return bbox;
-}
-
-bool KDNode::hit(KDNode* node, const Ray& ray, float& t, float& min, HitResult& hitResult)
-{
-	if (node->bbox.hit(ray))
+	inline void ray_setup(const Ray& ray, float* o, float* d, float* inv_d)
 	{
-		pcm::NormalType normal;
-		bool hit_tris = false;
-
-		//if either child still has triangles ,recurse down both sides and check for intersection
-		bool isheat = false;
-		if (node->left &&
-			node->left->triangles_.size() > 0 || node->right &&node->right->triangles_.size() > 0)
+		for (int k = 0; k < 3; ++k)
 		{
-
-				bool hitleft = hit(node->left, ray, t, min, hitResult);
-				bool hitright = hit(node->right, ray, t, min, hitResult);
-				return hitleft || hitright;
+			o[k] = ray.origin(k);
+			d[k] = ray.dir(k);
+			inv_d[k] = 1.0f / d[k];
 		}
-		else
-		{
-			//we have reched a leaf
-			float min_t = 10000.0f;
-			pcm::PointType hit_pt, local_hit_pt;
-			HitResult besthit;
-			for (int i = 0; i < node->triangles_.size(); ++i)
-			{
-				HitResult triangle_hitresult;
-				if (node->triangles_[i]->hit(ray, t, min, triangle_hitresult))
-				{
-					hit_tris = true;
-					if( t <min_t)
-						besthit = triangle_hitresult;
-
-				}
-			}
-			if (hit_tris)
-			{
-				hitResult = besthit;
-				hitResult.hit_obj = true;
-				return true;
-			}
-			return false;
-
-
-		}
-
 	}
-	return false;
 }
 
-
-
 Shader*  KDTree::openglShader = NULL;
 int		 KDTree::reference_count = 0;
 void KDTree::loalshader(Shader*& shader, const std::string& vertexPath, const std::string& fragmentPath, const std::string& geometryPath /*= std::string()*/)
@@ -181,8 +71,8 @@ void KDTree::loalshader(Shader*& shader, const std::string& vertexPath, const st
 
 
 }
-KDTree::KDTree(Sample& _smp):smp_(_smp), isBuild(false),isBufferSetup(false),root(NULL),
- count(NULL),indices(NULL), isHitrayBufferSetup(false)
+KDTree::KDTree(Sample& _smp):smp_(_smp), isBuild(false),isBufferSetup(false),
+ count(NULL),indices(NULL), isHitrayBufferSetup(false), isCubeBufferUpdated(true)
 {
 	reference_count++;
 	if (!openglShader)
@@ -195,17 +85,12 @@ KDTree::KDTree(Sample& _smp):smp_(_smp), isBuild(false),isBufferSetup(false),roo
 	canvas_ = Global_Canvas;
 }
 
-void buildDebugCub(KDNode* node, std::vector<pcm::PointType>& cubic_position_,
+static void pushDebugCub(const BVHNode& node, std::vector<pcm::PointType>& cubic_position_,
 std::vector<int>&	cubic_idx_)
 {
-	if (!node)
-		return;
-	if (!node->triangles_.size())
-		return;
-	Box& box = node->get_bounding_box();
 	int vtx_size = cubic_position_.size();
-	const pcm::PointType& high = box.high_corner();
-	const pcm::PointType& low = box.low_corner();
+	const pcm::PointType high(node.bmax[0], node.bmax[1], node.bmax[2]);
+	const pcm::PointType low(node.bmin[0], node.bmin[1], node.bmin[2]);
 	cubic_position_.push_back(low);
 	cubic_position_.push_back(pcm::PointType(high(0),low(1),low(2)));
 	cubic_position_.push_back(pcm::PointType(high(0), high(1), low(2)));
@@ -232,17 +117,110 @@ std::vector<int>&	cubic_idx_)
 	cubic_idx_.push_back(vtx_size + 3);
 	cubic_idx_.push_back(vtx_size + 7);
 	cubic_idx_.push_back(vtx_size + 6);
-	buildDebugCub(node->left, cubic_position_, cubic_idx_);
-	buildDebugCub(node->right, cubic_position_, cubic_idx_);
+}
+// boxes of the first levels of the tree
+static void buildDebugCub(const std::vector<BVHNode>& nodes, std::vector<pcm::PointType>& cubic_position_,
+std::vector<int>&	cubic_idx_)
+{
+	if (nodes.empty())
+		return;
+	std::vector<std::pair<int, int> > stack(1, std::make_pair(0, 0));
+	while (!stack.empty())
+	{
+		int node = stack.back().first;
+		int depth = stack.back().second;
+		stack.pop_back();
+		pushDebugCub(nodes[node], cubic_position_, cubic_idx_);
+		if (nodes[node].is_leaf() || depth >= DEBUG_CUBE_DEPTH)
+			continue;
+		stack.push_back(std::make_pair(nodes[node].offset, depth + 1));
+		stack.push_back(std::make_pair(node + 1, depth + 1));
+	}
+}
+void KDTree::build_bvh()
+{
+	vector<TriangleType*>& triangles = smp_.getTriangleArray();
+	const int nb_tris = (int)triangles.size();
+	nodes_.clear();
+	tri_index_.resize(nb_tris);
+	tri_data_.resize(9 * nb_tris);
+	if (!nb_tris)
+		return;
 
+	std::vector<BVHBox> boxes(nb_tris);
+	std::vector<float> centroids(3 * nb_tris);
+	#pragma omp parallel for
+	for (int i = 0; i < nb_tris; ++i)
+	{
+		boxes[i].reset();
+		for (int k = 0; k < 3; ++k)
+		{
+			const pcm::PointType& p = smp_[triangles[i]->get_i_vertex(k)].get_position();
+			float pf[3] = { p(0), p(1), p(2) };
+			boxes[i].expand(pf);
+		}
+		for (int k = 0; k < 3; ++k)
+			centroids[3 * i + k] = 0.5f * (boxes[i].bmin[k] + boxes[i].bmax[k]);
+	}
+	::build_bvh(boxes, centroids, tri_index_, nodes_);
+	update_triangle_data();
 }
-void KDTree::build()
+void KDTree::update_triangle_data()
 {
-	KDNode::max_depth = 7;
 	vector<TriangleType*>& triangles = smp_.getTriangleArray();
-	KDNode node(smp_);
-	root = node.build(triangles, 0);
-	buildDebugCub(root, cubic_position_, cubic_idx_);
+	const int nb_tris = (int)tri_index_.size();
+	#pragma omp parallel for
+	for (int i = 0; i < nb_tris; ++i)
+	{
+		TriangleType* p_tri = triangles[tri_index_[i]];
+		const pcm::PointType& p0 = smp_[p_tri->get_i_vertex(0)].get_position();
+		const pcm::PointType& p1 = smp_[p_tri->get_i_vertex(1)].get_position();
+		const pcm::PointType& p2 = smp_[p_tri->get_i_vertex(2)].get_position();
+		float* dst = &tri_data_[9 * i];
+		for (int k = 0; k < 3; ++k)
+		{
+			dst[k] = p0(k);
+			dst[3 + k] = p1(k) - p0(k);
+			dst[6 + k] = p2(k) - p0(k);
+		}
+	}
+}
+void KDTree::refit()
+{
+	if (!isBuild || (int)tri_index_.size() != (int)smp_.getTriangleArray().size())
+	{
+		build();
+		return;
+	}
+	update_triangle_data();
+	const int nb_tris = (int)tri_index_.size();
+	std::vector<BVHBox> boxes(nb_tris);
+	#pragma omp parallel for
+	for (int i = 0; i < nb_tris; ++i)
+	{
+		const float* data = &tri_data_[9 * i];
+		float p1[3] = { data[0] + data[3], data[1] + data[4], data[2] + data[5] };
+		float p2[3] = { data[0] + data[6], data[1] + data[7], data[2] + data[8] };
+		boxes[i].reset();
+		boxes[i].expand(data);
+		boxes[i].expand(p1);
+		boxes[i].expand(p2);
+	}
+	refit_bvh(boxes, nodes_);
+	// same cubes, new corners
+	cubic_position_.clear();
+	cubic_idx_.clear();
+	buildDebugCub(nodes_, cubic_position_, cubic_idx_);
+	isCubeBufferUpdated = false;
+}
+void KDTree::build()
+{
+	build_bvh();
+	isBuild = true;
+	cubic_position_.clear();
+	cubic_idx_.clear();
+	buildDebugCub(nodes_, cubic_position_, cubic_idx_);
+	isCubeBufferUpdated = false;
 	element_size = this->cubic_idx_.size() / 4;
 	if (count)
 		delete[] count;
@@ -395,6 +373,9 @@ void KDTree::drawKdTree()
 	canvas_->makeCurrent();
 	if (!isBufferSetup)
 		setupBuffer();
+	else if (!isCubeBufferUpdated)
+		updateBuffer();
+	isCubeBufferUpdated = true;
 	if (!isHitrayBufferSetup)
 		updateHitrayBuffer();
 	updateViewOfMesh();
@@ -470,35 +451,205 @@ void KDTree::drawKdTree()
 
 }
 
-bool KDTree::hit(const Ray& ray, float& t, float& min, HitResult& hitResult)
+int KDTree::intersect(const Ray& ray, float& best_t, float& best_u, float& best_v) const
 {
-	if (root->hit(root, ray, t, min, hitResult))
+	best_t = (float)ray.max_length;
+	if (nodes_.empty())
+		return -1;
+	float o[3], d[3], inv_d[3];
+	ray_setup(ray, o, d, inv_d);
+
+	int best = -1;
+	int stack[BVH_STACK_SIZE];
+	int sp = 0;
+	int node = 0;
+	if (bvh_slab(nodes_[0], o, inv_d, best_t) == FLT_MAX)
+		return -1;
+	while (true)
 	{
-		//add hit result to render;
-		int vtx_size = hitray_position_.size();
-		hitray_position_.push_back(ray.origin);
-		hitray_position_.push_back(hitResult.target_ph);
-		//hitray_position_.push_back(hitResult.ph+pcm::PointType(0.01f,0.01f,0.01f));
-		//hitray_position_.push_back(ray.origin+pcm::Vec3(0.01f, 0.01f, 0.01f));
-		hitray_idx_.push_back(vtx_size + 0);
-		hitray_idx_.push_back(vtx_size + 1);
-		//hitray_idx_.push_back(vtx_size + 2);
-		//hitray_idx_.push_back(vtx_size + 3);
-		isHitrayBufferSetup = false;
-		return true;
+		const BVHNode& n = nodes_[node];
+		if (n.is_leaf())
+		{
+			for (int i = n.offset; i < n.offset + n.count; ++i)
+			{
+				float t, u, v;
+				if (intersect_triangle(&tri_data_[9 * i], o, d, best_t, t, u, v))
+				{
+					best = i;
+					best_t = t;
+					best_u = u;
+					best_v = v;
+				}
+			}
+		}
+		else
+		{
+			// near child first, the far one is only visited if it may hold something closer
+			int near_node = node + 1, far_node = n.offset;
+			float t_near = bvh_slab(nodes_[near_node], o, inv_d, best_t);
+			float t_far = bvh_slab(nodes_[far_node], o, inv_d, best_t);
+			if (t_far < t_near)
+			{
+				std::swap(near_node, far_node);
+				std::swap(t_near, t_far);
+			}
+			if (t_near != FLT_MAX)
+			{
+				if (t_far != FLT_MAX)
+					stack[sp++] = far_node;
+				node = near_node;
+				continue;
+			}
+		}
+		// pop, skipping the nodes that start behind the closest hit
+		node = -1;
+		while (sp > 0)
+		{
+			int candidate = stack[--sp];
+			if (bvh_slab(nodes_[candidate], o, inv_d, best_t) != FLT_MAX)
+			{
+				node = candidate;
+				break;
+			}
+		}
+		if (node < 0)
+			break;
 	}
-	else
+	return best;
+}
+
+void KDTree::intersect_packet(const Ray* rays, int nb_rays, int* tri, float* best_t, float* best_u, float* best_v) const
+{
+	float o[PACKET_SIZE][3], d[PACKET_SIZE][3], inv_d[PACKET_SIZE][3];
+	for (int r = 0; r < nb_rays; ++r)
 	{
-		int vtx_size = hitray_position_.size();
-		hitray_position_.push_back(ray.origin);
+		ray_setup(rays[r], o[r], d[r], inv_d[r]);
+		tri[r] = -1;
+		best_t[r] = (float)rays[r].max_length;
+	}
+	if (nodes_.empty())
+		return;
+
+	int stack[BVH_STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp > 0)
+	{
+		const int node = stack[--sp];
+		const BVHNode& n = nodes_[node];
+		// early out: no ray of the packet can find something closer in this node
+		int first_active = -1;
+		for (int r = 0; r < nb_rays; ++r)
+		{
+			if (bvh_slab(n, o[r], inv_d[r], best_t[r]) != FLT_MAX)
+			{
+				first_active = r;
+				break;
+			}
+		}
+		if (first_active < 0)
+			continue;
+
+		if (n.is_leaf())
+		{
+			for (int i = n.offset; i < n.offset + n.count; ++i)
+			{
+				const float* tri_data = &tri_data_[9 * i];
+				for (int r = first_active; r < nb_rays; ++r)
+				{
+					float t, u, v;
+					if (intersect_triangle(tri_data, o[r], d[r], best_t[r], t, u, v))
+					{
+						tri[r] = i;
+						best_t[r] = t;
+						best_u[r] = u;
+						best_v[r] = v;
+					}
+				}
+			}
+		}
+		else
+		{
+			// order with the first active ray, the packet is assumed coherent
+			if (d[first_active][n.axis()] >= 0.0f)
+			{
+				stack[sp++] = n.offset;
+				stack[sp++] = node + 1;
+			}
+			else
+			{
+				stack[sp++] = node + 1;
+				stack[sp++] = n.offset;
+			}
+		}
+	}
+}
+
+void KDTree::fill_hit_result(const Ray& ray, int tri, float t, float u, float v, HitResult& hitResult)
+{
+	const float* data = &tri_data_[9 * tri];
+	pcm::PointType p0(data[0], data[1], data[2]);
+	pcm::PointType p1(p0(0) + data[3], p0(1) + data[4], p0(2) + data[5]);
+	pcm::PointType p2(p0(0) + data[6], p0(1) + data[7], p0(2) + data[8]);
+	hitResult.target_ph = ray.origin + t*ray.dir;
+	hitResult.target_ph2 = (1 - u - v)*p0 + u*p1 + v*p2;
+	hitResult.hit_obj = true;
+	hitResult.target_sample_idx = smp_.smpId;
+	hitResult.target_triangle_idx = smp_.getTriangleArray()[tri_index_[tri]]->get_idx();
+	hitResult.u = u;
+	hitResult.v = v;
+	hitResult.t = t;
+	hitResult.p0 = p0;
+	hitResult.p1 = p1;
+	hitResult.p2 = p2;
+}
+
+void KDTree::add_hitray(const Ray& ray, bool is_hit, const HitResult& hitResult)
+{
+	//add hit result to render;
+	int vtx_size = hitray_position_.size();
+	hitray_position_.push_back(ray.origin);
+	if (is_hit)
+		hitray_position_.push_back(hitResult.target_ph);
+	else
 		hitray_position_.push_back(ray.origin+ray.max_length*ray.dir);
-		//hitray_position_.push_back(hitResult.ph+pcm::PointType(0.01f,0.01f,0.01f));
-		//hitray_position_.push_back(ray.origin+pcm::Vec3(0.01f, 0.01f, 0.01f));
-		hitray_idx_.push_back(vtx_size + 0);
-		hitray_idx_.push_back(vtx_size + 1);
-		//hitray_idx_.push_back(vtx_size + 2);
-		//hitray_idx_.push_back(vtx_size + 3);
-		isHitrayBufferSetup = false;
+	hitray_idx_.push_back(vtx_size + 0);
+	hitray_idx_.push_back(vtx_size + 1);
+	isHitrayBufferSetup = false;
+}
+
+bool KDTree::hit(const Ray& ray, float& t, float& min, HitResult& hitResult)
+{
+	float u, v;
+	int tri = intersect(ray, t, u, v);
+	if (tri >= 0)
+		fill_hit_result(ray, tri, t, u, v, hitResult);
+	add_hitray(ray, tri >= 0, hitResult);
+	return tri >= 0;
+}
+
+void KDTree::hit_batch(const std::vector<Ray>& rays, std::vector<HitResult>& results, std::vector<char>& hits)
+{
+	const int nb_rays = (int)rays.size();
+	results.resize(nb_rays);
+	hits.assign(nb_rays, 0);
+	const int nb_packets = (nb_rays + PACKET_SIZE - 1) / PACKET_SIZE;
+	#pragma omp parallel for schedule(dynamic, 4)
+	for (int p = 0; p < nb_packets; ++p)
+	{
+		const int first = p * PACKET_SIZE;
+		const int nb = std::min(PACKET_SIZE, nb_rays - first);
+		int tri[PACKET_SIZE];
+		float t[PACKET_SIZE], u[PACKET_SIZE], v[PACKET_SIZE];
+		intersect_packet(&rays[first], nb, tri, t, u, v);
+		for (int r = 0; r < nb; ++r)
+		{
+			if (tri[r] < 0)
+				continue;
+			fill_hit_result(rays[first + r], tri[r], t[r], u[r], v[r], results[first + r]);
+			hits[first + r] = 1;
+		}
 	}
-	return false;
+	for (int i = 0; i < nb_rays; ++i)
+		add_hitray(rays[i], hits[i] != 0, results[i]);
 }
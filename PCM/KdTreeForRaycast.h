@@ -3,55 +3,43 @@
 #include "box.h"
 #include "ray.h"
 #include "shader.h"
+#include "flat_bvh.h"
 #include <vector>
 class TriangleType;
 class Sample;
 class PaintCanvas;
-class KDNode
-{
-public:
-	static int max_depth;
-	KDNode(Sample& _smp);
-	KDNode* build(std::vector<TriangleType*>& tris,int depth);
-	Box& get_bounding_box();
-	bool hit(KDNode* node, const Ray& ray, float& t, float& min, HitResult& hitResult);
-	Box bbox;
-	KDNode* left;
-	KDNode* right;
-	std::vector<TriangleType*> triangles_;
-	Sample& smp_;
-
-};
+/*
+	Ray caster of a sample (kept the KDTree name, it is a BVH now), the tree is
+	built by build_bvh() of flat_bvh.h. hit() returns the closest triangle. hit_batch()
+	traces rays in packets of PACKET_SIZE sharing one traversal (near child first, early out once
+	every ray of the packet found something closer than the node), packets are spread
+	over the threads.
+*/
 class KDTree
 {
 public:
+	static const int PACKET_SIZE = 8;
+
 	static Shader* openglShader;
 	static int reference_count;
 	static void loalshader(Shader*& shader, const std::string& vertexPath, const std::string& fragmentPath, const std::string& geometryPath = std::string());
 	KDTree(Sample& _smp);
 	~KDTree()
 	{
-		freeNode(root);
-	}
-	void freeNode(KDNode* node)
-	{
-		if (node)
-		{
-			KDNode* left = node->left;
-			KDNode* right = node->right;
-			delete node;
-			freeNode(left);
-			freeNode(right);
-		}
-
+		delete[] count;
+		delete[] indices;
 	}
 	void build();
+	// Triangles moved (same triangles, same vertices): update the boxes bottom up, keep the tree
+	void refit();
 	void updateViewOfMesh();
 	void setupBuffer();
 	void updateBuffer();
 	void updateHitrayBuffer();
 	void drawKdTree();
 	bool hit(const Ray& ray, float& t, float& min, HitResult& hitResult);
+	// Trace every ray (in the sample's local frame), hits[i] tells if results[i] is valid
+	void hit_batch(const std::vector<Ray>& rays, std::vector<HitResult>& results, std::vector<char>& hits);
 	void clearDebugCube()
 	{
 		cubic_position_.clear();
@@ -66,11 +54,20 @@ public:
 		isHitrayBufferSetup = false;
 	}
 private:
-	bool max_depth;
+	void build_bvh();
+	void update_triangle_data();
+	int  intersect(const Ray& ray, float& best_t, float& best_u, float& best_v) const;
+	void intersect_packet(const Ray* rays, int nb_rays, int* tri, float* best_t, float* best_u, float* best_v) const;
+	void fill_hit_result(const Ray& ray, int tri, float t, float u, float v, HitResult& hitResult);
+	void add_hitray(const Ray& ray, bool is_hit, const HitResult& hitResult);
+
 	bool isBuild;
 	bool isBufferSetup;
 	bool isHitrayBufferSetup;
-	KDNode* root;
+	bool isCubeBufferUpdated;
+	std::vector<BVHNode>	nodes_;
+	std::vector<int>		tri_index_;		// BVH order -> index in the sample's triangle array
+	std::vector<float>		tri_data_;		// BVH order, 9 floats per triangle: p0, p1 - p0, p2 - p0
 	Sample& smp_;
 	PaintCanvas* canvas_;
 	GLfloat p_viewmatrix_[16];
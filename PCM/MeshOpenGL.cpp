@@ -8,6 +8,7 @@
 #include <QGLViewer\manipulatedFrame.h>
 #include <sstream>
 #include <string>
+#include <cstring>
 using namespace std;
 static bool isDebug = true;
 namespace MyOpengl
@@ -466,17 +467,21 @@ namespace MyOpengl
 		colors.clear();
 		//vertices.resize(smp_.num_vertices());
 		//indices.resize(smp_.num_triangles());
-		for (int i = 0; i < smp_.num_vertices(); i++)
-		{
-			OpenglVertex vertex;
-			vertex.Position  =  smp_[i].get_position();
-			vertex.Normal    =  smp_[i].get_normal();
-			vertex.TexCoords =  smp_[i].get_texture();
-			vertex.Tangent   =  smp_[i].get_tangent();
-			vertex.Bitangent =  smp_[i].get_bi_tangent();
-			Vertex& v = smp_[i];
-			vertices.push_back(vertex);
-
+		// read the columns of the store instead of going through every vertex view
+		VertexStore& store = smp_.vertex_store();
+		const int n_vtx = (int)store.size();
+		vertices.resize(n_vtx);
+		#pragma omp parallel for
+		for (int i = 0; i < n_vtx; i++)
+		{
+			OpenglVertex& vertex = vertices[i];
+			const ScalarType* p = store.position(i);
+			const ScalarType* n = store.normal(i);
+			vertex.Position  =  pcm::PointType(p[0], p[1], p[2]);
+			vertex.Normal    =  pcm::NormalType(n[0], n[1], n[2]);
+			vertex.TexCoords =  store.texture(i);
+			vertex.Tangent   =  store.tangent(i);
+			vertex.Bitangent =  store.bi_tangent(i);
 		}
 		for (size_t i = 0; i < smp_.num_triangles(); i++)
 		{
@@ -486,12 +491,10 @@ namespace MyOpengl
 			indices.push_back(triangle.get_i_vertex(2));
 
 		}
-		for (size_t i = 0; i < smp_.num_vertices(); i++)
-		{
-			OpenglColor openglColor;
-			openglColor.color = pcm::ColorType(smp_[i].r(), smp_[i].g(), smp_[i].b(), smp_[i].alpha());
-			colors.push_back(openglColor);
-		}
+		// same RGBA float layout as OpenglColor
+		colors.resize(n_vtx);
+		if (n_vtx)
+			memcpy(&colors[0], store.colors_data(), n_vtx * sizeof(OpenglColor));
 		if (isDebug)
 		{
 			Logger << "loadMeshFromSample" << endl;
@@ -556,13 +559,8 @@ namespace MyOpengl
 			}
 			else
 			{
-				for (size_t i = 0; i < smp_.num_vertices(); i++)
-				{
-					OpenglColor openglColor;
-					openglColor.color = pcm::ColorType(smp_[i].r(), smp_[i].g(), smp_[i].b(), smp_[i].alpha());
-					colors.push_back(openglColor);
-				}
-
+				colors.resize(smp_.num_vertices());
+				memcpy(&colors[0], smp_.vertex_store().colors_data(), colors.size() * sizeof(OpenglColor));
 			}
 		}
 		else
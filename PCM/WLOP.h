@@ -2,130 +2,204 @@
 #define _WLOP_H
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include "basic_types.h"
 #include "sample_set.h"
 
 using namespace std;
 
+/*
+	Weighted locally optimal projection of a sample onto itself.
+
+	Every iteration moves a point to the gaussian weighted average of its k nearest
+	neighbours, plus mu times the repulsion from them (weight theta(r) / r^rep_power).
+	Both terms are accumulated in one sweep over the neighbour list of the point; the
+	neighbours are gathered into small per thread arrays first so the weight loop is a
+	plain float loop the compiler can vectorize.
+
+	The positions are double buffered: an iteration reads the front buffer and writes
+	the back one, so the points are processed in parallel and the result does not depend
+	on their order. The neighbour lists are only queried again once a point moved more
+	than reuse_ratio * radius since the last query; the sample itself (and its kd-tree)
+	is only written at that time and at the end of run().
+*/
 class WLOP
 {
 public:
+	WLOP():k_(20){}
 
-	void init(IndexType si, ScalarType rad, ScalarType gau, ScalarType rep_pow, ScalarType mu)
+	void init(IndexType si, ScalarType rad, ScalarType gau, ScalarType rep_pow, ScalarType mu, ScalarType reuse_ratio = 0.1f)
 	{
 		radius_ = rad;
 		gaussian_para_ = gau;
 		rep_mu_ = mu;
 		smp_idx_ = si;
 		rep_power_ = rep_pow;
-		avg_.clear();
-		IndexType v_siz = SampleSet::get_instance()[smp_idx_].num_vertices();
-		avg_.resize( v_siz );
-		avg_w_sum_.resize( v_siz );
-		repulsion_.resize( v_siz );
-		rep_w_sum_.resize( v_siz );
+		reuse_ratio_ = reuse_ratio;
+		neighbours_.clear();
+		Sample& smp = SampleSet::get_instance()[smp_idx_];
+		const ScalarType* p = smp.vertex_store().positions_data();
+		front_.assign( p, p + 3 * smp.num_vertices() );
+		back_.resize( front_.size() );
 	}
 
-	void compute_repulsion_term()
+	void run(int n_iterate)
 	{
-		ScalarType radius2 = radius_ * radius_;
-		ScalarType iradius16 = - gaussian_para_ / radius2;
-
-		Sample& smp = SampleSet::get_instance()[smp_idx_];
-
-		for (IndexType i = 0; i < smp.num_vertices(); ++i)
+		for (int i=0; i<n_iterate; i++)
 		{
-			Vertex& v = smp[i];
-			const IndexType k = 20;
-			IndexType neigs[k];
-			smp.neighbours(i,k, neigs);
-			for ( IndexType j =0; j<k; j++ )
-			{
-				Vertex& neig_v = smp[ neigs[j] ];
-				ScalarType dx = v.x() - neig_v.x();
-				ScalarType dy = v.y() - neig_v.y();
-				ScalarType dz = v.z() - neig_v.z();
-				ScalarType dist2 = dx * dx + dy * dy + dz * dz;
-				ScalarType w = exp( dist2 * iradius16 );
-				ScalarType len = sqrt(dist2);
-				if(len <= 0.001 * radius_) len = radius_*0.001;
-				ScalarType rep = w * pow(1.0/len, rep_power_);
-
-				repulsion_[i] += rep * PointType( dx, dy, dz );
-				rep_w_sum_[i] += rep;
-
-			}
+			iterate();
+		}
+		write_back();
 	}
 
-	void compute_avg_term( )
+	void iterate()
 	{
-		ScalarType radius2 = radius_ * radius_;
-		ScalarType iradius16 = - gaussian_para_ / radius2;
-
-		Sample& smp = SampleSet::get_instance()[smp_idx_];
-
-		for (IndexType i = 0; i < smp.num_vertices(); ++i)
+		const IndexType n = (IndexType)front_.size() / 3;
+		if ( !n )
+			return;
+		if ( neighbours_.empty() || max_displacement() > reuse_ratio_ * radius_ )
+			query_neighbours();
+
+		const IndexType k = k_;
+		const ScalarType iradius16 = - gaussian_para_ / (radius_ * radius_);
+		const ScalarType min_len2 = (0.001f * radius_) * (0.001f * radius_);
+		const ScalarType half_power = 0.5f * rep_power_;
+		const ScalarType mu = rep_mu_;
+		const ScalarType* src = &front_[0];
+		ScalarType* dst = &back_[0];
+
+		#pragma omp parallel
 		{
-			Vertex& v = smp[i];
-			const IndexType k = 20;
-			IndexType neigs[k];
-			smp.neighbours(i,k, neigs);
-			for ( IndexType j =0; j<k; j++ )
+			std::vector<ScalarType> buf( 5 * k );
+			ScalarType* dx = &buf[0];
+			ScalarType* dy = dx + k;
+			ScalarType* dz = dy + k;
+			ScalarType* avg_w = dz + k;
+			ScalarType* rep_w = avg_w + k;
+
+			#pragma omp for schedule(static)
+			for (int i = 0; i < n; ++i)
 			{
-				Vertex& neig_v = smp[ neigs[j] ];
-				ScalarType dx = v.x() - neig_v.x();
-				ScalarType dy = v.y() - neig_v.y();
-				ScalarType dz = v.z() - neig_v.z();
-				ScalarType dist2 = dx * dx + dy * dy + dz * dz;
-				ScalarType w = exp( dist2 * iradius16 );
-				avg_[i] = w * PointType( v.x(), v.y(), v.z() );
-				avg_w_sum_[i] += w;
+				const IndexType* neigs = &neighbours_[ (size_t)i * k ];
+				const ScalarType px = src[3*i], py = src[3*i+1], pz = src[3*i+2];
+				for ( IndexType j = 0; j < k; ++j )
+				{
+					const ScalarType* q = src + 3 * neigs[j];
+					dx[j] = px - q[0];
+					dy[j] = py - q[1];
+					dz[j] = pz - q[2];
+				}
+				// theta(r) and theta(r) / r^rep_power in a single exp
+				for ( IndexType j = 0; j < k; ++j )
+				{
+					const ScalarType dist2 = dx[j] * dx[j] + dy[j] * dy[j] + dz[j] * dz[j];
+					const ScalarType len2 = std::max( dist2, min_len2 );
+					avg_w[j] = std::exp( dist2 * iradius16 );
+					rep_w[j] = std::exp( dist2 * iradius16 - half_power * std::log(len2) );
+				}
+
+				ScalarType avg_sum = 0, ax = 0, ay = 0, az = 0;
+				ScalarType rep_sum = 0, rx = 0, ry = 0, rz = 0;
+				for ( IndexType j = 0; j < k; ++j )
+				{
+					// neighbour = p - d
+					avg_sum += avg_w[j];
+					ax -= avg_w[j] * dx[j];
+					ay -= avg_w[j] * dy[j];
+					az -= avg_w[j] * dz[j];
+					if ( neigs[j] == i )
+						continue;
+					rep_sum += rep_w[j];
+					rx += rep_w[j] * dx[j];
+					ry += rep_w[j] * dy[j];
+					rz += rep_w[j] * dz[j];
+				}
+
+				ScalarType x = px, y = py, z = pz;
+				if ( avg_sum > 1e-20 )
+				{
+					x += ax / avg_sum;
+					y += ay / avg_sum;
+					z += az / avg_sum;
+				}
+				if ( rep_sum > 1e-20 && mu >= 0 )
+				{
+					x += mu * rx / rep_sum;
+					y += mu * ry / rep_sum;
+					z += mu * rz / rep_sum;
+				}
+				dst[3*i] = x;
+				dst[3*i+1] = y;
+				dst[3*i+2] = z;
 			}
 		}
-
+		front_.swap( back_ );
 	}
 
-	void run(int n_iterate)
+private:
+	// largest move since the sample positions were last written
+	ScalarType max_displacement()
 	{
-		for (int i=0; i<n_iterate; i++)
+		const IndexType n = (IndexType)front_.size() / 3;
+		const ScalarType* p = SampleSet::get_instance()[smp_idx_].vertex_store().positions_data();
+		ScalarType max_d2 = 0;
+		#pragma omp parallel
 		{
-			iterate();
+			ScalarType local_max = 0;
+			#pragma omp for
+			for (int i = 0; i < 3 * n; i += 3)
+			{
+				const ScalarType dx = front_[i] - p[i];
+				const ScalarType dy = front_[i+1] - p[i+1];
+				const ScalarType dz = front_[i+2] - p[i+2];
+				local_max = std::max( local_max, dx * dx + dy * dy + dz * dz );
+			}
+			#pragma omp critical
+			max_d2 = std::max( max_d2, local_max );
 		}
-		SampleSet::get_instance()[smp_idx_].build_kdtree();
+		return std::sqrt( max_d2 );
 	}
-	void iterate()
+
+	void write_back()
 	{
-		compute_repulsion_term();
-		compute_avg_term();
-		
 		Sample& smp = SampleSet::get_instance()[smp_idx_];
+		if ( front_.empty() || front_.size() != 3 * smp.num_vertices() )
+			return;
+		std::copy( front_.begin(), front_.end(), smp.vertices_matrix().data() );
+		smp.refit_kdtree();
+	}
 
-		for (int i=0; i<smp.num_vertices(); i++)
+	void query_neighbours()
+	{
+		write_back();
+		Sample& smp = SampleSet::get_instance()[smp_idx_];
+		const IndexType n = smp.num_vertices();
+		const IndexType k = k_ = std::min<IndexType>( 20, n );
+		neighbours_.resize( (size_t)n * k );
+		#pragma omp parallel
 		{
-			Vertex& v = smp[i];
-			if ( avg_w_sum_[i] > 1e-20 )
+			std::vector<ScalarType> dist( k );
+			#pragma omp for schedule(dynamic, 256)
+			for (int i = 0; i < n; ++i)
 			{
-				v.set_position( avg_[i] / avg_w_sum_[i] );
+				IndexType* neigs = &neighbours_[ (size_t)i * k ];
+				if ( !smp.neighbours( i, k, neigs, &dist[0] ) )
+					std::fill( neigs, neigs + k, i );
 			}
-			if ( rep_w_sum_[i] > 1e-20 && rep_mu_ >=0 )
-			{
-				PointType tmp_v( v.x(), v.y(), v.z() );
-				v.set_position( tmp_v + rep_mu_*(repulsion_[i]/rep_w_sum_[i]) );
-			}
-
 		}
 	}
 
-private:
 	ScalarType radius_;
 	ScalarType rep_mu_;
 	ScalarType gaussian_para_;
 	ScalarType rep_power_;
+	ScalarType reuse_ratio_;
 	IndexType smp_idx_;
-	vector<PointType> avg_;
-	vector<ScalarType> avg_w_sum_;
-	vector<PointType> repulsion_;
-	vector<ScalarType> rep_w_sum_;
+	IndexType k_;
+	vector<IndexType> neighbours_;	// k_ x N
+	vector<ScalarType> front_;		// 3 x N, positions of the last iteration
+	vector<ScalarType> back_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -12,11 +12,21 @@
 #include <iostream>
 #include <fstream>
 #include <deque>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "parsers/mapped_file.hpp"
+#include <QDir>
+#include <QFileInfo>
 
 
 #ifndef NO_MOSEK
 #  include <igl/mosek/bbw.h>
 #endif
+#include <igl/active_set.h>
+#include <igl/cotmatrix.h>
+#include <igl/massmatrix.h>
+#include <igl/invert_diag.h>
 #include <Eigen/Dense>
 
 using namespace std;
@@ -280,100 +290,397 @@ bool boundary_conditionsWrapper(
 
 #endif
 
-void computeWeights(Sample* sample, std::vector<Handle*>& _handles, std::vector<std::vector<float>>& _wieghts)
+// =============================================================================
+// BBW cache
+//
+// The tet mesh only depends on the surface (V, F) and the boundary conditions
+// on the handles, both are kept in memory and on disk keyed by a hash of their
+// content. Weights are solved one handle per thread with the biharmonic
+// energy built once per tet mesh. When the handles moved slightly since the
+// last solve the previous weights are the initial guess of the active set.
+//
+// Only the first rows of the tet mesh are the surface vertices (tetgen keeps
+// the input points first), the Steiner points it adds are solved for but
+// never returned nor written.
+//
+// Cache files are raw native endian dumps in s_cache_dir, the oldest are
+// removed once the directory is over s_cache_max_bytes:
+// bbw_<mesh key>.tet    : "TETC", version, key, #VT, #Tets, #BF, VT, Tets, BF
+// bbw_<mesh key>.weight : see writeWeightToBinaryFile()
+// =============================================================================
+
+static const char s_tet_magic[4]    = { 'T', 'E', 'T', 'C' };
+static const char s_weight_magic[4] = { 'B', 'B', 'W', 'W' };
+static const int  s_cache_version   = 1;
+static const char s_cache_dir[]     = "./bbw_cache";
+static const qint64 s_cache_max_bytes = 512ll * 1024 * 1024;
+/// Handles moving less than this ratio of the bounding box diagonal reuse the
+/// previous weights as initial guess
+static const double s_warm_start_ratio = 0.05;
+
+struct Bbw_cache
 {
-	using namespace std;
-	// #V by 3 Matrix of mesh vertex 3D positions
-	Eigen::MatrixXd V;
+	Bbw_cache() : mesh_key(0), handle_key(0), nb_surface(0) {}
 
-	// #F by 3 Matrix of face (triangle) indices
-	Eigen::MatrixXi F;
-	// #Tets by 4 Matrix of tet (indices), empty means surface
+	unsigned long long mesh_key;
+	Eigen::MatrixXd VT;
 	Eigen::MatrixXi Tets;
-	// Original #V by #original_weights Matrix of per-mesh vertex, per-handle
-	// weights unsorted.
-	Eigen::MatrixXd OW;
-	// Extra weights, #V by #extra_weights Matrix of per-mesh vertex,
-	// per-handle weights (probably don't partition unity)
-	Eigen::MatrixXd EW;
-	
+	Eigen::MatrixXi BF;
+	/// Biharmonic energy L' M^-1 L of the tet mesh (built on first solve)
+	Eigen::SparseMatrix<double> Q;
+
+	unsigned long long handle_key;
+	Eigen::MatrixXd C;	// handle positions of 'W'
+	Eigen::VectorXi P;	// handle indices of 'W'
+	Eigen::VectorXi b;
+	Eigen::MatrixXd bc;
+	Eigen::MatrixXd W;	// normalized weights, at least the 'nb_surface' first rows
+	int nb_surface;		// number of vertices of the input mesh
+};
+
+static Bbw_cache s_bbw_cache;
+
+// -----------------------------------------------------------------------------
+
+/// FNV-1a
+static unsigned long long hash_bytes(const void* data, size_t size, unsigned long long h = 14695981039346656037ull)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
 	{
-		V.resize(sample->num_vertices(),3);
-		pcm::Matrix3X& vertex_matrix = sample->vertices_matrix();
-		for (int i = 0; i < sample->num_vertices(); ++i)
-		{
-			V(i,0) = vertex_matrix(0, i);
-			V(i,1) = vertex_matrix(1, i);
-			V(i,2) = vertex_matrix(2, i);
-		}
-		F.resize(sample->num_triangles(), 3);
-		for (int i = 0; i < sample->num_triangles(); ++i)
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static unsigned long long hash_mesh(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F)
+{
+	int dims[4] = { (int)V.rows(), (int)V.cols(), (int)F.rows(), (int)F.cols() };
+	unsigned long long h = hash_bytes(dims, sizeof(dims));
+	h = hash_bytes(V.data(), V.size() * sizeof(double), h);
+	return hash_bytes(F.data(), F.size() * sizeof(int), h);
+}
+
+static unsigned long long hash_handles(const Eigen::MatrixXd& C, const Eigen::VectorXi& P, unsigned long long mesh_key)
+{
+	unsigned long long h = hash_bytes(&mesh_key, sizeof(mesh_key));
+	h = hash_bytes(C.data(), C.size() * sizeof(double), h);
+	return hash_bytes(P.data(), P.size() * sizeof(int), h);
+}
+
+static std::string cache_path(unsigned long long key, const char* ext)
+{
+	char name[64];
+	sprintf(name, "%s/bbw_%016llx.%s", s_cache_dir, key, ext);
+	return std::string(name);
+}
+
+static bool make_cache_dir()
+{
+	if (QDir().mkpath(s_cache_dir))
+		return true;
+	cerr << "ERROR: can't create " << s_cache_dir << endl;
+	return false;
+}
+
+/// Remove the least recently written files beyond s_cache_max_bytes
+static void prune_cache_dir()
+{
+	QDir dir(s_cache_dir);
+	QFileInfoList files = dir.entryInfoList(QStringList() << "bbw_*.tet" << "bbw_*.weight",
+		QDir::Files | QDir::NoSymLinks, QDir::Time);
+	qint64 total = 0;
+	for (int i = 0; i < files.size(); ++i)
+	{
+		total += files[i].size();
+		// Always keep the newest file, it's the one just written
+		if (i > 0 && total > s_cache_max_bytes)
+			dir.remove(files[i].fileName());
+	}
+}
+
+/// Surface rows of 'W' as the vector of vector of computeWeights()
+static void surface_weights(const Eigen::MatrixXd& W, int nb_surface, std::vector<std::vector<float>>& out)
+{
+	const int rows = std::min(nb_surface, (int)W.rows());
+	out.clear();
+	out.resize(rows);
+	for (int i = 0; i < rows; i++)
+	{
+		out[i].resize(W.cols());
+		for (int j = 0; j < W.cols(); j++)
+			out[i][j] = (float)W(i, j);
+	}
+}
+
+// -----------------------------------------------------------------------------
+
+static void write_tet_cache(const Bbw_cache& c)
+{
+	if (!make_cache_dir())
+		return;
+	ofstream file(cache_path(c.mesh_key, "tet").c_str(), ios::binary | ios::trunc);
+	if (!file.is_open())
+		return;
+	int header[5] = { s_cache_version, 0, (int)c.VT.rows(), (int)c.Tets.rows(), (int)c.BF.rows() };
+	file.write(s_tet_magic, 4);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&c.mesh_key, sizeof(c.mesh_key));
+	// Row major so that the file doesn't depend on Eigen's storage order
+	Eigen::Matrix<double, Dynamic, Dynamic, RowMajor> VT = c.VT;
+	Eigen::Matrix<int, Dynamic, Dynamic, RowMajor> Tets = c.Tets;
+	Eigen::Matrix<int, Dynamic, Dynamic, RowMajor> BF = c.BF;
+	file.write((const char*)VT.data(), VT.size() * sizeof(double));
+	file.write((const char*)Tets.data(), Tets.size() * sizeof(int));
+	file.write((const char*)BF.data(), BF.size() * sizeof(int));
+	file.close();
+	prune_cache_dir();
+}
+
+static bool read_tet_cache(unsigned long long key, Bbw_cache& c)
+{
+	Loader::Mapped_file file;
+	if (!file.open(cache_path(key, "tet")))
+		return false;
+	const size_t header_size = 4 + 5 * sizeof(int) + sizeof(unsigned long long);
+	if (file.size() < header_size || memcmp(file.data(), s_tet_magic, 4) != 0)
+		return false;
+
+	int header[5];
+	unsigned long long file_key;
+	memcpy(header, file.data() + 4, sizeof(header));
+	memcpy(&file_key, file.data() + 4 + sizeof(header), sizeof(file_key));
+	const int nVT = header[2], nTets = header[3], nBF = header[4];
+	if (header[0] != s_cache_version || file_key != key || nVT < 0 || nTets < 0 || nBF < 0)
+		return false;
+	const size_t size = header_size + (size_t)nVT * 3 * sizeof(double) + ((size_t)nTets * 4 + (size_t)nBF * 3) * sizeof(int);
+	if (file.size() != size)
+		return false;
+
+	const char* p = file.data() + header_size;
+	Eigen::Matrix<double, Dynamic, Dynamic, RowMajor> VT(nVT, 3);
+	Eigen::Matrix<int, Dynamic, Dynamic, RowMajor> Tets(nTets, 4), BF(nBF, 3);
+	memcpy(VT.data(), p, VT.size() * sizeof(double));	p += VT.size() * sizeof(double);
+	memcpy(Tets.data(), p, Tets.size() * sizeof(int));	p += Tets.size() * sizeof(int);
+	memcpy(BF.data(), p, BF.size() * sizeof(int));
+	c.VT = VT;
+	c.Tets = Tets;
+	c.BF = BF;
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// "BBWW", version, #rows, #cols, handle key, handle positions (#cols x 3
+/// doubles), weights (#rows x #cols floats, row major)
+static bool write_weight_file(const std::string& path,
+	const std::vector<std::vector<float>>& _weights,
+	unsigned long long handle_key,
+	const Eigen::MatrixXd& C)
+{
+	ofstream file(path.c_str(), ios::binary | ios::trunc);
+	if (!file.is_open())
+	{
+		cerr << "ERROR: can't create/open " << path << endl;
+		return false;
+	}
+	const int rows = (int)_weights.size();
+	const int cols = rows > 0 ? (int)_weights[0].size() : 0;
+	int header[3] = { s_cache_version, rows, cols };
+	file.write(s_weight_magic, 4);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&handle_key, sizeof(handle_key));
+	for (int j = 0; j < cols; ++j)
+	{
+		double pos[3] = { 0., 0., 0. };
+		if (j < C.rows())
 		{
-			TriangleType& tt =sample->getTriangle(i);
-			F(i,0) =  tt.get_i_vertex(0);
-			F(i,1) =  tt.get_i_vertex(1);
-			F(i,2) =  tt.get_i_vertex(2);
+			pos[0] = C(j, 0); pos[1] = C(j, 1); pos[2] = C(j, 2);
 		}
+		file.write((const char*)pos, sizeof(pos));
 	}
+	for (int i = 0; i < rows; ++i)
+	{
+		assert((int)_weights[i].size() == cols);
+		if (cols > 0)
+			file.write((const char*)&(_weights[i][0]), cols * sizeof(float));
+	}
+	return file.good();
+}
 
+static bool read_weight_file(const std::string& path,
+	std::vector<std::vector<float>>& _weights,
+	unsigned long long* handle_key,
+	Eigen::MatrixXd* C)
+{
+	_weights.clear();
+	Loader::Mapped_file file;
+	if (!file.open(path))
+		return false;
+	const size_t header_size = 4 + 3 * sizeof(int) + sizeof(unsigned long long);
+	if (file.size() < header_size || memcmp(file.data(), s_weight_magic, 4) != 0)
+		return false;
 
+	int header[3];
+	memcpy(header, file.data() + 4, sizeof(header));
+	const int rows = header[1], cols = header[2];
+	if (header[0] != s_cache_version || rows < 0 || cols < 0)
+		return false;
+	const size_t size = header_size + (size_t)cols * 3 * sizeof(double) + (size_t)rows * cols * sizeof(float);
+	if (file.size() != size)
+		return false;
 
-	//std::vector<std::vector<float > >  V_vec;
-	//const std::vector<std::vector<int> >  F_vec;
-	const std::string switches;
-	//std::vector<std::vector<float > >  TV_vec;
-	//std::vector<std::vector<int > >  TT_vec;
-	//std::vector<std::vector<int> >  TF_vec;
+	const char* p = file.data() + 4 + sizeof(header);
+	if (handle_key)
+		memcpy(handle_key, p, sizeof(unsigned long long));
+	p += sizeof(unsigned long long);
+	if (C)
+	{
+		C->resize(cols, 3);
+		for (int j = 0; j < cols; ++j)
+			for (int k = 0; k < 3; ++k)
+				memcpy(&(*C)(j, k), p + (j * 3 + k) * sizeof(double), sizeof(double));
+	}
+	p += cols * 3 * sizeof(double);
 
-	verbose("Computing BBW weights\n");
-	// Determine which Bones have weights
-	bool success = false;// = distribute_weight_indices(skinning->skel->roots);
-	//if (!success)
-	//{
-	//	return;
-	//}
-
-	// Boundary faces
-	MatrixXi BF;
-	//V by 3 Matrix of mesh vertex 3D positions
-	Eigen::MatrixXd VT;
+	_weights.resize(rows);
+	for (int i = 0; i < rows; ++i)
+	{
+		_weights[i].resize(cols);
+		if (cols > 0)
+			memcpy(&(_weights[i][0]), p + (size_t)i * cols * sizeof(float), cols * sizeof(float));
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+
+static bool tetrahedralize_surface(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F, Bbw_cache& c)
+{
 	cout << "tetgen begin()" << endl;
 	int status = igl::copyleft::tetgen::tetrahedralize(V, F,
 		"Ypq100",
-		VT,
-		Tets,
-		BF);
+		c.VT,
+		c.Tets,
+		c.BF);
 	cout << "tetgen end()" << endl;
-	if (BF.rows() != F.rows())
+	if (c.BF.rows() != F.rows())
 	{
-		//assert(BF.maxCoeff() == skinning->F.maxCoeff());
 		cout << "^%s: Warning: boundary faces != orignal faces\n"<<endl;
 	}
 	if (status != 0)
 	{
 		cout <<
-			"************************************************************\n"
-			"************************************************************\n"
-			"************************************************************\n"
 			"************************************************************\n"
 			"* ^%s: tetgen failed. Just meshing convex hull\n"
-			"************************************************************\n"
-			"************************************************************\n"
-			"************************************************************\n"
 			"************************************************************\n" << endl;
 		status =
 			igl::copyleft::tetgen::tetrahedralize(
-				V, F, "q1.414", VT, Tets, BF);
+				V, F, "q1.414", c.VT, c.Tets, c.BF);
 		assert( F.maxCoeff() < V.rows());
 		if (status != 0)
 		{
 			cout << "^%s: tetgen failed again.\n" << endl;
-			return;
+			return false;
 		}
 	}
-	if (1)
-		igl::writeMESH("./Keg.mesh", VT, Tets, F);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Solve the weights of every handle, one active set per thread.
+/// 'W' is the initial guess if it has the right size.
+static bool solve_bbw(Bbw_cache& c, Eigen::MatrixXd& W)
+{
+	const int n = (int)c.VT.rows();
+	const int m = (int)c.bc.cols();
+
+	if (c.Q.rows() != n)
+	{
+		// Same energy as igl::bbw()
+		SparseMatrix<double> L, M, Mi;
+		igl::cotmatrix(c.VT, c.Tets, L);
+		igl::massmatrix(c.VT, c.Tets, igl::MASSMATRIX_TYPE_DEFAULT, M);
+		igl::invert_diag(M, Mi);
+		c.Q = L.transpose() * Mi * L;
+	}
 
+	const bool warm = W.rows() == n && W.cols() == m;
+	if (!warm)
+		W = Eigen::MatrixXd::Zero(n, m);
+	cout << "BBW solve of " << m << " handles" << (warm ? " (warm start)" : "") << endl;
+
+	igl::active_set_params params;
+	params.max_iter = 10;
+	params.Auu_pd = true;
+
+	bool error = false;
+	#pragma omp parallel for schedule(dynamic, 1) reduction(||:error)
+	for (int i = 0; i < m; ++i)
+	{
+		// No linear terms, no linear constraints, box constraints [0 1]
+		const VectorXd B = VectorXd::Zero(n);
+		const SparseMatrix<double> Aeq(0, n), Aieq(0, n);
+		const VectorXd Beq(0), Bieq(0);
+		const VectorXd lx = VectorXd::Zero(n);
+		const VectorXd ux = VectorXd::Ones(n);
+		const VectorXd bci = c.bc.col(i);
+		VectorXd Wi = W.col(i);
+		igl::SolverStatus ret = igl::active_set(c.Q, B, c.b, bci, Aeq, Beq, Aieq, Bieq, lx, ux, params, Wi);
+		switch (ret)
+		{
+		case igl::SOLVER_STATUS_CONVERGED:
+			break;
+		case igl::SOLVER_STATUS_MAX_ITER:
+			#pragma omp critical
+			cerr << "active_set: max iter without convergence (handle " << i << ")" << endl;
+			break;
+		default:
+			#pragma omp critical
+			cerr << "active_set error (handle " << i << ")" << endl;
+			error = true;
+		}
+		W.col(i) = Wi;
+	}
+	return !error;
+}
+
+// -----------------------------------------------------------------------------
+
+void clearWeightCache()
+{
+	s_bbw_cache = Bbw_cache();
+}
+
+void computeWeights(Sample* sample, std::vector<Handle*>& _handles, std::vector<std::vector<float>>& _wieghts)
+{
+	using namespace std;
+	// #V by 3 Matrix of mesh vertex 3D positions
+	Eigen::MatrixXd V;
+
+	// #F by 3 Matrix of face (triangle) indices
+	Eigen::MatrixXi F;
+	
+	{
+		V.resize(sample->num_vertices(),3);
+		VertexStore::Matrix3XMap vertex_matrix = sample->vertices_matrix();
+		for (int i = 0; i < sample->num_vertices(); ++i)
+		{
+			V(i,0) = vertex_matrix(0, i);
+			V(i,1) = vertex_matrix(1, i);
+			V(i,2) = vertex_matrix(2, i);
+		}
+		F.resize(sample->num_triangles(), 3);
+		for (int i = 0; i < sample->num_triangles(); ++i)
+		{
+			TriangleType& tt =sample->getTriangle(i);
+			F(i,0) =  tt.get_i_vertex(0);
+			F(i,1) =  tt.get_i_vertex(1);
+			F(i,2) =  tt.get_i_vertex(2);
+		}
+	}
 
 	Eigen::MatrixXd C; //Node positon
 	Eigen::VectorXi P;  //Point handle
@@ -390,52 +697,94 @@ void computeWeights(Sample* sample, std::vector<Handle*>& _handles, std::vector<
 		P(i) = _handles[i]->handle_idx_;
 	}
 
-	// Get boundary conditions
-	VectorXi b; //boundary
-	MatrixXd bc; //boundary condiction
-	igl::boundary_conditions(VT, Tets, C, P, BE, CE, b, bc);
-//	boundary_conditionsWrapper(V, Tets, vector<Handle*>(), b, bc);
-
-	//now caculate weight
-	igl::BBWData bbw_data;
-	bbw_data.active_set_params.max_iter = 10;
-	bbw_data.verbosity = 2;
-	success = igl::bbw(
-		VT,
-		Tets,
-		b,
-		bc,
-		bbw_data,
-		OW
-	);
+	verbose("Computing BBW weights\n");
+	Bbw_cache& cache = s_bbw_cache;
+	const unsigned long long mesh_key = hash_mesh(V, F);
+	const unsigned long long handle_key = hash_handles(C, P, mesh_key);
 
-	if (!success)
+	// Tet mesh: memory, disk, then tetgen
+	if (cache.mesh_key != mesh_key)
 	{
-		return;
+		cache = Bbw_cache();
+		const bool from_disk = read_tet_cache(mesh_key, cache);
+		if (!from_disk && !tetrahedralize_surface(V, F, cache))
+			return;
+		cache.mesh_key = mesh_key;
+		cache.nb_surface = (int)V.rows();
+		if (!from_disk)
+			write_tet_cache(cache);
+
+		// Previous weights of this mesh from the disk cache (surface rows only)
+		std::vector<std::vector<float>> weights;
+		unsigned long long file_key = 0;
+		Eigen::MatrixXd file_C;
+		if (read_weight_file(cache_path(mesh_key, "weight"), weights, &file_key, &file_C) &&
+			(int)weights.size() == cache.nb_surface && weights.size() > 0)
+		{
+			cache.W.resize(weights.size(), weights[0].size());
+			for (int i = 0; i < cache.W.rows(); ++i)
+				for (int j = 0; j < cache.W.cols(); ++j)
+					cache.W(i, j) = weights[i][j];
+			cache.handle_key = file_key;
+			cache.C = file_C;
+		}
 	}
 
-	for (size_t i = 0; i < OW.rows(); i++)
+	if (cache.handle_key != handle_key || cache.W.rows() < cache.nb_surface)
 	{
-		for (size_t j = 0; j < OW.cols(); j++)
+		// Warm start only when the same handles moved a little
+		const double diag = (V.colwise().maxCoeff() - V.colwise().minCoeff()).norm();
+		bool warm = cache.W.rows() >= cache.nb_surface &&
+			cache.C.rows() == C.rows() && cache.W.cols() == C.rows() &&
+			(cache.P.size() == 0 || cache.P == P);
+		if (warm && C.rows() > 0)
+			warm = (cache.C - C).rowwise().norm().maxCoeff() <= s_warm_start_ratio * diag;
+
+		// Get boundary conditions
+		if (!igl::boundary_conditions(cache.VT, cache.Tets, C, P, BE, CE, cache.b, cache.bc))
+			return;
+
+		Eigen::MatrixXd OW;
+		if (warm)
 		{
-			if (OW(i, j) < 0.0)
-				OW(i, j) = 0.0;
+			// Weights read from the disk have no Steiner points rows
+			const int nb_steiner = (int)cache.VT.rows() - (int)cache.W.rows();
+			OW = cache.W;
+			if (nb_steiner > 0)
+			{
+				OW.conservativeResize(cache.VT.rows(), Eigen::NoChange);
+				OW.bottomRows(nb_steiner).setZero();
+			}
 		}
+		if (!solve_bbw(cache, OW))
+			return;
+
+		for (int i = 0; i < OW.rows(); i++)
+		{
+			for (int j = 0; j < OW.cols(); j++)
+			{
+				if (OW(i, j) < 0.0)
+					OW(i, j) = 0.0;
+			}
+		}
+		// Normalize weights to sum to one
+		OW = (OW.array().colwise() /
+			OW.rowwise().sum().array()).eval();
+
+		cache.W = OW;
+		cache.C = C;
+		cache.P = P;
+		cache.handle_key = handle_key;
+
+		surface_weights(OW, cache.nb_surface, _wieghts);
+		if (make_cache_dir() && write_weight_file(cache_path(mesh_key, "weight"), _wieghts, handle_key, C))
+			prune_cache_dir();
 	}
-	// Normalize weights to sum to one
-	OW = (OW.array().colwise() /
-		OW.rowwise().sum().array()).eval();
-	EW.resize(OW.rows(), 0);
-	_wieghts.clear();
-	_wieghts.resize(OW.rows());
-	for (size_t i = 0; i < OW.rows(); i++)
+	else
 	{
-		for (size_t j = 0; j < OW.cols(); j++)
-		{
-			_wieghts[i].push_back( OW(i, j)) ;
-		}		
+		cout << "BBW weights from the cache" << endl;
+		surface_weights(cache.W, cache.nb_surface, _wieghts);
 	}
-	writeWeightToFile(string("./keg.weight"), _wieghts);
 	verbose("Computing BBW weights done\n");
 }
 
@@ -545,10 +894,14 @@ void computeWeights(Sample* sample, std::vector<Handle*>& _handles,
 	 int _numIndices)
 {
 	std::vector<std::vector<float>> weights;
-	if (0)
-		computeWeights(sample, _handles, weights);
-	else
-		getWeightFromFile(string("./keg.weight"), weights);
+	computeWeights(sample, _handles, weights);
+	if (weights.empty())
+	{
+		cerr << "ERROR: BBW weights computation failed" << endl;
+		_wieghts.clear();
+		_wieghts_idx.clear();
+		return;
+	}
 	//
 	_wieghts.resize(weights.size() * _numIndices);
 	_wieghts_idx.resize(weights.size() * _numIndices);
@@ -614,3 +967,13 @@ void getWeightFromFile(std::string& path, std::vector<std::vector<float>>& _weig
 	reader.close();
 
 }
+
+bool writeWeightToBinaryFile(const std::string& path, const std::vector<std::vector<float>>& _weights)
+{
+	return write_weight_file(path, _weights, 0, Eigen::MatrixXd());
+}
+
+bool getWeightFromBinaryFile(const std::string& path, std::vector<std::vector<float>>& _weights)
+{
+	return read_weight_file(path, _weights, 0, 0);
+}
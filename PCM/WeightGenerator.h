@@ -10,4 +10,8 @@ void computeWeights(Sample* sample, std::vector<Handle*>& _handles,
 void computeWeights(Sample* sample, std::vector<Handle*>& _handles, std::vector<std::vector<float>>& _wieghts);
 void writeWeightToFile(std::string& path, std::vector<std::vector<float>>& _weights);
 void getWeightFromFile(std::string& path, std::vector<std::vector<float>>& _weights);
-
+// Binary weights file (the computeWeights() cache format), read back through a memory mapping
+bool writeWeightToBinaryFile(const std::string& path, const std::vector<std::vector<float>>& _weights);
+bool getWeightFromBinaryFile(const std::string& path, std::vector<std::vector<float>>& _weights);
+// Drop the tet mesh and weights kept in memory by computeWeights()
+void clearWeightCache();
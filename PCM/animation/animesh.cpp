@@ -7,7 +7,7 @@
 //#include "animesh_kers.hpp"
 #include "../global_datas/macros.hpp"
 //#include "distance_field.hpp"
-//#include "auto_rig.hpp"
+#include "pinocchio/auto_rig.hpp"
 #include "../control/color_ctrl.hpp"
 #include "../animation/skeleton.hpp"
 #include "../meshes/mesh_utils.hpp"
@@ -42,6 +42,7 @@ Animesh::Animesh(Mesh* m_, Skeleton* s_) :
     _mesh(m_), _skel(s_),
     _do_bone_deform(s_->nb_joints(), true),
     mesh_color(EAnimesh::BASE_POTENTIAL),
+    skinning_backend(EAnimesh::SKIN_SIMD),
     do_implicit_skinning(false),
     do_smooth_mesh(false),
     do_local_smoothing(true),
@@ -1214,9 +1215,6 @@ void Animesh::heat_diffuse_ssd_weights(float heat)
     std::vector< Vec3             > vertices(nv);
     // edges[nb_vertex][nb_vertex_connected_to_it]
     std::vector< std::vector<int>    > edges(nv);
-    std::vector< std::vector<double> > boneDists(nv);
-    std::vector< std::vector<bool>   > boneVis(nv);
-    std::vector<std::vector<std::pair<int, double> > > nzweights(nv);
 
     // Fill edges and vertices
     for(int i = 0; i<nv; ++i)
@@ -1229,119 +1227,37 @@ void Animesh::heat_diffuse_ssd_weights(float heat)
             edges[i].push_back(_mesh->get_1st_ring(j));
     }
 
-    // Compute bone visibility and distance from a vertex to each bone
-    for(int i = 0; i < nv; ++i)
+    std::vector<int> tris(_mesh->get_nb_tris() * 3);
+    for(int t = 0; t < _mesh->get_nb_tris(); ++t)
     {
-        boneDists[i].resize(nb_bones, -1);
-        boneVis[i].resize(nb_bones, true);
-        Point3 cPos( vertices[i] );
-
-        // Compute the normal of each adjacent face
-        std::vector<Vec3> normals;
-        for(int j = 0; j < (int)edges[i].size(); ++j)
-        {
-            int nj = (j + 1) % edges[i].size();
-            Vec3 v1 = vertices[edges[i][j] ] - cPos;
-            Vec3 v2 = vertices[edges[i][nj]] - cPos;
-            Vec3 n  = (v1.cross(v2)).normalized();
-            normals.push_back( n );
-        }
-
-#if 1
-        // Compute the nearest bone euclidean distance to the current vertex
-
-        const double inf = std::numeric_limits<double>::infinity();;
-        double minDist   = inf;
-        for(int j = 0; j < nb_bones; ++j)
-        {
-            if( _skel->is_leaf(j) || !_do_bone_deform[j] )
-            {
-                boneDists[i][j] = inf;
-                continue;
-            }
-
-            Bone_cu bone = _skel->get_bone_rest_pose(j);
-
-            Point3 p1 = bone.org();
-            Point3 p2 = bone.org() + bone.dir();
-            boneDists[i][j] = sqrt(distsqToSeg(cPos, p1, p2));
-            minDist = min(boneDists[i][j], minDist);
-        }
-#endif
-
-        for(int j = 0; j < nb_bones; ++j)
-        {
-            //the reason we don't just pick the closest bone is so that if two are
-            //equally close, both are factored in.
-            if(boneDists[i][j] > minDist * 1.0001)
-                continue;
-
-            //Bone_cu bone = _skel->get_bone_rest_pose( j );
-
-            //Point3 pos  = cPos;
-            //Point3 p1   = bone.org();
-            //Point3 p2   = bone.org() + bone.dir();
-            //Point3 proj = projToSeg(pos, p1, p2);
-
-            if( _skel->is_leaf(j) )
-                boneVis[i][j] = false;
-            else
-                // TODO: implement visibility test
-                boneVis[i][j] = /*tester->canSee(cPos, p)*/true /*&& vectorInCone(-(pos - proj), normals)*/;
-        }
+        EMesh::Tri_face f = _mesh->get_tri(t);
+        tris[t*3    ] = f.a;
+        tris[t*3 + 1] = f.b;
+        tris[t*3 + 2] = f.c;
     }
 
-#if 0
-    // Fill boneDists with voxel distance
+    // Bones in rest pose, leaves and bones that don't deform can't be
+    // candidates
+    std::vector<Vec3> bone_org(nb_bones), bone_end(nb_bones);
+    std::vector<bool> deform(nb_bones);
     for(int j = 0; j < nb_bones; ++j)
     {
-        std::vector<Vox::Segment> bones;
-        Bone_cu bone = _skel->get_bone_rest_pose(j+1);
-
-        Point3 org = bone.org();
-        Point3 end = bone.org() + bone->dir();
-        bones.push_back( Vox::Segment(Vox::V3d(org.x, org.y, org.z),
-                                      Vox::V3d(end.x, end.y, end.z) )
-                        );
-
-        Grid grid_closest = Vox::Geo_dist::closest_bone(*_voxels, bones);
-
-        for(int i = 0; i < nv; ++i)
-        {
-            Vec3    v     = _mesh->get_vertex(i);
-            Vox::V3d  x     = Vox::V3d(v.x, v.y, v.z);
-            Vox::V3d  x_vox = grid_closest.convert_real_to_voxel_index( x );
-            Vox::Idx3 u_vox = x_vox.to_index_3();
-            Vox::Geo_dist::Cell c = grid_closest.get( u_vox );
-            boneDists[i][j] = c._dist;
-        }
+        Bone_cu bone = _skel->get_bone_rest_pose(j);
+        bone_org[j] = bone.org().to_vec3();
+        bone_end[j] = (bone.org() + bone.dir()).to_vec3();
+        deform  [j] = !_skel->is_leaf(j) && _do_bone_deform[j];
     }
-#endif
-
-    // Compute weights
-//    rig(vertices, edges, boneDists, boneVis, nzweights, heat);
 
-    // convert nzweights to our array representation
-    std::vector<float> h_weights; h_weights.reserve(2 * nv);
-    std::vector<int>   h_joints; h_joints.reserve( 2 * nv);
-    std::vector<int>   h_jpv(2u*nv);
+    // Nearest bones of each vertex visible from it
+    Bone_candidates cand;
+    bone_candidates(vertices, tris, bone_org, bone_end, deform, cand);
 
-    int acc = 0;
-    for(int i=0; i<nv; ++i)
-    {
-        int size = nzweights[i].size();
-        for(int j=0; j<size; j++)
-        {
-            int   joint_id = nzweights[i][j].first;
-            float weight   = (float)nzweights[i][j].second;
-
-            h_joints. push_back( joint_id );
-            h_weights.push_back( weight   );
-        }
-        h_jpv[i*2    ] = acc;  // starting index
-        h_jpv[i*2 + 1] = size; // number of bones influencing the vertex
-        acc += size;
-    }
+    // Compute weights
+    std::vector<float> h_weights;
+    std::vector<int>   h_joints;
+    std::vector<int>   h_jpv;
+    rig(vertices, edges, cand, h_jpv, h_joints, h_weights, heat);
+    const int acc = (int)h_joints.size();
 
     d_jpv = h_jpv;
     d_weights.resize(acc);
@@ -1349,6 +1265,7 @@ void Animesh::heat_diffuse_ssd_weights(float heat)
     d_joints.resize(acc);
     d_joints =h_joints;
 
+    update_packed_ssd_weights();
     update_host_ssd_weights();
 
 //    std::cout << "COMPUTE NEW CLUSTER FROM WEIGHTS" << std::endl;
@@ -1387,6 +1304,8 @@ void Animesh::init_rigid_ssd_weights()
     d_weights= weights;
     d_joints.resize(nb_vert);
     d_joints =joints;
+
+    update_packed_ssd_weights();
 }
 
 // -----------------------------------------------------------------------------
@@ -1718,6 +1637,8 @@ void Animesh::set_ssd_weight(int id_vertex, int id_joint, float weight)
             d_weights[i]= w+delta;
         }
     }
+
+    hd_ssd_weights.update_vertex(id_vertex, d_joints, d_weights, d_jpv);
 }
 
 // -----------------------------------------------------------------------------
@@ -1821,6 +1742,8 @@ void Animesh::set_ssd_weights(const std::vector<std::map<int, float> >& in_weigh
     d_joints= joints;
     d_jpv = jpv;
 
+    update_packed_ssd_weights();
+
 //    std::cout << "COMPUTE NEW CLUSTER FROM WEIGHTS" << std::endl;
 //    clusterize( EAnimesh::FROM_WEIGHTS );/////////////////////DEBUG//////////////
 }
@@ -1834,24 +1757,25 @@ void Animesh::update_device_ssd_weights()
 
 // -----------------------------------------------------------------------------
 
+void Animesh::update_packed_ssd_weights()
+{
+    hd_ssd_weights.set(d_joints, d_weights, d_jpv);
+}
+
+// -----------------------------------------------------------------------------
+
 void Animesh::compute_potential(const Vec3* vert_pos,
                                 const int nb_vert,
                                 float* d_base_potential,
                                 Vec3* d_base_grad)
 {
-    //const int nb_verts = nb_vert;
-    //const int block_size = 256;
-    //const int grid_size =
-    //        (nb_verts + block_size - 1) / block_size;
-
-    //Animesh_kers::compute_potential<<<grid_size, block_size>>>
-    //    (_skel->skel_id(),
-    //     (Point3*)vert_pos,
-    //     nb_vert,
-    //     d_base_potential,
-    //     d_base_grad);
-
-    //CUDA_CHECK_ERRORS();
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < nb_vert; ++i)
+    {
+        Vec3 gf;
+        d_base_potential[i] = h_skel_potential.fngf(vert_pos[i], gf);
+        if( d_base_grad != 0 ) d_base_grad[i] = gf;
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -1988,6 +1912,7 @@ void Animesh::read_weights_from_file(const char* filename,
     d_joints.resize(k);
     d_joints=h_joints;
 
+    update_packed_ssd_weights();
     update_host_ssd_weights();
 
     cout << "file \"" << filename << "\" loaded successfully" << endl;
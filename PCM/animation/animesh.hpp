@@ -4,6 +4,8 @@
 // -----------------------------------------------------------------------------
 
 #include "animesh_enum.hpp"
+#include "animesh_weights.hpp"
+#include "skeleton_potential.hpp"
 #include "toolbox/maths/selection_heuristic.hpp"
 #include "toolbox/maths/mat2.hpp"
 #include "../meshes/gl_mesh.hpp"
@@ -150,6 +152,22 @@ public:
     /// that value of the potential.
     void update_base_potential();
 
+    /// Bake the potential of each bone in a grid following it (see
+    /// Skeleton_potential::bake()) then update the base potential with it.
+    /// @param res number of cells across the support of a bone
+    void bake_potential(int res = 32, Bone_grid::Interpolation interp = Bone_grid::TRILINEAR);
+
+    /// Back to the analytic potential
+    void clear_baked_potential();
+
+    /// @return false if the file can't be written
+    bool save_baked_potential(const std::string& path) const;
+
+    /// Load grids saved with save_baked_potential() and update the base
+    /// potential. Grids baked for another rest pose are ignored.
+    /// @return false if the file can't be read
+    bool load_baked_potential(const std::string& path);
+
     /// Transform the vertices of the mesh given the rotation at each bone.
     /// Transformation is computed from the initial position of the mesh
     /// @param type specify the technic used to compute vertices deformations
@@ -306,6 +324,9 @@ public:
 
     void update_device_ssd_weights();
 
+    /// Packed copy of the ssd weights read by the skinning kernels
+    const Ssd_weights& get_packed_ssd_weights() const { return hd_ssd_weights; }
+
     // -------------------------------------------------------------------------
     /// @name Getter & Setters
     // -------------------------------------------------------------------------
@@ -367,6 +388,21 @@ public:
     inline void set_implicit_skinning  ( bool s) { do_implicit_skinning = s;                     }
     inline void switch_implicit_skinning(      ) { do_implicit_skinning = !do_implicit_skinning; }
 
+    /// Choose the CPU path of the SSD/dual quaternion/rigid deformation.
+    /// EAnimesh::SKIN_SCALAR is the reference the other backends must match
+    void set_skinning_backend(EAnimesh::Skinning_backend b) { skinning_backend = b; }
+    EAnimesh::Skinning_backend get_skinning_backend() const { return skinning_backend; }
+
+    /// Deform the mesh 'nb_runs' times with each backend then print the
+    /// ms/frame and the largest deviation from EAnimesh::SKIN_SCALAR
+    /// @return the largest deviation of the vertices over every backend
+    float benchmark_skinning(EAnimesh::Blending_type type, int nb_runs = 50);
+
+    /// Deform the mesh 'nb_runs' times with implicit skinning then print the
+    /// ms/frame of the projection and of the smoothing, and how many vertices
+    /// ended in each EAnimesh::Vert_state
+    void benchmark_fitting(EAnimesh::Blending_type type, int nb_runs = 50);
+
     inline const std::vector<Tbx::Vec3>& get_ssd_normals() const {
         return d_ssd_normals;
     }
@@ -447,11 +483,13 @@ private:
     /// their closest bone
     void set_default_bones_radius();
 
-    /// make the mesh smooth with the smoothing technique specified by
-    /// mesh_smoothing
-    void smooth_mesh(Tbx::Vec3* output_vertices,
-                     Tbx::Vec3* verts_buffer,
-                     float* factors,
+    /// Laplacian smoothing of 'output_vertices' over their first ring
+    /// @param verts_buffer scratch of the size of 'output_vertices'
+    /// @param local_smoothing use the per vertex 'factors' instead of
+    /// 'smooth_force_a'
+    void smooth_mesh(std::vector<Tbx::Vec3>& output_vertices,
+                     std::vector<Tbx::Vec3>& verts_buffer,
+                     const float* factors,
                      int nb_iter,
                      bool local_smoothing = true);
 
@@ -483,22 +521,35 @@ private:
     void compute_blended_dual_quat_rots();
 
     /// Interpolates between out_verts and ssd_position (in place)
-    void ssd_lerp(Tbx::Vec3* out_verts);
-
-    void fit_mesh(int nb_vert_to_fit,
-                  int* d_vert_to_fit,
-                  bool full_eval,
-                  bool smooth_fac_from_iso,
-                  Tbx::Vec3 *d_vertices,
-                  int nb_steps, float smooth_strength);
-
-    void fit_mesh_std(int nb_vert_to_fit,
-                      int* d_vert_to_fit,
-                      bool full_eval,
-                      bool smooth_fac_from_iso,
-                      Tbx::Vec3* d_vertices,
-                      int nb_steps,
-                      float smooth_strength);
+    void ssd_lerp(std::vector<Tbx::Vec3>& out_verts);
+
+    /// Project the vertices of 'd_vert_to_fit' on their base potential.
+    /// Vertices which stopped are set to -1 in 'd_vert_to_fit' unless
+    /// 'full_eval' is set. Their penetration into other limbs is limited to
+    /// Cuda_ctrl::_debug._collision_depth when it is positive.
+    /// @param nb_steps maximum number of steps of each vertex march
+    /// @return number of vertices left to fit
+    int fit_mesh(int nb_vert_to_fit,
+                 int* d_vert_to_fit,
+                 bool full_eval,
+                 bool smooth_fac_from_iso,
+                 std::vector<Tbx::Vec3>& d_vertices,
+                 int nb_steps, float smooth_strength);
+
+    /// Same as fit_mesh() but a vertex meeting another limb always takes its
+    /// full last step (original algorithm)
+    int fit_mesh_std(int nb_vert_to_fit,
+                     int* d_vert_to_fit,
+                     bool full_eval,
+                     bool smooth_fac_from_iso,
+                     std::vector<Tbx::Vec3>& d_vertices,
+                     int nb_steps,
+                     float smooth_strength);
+
+    /// Implicit skinning of 'out_verts' (deformed by geometric_deformation()):
+    /// interleaved projection and smoothing passes, a last projection of every
+    /// vertex, the final smoothing and the blend with SSD
+    void fit_to_base_potential(std::vector<Tbx::Vec3>& out_verts);
 
     /// diffuse values over the mesh on GPU
     void diffuse_attr(int nb_iter, float strength, float* attr);
@@ -574,6 +625,9 @@ private:
 
     void init_cotan_weights();
 
+    /// Rebuild 'hd_ssd_weights' from d_joints, d_weights and d_jpv
+    void update_packed_ssd_weights();
+
     /// @return true if mesh color enum belongs to the subset of colors that
     /// needs to be updated dynamically
     bool is_dynamic_color( EAnimesh::Color_type mesh_col );
@@ -595,6 +649,7 @@ public:
 
     EAnimesh::Color_type  mesh_color;
 //    EAnimesh::Smooth_type mesh_smoothing;
+    EAnimesh::Skinning_backend skinning_backend;
 
     bool do_implicit_skinning;
     bool do_smooth_mesh;
@@ -683,6 +738,10 @@ public:
     /// Base gradient associated to the ith vertex (i.e in rest pose of skel)
     std::vector<Tbx::Vec3> d_base_gradient;
 
+    /// Implicit surface of the skeleton evaluated on the host, its bones are
+    /// the animated ones except while computing the base potential
+    Skeleton_potential h_skel_potential;
+
     /// Buffer used to compute normals on GPU. this array holds normals for each
     /// face. d_unpacked_normals[vert_id*nb_max_face_per_vert + ith_face_of_vert]
     /// == normal_at_vert_id_for_its_ith_face
@@ -839,6 +898,11 @@ public:
     /// h_weights[ith_vert] = pair(first:joint, second:weight)
     std::vector<std::map<int, float> > h_weights;
 
+    /// SSD weights packed for the deformation kernels. Mirrors d_joints,
+    /// d_weights and d_jpv, it must be refreshed with
+    /// update_packed_ssd_weights() each time they change.
+    Ssd_weights hd_ssd_weights;
+
     // -------------------------------------------------------------------------
     /// @name CLUSTER
     // -------------------------------------------------------------------------
@@ -67,6 +67,15 @@ enum Blending_type {
 
 // -----------------------------------------------------------------------------
 
+/// CPU code path used by the geometric deformation kernels
+enum Skinning_backend {
+    SKIN_SCALAR = 0, ///< Single threaded reference implementation
+    SKIN_THREADED,   ///< Vertices spread over every core
+    SKIN_SIMD        ///< Multithreaded with SSE blending of the bone transformations
+};
+
+// -----------------------------------------------------------------------------
+
 enum Cluster_type {
     /// Clusterize the mesh computing the euclidean dist to each bone
     EUCLIDEAN,
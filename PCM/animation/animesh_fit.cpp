@@ -0,0 +1,247 @@
+#include "animesh_fit.h"
+#include <algorithm>
+#include <cmath>
+
+// Max number of steps for the vertices fit with the dichotomie
+#define DICHOTOMIE (20)
+
+#define EPSILON 0.0001f
+
+using namespace Tbx;
+
+namespace Animesh_kers
+{
+	/// Transform the distance to the iso-surface into a smoothing factor:
+	/// 1 - (|x| - 1)^s clamped to [0 1]
+	static inline float iso_to_sfactor(float x, int s)
+	{
+		x = std::fabs(x) - 1.f;
+		float res = 1.f;
+		for(int i = 0; i < s; i++) res *= x;
+		return (res > 1.f) ? 1.f : 1.f - res;
+	}
+
+	// -------------------------------------------------------------------------
+
+	/// Bisection of the segment org + dir * [t0 t1] where the potential
+	/// crosses 'iso'
+	static float dichotomic_search(const Skeleton_potential& field,
+		const Vec3& org,
+		const Vec3& dir,
+		float t0, float t1,
+		Vec3& grad,
+		float iso)
+	{
+		float t = t0;
+		float f0 = field.fngf(org + dir * t0, grad);
+		float f1 = field.fngf(org + dir * t1, grad);
+
+		if(f0 > f1){
+			t0 = t1;
+			t1 = t;
+		}
+
+		for(int i = 0 ; i < DICHOTOMIE; ++i)
+		{
+			t = (t0 + t1) * 0.5f;
+			f0 = field.fngf(org + dir * t, grad);
+
+			if(f0 > iso){
+				t1 = t;
+				if((f0-iso) < EPSILON) break;
+			} else {
+				t0 = t;
+				if((iso-f0) < EPSILON) break;
+			}
+		}
+		return t;
+	}
+
+	// -------------------------------------------------------------------------
+
+	int match_base_potential(const Skeleton_potential& field,
+		const Fit_params& params,
+		std::vector<Tbx::Vec3>& out_verts,
+		const std::vector<float>& base_potential,
+		std::vector<Tbx::Vec3>& out_gradient,
+		std::vector<float>& smooth_factors_iso,
+		std::vector<float>& smooth_factors_laplacian,
+		std::vector<EAnimesh::Vert_state>& vert_state,
+		int* vert_to_fit,
+		int nb_vert_to_fit)
+	{
+		const bool full_fit = params.full_fit;
+		const float dl_abs = params.step_length;
+		int nb_left = 0;
+
+		// The number of steps varies a lot from one vertex to another
+		#pragma omp parallel for schedule(dynamic, 64) reduction(+:nb_left)
+		for(int k = 0; k < nb_vert_to_fit; ++k)
+		{
+			const int p = vert_to_fit[k];
+			if(p == -1) continue;
+
+			smooth_factors_laplacian[p] = 0.f;
+			const float ptl = base_potential[p];
+
+			Vec3 v0 = out_verts[p];
+			Vec3 gf0;
+			float f0 = field.fngf(v0, gf0) - ptl;
+
+			if(params.smooth_fac_from_iso)
+				smooth_factors_iso[p] = iso_to_sfactor(f0, params.slope) * params.smooth_strength;
+
+			out_gradient[p] = gf0;
+			// STOP CASE : Gradient is null we can't know where to march
+			if(gf0.norm() <= 0.00001f){
+				if(!full_fit) vert_to_fit[k] = -1;
+				vert_state[p] = EAnimesh::NORM_GRAD_NULL;
+				continue;
+			}
+
+			// STOP CASE : Point already near enough the isosurface
+			if( std::fabs(f0) < EPSILON ){
+				if(!full_fit) vert_to_fit[k] = -1;
+				vert_state[p] = EAnimesh::NOT_DISPLACED;
+				continue;
+			}
+
+			vert_state[p] = EAnimesh::NB_ITER_MAX;
+			bool stopped = false;
+
+			// Inside we march along the inverted gradient
+			// outside along the gradient :
+			const float dl = (f0 > 0.f) ? -dl_abs : dl_abs;
+
+			Vec3  org    = v0;
+			Vec3  dir    = Vec3(0.f, 0.f, 0.f);
+			float t      = 0.f;
+			Vec3  gfi    = gf0;
+			float abs_f0 = std::fabs(f0);
+
+			for(int i = 0; i < params.nb_iter; ++i)
+			{
+				org = v0;
+				if( params.raphson ){
+					dir = gf0;
+					t   = dl * abs_f0 / gf0.norm_squared();
+				} else {
+					dir = gf0.normalized();
+					t   = dl;
+				}
+
+				const Vec3 vi = org + dir * t;
+				const float fi = field.fngf(vi, gfi) - ptl;
+
+				// STOP CASE 1 : Initial iso-surface reached
+				abs_f0 = std::fabs(fi);
+				if( (params.raphson && abs_f0 < EPSILON) || fi * f0 <= 0.f )
+				{
+					if( fi * f0 <= 0.f )
+						t = dichotomic_search(field, org, dir, 0.f, t, gfi, ptl);
+					stopped = true;
+					vert_state[p] = EAnimesh::FITTED;
+					break;
+				}
+
+				// STOP CASE 2 : Gradient divergence
+				if( (gf0.normalized()).dot(gfi.normalized()) < params.gradient_threshold )
+				{
+					if( params.collision_depth >= 0.f )
+						t = t < 0.f ? std::max(t, -params.collision_depth) :
+						              std::min(t,  params.collision_depth);
+					stopped = true;
+					smooth_factors_laplacian[p] = params.smooth_strength;
+					vert_state[p] = EAnimesh::GRADIENT_DIVERGENCE;
+					break;
+				}
+
+				// STOP CASE 3 : Potential pit
+				if( (fi - f0)*dl < 0.f && params.potential_pit )
+				{
+					stopped = true;
+					smooth_factors_laplacian[p] = params.smooth_strength;
+					vert_state[p] = EAnimesh::POTENTIAL_PIT;
+					break;
+				}
+
+				v0  = vi;
+				f0  = fi;
+				gf0 = gfi;
+
+				if(gf0.norm_squared() < (0.001f*0.001f)) break;
+			}
+
+			out_gradient[p] = gfi;
+			out_verts[p] = org + dir * t;
+
+			if(stopped && !full_fit) vert_to_fit[k] = -1;
+			else                     nb_left++;
+		}
+		return nb_left;
+	}
+
+	// -------------------------------------------------------------------------
+
+	int pack_vert_to_fit(int* vert_to_fit, int nb_vert_to_fit)
+	{
+		int j = 0;
+		for(int i = 0; i < nb_vert_to_fit; ++i)
+			if(vert_to_fit[i] >= 0)
+				vert_to_fit[j++] = vert_to_fit[i];
+		return j;
+	}
+
+	// -------------------------------------------------------------------------
+
+	void laplacian_smooth(std::vector<Tbx::Vec3>& verts,
+		std::vector<Tbx::Vec3>& buffer,
+		const std::vector<int>& ring,
+		const std::vector<int>& ring_offsets,
+		const std::vector<float>& ring_weights,
+		const float* factors,
+		float strength,
+		int nb_iter)
+	{
+		const int n = std::min((int)verts.size(), (int)ring_offsets.size() / 2);
+		if(nb_iter <= 0 || n == 0) return;
+		buffer.resize( verts.size() );
+		const bool use_weights = ring_weights.size() == ring.size();
+
+		std::vector<Tbx::Vec3>* src = &verts;
+		std::vector<Tbx::Vec3>* dst = &buffer;
+		for(int it = 0; it < nb_iter; ++it)
+		{
+			const Vec3* in  = &(*src)[0];
+			Vec3*       out = &(*dst)[0];
+			#pragma omp parallel for schedule(static)
+			for(int i = 0; i < n; ++i)
+			{
+				const float factor = factors != 0 ? factors[i] : strength;
+				const int offset = ring_offsets[2*i  ];
+				const int nb_ngb = ring_offsets[2*i+1];
+				if(factor == 0.f || nb_ngb == 0){
+					out[i] = in[i];
+					continue;
+				}
+
+				Vec3  centroid(0.f, 0.f, 0.f);
+				float sum = 0.f;
+				for(int r = offset; r < offset + nb_ngb; ++r)
+				{
+					const float w = use_weights ? ring_weights[r] : 1.f;
+					centroid += in[ ring[r] ] * w;
+					sum += w;
+				}
+				out[i] = std::fabs(sum) > 1e-6f ? centroid * (1.f/sum) * factor + in[i] * (1.f-factor) : in[i];
+			}
+			// Vertices without a ring entry keep their position
+			for(int i = n; i < (int)verts.size(); ++i)
+				out[i] = in[i];
+			std::swap(src, dst);
+		}
+
+		if(src != &verts)
+			verts.swap(buffer);
+	}
+}
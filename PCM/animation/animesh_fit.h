@@ -0,0 +1,83 @@
+#ifndef _ANIMESH_FIT_
+#define _ANIMESH_FIT_
+
+#include "toolbox/maths/vec3.hpp"
+#include "animesh_enum.hpp"
+#include "skeleton_potential.hpp"
+#include <vector>
+
+/// CPU kernels of the implicit skinning projection.
+/// Vertices are independent during a march so they are spread over every
+/// core (OpenMP); the smoothing is double buffered for the same reason.
+namespace Animesh_kers
+{
+	/// Settings of match_base_potential(), mostly read from Cuda_ctrl::_debug
+	struct Fit_params
+	{
+		Fit_params() :
+			full_fit(false),
+			smooth_fac_from_iso(false),
+			nb_iter(1),
+			gradient_threshold(0.9f),
+			step_length(0.05f),
+			potential_pit(true),
+			smooth_strength(0.5f),
+			collision_depth(-1.f),
+			slope(2),
+			raphson(false)
+		{ }
+
+		bool  full_fit;            ///< last pass: keep every vertex in the list
+		bool  smooth_fac_from_iso; ///< update the conservative smoothing factors
+		int   nb_iter;             ///< maximum number of steps of the march
+		float gradient_threshold;  ///< contact when dot(grad0, grad) drops below
+		float step_length;
+		bool  potential_pit;       ///< stop when the potential moves away from the base one
+		float smooth_strength;
+		float collision_depth;     ///< depth allowed into a contact, < 0 for a full step
+		int   slope;               ///< slope of the conservative smoothing factor
+		bool  raphson;             ///< newton steps instead of fixed length ones
+	};
+
+	/// Move the vertices listed in 'vert_to_fit' along the gradient of 'field'
+	/// until they match their base potential. A vertex stops when it reaches
+	/// its iso-surface, meets another limb (gradient divergence), falls in a
+	/// potential pit or has no gradient; its index is then replaced by -1
+	/// in 'vert_to_fit' unless 'params.full_fit' is set.
+	/// @param vert_state stop case of each vertex @see EAnimesh::Vert_state
+	/// @return number of vertices still to fit
+	int match_base_potential(const Skeleton_potential& field,
+		const Fit_params& params,
+		std::vector<Tbx::Vec3>& out_verts,
+		const std::vector<float>& base_potential,
+		std::vector<Tbx::Vec3>& out_gradient,
+		std::vector<float>& smooth_factors_iso,
+		std::vector<float>& smooth_factors_laplacian,
+		std::vector<EAnimesh::Vert_state>& vert_state,
+		int* vert_to_fit,
+		int nb_vert_to_fit);
+
+	/// Move the indices >= 0 of 'vert_to_fit' to its front, keeping their order
+	/// @return number of indices >= 0
+	int pack_vert_to_fit(int* vert_to_fit, int nb_vert_to_fit);
+
+	/// Laplacian smoothing of 'verts' over their first ring.
+	/// The ring of vertex i is ring[ring_offsets[2*i]] to
+	/// ring[ring_offsets[2*i] + ring_offsets[2*i+1] - 1].
+	/// @param ring_weights weight of each ring entry (i.e. cotan weights),
+	/// uniform weights when its size differs from 'ring'
+	/// @param factors per vertex strength, 'strength' is used if null.
+	/// A vertex whose factor is null is not moved
+	/// @param buffer scratch of the size of 'verts'
+	void laplacian_smooth(std::vector<Tbx::Vec3>& verts,
+		std::vector<Tbx::Vec3>& buffer,
+		const std::vector<int>& ring,
+		const std::vector<int>& ring_offsets,
+		const std::vector<float>& ring_weights,
+		const float* factors,
+		float strength,
+		int nb_iter);
+}
+
+
+#endif
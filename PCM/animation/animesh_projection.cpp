@@ -11,7 +11,10 @@
 #include "toolbox/utils.hpp"
 #include "../animation/skeleton.hpp"
 #include "../animation/animesh_rig.h"
+#include "../animation/animesh_fit.h"
+#include <QTime>
 #include <iostream>
+#include <algorithm>
 using std::cout;
 using std::endl;
 using namespace Tbx;
@@ -33,32 +36,66 @@ bool Animesh::is_dynamic_color( EAnimesh::Color_type mesh_col )
 
 void Animesh::update_base_potential()
 {
+    if(!do_update_potential) return;
 
-	cout<<"update_base_potential"<<endl;
-    //if(!do_update_potential) return;
+    const int nb_verts = d_input_vertices.size();
+    if(nb_verts == 0) return;
+    h_skel_potential.update(*_skel, _do_bone_deform, true);
+    compute_potential(&d_input_vertices[0], nb_verts, &d_base_potential[0], &d_base_gradient[0]);
+    h_skel_potential.update(*_skel, _do_bone_deform, false);
 
-    //Timer time;
-    //time.start();
-    //const int nb_verts = d_input_vertices.size();
-    //const int block_size = 256;
-    //const int grid_size =
-    //        (nb_verts + block_size - 1) / block_size;
+    if(mesh_color == EAnimesh::BASE_POTENTIAL)
+        set_colors(mesh_color);
+}
 
-    //_skel->reset();
+// -----------------------------------------------------------------------------
 
-    //Animesh_kers::compute_base_potential<<<grid_size, block_size>>>
-    //    (_skel->skel_id(), d_input_vertices.ptr(), nb_verts, d_base_potential.ptr(), d_base_gradient.ptr());
+void Animesh::bake_potential(int res, Bone_grid::Interpolation interp)
+{
+    QTime t;
+    t.start();
+    h_skel_potential.set_interpolation( interp );
+    h_skel_potential.bake(*_skel, _do_bone_deform, res);
+    cout << "Baked " << h_skel_potential.nb_grids() << " bone grids in "
+         << t.elapsed() << " ms ("
+         << h_skel_potential.grids_memory_size() / 1024 << " KB)" << endl;
+
+    // The base potential must be evaluated the same way as the fitting
+    h_skel_potential.update(*_skel, _do_bone_deform, false);
+    update_base_potential();
+}
 
-    //compute_mvc();///////
+// -----------------------------------------------------------------------------
 
-    //CUDA_CHECK_ERRORS();
+void Animesh::clear_baked_potential()
+{
+    h_skel_potential.clear_grids();
+    h_skel_potential.update(*_skel, _do_bone_deform, false);
+    update_base_potential();
+}
 
-    //_skel->unreset();
+// -----------------------------------------------------------------------------
 
-    //if(mesh_color == EAnimesh::BASE_POTENTIAL)
-    //    set_colors(mesh_color);
+bool Animesh::save_baked_potential(const std::string& path) const
+{
+    if( !h_skel_potential.save_grids(path) ){
+        cout << "ERROR: can't write the bone grids to " << path << endl;
+        return false;
+    }
+    return true;
+}
 
-    //std::cout << "Update base potential in " << time.stop() << " sec" << std::endl;
+// -----------------------------------------------------------------------------
+
+bool Animesh::load_baked_potential(const std::string& path)
+{
+    if( !h_skel_potential.load_grids(path) ){
+        cout << "ERROR: can't read the bone grids from " << path << endl;
+        return false;
+    }
+    h_skel_potential.update(*_skel, _do_bone_deform, false);
+    update_base_potential();
+    return true;
 }
 
 // -----------------------------------------------------------------------------
@@ -145,138 +182,131 @@ void Animesh::compute_normals(const std::vector<Tbx::Vec3>& vertices, std::vecto
 // -----------------------------------------------------------------------------
 
 
-void Animesh::smooth_mesh(Vec3* output_vertices,
-                          Vec3* verts_buffer,
-                          float* factors,
+void Animesh::smooth_mesh(std::vector<Vec3>& output_vertices,
+                          std::vector<Vec3>& verts_buffer,
+                          const float* factors,
                           int nb_iter,
                           bool local_smoothing)
 {
-		cout<<"Animesh::smooth_mesh"<<endl;
-
-    //if(nb_iter == 0) return;
-    //Animesh_kers::laplacian_smooth(output_vertices,
-    //                               verts_buffer,
-    //                               hd_1st_ring_cotan.d_ptr(),
-    //                               d_1st_ring_list,
-    //                               d_1st_ring_list_offsets,
-    //                               factors,
-    //                               local_smoothing,
-    //                               smooth_force_a,
-    //                               nb_iter,
-    //                               3);
-
+    Animesh_kers::laplacian_smooth(output_vertices,
+                                   verts_buffer,
+                                   d_1st_ring_list,
+                                   d_1st_ring_list_offsets,
+                                   hd_1st_ring_cotan,
+                                   local_smoothing ? factors : 0,
+                                   smooth_force_a,
+                                   nb_iter);
 }
 
 // -----------------------------------------------------------------------------
 
-void Animesh::fit_mesh(int nb_vert_to_fit,
-                       int* d_vert_to_fit,
-                       bool full_eval,
-                       bool smooth_fac_from_iso,
-                       Vec3* d_vertices,
-                       int nb_steps,
-                       float smooth_strength)
+/// Fitting settings from the debug controller
+static Animesh_kers::Fit_params fit_params(bool full_eval,
+                                          bool smooth_fac_from_iso,
+                                          int nb_steps,
+                                          float smooth_strength)
 {
-	cout<<"Animesh::fit_mesh"<<endl;
-    //if(nb_vert_to_fit == 0) return;
+    Animesh_kers::Fit_params params;
+    params.full_fit            = full_eval;
+    params.smooth_fac_from_iso = smooth_fac_from_iso;
+    params.nb_iter             = nb_steps;
+    params.gradient_threshold  = Cuda_ctrl::_debug._collision_threshold;
+    params.step_length         = Cuda_ctrl::_debug._step_length;
+    params.potential_pit       = Cuda_ctrl::_debug._potential_pit;
+    params.smooth_strength     = smooth_strength;
+    params.slope               = Cuda_ctrl::_debug._slope_smooth_weight;
+    params.raphson             = Cuda_ctrl::_debug._raphson;
+    return params;
+}
 
-    //const int nb_vert    = nb_vert_to_fit;
-    //const int block_size = 16;
-    //const int grid_size  = (nb_vert + block_size - 1) / block_size;
+// -----------------------------------------------------------------------------
 
-    //CUDA_CHECK_ERRORS();
-    //CUDA_CHECK_KERNEL_SIZE(block_size, grid_size);
-
-    //Animesh_kers::match_base_potential
-    //    <<<grid_size, block_size >>>    //hd_verts_3drots.update_device_mem();
-    //    (_skel->skel_id(),
-    //     full_eval,
-    //     smooth_fac_from_iso,
-    //     d_vertices,
-    //     d_input_vertices.ptr(),
-    //     _skel->d_transfos(),
-    //     d_base_potential.ptr(),
-    //     d_ssd_normals.ptr(),
-    //     hd_gradient.d_ptr() /*d_ssd_normals.ptr()*/,
-    //     d_nearest_bone_in_device_mem.ptr(),
-    //     d_vertices_nearest_bones.ptr(),
-    //     d_nearest_joint_in_device_mem.ptr(),
-    //     d_smooth_factors_conservative.ptr(),
-    //     d_smooth_factors_laplacian.ptr(),
-    //     d_vert_to_fit,
-    //     nb_vert_to_fit,
-    //     /* (do_tune_direction && !full_eval), */
-    //     (unsigned short)nb_steps,
-    //     Cuda_ctrl::_debug._collision_threshold,
-    //     Cuda_ctrl::_debug._step_length,
-    //     Cuda_ctrl::_debug._potential_pit,
-    //     (int*)d_vertices_state.ptr(),
-    //     smooth_strength,
-    //     Cuda_ctrl::_debug._collision_depth,
-    //     Cuda_ctrl::_debug._slope_smooth_weight,
-    //     Cuda_ctrl::_debug._raphson,
-    //     d_flip_propagation.ptr());
+int Animesh::fit_mesh(int nb_vert_to_fit,
+                      int* d_vert_to_fit,
+                      bool full_eval,
+                      bool smooth_fac_from_iso,
+                      std::vector<Vec3>& d_vertices,
+                      int nb_steps,
+                      float smooth_strength)
+{
+    if(nb_vert_to_fit == 0) return 0;
+
+    Animesh_kers::Fit_params params = fit_params(full_eval, smooth_fac_from_iso, nb_steps, smooth_strength);
+    if(Cuda_ctrl::_debug._collision_depth > 0.f)
+        params.collision_depth = Cuda_ctrl::_debug._collision_depth;
+
+    return Animesh_kers::match_base_potential(h_skel_potential,
+                                              params,
+                                              d_vertices,
+                                              d_base_potential,
+                                              hd_gradient,
+                                              d_smooth_factors_conservative,
+                                              d_smooth_factors_laplacian,
+                                              d_vertices_state,
+                                              d_vert_to_fit,
+                                              nb_vert_to_fit);
+}
 
-    //CUDA_CHECK_ERRORS();
+// -----------------------------------------------------------------------------
 
-    // copy device mem gradient into host mem
-    //hd_gradient.update_host_mem(); ///////////DEBUG will slow down animation
+int Animesh::fit_mesh_std(int nb_vert_to_fit,
+                          int* d_vert_to_fit,
+                          bool full_eval,
+                          bool smooth_fac_from_iso,
+                          std::vector<Vec3>& d_vertices,
+                          int nb_steps,
+                          float smooth_strength)
+{
+    if(nb_vert_to_fit == 0) return 0;
+
+    const Animesh_kers::Fit_params params = fit_params(full_eval, smooth_fac_from_iso, nb_steps, smooth_strength);
+    return Animesh_kers::match_base_potential(h_skel_potential,
+                                              params,
+                                              d_vertices,
+                                              d_base_potential,
+                                              hd_gradient,
+                                              d_smooth_factors_conservative,
+                                              d_smooth_factors_laplacian,
+                                              d_vertices_state,
+                                              d_vert_to_fit,
+                                              nb_vert_to_fit);
 }
 
 // -----------------------------------------------------------------------------
 
-void Animesh::fit_mesh_std(int nb_vert_to_fit,
-                           int* d_vert_to_fit,
-                           bool full_eval,
-                           bool smooth_fac_from_iso,
-                           Vec3* d_vertices,
-                           int nb_steps,
-                           float smooth_strength)
+void Animesh::fit_to_base_potential(std::vector<Vec3>& out_verts)
 {
-		cout<<"Animesh::fit_mesh_std"<<endl;
-    //if(nb_vert_to_fit == 0) return;
+    h_skel_potential.update(*_skel, _do_bone_deform, false);
 
-    //const int nb_vert    = nb_vert_to_fit;
-    //const int block_size = 16;
-    //const int grid_size  = (nb_vert + block_size - 1) / block_size;
+    d_vert_to_fit = d_vert_to_fit_base;
+    int nb_vert_to_fit = d_vert_to_fit.size();
+    if(nb_vert_to_fit == 0) return;
 
-    //CUDA_CHECK_ERRORS();
-    //CUDA_CHECK_KERNEL_SIZE(block_size, grid_size);
-
-    //Animesh_kers::match_base_potential_standard
-    //    <<<grid_size, block_size >>>    //hd_verts_3drots.update_device_mem();
-    //    (_skel->skel_id(),
-    //     full_eval,
-    //     smooth_fac_from_iso,
-    //     d_vertices,
-    //     d_input_vertices.ptr(),
-    //     _skel->d_transfos(),
-    //     d_base_potential.ptr(),
-    //     d_ssd_normals.ptr(),
-    //     hd_gradient.d_ptr() /*d_ssd_normals.ptr()*/,
-    //     d_nearest_bone_in_device_mem.ptr(),
-    //     d_vertices_nearest_bones.ptr(),
-    //     d_nearest_joint_in_device_mem.ptr(),
-    //     d_smooth_factors_conservative.ptr(),
-    //     d_smooth_factors_laplacian.ptr(),
-    //     d_vert_to_fit,
-    //     nb_vert_to_fit,
-    //     /* (do_tune_direction && !full_eval), */
-    //     (unsigned short)nb_steps,
-    //     Cuda_ctrl::_debug._collision_threshold,
-    //     Cuda_ctrl::_debug._step_length,
-    //     Cuda_ctrl::_debug._potential_pit,
-    //     (int*)d_vertices_state.ptr(),
-    //     smooth_strength,
-    //     Cuda_ctrl::_debug._collision_depth,
-    //     Cuda_ctrl::_debug._slope_smooth_weight,
-    //     Cuda_ctrl::_debug._raphson,
-    //     d_flip_propagation.ptr());
+    const int nb_steps = Cuda_ctrl::_debug._nb_step;
+    if(do_interleave_fitting)
+    {
+        // Two steps per vertex between each smoothing so the vertices stopped
+        // by a contact are relaxed along with the ones still marching.
+        // Stopped vertices are packed out of the list.
+        for(int i = 0; i < nb_steps && nb_vert_to_fit > 0; i += 2)
+        {
+            fit_mesh(nb_vert_to_fit, &d_vert_to_fit[0], false, true, out_verts, 2, smooth_force_a);
+            nb_vert_to_fit = Animesh_kers::pack_vert_to_fit(&d_vert_to_fit[0], nb_vert_to_fit);
+            if(do_smooth_mesh)
+                smooth_mesh(out_verts, hd_tmp_vertices, &d_smooth_factors_conservative[0], smoothing_iter, true);
+        }
 
-    //CUDA_CHECK_ERRORS();
+        // The smoothing moved the vertices off their iso-surface
+        if(do_smooth_mesh)
+            fit_mesh(d_vert_to_fit_base.size(), &d_vert_to_fit_base[0], true, false, out_verts, 2, smooth_force_a);
+    }
+    else
+        fit_mesh(nb_vert_to_fit, &d_vert_to_fit[0], false, true, out_verts, nb_steps, smooth_force_a);
+
+    if(do_smooth_mesh)
+        smooth_mesh(out_verts, hd_tmp_vertices, &d_smooth_factors_laplacian[0], smoothing_iter, do_local_smoothing);
 
-    // copy device mem gradient into host mem
-    //hd_gradient.update_host_mem(); ///////////DEBUG will slow down animation
+    ssd_lerp(out_verts);
 }
 
 // -----------------------------------------------------------------------------
@@ -294,7 +324,8 @@ void Animesh::compute_blended_dual_quat_rots()
 		hd_verts_3drots,
 		_mesh->get_nb_vertices(),
 		tr,
-		h_weights);
+		hd_ssd_weights,
+		skinning_backend);
 }
 
 // -----------------------------------------------------------------------------
@@ -322,7 +353,8 @@ void Animesh::geometric_deformation(EAnimesh::Blending_type type,
              out2,
              d_ssd_normals,
              tr,
-			 h_weights);
+             hd_ssd_weights,
+             skinning_backend);
     }
     else if(type == EAnimesh::MATRIX_BLENDING )
     {
@@ -335,7 +367,8 @@ void Animesh::geometric_deformation(EAnimesh::Blending_type type,
              out2,
              d_ssd_normals,
              tr,
-			 h_weights	);
+             hd_ssd_weights,
+             skinning_backend);
     }
     else if(type == EAnimesh::RIGID )
     {
@@ -349,7 +382,8 @@ void Animesh::geometric_deformation(EAnimesh::Blending_type type,
                   d_ssd_normals,
                   tr,
                   /*hd_verts_3drots.d_ptr()*/0,
-                  &d_vertices_nearest_bones[0]);
+                  &d_vertices_nearest_bones[0],
+                  skinning_backend);
     }
 
     compute_blended_dual_quat_rots();
@@ -358,23 +392,111 @@ void Animesh::geometric_deformation(EAnimesh::Blending_type type,
 
 // -----------------------------------------------------------------------------
 
-void Animesh::ssd_lerp(Vec3* out_verts)
+float Animesh::benchmark_skinning(EAnimesh::Blending_type type, int nb_runs)
 {
-	cout<<"Animesh::ssd_lerp"<<endl;
-    //const int nb_vert_to_fit = d_vert_to_fit_base.size();
-    //if( nb_vert_to_fit == 0) return;
-    //const int block_size = 16;
-    //const int grid_size  = (nb_vert_to_fit + block_size - 1) / block_size;
+    const EAnimesh::Skinning_backend backends[3] = { EAnimesh::SKIN_SCALAR,
+                                                     EAnimesh::SKIN_THREADED,
+                                                     EAnimesh::SKIN_SIMD };
+    const char* names[3] = { "scalar", "threaded", "simd" };
+
+    const std::vector<Transfo>&      tr = _skel->d_transfos();
+    const std::vector<Dual_quat_cu>& dq = _skel->d_dual_quat();
+    const int nb_verts = (int)d_input_vertices.size();
+
+    std::vector<Vec3> ref_verts, ref_normals;
+    float max_err = 0.f;
+    for(int b = 0; b < 3; ++b)
+    {
+        std::vector<Vec3> verts, verts2, normals;
+        QTime timer;
+        timer.start();
+        for(int r = 0; r < std::max(nb_runs, 1); ++r)
+        {
+            if(type == EAnimesh::DUAL_QUAT_BLENDING)
+                Animesh_kers::transform_dual_quat(d_input_vertices, d_base_gradient, nb_verts,
+                                                  verts, verts2, normals, dq, hd_ssd_weights, backends[b]);
+            else if(type == EAnimesh::MATRIX_BLENDING)
+                Animesh_kers::transform_SSD(d_input_vertices, d_base_gradient, nb_verts,
+                                            verts, verts2, normals, tr, hd_ssd_weights, backends[b]);
+            else
+                Animesh_kers::transform_rigid(d_input_vertices, d_base_gradient, nb_verts,
+                                              verts, verts2, normals, tr, 0,
+                                              &d_vertices_nearest_bones[0], backends[b]);
+        }
+        const float ms = (float)timer.elapsed() / (float)std::max(nb_runs, 1);
 
-    //Animesh_kers::lerp_kernel<<<grid_size, block_size>>>
-    //        (d_vert_to_fit_base.ptr(),
-    //         out_verts,
-    //         (Vec3*)d_ssd_vertices.ptr(),
-    //         hd_ssd_interpolation_factor.d_ptr(),
-    //         out_verts,
-    //         nb_vert_to_fit);
+        if(b == 0){
+            ref_verts   = verts;
+            ref_normals = normals;
+        }
 
-    //CUDA_CHECK_ERRORS();
+        float err_v = 0.f, err_n = 0.f;
+        for(int i = 0; i < nb_verts; ++i){
+            err_v = std::max(err_v, (verts  [i] - ref_verts  [i]).norm());
+            err_n = std::max(err_n, (normals[i] - ref_normals[i]).norm());
+        }
+        max_err = std::max(max_err, err_v);
+        cout << "skinning " << names[b] << ": " << ms << " ms/frame, "
+             << "max error vertices " << err_v << " normals " << err_n << endl;
+    }
+    return max_err;
+}
+
+// -----------------------------------------------------------------------------
+
+void Animesh::benchmark_fitting(EAnimesh::Blending_type type, int nb_runs)
+{
+    std::vector<Vec3> geom_verts;
+    geometric_deformation(type, d_input_vertices, geom_verts, d_ssd_vertices);
+    h_skel_potential.update(*_skel, _do_bone_deform, false);
+
+    const int nb_steps = Cuda_ctrl::_debug._nb_step;
+    std::vector<Vec3> verts, buffer;
+    int fit_ms = 0, smooth_ms = 0;
+    for(int r = 0; r < nb_runs; ++r)
+    {
+        verts = geom_verts;
+        d_vert_to_fit = d_vert_to_fit_base;
+
+        QTime timer;
+        timer.start();
+        fit_mesh(d_vert_to_fit.size(), &d_vert_to_fit[0], false, true, verts, nb_steps, smooth_force_a);
+        fit_ms += timer.elapsed();
+
+        timer.start();
+        smooth_mesh(verts, buffer, &d_smooth_factors_laplacian[0], smoothing_iter, true);
+        smooth_ms += timer.elapsed();
+    }
+
+    int nb_states[EAnimesh::NB_CASES] = { 0 };
+    for(unsigned i = 0; i < d_vert_to_fit_base.size(); ++i)
+        nb_states[ d_vertices_state[ d_vert_to_fit_base[i] ] ]++;
+
+    const float runs = (float)std::max(nb_runs, 1);
+    cout << "implicit skinning: " << d_vert_to_fit_base.size() << " vertices, "
+         << h_skel_potential.nb_prims() << " bones, "
+         << (float)fit_ms / runs << " ms/frame projection, "
+         << (float)smooth_ms / runs << " ms/frame smoothing" << endl;
+    cout << "fitted " << nb_states[EAnimesh::FITTED]
+         << ", not displaced " << nb_states[EAnimesh::NOT_DISPLACED]
+         << ", contact " << nb_states[EAnimesh::GRADIENT_DIVERGENCE]
+         << ", potential pit " << nb_states[EAnimesh::POTENTIAL_PIT]
+         << ", max steps " << nb_states[EAnimesh::NB_ITER_MAX]
+         << ", null gradient " << nb_states[EAnimesh::NORM_GRAD_NULL] << endl;
+}
+
+// -----------------------------------------------------------------------------
+
+void Animesh::ssd_lerp(std::vector<Vec3>& out_verts)
+{
+    const int nb_vert_to_fit = d_vert_to_fit_base.size();
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < nb_vert_to_fit; ++i)
+    {
+        const int p = d_vert_to_fit_base[i];
+        const float f = hd_ssd_interpolation_factor[p];
+        out_verts[p] = d_ssd_vertices[p] * f + out_verts[p] * (1.f - f);
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -402,6 +524,9 @@ void Animesh::transform_vertices(EAnimesh::Blending_type type, bool refresh)
 //
     geometric_deformation(type, d_input_vertices, out_verts, ssd_verts);
 
+    if(do_implicit_skinning)
+        fit_to_base_potential(out_verts);
+
     ///////////////////////////////
     if( !refresh )
     {
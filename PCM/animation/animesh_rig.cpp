@@ -1,5 +1,7 @@
 #include "animesh_rig.h"
 #include <iostream>
+#include <algorithm>
+#include <xmmintrin.h>
 
 namespace Animesh_kers
 {
@@ -11,21 +13,382 @@ namespace Animesh_kers
 		std::vector<Tbx::Vec3>& out_normals,
 		const std::vector<Tbx::Transfo>& transfos,
 		Mat3 *rots,
-		const int* nearest_bone)
+		const int* nearest_bone,
+		EAnimesh::Skinning_backend backend)
 	{
 		out_verts.resize( nb_verts);
 		out_verts2.resize(nb_verts);
 		out_normals.resize(nb_verts);
 
-		for( int i = 0 ; i< in_verts.size(); ++i)
+		const int n = (int)in_verts.size();
+		if( backend == EAnimesh::SKIN_SCALAR )
 		{
-			Transfo t = transfos[ nearest_bone[i] ];
-			Vec3 vi = t*in_verts[i];
+			for( int i = 0 ; i< n; ++i)
+			{
+				Transfo t = transfos[ nearest_bone[i] ];
+				Vec3 vi = t*in_verts[i];
+				out_verts[i] = vi;
+				out_verts2[i] = vi;
+				out_normals[i] = t.fast_invert().transpose()*in_normals[i];
+			}
+			return;
+		}
+
+		// No blending here, SKIN_SIMD only shares the threading and the
+		// per bone normal matrices
+		std::vector<Transfo> normal_transfos( transfos.size() );
+		for( unsigned j = 0; j < transfos.size(); ++j)
+			normal_transfos[j] = transfos[j].fast_invert().transpose();
+
+		#pragma omp parallel for schedule(static)
+		for( int i = 0 ; i< n; ++i)
+		{
+			const int bone_id = nearest_bone[i];
+			Vec3 vi = transfos[bone_id]*in_verts[i];
 			out_verts[i] = vi;
 			out_verts2[i] = vi;
-			out_normals[i] = t.fast_invert().transpose()*in_normals[i];
+			out_normals[i] = normal_transfos[bone_id]*in_normals[i];
+		}
+	}
+
+	// -------------------------------------------------------------------------
+
+	/// Number of influences the kernels loop over for vertex 'i'
+	/// (padded slots included in the fixed-K layout)
+	static inline int nb_slots(const Ssd_weights& weights, int i)
+	{
+		return weights.is_fixed_k() ? weights.k() : weights.nb_influences(i);
+	}
+
+	// -------------------------------------------------------------------------
+
+	/// Copy the 3x4 upper part of each bone matrix as 3 SSE rows of
+	/// 4 floats: rows[12*j + 4*r + c]. An identity is appended at index
+	/// transfos.size() for the '-1' bone ids and the padding lanes.
+	static void pack_transfo_rows(const std::vector<Tbx::Transfo>& transfos,
+		std::vector<float>& rows)
+	{
+		const unsigned nb = (unsigned)transfos.size();
+		rows.resize( (nb + 1) * 12 );
+		for( unsigned j = 0; j <= nb; ++j)
+		{
+			const Transfo t = (j == nb) ? Transfo::identity() : transfos[j];
+			const Mat3 m  = t.get_mat3();
+			const Vec3 tr = t.get_translation();
+			float* r = &rows[12*j];
+			r[0] = m.a; r[1] = m.b; r[ 2] = m.c; r[ 3] = tr.x;
+			r[4] = m.d; r[5] = m.e; r[ 6] = m.f; r[ 7] = tr.y;
+			r[8] = m.g; r[9] = m.h; r[10] = m.i; r[11] = tr.z;
+		}
+	}
+
+	/// Copy each dual quaternion as 2 SSE registers (non dual part then
+	/// dual part, w i j k order). An identity is appended at index
+	/// dual_quat.size() for the '-1' bone ids and the padding lanes.
+	static void pack_dual_quats(const std::vector<Dual_quat_cu>& dual_quat,
+		std::vector<float>& dq)
+	{
+		const unsigned nb = (unsigned)dual_quat.size();
+		dq.resize( (nb + 1) * 8 );
+		for( unsigned j = 0; j <= nb; ++j)
+		{
+			const Dual_quat_cu& d = (j == nb) ? Dual_quat_cu::identity() : dual_quat[j];
+			const Quat_cu q0 = d.get_non_dual_part();
+			const Quat_cu qe = d.get_dual_part();
+			float* r = &dq[8*j];
+			r[0] = q0.w(); r[1] = q0.i(); r[2] = q0.j(); r[3] = q0.k();
+			r[4] = qe.w(); r[5] = qe.i(); r[6] = qe.j(); r[7] = qe.k();
+		}
+	}
+
+	// -------------------------------------------------------------------------
+
+	/// The SIMD kernels skin 4 consecutive vertices at once, one per SSE
+	/// lane (structure of arrays). Lanes past the last vertex are padding.
+	/// They only handle the fixed-K layout: with CSR weights every lane is
+	/// padded to the largest influence count of the group, which made the
+	/// batch slower than the per vertex loop, so CSR goes through the
+	/// threaded path.
+	struct Simd_group {
+		int   first;       ///< first vertex of the group
+		int   nb_slots;    ///< largest slot count of the group
+		int   count[4];    ///< slot count of each lane (0 for padding)
+		__m128 empty;      ///< all bits set for lanes without influence
+		float empty_f[4];  ///< 1.f for lanes without influence
+	};
+
+	static inline Simd_group make_group(const Ssd_weights& weights, int first, int n)
+	{
+		Simd_group g;
+		g.first = first;
+		g.nb_slots = 0;
+		for( int l = 0; l < 4; ++l)
+		{
+			const int v = first + l;
+			const bool empty = v >= n || weights.nb_influences(v) == 0;
+			g.empty_f[l] = empty ? 1.f : 0.f;
+			g.count  [l] = v < n ? nb_slots(weights, v) : 0;
+			g.nb_slots = std::max(g.nb_slots, g.count[l]);
+		}
+		g.empty = _mm_cmpgt_ps(_mm_loadu_ps(g.empty_f), _mm_setzero_ps());
+		return g;
+	}
+
+	/// Influence 's' of the 4 vertices of the group. Missing slots, padding
+	/// lanes and '-1' bones point to 'identity_id' with a null weight for the
+	/// first two, weights of lanes without influence are zeroed.
+	static inline __m128 get_group_influence(const Ssd_weights& weights,
+		const Simd_group& g,
+		int n,
+		int s,
+		int identity_id,
+		int bone_ids[4])
+	{
+		__m128 w;
+		if( (g.first + 4) <= n )
+		{
+			const int* joints = weights.k_joints(s) + g.first;
+			for( int l = 0; l < 4; ++l)
+				bone_ids[l] = joints[l] == -1 ? identity_id : joints[l];
+			w = _mm_loadu_ps(weights.k_weights(s) + g.first);
+		}
+		else
+		{
+			float ws[4];
+			for( int l = 0; l < 4; ++l)
+			{
+				if( s < g.count[l] )
+				{
+					bone_ids[l] = weights.k_joints (s)[g.first + l];
+					ws[l]       = weights.k_weights(s)[g.first + l];
+					if( bone_ids[l] == -1 ) bone_ids[l] = identity_id;
+				}
+				else
+				{
+					bone_ids[l] = identity_id;
+					ws[l] = 0.f;
+				}
+			}
+			w = _mm_loadu_ps(ws);
+		}
+		return _mm_andnot_ps(g.empty, w);
+	}
+
+	/// Transpose the 4 floats at 'base + stride * bone_ids[l] + offset'
+	/// (l in [0 3]) so that out[c] holds component 'c' of the 4 lanes
+	static inline void gather4(const float* base,
+		int stride,
+		int offset,
+		const int bone_ids[4],
+		__m128 out[4])
+	{
+		out[0] = _mm_loadu_ps(base + stride * bone_ids[0] + offset);
+		out[1] = _mm_loadu_ps(base + stride * bone_ids[1] + offset);
+		out[2] = _mm_loadu_ps(base + stride * bone_ids[2] + offset);
+		out[3] = _mm_loadu_ps(base + stride * bone_ids[3] + offset);
+		_MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+	}
+
+	/// SSE version of blend_transfo() then point and normal transformation
+	/// for the 4 vertices of the group. The normal is multiplied by the
+	/// inverse transpose of the blended 3x3 matrix (cofactors over
+	/// determinant) like fast_invert().transpose(). Vertices without
+	/// influence keep their rest position.
+	static inline void skin_group_simd(const float* rows,
+		int identity_id,
+		const Ssd_weights& weights,
+		int first,
+		int n,
+		const std::vector<Vec3>& in_verts,
+		const std::vector<Vec3>& in_normals,
+		std::vector<Vec3>& out_verts,
+		std::vector<Vec3>& out_normals)
+	{
+		const Simd_group g = make_group(weights, first, n);
+
+		// t[4*r + c]: blended matrix element (r, c) of each lane
+		__m128 t[12];
+		for( int e = 0; e < 12; ++e)
+			t[e] = _mm_setzero_ps();
+
+		for( int s = 0; s < g.nb_slots; ++s)
+		{
+			int bone_ids[4];
+			const __m128 w = get_group_influence(weights, g, n, s, identity_id, bone_ids);
+			for( int r = 0; r < 3; ++r)
+			{
+				__m128 m[4];
+				gather4(rows, 12, 4*r, bone_ids, m);
+				for( int c = 0; c < 4; ++c)
+					t[4*r + c] = _mm_add_ps(t[4*r + c], _mm_mul_ps(w, m[c]));
+			}
+		}
+
+		// identity for the lanes without influence
+		const __m128 e = _mm_loadu_ps(g.empty_f);
+		t[0]  = _mm_add_ps(t[0] , e);
+		t[5]  = _mm_add_ps(t[5] , e);
+		t[10] = _mm_add_ps(t[10], e);
+
+		float px[4], py[4], pz[4], nx[4], ny[4], nz[4];
+		for( int l = 0; l < 4; ++l)
+		{
+			const int v = std::min(first + l, n - 1);
+			px[l] = in_verts  [v].x; py[l] = in_verts  [v].y; pz[l] = in_verts  [v].z;
+			nx[l] = in_normals[v].x; ny[l] = in_normals[v].y; nz[l] = in_normals[v].z;
+		}
+		const __m128 x = _mm_loadu_ps(px), y = _mm_loadu_ps(py), z = _mm_loadu_ps(pz);
+
+		#define MADD3(a, b, c, d) _mm_add_ps(_mm_add_ps(_mm_mul_ps(t[a], x), _mm_mul_ps(t[b], y)), _mm_add_ps(_mm_mul_ps(t[c], z), t[d]))
+		_mm_storeu_ps(px, MADD3(0, 1,  2,  3));
+		_mm_storeu_ps(py, MADD3(4, 5,  6,  7));
+		_mm_storeu_ps(pz, MADD3(8, 9, 10, 11));
+		#undef MADD3
+
+		#define CROSS(a, b, c, d) _mm_sub_ps(_mm_mul_ps(t[a], t[b]), _mm_mul_ps(t[c], t[d]))
+		const __m128 c00 = CROSS(5, 10, 6, 9), c01 = CROSS(6, 8, 4, 10), c02 = CROSS(4, 9, 5, 8);
+		const __m128 c10 = CROSS(2,  9, 1, 10), c11 = CROSS(0, 10, 2, 8), c12 = CROSS(1, 8, 0, 9);
+		const __m128 c20 = CROSS(1,  6, 2,  5), c21 = CROSS(2,  4, 0, 6), c22 = CROSS(0, 5, 1, 4);
+		#undef CROSS
+		const __m128 det = _mm_add_ps(_mm_mul_ps(t[0], c00), _mm_add_ps(_mm_mul_ps(t[1], c01), _mm_mul_ps(t[2], c02)));
+		const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+		const __m128 vnx = _mm_loadu_ps(nx), vny = _mm_loadu_ps(ny), vnz = _mm_loadu_ps(nz);
+
+		#define DOT3(a, b, c) _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, vnx), _mm_mul_ps(b, vny)), _mm_mul_ps(c, vnz)), inv_det)
+		_mm_storeu_ps(nx, DOT3(c00, c01, c02));
+		_mm_storeu_ps(ny, DOT3(c10, c11, c12));
+		_mm_storeu_ps(nz, DOT3(c20, c21, c22));
+		#undef DOT3
+
+		for( int l = 0; l < 4 && (first + l) < n; ++l)
+		{
+			out_verts  [first + l] = Vec3(px[l], py[l], pz[l]);
+			out_normals[first + l] = Vec3(nx[l], ny[l], nz[l]);
 		}
 	}
+
+	/// SSE version of blend_dual_quat() for the 4 vertices of the group.
+	/// The shortest rotation test is done on the lanes with a sign mask, the
+	/// blended quaternions are only stored once at the end.
+	static inline void blend_dual_quat_group(const float* dq,
+		const std::vector<Dual_quat_cu>& dual_quat,
+		const Ssd_weights& weights,
+		int first,
+		int n,
+		Dual_quat_cu out[4])
+	{
+		const Simd_group g = make_group(weights, first, n);
+		const int identity_id = (int)dual_quat.size();
+		const __m128 sign_bit = _mm_set1_ps(-0.f);
+		const __m128 zero     = _mm_setzero_ps();
+
+		// b[0..3] non dual part, b[4..7] dual part, w i j k
+		__m128 pivot[4], b[8];
+		for( int s = 0; s < g.nb_slots; ++s)
+		{
+			int bone_ids[4];
+			__m128 w = get_group_influence(weights, g, n, s, identity_id, bone_ids);
+			__m128 q0[4], qe[4];
+			gather4(dq, 8, 0, bone_ids, q0);
+			gather4(dq, 8, 4, bone_ids, qe);
+			if( s == 0 )
+			{
+				for( int c = 0; c < 4; ++c)
+				{
+					pivot[c] = q0[c];
+					b[c]     = zero;
+					b[4 + c] = zero;
+				}
+			}
+			else
+			{
+				// Seek shortest rotation:
+				const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q0[0], pivot[0]), _mm_mul_ps(q0[1], pivot[1])),
+				                            _mm_add_ps(_mm_mul_ps(q0[2], pivot[2]), _mm_mul_ps(q0[3], pivot[3])));
+				w = _mm_xor_ps(w, _mm_and_ps(_mm_cmplt_ps(d, zero), sign_bit));
+			}
+			for( int c = 0; c < 4; ++c)
+			{
+				b[c]     = _mm_add_ps(b[c]    , _mm_mul_ps(w, q0[c]));
+				b[4 + c] = _mm_add_ps(b[4 + c], _mm_mul_ps(w, qe[c]));
+			}
+		}
+
+		float r[8][4];
+		for( int c = 0; c < 8; ++c)
+			_mm_storeu_ps(r[c], g.nb_slots > 0 ? b[c] : zero);
+		for( int l = 0; l < 4 && (first + l) < n; ++l)
+		{
+			if( g.empty_f[l] != 0.f )
+				out[l] = dual_quat[0];
+			else
+				out[l] = Dual_quat_cu(Quat_cu(r[0][l], r[1][l], r[2][l], r[3][l]),
+				                      Quat_cu(r[4][l], r[5][l], r[6][l], r[7][l]));
+		}
+	}
+
+	// -------------------------------------------------------------------------
+	/// Blend the SSD matrices of vertex 'i'
+	static inline Transfo blend_transfo(const std::vector<Tbx::Transfo>& transfos,
+		const Ssd_weights& weights,
+		int i)
+	{
+		if( weights.nb_influences(i) == 0 )
+			return Transfo::identity();
+
+		Transfo t;
+		if( weights.is_fixed_k() )
+		{
+			t = transfos[ weights.k_joints(0)[i] ] * weights.k_weights(0)[i];
+			for (int s = 1; s < weights.k(); ++s)
+				t = t + transfos[ weights.k_joints(s)[i] ] * weights.k_weights(s)[i];
+		}
+		else
+		{
+			const int*   joints = weights.csr_joints();
+			const float* w      = weights.csr_weights();
+			const int st_j = weights.offset(i);
+			const int nb_j = weights.nb_influences(i);
+			t = transfos[ joints[st_j] ] * w[st_j];
+			for (int j = st_j + 1; j < (st_j + nb_j); ++j)
+				t = t + transfos[ joints[j] ] * w[j];
+		}
+		return t;
+	}
+
+	/// Blend the dual quaternions of vertex 'i', the first influence is the pivot
+	/// used to pick the shortest rotation
+	static inline Dual_quat_cu blend_dual_quat(const std::vector<Dual_quat_cu>& dual_quat,
+		const Ssd_weights& weights,
+		int i)
+	{
+		const int nb_j = weights.nb_influences(i);
+		if( nb_j == 0 )
+			return dual_quat[0];
+
+		const bool fixed_k = weights.is_fixed_k();
+		const int  nb_slots = fixed_k ? weights.k() : nb_j;
+		const int  st_j     = fixed_k ? 0 : weights.offset(i);
+
+		int   k0 = fixed_k ? weights.k_joints (0)[i] : weights.csr_joints ()[st_j];
+		float w0 = fixed_k ? weights.k_weights(0)[i] : weights.csr_weights()[st_j];
+		const Dual_quat_cu& dq0 = (k0 == -1) ? Dual_quat_cu::identity() : dual_quat[k0];
+		Dual_quat_cu dq_blend = dq0 * w0;
+		Quat_cu q0 = dq0.rotation();
+
+		for (int s = 1; s < nb_slots; ++s)
+		{
+			int   bone_id = fixed_k ? weights.k_joints (s)[i] : weights.csr_joints ()[st_j + s];
+			float w       = fixed_k ? weights.k_weights(s)[i] : weights.csr_weights()[st_j + s];
+			const Dual_quat_cu& dq = (bone_id == -1) ? Dual_quat_cu::identity() : dual_quat[bone_id];
+			// Seek shortest rotation:
+			if( dq.rotation().dot( q0 ) < 0.f )
+				w *= -1.f;
+			dq_blend = dq_blend + dq * w;
+		}
+		return dq_blend;
+	}
+
 	/// Transform each vertex with SSD
 	/// @param in_verts : vertices in rest position
 	/// @param out_verts : animated vertices
@@ -37,48 +400,43 @@ namespace Animesh_kers
 		std::vector<Tbx::Vec3>& out_verts2,
 		std::vector<Tbx::Vec3>& out_normals,
 		const std::vector<Tbx::Transfo>& transfos,
-		const std::vector<std::map<int, float> >& h_weights )
+		const Ssd_weights& weights,
+		EAnimesh::Skinning_backend backend)
 	{
-		//for (int i = 0; i < transfos.size(); i++)
-		//{
-		//	const Tbx::Transfo& tr = transfos[i];
-		//	 Vec3& trans = tr.get_translation();
-		//	 std::cout<<"bone "<<i<<" tr "<< trans.x<<" "<<trans.y<<" "<<trans.z<<std::endl;
-		//}
-
-
 		out_verts.resize( nb_verts);
 		out_verts2.resize(nb_verts);
 		out_normals.resize(nb_verts);
-		for (int i_vtx = 0; i_vtx < in_verts.size(); ++i_vtx)
-		{
-			Transfo t;
-			auto iter = h_weights[i_vtx].begin();
-			t = (  h_weights[i_vtx].size() > 0) ? transfos[ iter->first ] * iter->second:
-				Transfo::identity();
-			for (int i_bone = 0; i_bone < h_weights[i_vtx].size(); ++i_bone ,++iter)
-			{	
-				if ( 0 == i_bone )
-				{
-					continue;
-				}
-				const int   k = iter->first;
-				const float w = iter->second;
-				t = t + transfos[k] * w;
+
+		const int n = (int)in_verts.size();
+		if( backend == EAnimesh::SKIN_SIMD && weights.is_fixed_k() )
+		{
+			std::vector<float> rows;
+			pack_transfo_rows(transfos, rows);
+			const int identity_id = (int)transfos.size();
+
+			const int nb_groups = (n + 3) / 4;
+			#pragma omp parallel for schedule(static)
+			for (int grp = 0; grp < nb_groups; ++grp)
+			{
+				const int first = grp * 4;
+				skin_group_simd(&rows[0], identity_id, weights, first, n,
+				                in_verts, in_normals, out_verts, out_normals);
+				for (int i_vtx = first; i_vtx < std::min(first + 4, n); ++i_vtx)
+					out_verts2[i_vtx] = out_verts[i_vtx];
 			}
+			return;
+		}
+
+		#pragma omp parallel for schedule(static) if(backend != EAnimesh::SKIN_SCALAR)
+		for (int i_vtx = 0; i_vtx < n; ++i_vtx)
+		{
+			Transfo t = blend_transfo(transfos, weights, i_vtx);
 			Vec3 vi = (t * in_verts[i_vtx].to_point3()).to_vec3();
 
 			out_verts[i_vtx] = vi;
 			out_verts2[i_vtx] = vi;
 			out_normals[i_vtx] = t.fast_invert().transpose()*in_normals[i_vtx];
 		}
-
-
-
-
-
-
-
 	}
 	/// Transform each vertex with dual quaternions
 	/// @param in_verts : vertices in rest position
@@ -91,66 +449,85 @@ namespace Animesh_kers
 		std::vector<Tbx::Vec3>& out_verts2,
 		std::vector<Tbx::Vec3>& out_normals,
 		const std::vector<Dual_quat_cu>& dual_quat,
-		const std::vector<std::map<int, float> >& h_weights)
+		const Ssd_weights& weights,
+		EAnimesh::Skinning_backend backend)
 	{
 
 		out_verts.resize( nb_verts);
 		out_verts2.resize(nb_verts);
 		out_normals.resize(nb_verts);
 
-		for (int i_vtx = 0; i_vtx < in_verts.size(); ++i_vtx)
+		const int n = (int)in_verts.size();
+		if( backend == EAnimesh::SKIN_SIMD && weights.is_fixed_k() )
 		{
-			int   k0 = -1;
-			float w0 = 0.f;
-			Dual_quat_cu dq_blend;
-			Quat_cu q0;
+			std::vector<float> dq;
+			pack_dual_quats(dual_quat, dq);
 
-			if( h_weights[i_vtx].size() )
+			// blending is batched over 4 vertices, the normalization and the
+			// transformation stay in Dual_quat_cu
+			const int nb_groups = (n + 3) / 4;
+			#pragma omp parallel for schedule(static)
+			for (int grp = 0; grp < nb_groups; ++grp)
 			{
-				k0 = h_weights[i_vtx].begin()->first;
-				w0 = h_weights[i_vtx].begin()->second;
-			}else
-			{
-				std::cout<<"weight empty "<<i_vtx<<std::endl;
-				dq_blend = Dual_quat_cu::identity();
-				k0 = 0;
-				w0 = 1.0f;
-			}
-
-			if( k0 != -1)
-				dq_blend =dual_quat[k0]*w0;
-			int pivot = k0;
-			q0 = dual_quat[pivot].rotation();
-			auto iter = h_weights[i_vtx].begin();
-			for (int i_bone = 0; i_bone < h_weights[i_vtx].size(); ++i_bone ,++iter)
-			{	
-				if ( 0 == i_bone )
+				const int first = grp * 4;
+				Dual_quat_cu dq_blend[4];
+				blend_dual_quat_group(&dq[0], dual_quat, weights, first, n, dq_blend);
+				for (int l = 0; l < 4 && (first + l) < n; ++l)
 				{
-					continue;
+					const int i_vtx = first + l;
+					Point3 p(in_verts[i_vtx].x,in_verts[i_vtx].y,in_verts[i_vtx].z);
+					Vec3 vi = dq_blend[l].transform( p);
+					out_verts[i_vtx] = vi;
+					out_verts2[i_vtx] = vi;
+					out_normals[i_vtx] = dq_blend[l].rotate( in_normals[i_vtx]);
 				}
-				int bone_id = iter->first;
-				float w = iter->second;
-				const Dual_quat_cu& dq = (bone_id == -1) ? Dual_quat_cu::identity() : dual_quat[bone_id];
-				// Seek shortest rotation:
-				if( dq.rotation().dot( q0 ) < 0.f )
-					w *= -1.f;
-				dq_blend = dq_blend + dq * w;
 			}
+			return;
+		}
+
+		#pragma omp parallel for schedule(static) if(backend != EAnimesh::SKIN_SCALAR)
+		for (int i_vtx = 0; i_vtx < n; ++i_vtx)
+		{
+			Dual_quat_cu dq_blend = blend_dual_quat(dual_quat, weights, i_vtx);
 			Point3 p(in_verts[i_vtx].x,in_verts[i_vtx].y,in_verts[i_vtx].z);
 			Vec3 vi = dq_blend.transform( p);
 			out_verts[i_vtx] = vi;
 			out_verts2[i_vtx] = vi;
 			out_normals[i_vtx] = dq_blend.rotate( in_normals[i_vtx]);
 		}
-
-
-
 	}
 	void transform_arap_dual_quat( std::vector<Tbx::Mat3>& rots,
 		int nb_verts,
 		const std::vector<Dual_quat_cu>& dual_quat,
-		const std::vector<std::map<int, float> >& h_weights)
+		const Ssd_weights& weights,
+		EAnimesh::Skinning_backend backend)
 	{
+		rots.resize(nb_verts);
 
+		const int n = std::min(nb_verts, weights.nb_verts());
+		if( backend == EAnimesh::SKIN_SIMD && weights.is_fixed_k() )
+		{
+			std::vector<float> dq;
+			pack_dual_quats(dual_quat, dq);
+
+			const int nb_groups = (n + 3) / 4;
+			#pragma omp parallel for schedule(static)
+			for (int grp = 0; grp < nb_groups; ++grp)
+			{
+				const int first = grp * 4;
+				Dual_quat_cu dq_blend[4];
+				blend_dual_quat_group(&dq[0], dual_quat, weights, first, n, dq_blend);
+				for (int l = 0; l < 4 && (first + l) < n; ++l)
+					rots[first + l] = dq_blend[l].to_transformation().get_mat3();
+			}
+			return;
+		}
+
+		#pragma omp parallel for schedule(static) if(backend != EAnimesh::SKIN_SCALAR)
+		for (int i_vtx = 0; i_vtx < n; ++i_vtx)
+		{
+			Dual_quat_cu dq_blend = blend_dual_quat(dual_quat, weights, i_vtx);
+			rots[i_vtx] = dq_blend.to_transformation().get_mat3();
+		}
 	}
 }
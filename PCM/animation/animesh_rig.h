@@ -4,11 +4,20 @@
 #include "toolbox/maths/vec3.hpp"
 #include "toolbox/maths/transfo.hpp"
 #include "toolbox/maths/dual_quat_cu.hpp"
+#include "animesh_weights.hpp"
+#include "animesh_enum.hpp"
 #include <vector>
 #include <map>
 using namespace Tbx;
+/// CPU skinning kernels.
+/// Every kernel takes an EAnimesh::Skinning_backend: SKIN_SCALAR is the
+/// single threaded reference, SKIN_THREADED runs the same code over every
+/// core (OpenMP) and SKIN_SIMD also blends the bone transformations with SSE,
+/// 4 vertices at a time, when the weights use the fixed-K layout.
+/// All backends write the same results up to float rounding.
 namespace Animesh_kers
 {
+	/// Transform each vertex with the matrix of its nearest bone
 	void transform_rigid(const std::vector<Tbx::Vec3>& in_verts,
 		const std::vector<Tbx::Vec3>& in_normals,
 		int nb_verts,
@@ -17,7 +26,8 @@ namespace Animesh_kers
 		std::vector<Tbx::Vec3>& out_normals,
 		const std::vector<Tbx::Transfo>& transfos,
 		Mat3 *rots,
-		const int* nearest_bone);
+		const int* nearest_bone,
+		EAnimesh::Skinning_backend backend = EAnimesh::SKIN_SCALAR);
 
 	/// Transform each vertex with SSD
 	/// @param in_verts : vertices in rest position
@@ -30,7 +40,8 @@ namespace Animesh_kers
 		std::vector<Tbx::Vec3>& out_verts2,
 		std::vector<Tbx::Vec3>& out_normals,
 		const std::vector<Tbx::Transfo>& transfos,
-		const std::vector<std::map<int, float> >& h_weights );
+		const Ssd_weights& weights,
+		EAnimesh::Skinning_backend backend = EAnimesh::SKIN_SCALAR);
 
 	/// Transform each vertex with dual quaternions
 	/// @param in_verts : vertices in rest position
@@ -43,12 +54,14 @@ namespace Animesh_kers
 		std::vector<Tbx::Vec3>& out_verts2,
 		std::vector<Tbx::Vec3>& out_normals,
 		const std::vector<Tbx::Dual_quat_cu>& d_transform,
-		const std::vector<std::map<int, float> >& h_weights);
+		const Ssd_weights& weights,
+		EAnimesh::Skinning_backend backend = EAnimesh::SKIN_SCALAR);
 
 	void transform_arap_dual_quat( std::vector<Tbx::Mat3>& rots,
 		int nb_verts,
 		const std::vector<Tbx::Dual_quat_cu>& dual_quat,
-		const std::vector<std::map<int, float> >& h_weights);
+		const Ssd_weights& weights,
+		EAnimesh::Skinning_backend backend = EAnimesh::SKIN_SCALAR);
 }
 
 
@@ -0,0 +1,139 @@
+#include "animesh_weights.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::clear()
+{
+    _nb_verts = 0;
+    _k        = 0;
+    _offsets.clear();
+    _joints.clear();
+    _weights.clear();
+    _k_joints.clear();
+    _k_weights.clear();
+}
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::set(const std::vector<int>& joints,
+                      const std::vector<float>& weights,
+                      const std::vector<int>& jpv)
+{
+    assert(joints.size() == weights.size());
+    _nb_verts = (int)jpv.size() / 2;
+
+    _offsets.resize(_nb_verts + 1);
+    _joints. clear(); _joints. reserve(joints.size());
+    _weights.clear(); _weights.reserve(weights.size());
+
+    _offsets[0] = 0;
+    for(int i = 0; i < _nb_verts; i++)
+    {
+        const int start = jpv[2*i];
+        const int nb    = jpv[2*i+1];
+        for(int j = start; j < (start + nb); j++)
+        {
+            _joints. push_back( joints [j] );
+            _weights.push_back( weights[j] );
+        }
+        _offsets[i+1] = _offsets[i] + nb;
+    }
+
+    build_fixed_k();
+}
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::set(const std::vector<std::map<int, float> >& weights)
+{
+    _nb_verts = (int)weights.size();
+
+    _offsets.resize(_nb_verts + 1);
+    _joints. clear(); _joints. reserve(_nb_verts * 2);
+    _weights.clear(); _weights.reserve(_nb_verts * 2);
+
+    _offsets[0] = 0;
+    for(int i = 0; i < _nb_verts; i++)
+    {
+        std::map<int, float>::const_iterator it;
+        for(it = weights[i].begin(); it != weights[i].end(); ++it)
+        {
+            _joints. push_back( it->first  );
+            _weights.push_back( it->second );
+        }
+        _offsets[i+1] = _offsets[i] + (int)weights[i].size();
+    }
+
+    build_fixed_k();
+}
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::get(std::vector<std::map<int, float> >& weights) const
+{
+    weights.clear();
+    weights.resize(_nb_verts);
+    for(int i = 0; i < _nb_verts; i++)
+        for(int j = _offsets[i]; j < _offsets[i+1]; j++)
+            weights[i][_joints[j]] = _weights[j];
+}
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::update_vertex(int vert_id,
+                                const std::vector<int>& joints,
+                                const std::vector<float>& weights,
+                                const std::vector<int>& jpv)
+{
+    const int start = jpv[2*vert_id];
+    const int nb    = jpv[2*vert_id+1];
+    assert(nb == nb_influences(vert_id));
+
+    const int off = _offsets[vert_id];
+    for(int j = 0; j < nb; j++)
+    {
+        _joints [off + j] = joints [start + j];
+        _weights[off + j] = weights[start + j];
+    }
+
+    if( is_fixed_k() ) fill_fixed_k_vertex(vert_id);
+}
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::build_fixed_k()
+{
+    _k = 0;
+    for(int i = 0; i < _nb_verts; i++)
+        _k = std::max(_k, nb_influences(i));
+
+    if( !is_fixed_k() )
+    {
+        _k_joints. clear();
+        _k_weights.clear();
+        return;
+    }
+
+    _k_joints. resize(_k * _nb_verts);
+    _k_weights.resize(_k * _nb_verts);
+    for(int i = 0; i < _nb_verts; i++)
+        fill_fixed_k_vertex(i);
+}
+
+// -----------------------------------------------------------------------------
+
+void Ssd_weights::fill_fixed_k_vertex(int vert_id)
+{
+    const int nb  = nb_influences(vert_id);
+    const int off = _offsets[vert_id];
+    // padding slots reuse the first joint with a null weight
+    const int pad = nb > 0 ? _joints[off] : 0;
+    for(int s = 0; s < _k; s++)
+    {
+        _k_joints [s * _nb_verts + vert_id] = s < nb ? _joints [off + s] : pad;
+        _k_weights[s * _nb_verts + vert_id] = s < nb ? _weights[off + s] : 0.f;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef ANIMESH_WEIGHTS_HPP__
+#define ANIMESH_WEIGHTS_HPP__
+
+#include <vector>
+#include <map>
+
+/** @brief Packed SSD weights read by the skinning kernels
+
+    Weights are stored twice:
+    - a CSR form (joints/weights plus per vertex offsets) which accepts any
+    number of influences per vertex;
+    - a fixed-K structure of arrays where every vertex owns exactly k() slots.
+    Slot 's' of every vertex is contiguous in memory:
+    k_joints(s)[vert_id] and k_weights(s)[vert_id].
+    Vertices with less than k() influences are padded with a zero weight
+    pointing to their first joint, so kernels can blend without branching.
+
+    The fixed-K form is only filled when the largest influence count is below
+    MAX_K, kernels must fall back to the CSR form otherwise (is_fixed_k()).
+
+    @note Influences keep the order of the source (ascending joint ids when
+    built from std::map) which means the first influence is the same pivot
+    the map-based kernels used for dual quaternion blending.
+*/
+class Ssd_weights {
+public:
+    /// Largest number of influences stored in the fixed-K layout
+    static const int MAX_K = 8;
+
+    Ssd_weights() : _nb_verts(0), _k(0) { }
+
+    void clear();
+
+    /// Build from Animesh's CSR arrays:
+    /// jpv[2*i] is the first index of vertex i in 'joints' and 'weights',
+    /// jpv[2*i+1] its number of influences.
+    void set(const std::vector<int>& joints,
+             const std::vector<float>& weights,
+             const std::vector<int>& jpv);
+
+    /// Build from one map(joint -> weight) per vertex
+    void set(const std::vector<std::map<int, float> >& weights);
+
+    /// Convert back to one map(joint -> weight) per vertex
+    void get(std::vector<std::map<int, float> >& weights) const;
+
+    /// Refresh the weights of a single vertex whose influence count did not
+    /// change, arrays are in the same format as set()
+    void update_vertex(int vert_id,
+                       const std::vector<int>& joints,
+                       const std::vector<float>& weights,
+                       const std::vector<int>& jpv);
+
+    int nb_verts() const { return _nb_verts; }
+
+    /// @name CSR form
+    /// @{
+    int nb_influences(int vert_id) const { return _offsets[vert_id+1] - _offsets[vert_id]; }
+    int offset       (int vert_id) const { return _offsets[vert_id]; }
+    const int*   csr_joints () const { return _joints.empty()  ? 0 : &_joints [0]; }
+    const float* csr_weights() const { return _weights.empty() ? 0 : &_weights[0]; }
+    /// @}
+
+    /// @name Fixed-K form
+    /// @{
+    bool is_fixed_k() const { return _k <= MAX_K; }
+    int  k() const { return _k; }
+    /// @return 0 when there is no slot (k() == 0 or no fixed-K form)
+    const int*   k_joints (int slot) const { return _k_joints .empty() ? 0 : &_k_joints [slot * _nb_verts]; }
+    const float* k_weights(int slot) const { return _k_weights.empty() ? 0 : &_k_weights[slot * _nb_verts]; }
+    /// @}
+
+private:
+    void build_fixed_k();
+    void fill_fixed_k_vertex(int vert_id);
+
+    int _nb_verts;
+    int _k;                       ///< slots per vertex in the fixed-K form
+
+    std::vector<int>   _offsets;  ///< size nb_verts+1, influences of i in [_offsets[i], _offsets[i+1])
+    std::vector<int>   _joints;
+    std::vector<float> _weights;
+
+    std::vector<int>   _k_joints;  ///< slot major: _k_joints[slot*nb_verts + vert_id]
+    std::vector<float> _k_weights;
+};
+
+#endif // ANIMESH_WEIGHTS_HPP__
@@ -0,0 +1,166 @@
+#include "bone_grid.hpp"
+
+#include <climits>
+#include <istream>
+#include <ostream>
+
+using namespace Tbx;
+
+// -----------------------------------------------------------------------------
+
+/// Cell of 'f' (grid coordinates) on an axis of 'res' nodes and the
+/// position 't' inside it
+static inline int cell(float f, int res, float& t)
+{
+    int i = (int)std::floor(f);
+    i = std::min(std::max(i, 0), res - 2);
+    t = std::min(std::max(f - (float)i, 0.f), 1.f);
+    return i;
+}
+
+/// Catmull-Rom weights and their derivatives for the nodes i-1, i, i+1, i+2
+static inline void catmull_rom(float t, float w[4], float dw[4])
+{
+    const float t2 = t * t, t3 = t2 * t;
+    w[0] = 0.5f * (-t3 + 2.f * t2 - t);
+    w[1] = 0.5f * (3.f * t3 - 5.f * t2 + 2.f);
+    w[2] = 0.5f * (-3.f * t3 + 4.f * t2 + t);
+    w[3] = 0.5f * (t3 - t2);
+    dw[0] = 0.5f * (-3.f * t2 + 4.f * t - 1.f);
+    dw[1] = 0.5f * (9.f * t2 - 10.f * t);
+    dw[2] = 0.5f * (-9.f * t2 + 8.f * t + 1.f);
+    dw[3] = 0.5f * (3.f * t2 - 2.f * t);
+}
+
+// -----------------------------------------------------------------------------
+
+void Bone_grid::clear()
+{
+    _vals.clear();
+    _res[0] = _res[1] = _res[2] = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+float Bone_grid::fngf(const Vec3& p, Vec3& gf, Interpolation interp) const
+{
+    return interp == TRICUBIC ? tricubic(p, gf) : trilinear(p, gf);
+}
+
+// -----------------------------------------------------------------------------
+
+float Bone_grid::trilinear(const Vec3& p, Vec3& gf) const
+{
+    float t[3];
+    const int x = cell((p.x - _pmin.x) * _inv_step, _res[0], t[0]);
+    const int y = cell((p.y - _pmin.y) * _inv_step, _res[1], t[1]);
+    const int z = cell((p.z - _pmin.z) * _inv_step, _res[2], t[2]);
+
+    float acc[4] = {0.f, 0.f, 0.f, 0.f};
+    for(int c = 0; c < 8; ++c)
+    {
+        const int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1;
+        const float w = (dx ? t[0] : 1.f - t[0]) *
+                        (dy ? t[1] : 1.f - t[1]) *
+                        (dz ? t[2] : 1.f - t[2]);
+        const float* node = &_vals[4 * node_idx(x + dx, y + dy, z + dz)];
+        acc[0] += w * node[0];
+        acc[1] += w * node[1];
+        acc[2] += w * node[2];
+        acc[3] += w * node[3];
+    }
+    gf = Vec3(acc[1], acc[2], acc[3]);
+    return acc[0];
+}
+
+// -----------------------------------------------------------------------------
+
+float Bone_grid::tricubic(const Vec3& p, Vec3& gf) const
+{
+    float t[3];
+    const int x = cell((p.x - _pmin.x) * _inv_step, _res[0], t[0]);
+    const int y = cell((p.y - _pmin.y) * _inv_step, _res[1], t[1]);
+    const int z = cell((p.z - _pmin.z) * _inv_step, _res[2], t[2]);
+
+    float wx[4], wy[4], wz[4], dwx[4], dwy[4], dwz[4];
+    catmull_rom(t[0], wx, dwx);
+    catmull_rom(t[1], wy, dwy);
+    catmull_rom(t[2], wz, dwz);
+
+    // Nodes past the border are clamped to it
+    int ix[4], iy[4], iz[4];
+    for(int i = 0; i < 4; ++i)
+    {
+        ix[i] = std::min(std::max(x - 1 + i, 0), _res[0] - 1);
+        iy[i] = std::min(std::max(y - 1 + i, 0), _res[1] - 1);
+        iz[i] = std::min(std::max(z - 1 + i, 0), _res[2] - 1);
+    }
+
+    float f = 0.f, gx = 0.f, gy = 0.f, gz = 0.f;
+    for(int k = 0; k < 4; ++k)
+    {
+        for(int j = 0; j < 4; ++j)
+        {
+            // Weights along x first, then the y and z factors
+            float fx = 0.f, dfx = 0.f;
+            for(int i = 0; i < 4; ++i)
+            {
+                const float v = _vals[4 * node_idx(ix[i], iy[j], iz[k])];
+                fx  += wx [i] * v;
+                dfx += dwx[i] * v;
+            }
+            f  += wy [j] * wz [k] * fx;
+            gx += wy [j] * wz [k] * dfx;
+            gy += dwy[j] * wz [k] * fx;
+            gz += wy [j] * dwz[k] * fx;
+        }
+    }
+    gf = Vec3(gx, gy, gz) * _inv_step;
+    return f;
+}
+
+// -----------------------------------------------------------------------------
+
+void Bone_grid::write(std::ostream& os) const
+{
+    const float header[7] = { _pmin.x, _pmin.y, _pmin.z, _pmax.x, _pmax.y, _pmax.z, _step };
+    os.write((const char*)_res, sizeof(_res));
+    os.write((const char*)header, sizeof(header));
+    if( !_vals.empty() )
+        os.write((const char*)&_vals[0], _vals.size() * sizeof(float));
+}
+
+// -----------------------------------------------------------------------------
+
+bool Bone_grid::read(std::istream& is)
+{
+    float header[7];
+    is.read((char*)_res, sizeof(_res));
+    is.read((char*)header, sizeof(header));
+    // bake() makes at least 2 nodes per axis, cell() relies on it. The values
+    // are indexed with int (node_idx()), reject sizes that would overflow it
+    bool valid = !is.fail() && header[6] > 0.f;
+    long long nb_vals = 4;
+    for(int i = 0; i < 3 && valid; ++i)
+    {
+        valid = _res[i] >= 2;
+        nb_vals *= _res[i];
+        valid = valid && nb_vals <= INT_MAX;
+    }
+    if( !valid ){
+        clear();
+        return false;
+    }
+
+    _pmin     = Vec3(header[0], header[1], header[2]);
+    _pmax     = Vec3(header[3], header[4], header[5]);
+    _step     = header[6];
+    _inv_step = 1.f / _step;
+    _vals.resize( (size_t)nb_vals );
+    is.read((char*)&_vals[0], _vals.size() * sizeof(float));
+    if( !is ){
+        clear();
+        return false;
+    }
+    return true;
+}
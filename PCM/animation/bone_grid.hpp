@@ -0,0 +1,103 @@
+#ifndef BONE_GRID_HPP__
+#define BONE_GRID_HPP__
+
+#include <vector>
+#include <iosfwd>
+#include <cmath>
+#include <algorithm>
+#include "toolbox/maths/vec3.hpp"
+
+/**
+  @class Bone_grid
+  @brief Potential and gradient of a bone baked on a regular grid
+
+  The grid lives in the bone's local frame (Bone_cu::get_frame() in rest
+  pose) so it follows the bone rigidly when the skeleton is animated and is
+  baked only once. Each node stores the potential and its gradient.
+
+  Lookup is either trilinear (potential and stored gradient interpolated) or
+  tricubic (Catmull-Rom over the 4x4x4 nearest nodes, the gradient is the
+  derivative of the interpolated potential). Queries outside the grid must be
+  answered by the caller, i.e. with the analytic field: see contains().
+*/
+class Bone_grid {
+public:
+    enum Interpolation {
+        TRILINEAR,
+        TRICUBIC
+    };
+
+    Bone_grid() : _step(0.f), _inv_step(0.f) { _res[0] = _res[1] = _res[2] = 0; }
+
+    /// Sample 'field' on the nodes pmin + (i, j, k) * step covering
+    /// [pmin, pmax]. Field must provide
+    /// float fngf(const Tbx::Vec3& p, Tbx::Vec3& gf) const
+    /// in local coordinates; it is called from several threads.
+    template<class Field>
+    void bake(const Field& field, const Tbx::Vec3& pmin, const Tbx::Vec3& pmax, float step);
+
+    void clear();
+
+    bool is_empty() const { return _vals.empty(); }
+
+    /// Is 'p' (local coordinates) inside the baked region
+    bool contains(const Tbx::Vec3& p) const {
+        return p.x >= _pmin.x && p.y >= _pmin.y && p.z >= _pmin.z &&
+               p.x <= _pmax.x && p.y <= _pmax.y && p.z <= _pmax.z;
+    }
+
+    /// Potential and gradient at 'p' (local coordinates, inside the grid)
+    float fngf(const Tbx::Vec3& p, Tbx::Vec3& gf, Interpolation interp) const;
+
+    /// Binary dump of the grid, read back with read()
+    void write(std::ostream& os) const;
+    bool read(std::istream& is);
+
+    /// Bytes used by the samples
+    size_t memory_size() const { return _vals.size() * sizeof(float); }
+
+private:
+    int node_idx(int x, int y, int z) const { return x + _res[0] * (y + _res[1] * z); }
+
+    float trilinear(const Tbx::Vec3& p, Tbx::Vec3& gf) const;
+    float tricubic (const Tbx::Vec3& p, Tbx::Vec3& gf) const;
+
+    Tbx::Vec3 _pmin;
+    Tbx::Vec3 _pmax;
+    float _step;
+    float _inv_step;
+    int   _res[3];              ///< number of nodes along x, y, z
+    std::vector<float> _vals;   ///< potential, gradient x, y, z per node
+};
+
+// -----------------------------------------------------------------------------
+
+template<class Field>
+void Bone_grid::bake(const Field& field, const Tbx::Vec3& pmin, const Tbx::Vec3& pmax, float step)
+{
+    _pmin     = pmin;
+    _step     = step;
+    _inv_step = 1.f / step;
+    _res[0] = std::max(2, (int)std::ceil((pmax.x - pmin.x) * _inv_step) + 1);
+    _res[1] = std::max(2, (int)std::ceil((pmax.y - pmin.y) * _inv_step) + 1);
+    _res[2] = std::max(2, (int)std::ceil((pmax.z - pmin.z) * _inv_step) + 1);
+    _pmax = pmin + Tbx::Vec3((float)(_res[0] - 1), (float)(_res[1] - 1), (float)(_res[2] - 1)) * step;
+    _vals.resize( 4 * _res[0] * _res[1] * _res[2] );
+
+    const int nb_slices = _res[2];
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int z = 0; z < nb_slices; ++z)
+        for(int y = 0; y < _res[1]; ++y)
+            for(int x = 0; x < _res[0]; ++x)
+            {
+                const Tbx::Vec3 p = _pmin + Tbx::Vec3((float)x, (float)y, (float)z) * step;
+                Tbx::Vec3 gf;
+                float* node = &_vals[4 * node_idx(x, y, z)];
+                node[0] = field.fngf(p, gf);
+                node[1] = gf.x;
+                node[2] = gf.y;
+                node[3] = gf.z;
+            }
+}
+
+#endif // BONE_GRID_HPP__
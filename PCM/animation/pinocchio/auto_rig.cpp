@@ -4,6 +4,7 @@
 #include <iostream>
 #include <limits>
 
+using namespace Tbx;
 
 #if 0
 // TODO: code in this #if to be deleted
@@ -137,73 +138,13 @@ void rig(const std::vector< Vec3             >& vertices,
 
 #else
 
-// -----------------------------------------------------------------------------
-
-/// Are angles obtuse between e0 and e1 (meaning a < PI/2)
-static bool check_obtuse(const Vec3& e0,
-                         const Vec3& e1)
-{
-    return e0.normalized().dot( e1.normalized() ) >= 0.f;
-}
-
-// -----------------------------------------------------------------------------
-
-/**
- * @brief Check if a triangle is obtuse (every angles < PI/2)
- * Here how edges must be defined :
-   @code
-      p0
-      |\
-      | \
-      |  \
-      |   \
-      |____\
-     p1     p2
-
-    Vec3 e0 = p1 - p0;
-    Vec3 e1 = p2 - p0;
-    Vec3 e2 = p2 - p1;
-   @endcode
- */
-static bool check_obtuse(const Vec3& e0,
-                         const Vec3& e1,
-                         const Vec3& e2)
-{
-    return check_obtuse(e0, e1) && check_obtuse(-e0, e2) && check_obtuse(-e1, -e2);
-}
-
-// -----------------------------------------------------------------------------
-
-static double mixed_voronoi_area(const Vec3& pi,
-                                 const Vec3& pj0,
-                                 const Vec3& pj1)
-{
-    double area = 0.;
-    Vec3 e0 = pj0 - pi ;
-    Vec3 e1 = pj1 - pi;
-    Vec3 e2 = pj1 - pj0;
-
-    if( check_obtuse(e0, e1, e2) )
-    {
-        area = (1/8.) * (double)(e0.norm_squared() * (-e0).cotan( e2) +
-                                 e1.norm_squared() * (-e1).cotan(-e2));
-    }
-    else
-    {
-        const double ta = (double)e0.cross( e1 ).norm() / 2.; // Tri area
-        area = ta / (check_obtuse(e0, e1) ? 2. : 4.);
-    }
-    return area;
-}
+#include <algorithm>
+#include <cassert>
 
-// -----------------------------------------------------------------------------
-
-#include <Eigen/LU>
-#include <Eigen/Dense>
 #include <Eigen/Sparse>
-#include <Eigen/Cholesky>
 #include <Eigen/SparseCholesky>
 
+#include "tri_bvh.hpp"
 
 typedef Eigen::Triplet<double, int> ETriplet;
 // declares a column-major sparse matrix type of double
@@ -212,288 +153,387 @@ using namespace Eigen;
 
 // -----------------------------------------------------------------------------
 
-void rig(const std::vector< Vec3             >& vertices,
-         const std::vector< std::vector<int>    >& edges,
-         const std::vector< std::vector<double> >& boneDists,
-         const std::vector< std::vector<bool>   >& boneVis,
-         std::vector<std::vector<std::pair<int, double> > >& nzweights,
-         double heat)
+/// Squared distance from 'p' to the segment [a b], 'proj' is the nearest point
+static float dist_sq_to_seg(const Vec3& p, const Vec3& a, const Vec3& b, Vec3& proj)
 {
-    bool state = false;
-    if(state)
-    {
-        std::cout << "COMPUTE HEAT DIFFUSION WITH MY LAPLACIAN" << std::endl;
-        // USING EIGEN AND MY LAPLACIAN ========================================
-        int i, j;
-        int nv       = vertices.size();
-        int nb_bones = boneDists[0].size();
+    const Vec3 ab = b - a;
+    const float len_sq = ab.dot( ab );
+    float t = len_sq > 0.f ? (p - a).dot( ab ) / len_sq : 0.f;
+    t = std::max(0.f, std::min(1.f, t));
+    proj = a + ab * t;
+    return (p - proj).norm_squared();
+}
 
-        // laplacian matrix
-        MatrixXd L = MatrixXd::Constant(nv, nv, 0.);
-        std::vector<double> D(nv, 0.), H(nv, 0.);
+// -----------------------------------------------------------------------------
 
-        std::vector<int> closest(nv, -1); // closest bone from the ith vertex
-        for(i = 0; i < nv; ++i)
+void bone_candidates(const std::vector< Vec3 >& vertices,
+                     const std::vector<int>& tris,
+                     const std::vector< Vec3 >& bone_org,
+                     const std::vector< Vec3 >& bone_end,
+                     const std::vector<bool>& deform,
+                     Bone_candidates& cand)
+{
+    const int nv       = (int)vertices.size();
+    const int nb_bones = (int)bone_org.size();
+
+    cand._nb_bones = nb_bones;
+    cand._closest.assign(nv, -1);
+    cand._closest_dist.assign(nv, std::numeric_limits<float>::infinity());
+    cand._offsets.assign(nv + 1, 0);
+    cand._bones.clear();
+
+    // Nearest bones: bones equaly distant (within 'minDist * 1.0001') are all
+    // candidates, the others can't receive heat from the vertex
+    std::vector<int> band(nv, 0);
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < nv; ++i)
+    {
+        Vec3 proj;
+        float min_sq = std::numeric_limits<float>::infinity();
+        for(int j = 0; j < nb_bones; ++j)
         {
-            Vec3 cPos = vertices[i];
-
-            //get bones
-            double minDist = std::numeric_limits<float>::infinity();
-            for(j = 0; j < nb_bones; ++j) {
-                if(boneDists[i][j] < minDist) {
-                    closest[i] = j;
-                    minDist = boneDists[i][j];
-                }
+            if( !deform[j] ) continue;
+            const float d = dist_sq_to_seg(vertices[i], bone_org[j], bone_end[j], proj);
+            if( d < min_sq ){
+                min_sq = d;
+                cand._closest[i] = j;
             }
+        }
+        if( cand._closest[i] < 0 ) continue;
 
-            // Bones equaly distant from vertex i are factored in H
-            for(j = 0; j < nb_bones; ++j)
-            {
-                if(boneVis[i][j] && boneDists[i][j] <= minDist * 1.00001)
-                {
-                    double dist = 1e-8 + boneDists[i][closest[i]];
-                    H[i] += heat / (dist * dist);
-                }
-            }
+        cand._closest_dist[i] = std::sqrt( min_sq );
+        const float max_dist = cand._closest_dist[i] * 1.0001f;
+        for(int j = 0; j < nb_bones; ++j)
+            if( deform[j] && std::sqrt(dist_sq_to_seg(vertices[i], bone_org[j], bone_end[j], proj)) <= max_dist )
+                band[i]++;
+    }
 
-            //get areas
-            for(j = 0; j < (int)edges[i].size(); ++j)
-            {
-                int nj = (j + 1) % edges[i].size();
-
-                #if 1
-                Vec3 p0 = vertices[edges[i][j] ];
-                Vec3 p1 = vertices[edges[i][nj]];
-                D[i] += mixed_voronoi_area(cPos, p0, p1 );
-                #else
-                Vec3 edge0 = vertices[edges[i][j] ] - cPos;
-                Vec3 edge1 = vertices[edges[i][nj]] - cPos;
-                D[i] += (edge0.cross(edge1)).norm() / 2.f;
-                #endif
-            }
-            D[i] = 1. / ((1e-10 + D[i]) * 2.f);
+    std::vector<int> seg_offset(nv + 1, 0);
+    for(int i = 0; i < nv; ++i)
+        seg_offset[i + 1] = seg_offset[i] + band[i];
 
-            //get laplacian
-            double sum = 0.;
-            for(j = 0; j < (int)edges[i].size(); ++j)
-            {
-                int nj = (j + 1) % edges[i].size();
-                int pj = (j + edges[i].size() - 1) % edges[i].size();
+    // Line of sight from the vertex to its projection on each nearest bone
+    std::vector<Tri_bvh::Segment> segs( seg_offset[nv] );
+    std::vector<int> seg_bone( seg_offset[nv] );
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < nv; ++i)
+    {
+        if( band[i] == 0 ) continue;
+        const float max_dist = cand._closest_dist[i] * 1.0001f;
+        int s = seg_offset[i];
+        for(int j = 0; j < nb_bones; ++j)
+        {
+            Vec3 proj;
+            if( !deform[j] || std::sqrt(dist_sq_to_seg(vertices[i], bone_org[j], bone_end[j], proj)) > max_dist )
+                continue;
+            segs[s].p0 = vertices[i];
+            segs[s].p1 = proj;
+            segs[s].ignore_vert = i;
+            seg_bone[s] = j;
+            s++;
+        }
+    }
 
-                Vec3 v1 = cPos                  - vertices[edges[i][pj]];
-                Vec3 v2 = vertices[edges[i][j]] - vertices[edges[i][pj]];
-                Vec3 v3 = cPos                  - vertices[edges[i][nj]];
-                Vec3 v4 = vertices[edges[i][j]] - vertices[edges[i][nj]];
+    std::vector<char> hits;
+    Tri_bvh bvh(vertices, tris);
+    bvh.occluded(segs, hits);
 
-                double cotan1 = (v1.dot(v2)) / (1e-6 + (v1.cross(v2)).norm() );
-                double cotan2 = (v3.dot(v4)) / (1e-6 + (v3.cross(v4)).norm() );
+    for(int i = 0; i < nv; ++i)
+    {
+        for(int s = seg_offset[i]; s < seg_offset[i + 1]; ++s)
+            if( !hits[s] ) cand._bones.push_back( seg_bone[s] );
+        cand._offsets[i + 1] = (int)cand._bones.size();
+    }
+}
 
-                double w = (cotan1 + cotan2) * D[i];
-                sum += w;
+// -----------------------------------------------------------------------------
 
-                L(i, edges[i][j]) = w;
+/// Candidates from the dense distances and visibility of the original
+/// Pinocchio interface
+static void dense_candidates(const std::vector< std::vector<double> >& boneDists,
+                             const std::vector< std::vector<bool>   >& boneVis,
+                             Bone_candidates& cand)
+{
+    const int nv       = (int)boneDists.size();
+    const int nb_bones = nv > 0 ? (int)boneDists[0].size() : 0;
+
+    cand._nb_bones = nb_bones;
+    cand._closest.assign(nv, -1);
+    cand._closest_dist.assign(nv, std::numeric_limits<float>::infinity());
+    cand._offsets.assign(nv + 1, 0);
+    cand._bones.clear();
+    for(int i = 0; i < nv; ++i)
+    {
+        double minDist = std::numeric_limits<double>::infinity();
+        for(int j = 0; j < nb_bones; ++j) {
+            if(boneDists[i][j] < minDist) {
+                cand._closest[i] = j;
+                minDist = boneDists[i][j];
             }
+        }
 
-            L(i,i) = -sum;
+        if( cand._closest[i] >= 0 )
+        {
+            cand._closest_dist[i] = (float)minDist;
+            // Bones equaly distant from vertex i are factored in
+            for(int j = 0; j < nb_bones; ++j)
+                if(boneVis[i][j] && boneDists[i][j] <= minDist * 1.00001)
+                    cand._bones.push_back( j );
         }
+        cand._offsets[i + 1] = (int)cand._bones.size();
+    }
+}
 
-        L *= -1.;
-        for(i = 0; i < nv; ++i)
-            L(i,i) += H[i];
+// -----------------------------------------------------------------------------
 
-        ColPivHouseholderQR<MatrixXd> llt;
-        //FullPivLU<MatrixXd> llt;
-        llt.compute( L );
+/**
+ * @brief Solve the heat equilibrium for every bone
+ *
+ * We have -Lw+Hw=HI, same as (H-L)w=HI, with (H-L)=DA (with D=diag(1./area))
+ * so w = A^-1 * HI * D^-1
+ *
+ * The symmetric matrix A (cotan laplacian plus the H term) is assembled as a
+ * sparse matrix and factored once (LDLt with a fill reducing ordering), each
+ * bone is then a back substitution. Bones are solved in parallel.
+ *
+ * @param bone_weights for each bone list of (vertex, weight) with weights
+ * above 1e-3, vertices sorted. Weights are not normalized.
+ * @return false if the factorization failed
+ */
+static bool heat_diffusion(const std::vector< Vec3             >& vertices,
+                           const std::vector< std::vector<int>    >& edges,
+                           const Bone_candidates& cand,
+                           double heat,
+                           std::vector< std::vector<std::pair<int, double> > >& bone_weights)
+{
+    const int nv       = (int)vertices.size();
+    const int nb_bones = cand._nb_bones;
 
-        nzweights.resize(nv);
-        for(j = 0; j < nb_bones; ++j)
-        {
-            VectorXd rhs = VectorXd::Constant(nv, 0.);
+    bone_weights.assign(nb_bones, std::vector<std::pair<int, double> >());
+    if( nv == 0 ) return true;
 
-            for(i = 0; i < nv; ++i)
-            {
-                if(boneVis[i][j] && boneDists[i][j] <= boneDists[i][closest[i]] * 1.00001)
-                    rhs(i) = H[i];
-            }
+    // Lower part of A, row i only depends on the first ring of i so the rows
+    // are filled in parallel at their offset in 'triplets'
+    std::vector<int> row_offset(nv + 1, 0);
+    for(int i = 0; i < nv; ++i)
+    {
+        int nb = 1; // diagonal
+        for(unsigned j = 0; j < edges[i].size(); ++j)
+            if( edges[i][j] <= i ) nb++;
+        row_offset[i + 1] = row_offset[i] + nb;
+    }
 
-            VectorXd res = llt.solve( rhs );
+    std::cout << "Trying to allocate: "
+              << (float)(row_offset[nv]*sizeof(ETriplet)) / 1024.f / 1024.f
+              << "Mb. To compute the heat diffusion"
+              << std::endl;
 
-            for(i = 0; i < nv; ++i)
-            {
-                if(res(i) > 1.)   res(i) = 1.; //clip just in case
+    std::vector<ETriplet> triplets( row_offset[nv] );
+    std::vector<double> D(nv, 0.), H(nv, 0.);
 
-                if(res(i) > 1e-3) nzweights[i].push_back(std::make_pair(j, res(i)));
-            }
-        }
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < nv; ++i)
+    {
+        const Vec3 cPos = vertices[i];
+        const int  nb_edges = (int)edges[i].size();
+        int j;
 
-        for(i = 0; i < nv; ++i)
+        //get areas
+        for(j = 0; j < nb_edges; ++j)
         {
-            double sum = 0.;
-            for(j = 0; j < (int)nzweights[i].size(); ++j)
-                sum += nzweights[i][j].second;
+            int nj = (j + 1) % nb_edges;
 
-            for(j = 0; j < (int)nzweights[i].size(); ++j)
-                nzweights[i][j].second /= sum;
+            Vec3 edge0 = vertices[edges[i][j] ] - cPos;
+            Vec3 edge1 = vertices[edges[i][nj]] - cPos;
+
+            D[i] += (edge0.cross(edge1)).norm();
         }
+        D[i] = 1. / (1e-10 + D[i]);
 
-        return;
-    }
-    else
-    {
-        // USING EIGEN AND ORIGINAL LAPLACIAN ==================================
-        int i, j;
-        int nv       = vertices.size();
-        int nb_bones = boneDists[0].size();
-
-        //We have -Lw+Hw=HI, same as (H-L)w=HI, with (H-L)=DA (with D=diag(1./area))
-        //so w = A^-1 * HI * D^-1
-        std::vector<std::vector<std::pair<int, double> > > A(nv);
-        std::vector<double> D(nv, 0.), H(nv, 0.);
-        std::vector<int> closest(nv, -1);
-        int acc = 0;
-        for(i = 0; i < nv; ++i)
+        // Nearest visible bones are factored in H
+        const int nb_cand = cand.nb_candidates(i);
+        if( nb_cand > 0 )
         {
-            Vec3 cPos = vertices[i];
-            //get areas
-            for(j = 0; j < (int)edges[i].size(); ++j)
-            {
-                int nj = (j + 1) % edges[i].size();
-
-                Vec3 edge0 = vertices[edges[i][j] ] - cPos;
-                Vec3 edge1 = vertices[edges[i][nj]] - cPos;
-
-                D[i] += (edge0.cross(edge1)).norm();
-            }
-            D[i] = 1. / (1e-10 + D[i]);
+            double dist = 1e-8 + cand._closest_dist[i];
+            H[i] = nb_cand * heat / (dist * dist);
+        }
 
+        // get laplacian
+        int t = row_offset[i];
+        double sum = 0.;
+        for(j = 0; j < nb_edges; ++j) {
+            int nj = (j + 1) % nb_edges;
+            int pj = (j + nb_edges - 1) % nb_edges;
 
-            //get bones
-            double minDist = std::numeric_limits<float>::infinity();
-            for(j = 0; j < nb_bones; ++j) {
-                if(boneDists[i][j] < minDist) {
-                    closest[i] = j;
-                    minDist = boneDists[i][j];
-                }
-            }
+            Vec3 v1 = cPos                  - vertices[edges[i][pj]];
+            Vec3 v2 = vertices[edges[i][j]] - vertices[edges[i][pj]];
+            Vec3 v3 = cPos                  - vertices[edges[i][nj]];
+            Vec3 v4 = vertices[edges[i][j]] - vertices[edges[i][nj]];
 
-            // Bones equaly distant from vertex i are factored in H
-            for(j = 0; j < nb_bones; ++j)
-            {
-                if(boneVis[i][j] && boneDists[i][j] <= minDist * 1.00001)
-                {
-                    double dist = 1e-8 + boneDists[i][closest[i]];
-                    H[i] += heat / (dist * dist);
-                }
-            }
+            double cot1 = (v1.dot(v2)) / (1e-6 + (v1.cross(v2)).norm() );
+            double cot2 = (v3.dot(v4)) / (1e-6 + (v3.cross(v4)).norm() );
 
-            // get laplacian
-            double sum = 0.;
-            for(j = 0; j < (int)edges[i].size(); ++j) {
-                int nj = (j + 1) % edges[i].size();
-                int pj = (j + edges[i].size() - 1) % edges[i].size();
+            sum += (cot1 + cot2);
 
-                Vec3 v1 = cPos                  - vertices[edges[i][pj]];
-                Vec3 v2 = vertices[edges[i][j]] - vertices[edges[i][pj]];
-                Vec3 v3 = cPos                  - vertices[edges[i][nj]];
-                Vec3 v4 = vertices[edges[i][j]] - vertices[edges[i][nj]];
+            //check for triangular here because sum should be computed regardless
+            if(edges[i][j] > i) continue;
 
-                double cot1 = (v1.dot(v2)) / (1e-6 + (v1.cross(v2)).norm() );
-                double cot2 = (v3.dot(v4)) / (1e-6 + (v3.cross(v4)).norm() );
+            assert(edges[i][j] < nv);
+            triplets[t++] = ETriplet(i, edges[i][j], -cot1 - cot2);
+        }
+        triplets[t++] = ETriplet(i, i, sum + H[i] / D[i]);
+        assert(t == row_offset[i + 1]);
+    }
 
-                sum += (cot1 + cot2);
+    SpMat A(nv, nv);
+    A.setFromTriplets(triplets.begin(), triplets.end());
+    std::vector<ETriplet>().swap( triplets );
 
-                //check for triangular here because sum should be computed regardless
-                if(edges[i][j] > i) continue;
+    SimplicialLDLT<SpMat, Lower> ldlt;
+    ldlt.compute( A );
+    if( ldlt.info() != Success )
+    {
+        std::cerr << "ERROR: heat diffusion, factorization failed" << std::endl;
+        return false;
+    }
 
-                assert(edges[i][j] < nv);
-                A[i].push_back(std::make_pair(edges[i][j], -cot1 - cot2));
-                acc++;
-            }
+    // Right hand sides: only the vertices for which the bone is a candidate
+    // are non zero. Leaves and bones that don't deform have none and are not
+    // solved.
+    std::vector< std::vector<int> > sources(nb_bones);
+    for(int i = 0; i < nv; ++i)
+        for(int k = cand._offsets[i]; k < cand._offsets[i + 1]; ++k)
+            sources[ cand._bones[k] ].push_back( i );
 
-            A[i].push_back( std::make_pair(i, sum + H[i] / D[i]) );
-            acc++;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int j = 0; j < nb_bones; ++j)
+    {
+        if( sources[j].size() == 0 ) continue;
 
-            std::sort(A[i].begin(), A[i].end());
+        VectorXd rhs = VectorXd::Constant(nv, 0.);
+        for(unsigned s = 0; s < sources[j].size(); ++s)
+        {
+            const int i = sources[j][s];
+            rhs(i) = H[i] / D[i];
         }
-        nzweights.resize(nv);
-
 
-#if 0
-        // Solving with plain matrix (slower but more robust)
-        MatrixXd L = MatrixXd::Constant(nv, nv, 0.);
-        for(int u = 0; u < nv; ++u) {
-            for(unsigned v = 0; v < A[u].size(); ++v) {
-                L(u, A[u][v].first) = A[u][v].second;
-                if(A[u][v].first != u)
-                    L(A[u][v].first, u) = A[u][v].second;
-            }
-        }
+        const VectorXd res = ldlt.solve( rhs );
 
-        //LLT<MatrixXd, Lower> llt;
-        ColPivHouseholderQR<MatrixXd> llt;
-        llt.compute( L );
-#else
-        // Faster solving with sparse matrix:
-        std::cout << "Trying to allocate: "
-                  << (float)(acc*sizeof(ETriplet)) / 1024.f / 1024.f
-                  << "Mb. To compute the heat diffusion"
-                  << std::endl;
-
-        std::vector<ETriplet> tripletList;
-        tripletList.resize( acc );
+        std::vector<std::pair<int, double> >& w = bone_weights[j];
+        for(int i = 0; i < nv; ++i)
         {
-            int acc = 0;
-            for(int u = 0; u < nv; ++u) {
-                for(unsigned v = 0; v < A[u].size(); ++v) {
-                    tripletList[acc] = ETriplet(u, A[u][v].first, A[u][v].second);
-                    acc++;
-                }
-            }
+            if(res(i) > 1e-3)
+                w.push_back( std::make_pair(i, std::min(res(i), 1.)) ); //clip just in case
         }
-        SpMat L(nv, nv);
-        L.setFromTriplets(tripletList.begin(), tripletList.end());
+    }
+    return true;
+}
 
-        SimplicialLLT<SpMat, Lower> llt;
-        llt.compute( L );
-#endif
+// -----------------------------------------------------------------------------
 
-        for(j = 0; j < nb_bones; ++j)
-        {
-            VectorXd rhs = VectorXd::Constant(nv, 0.);
+void rig(const std::vector< Vec3             >& vertices,
+         const std::vector< std::vector<int>    >& edges,
+         const std::vector< std::vector<double> >& boneDists,
+         const std::vector< std::vector<bool>   >& boneVis,
+         std::vector<std::vector<std::pair<int, double> > >& nzweights,
+         double heat)
+{
+    std::vector<int> jpv, joints;
+    std::vector<float> weights;
+    rig(vertices, edges, boneDists, boneVis, jpv, joints, weights, heat);
+
+    const int nv = (int)vertices.size();
+    nzweights.assign(nv, std::vector<std::pair<int, double> >());
+    for(int i = 0; i < nv; ++i)
+        for(int k = jpv[i*2]; k < (jpv[i*2] + jpv[i*2 + 1]); ++k)
+            nzweights[i].push_back( std::make_pair(joints[k], (double)weights[k]) );
+}
 
-            for(i = 0; i < nv; ++i)
-            {
-                if(boneVis[i][j] && boneDists[i][j] <= boneDists[i][closest[i]] * 1.00001)
-                {
-                    rhs(i) = H[i] / D[i];
-                }
-            }
+// -----------------------------------------------------------------------------
 
-            VectorXd res = llt.solve( rhs );
+void rig(const std::vector< Vec3             >& vertices,
+         const std::vector< std::vector<int>    >& edges,
+         const std::vector< std::vector<double> >& boneDists,
+         const std::vector< std::vector<bool>   >& boneVis,
+         std::vector<int>& jpv,
+         std::vector<int>& joints,
+         std::vector<float>& weights,
+         double heat)
+{
+    Bone_candidates cand;
+    dense_candidates(boneDists, boneVis, cand);
+    rig(vertices, edges, cand, jpv, joints, weights, heat);
+}
 
-            for(i = 0; i < nv; ++i)
-            {
-                if(res(i) > 1.) res(i) = 1.; //clip just in case
+// -----------------------------------------------------------------------------
 
-                if(res(i) > 1e-3)
-                    nzweights[i].push_back(std::make_pair(j, res(i)));
-            }
-        }
+void rig(const std::vector< Vec3             >& vertices,
+         const std::vector< std::vector<int>    >& edges,
+         const Bone_candidates& cand,
+         std::vector<int>& jpv,
+         std::vector<int>& joints,
+         std::vector<float>& weights,
+         double heat)
+{
+    const int nv = (int)vertices.size();
+    const std::vector<int>& closest = cand._closest;
+    std::vector< std::vector<std::pair<int, double> > > bone_weights;
+    if( !heat_diffusion(vertices, edges, cand, heat, bone_weights) )
+        bone_weights.assign(bone_weights.size(), std::vector<std::pair<int, double> >());
+
+    const int nb_bones = (int)bone_weights.size();
+
+    // Vertices left without weights are bound to their nearest bone
+    std::vector<int> count(nv, 0);
+    for(int j = 0; j < nb_bones; ++j)
+        for(unsigned k = 0; k < bone_weights[j].size(); ++k)
+            count[ bone_weights[j][k].first ]++;
+
+    jpv.resize(2 * nv);
+    int acc = 0;
+    for(int i = 0; i < nv; ++i)
+    {
+        const int size = (count[i] == 0 && closest[i] >= 0) ? 1 : count[i];
+        jpv[i*2    ] = acc;  // starting index
+        jpv[i*2 + 1] = size; // number of bones influencing the vertex
+        acc += size;
+    }
 
-        for(i = 0; i < nv; ++i)
+    // Bones are visited in order so each vertex gets its joints sorted
+    joints. resize( acc );
+    weights.resize( acc );
+    std::fill(count.begin(), count.end(), 0);
+    for(int j = 0; j < nb_bones; ++j)
+    {
+        for(unsigned k = 0; k < bone_weights[j].size(); ++k)
         {
-            double sum = 0.;
-            for(j = 0; j < (int)nzweights[i].size(); ++j)
-                sum += nzweights[i][j].second;
-
-            for(j = 0; j < (int)nzweights[i].size(); ++j)
-                nzweights[i][j].second /= sum;
+            const int i = bone_weights[j][k].first;
+            const int idx = jpv[i*2] + count[i]++;
+            joints [idx] = j;
+            weights[idx] = (float)bone_weights[j][k].second;
         }
-        return;
     }
-}
 
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < nv; ++i)
+    {
+        const int dep = jpv[i*2], size = jpv[i*2 + 1];
+        if( count[i] == 0 )
+        {
+            if( size == 1 ){
+                joints [dep] = closest[i];
+                weights[dep] = 1.f;
+            }
+            continue;
+        }
 
-#endif
+        double sum = 0.;
+        for(int k = dep; k < (dep + size); ++k)
+            sum += weights[k];
 
+        for(int k = dep; k < (dep + size); ++k)
+            weights[k] = (float)(weights[k] / sum);
+    }
+}
 
+#endif
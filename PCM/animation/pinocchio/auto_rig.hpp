@@ -4,6 +4,23 @@
 #include <vector>
 #include "toolbox/maths/vec3.hpp"
 
+/// Bones receiving the heat of each vertex
+struct Bone_candidates {
+    Bone_candidates() : _nb_bones(0) { }
+
+    int nb_candidates(int vert) const { return _offsets[vert + 1] - _offsets[vert]; }
+
+    int _nb_bones;
+    std::vector<int>   _closest;      ///< nearest bone per vertex (-1 if none)
+    std::vector<float> _closest_dist; ///< distance to the nearest bone
+    /// Candidates of the ith vertex are _bones[k] with k in
+    /// [_offsets[i], _offsets[i+1])
+    std::vector<int>   _offsets;
+    std::vector<int>   _bones;
+};
+
+// -----------------------------------------------------------------------------
+
 /**
   Automatic SSD weight computation from :
   @code
@@ -24,15 +41,63 @@
   }
   @endcode
 
+  Only the nearest bones of a vertex (bones equaly distant are all kept) that
+  can be seen from it receive its heat. They are listed per vertex in a
+  Bone_candidates, computed with bone_candidates() from the mesh triangles:
+  the line of sight from the vertex to its projection on each bone is tested
+  against a triangle BVH. The original interface with dense nv x nb_bones
+  distances and visibility is still available.
 
+  The cotan laplacian plus the heat term is assembled as a sparse matrix and
+  factored once with a sparse Cholesky (LDLt), bones are then solved in
+  parallel as back substitutions. Memory is linear in the number of vertices.
 
+  @param edges first ring of each vertex, ordered around the vertex
+  @param boneDists distance from each vertex to each bone (infinity for bones
+  that must not influence the mesh)
+  @param boneVis wether a bone is visible from a vertex
+  @param nzweights for each vertex the list of (bone, weight), weights sum to 1
 */
-void rig(const std::vector< Vec3             >& vertices,
+void rig(const std::vector< Tbx::Vec3           >& vertices,
          const std::vector< std::vector<int>    >& edges,
          const std::vector< std::vector<double> >& boneDists,
          const std::vector< std::vector<bool>   >& boneVis,
          std::vector<std::vector<std::pair<int, double> > >& nzweights,
          double heat);
 
+/// Same as above but weights are packed as Animesh stores them: the
+/// weights of the ith vertex are joints[k] and weights[k] with k in
+/// [jpv[i*2], jpv[i*2] + jpv[i*2+1]). Vertices with no weights are bound to
+/// their nearest bone.
+void rig(const std::vector< Tbx::Vec3           >& vertices,
+         const std::vector< std::vector<int>    >& edges,
+         const std::vector< std::vector<double> >& boneDists,
+         const std::vector< std::vector<bool>   >& boneVis,
+         std::vector<int>& jpv,
+         std::vector<int>& joints,
+         std::vector<float>& weights,
+         double heat);
+
+/// Same as above with the compact list of candidate bones per vertex
+void rig(const std::vector< Tbx::Vec3           >& vertices,
+         const std::vector< std::vector<int>    >& edges,
+         const Bone_candidates& cand,
+         std::vector<int>& jpv,
+         std::vector<int>& joints,
+         std::vector<float>& weights,
+         double heat);
+
+/// Find the nearest bones of each vertex and keep those visible from the
+/// vertex. Queries are batched through a triangle BVH and run in parallel.
+/// @param tris mesh triangles, three vertex indices per triangle
+/// @param bone_org, bone_end segment of each bone
+/// @param deform bones with 'false' never influence the mesh (i.e leaves)
+void bone_candidates(const std::vector< Tbx::Vec3 >& vertices,
+                     const std::vector<int>& tris,
+                     const std::vector< Tbx::Vec3 >& bone_org,
+                     const std::vector< Tbx::Vec3 >& bone_end,
+                     const std::vector<bool>& deform,
+                     Bone_candidates& cand);
+
 
 #endif // AUTO_RIG_HPP__
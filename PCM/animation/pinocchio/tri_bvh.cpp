@@ -0,0 +1,107 @@
+#include "tri_bvh.hpp"
+
+#include <cmath>
+
+using namespace Tbx;
+
+// -----------------------------------------------------------------------------
+
+void Tri_bvh::build(const std::vector<Vec3>& verts, const std::vector<int>& tris)
+{
+    _verts = verts;
+    _faces = tris;
+
+    const int nb_tris = (int)tris.size() / 3;
+    std::vector<BVHBox> boxes( nb_tris );
+    std::vector<float>  centroids( 3 * nb_tris );
+    for(int t = 0; t < nb_tris; ++t)
+    {
+        boxes[t].reset();
+        for(int k = 0; k < 3; ++k)
+        {
+            const Vec3& v = verts[tris[t*3 + k]];
+            const float p[3] = { v.x, v.y, v.z };
+            boxes[t].expand( p );
+        }
+        for(int a = 0; a < 3; ++a)
+            centroids[3*t + a] = 0.5f * (boxes[t].bmin[a] + boxes[t].bmax[a]);
+    }
+    build_bvh(boxes, centroids, _tris, _nodes);
+}
+
+// -----------------------------------------------------------------------------
+
+/// Moller-Trumbore, hit strictly inside the segment
+static bool hit_tri(const Vec3& org, const Vec3& dir,
+                    const Vec3& a, const Vec3& b, const Vec3& c)
+{
+    const float eps = 1e-7f;
+    const Vec3 e1 = b - a;
+    const Vec3 e2 = c - a;
+    const Vec3 p  = dir.cross( e2 );
+    const float det = e1.dot( p );
+    if( std::fabs(det) < eps * e1.norm() * e2.norm() * dir.norm() ) return false;
+
+    const float inv_det = 1.f / det;
+    const Vec3 s = org - a;
+    const float u = s.dot( p ) * inv_det;
+    if( u < 0.f || u > 1.f ) return false;
+
+    const Vec3 q = s.cross( e1 );
+    const float v = dir.dot( q ) * inv_det;
+    if( v < 0.f || (u + v) > 1.f ) return false;
+
+    const float t = e2.dot( q ) * inv_det;
+    return t > 1e-5f && t < (1.f - 1e-5f);
+}
+
+// -----------------------------------------------------------------------------
+
+bool Tri_bvh::occluded(const Vec3& p0, const Vec3& p1, int ignore_vert) const
+{
+    if( _nodes.empty() ) return false;
+
+    const Vec3 dir = p1 - p0;
+    const float org[3] = { p0.x, p0.y, p0.z };
+    const float inv_dir[3] = { 1.f / dir.x, 1.f / dir.y, 1.f / dir.z };
+
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while( top > 0 )
+    {
+        const int idx = stack[--top];
+        const BVHNode& n = _nodes[idx];
+        // segment p0 + t * dir, t in [0 1]
+        if( bvh_slab(n, org, inv_dir, 1.f) == FLT_MAX ) continue;
+
+        if( n.is_leaf() )
+        {
+            for(int i = n.offset; i < (n.offset + n.count); ++i)
+            {
+                const int* f = &(_faces[_tris[i] * 3]);
+                if( f[0] == ignore_vert || f[1] == ignore_vert || f[2] == ignore_vert )
+                    continue;
+                if( hit_tri(p0, dir, _verts[f[0]], _verts[f[1]], _verts[f[2]]) )
+                    return true;
+            }
+        }
+        else
+        {
+            stack[top++] = n.offset;
+            stack[top++] = idx + 1;
+        }
+    }
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+
+void Tri_bvh::occluded(const std::vector<Segment>& segs, std::vector<char>& hits) const
+{
+    const int nb_segs = (int)segs.size();
+    hits.resize( nb_segs );
+    #pragma omp parallel for schedule(dynamic, 256)
+    for(int i = 0; i < nb_segs; ++i)
+        hits[i] = occluded(segs[i].p0, segs[i].p1, segs[i].ignore_vert) ? 1 : 0;
+}
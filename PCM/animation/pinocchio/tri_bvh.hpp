@@ -0,0 +1,48 @@
+#ifndef TRI_BVH_HPP__
+#define TRI_BVH_HPP__
+
+#include <vector>
+#include "toolbox/maths/vec3.hpp"
+#include "flat_bvh.h"
+
+/**
+  @class Tri_bvh
+  @brief Bounding volume hierarchy over the triangles of a mesh to answer
+  segment occlusion queries (Pinocchio's visibility tester)
+
+  The tree is the flat SAH BVH of the ray caster (build_bvh() in
+  flat_bvh.h), leaves hold 'count' triangles starting at 'offset' in '_tris'.
+*/
+class Tri_bvh {
+public:
+    /// Segment [p0 p1] for occluded()
+    struct Segment {
+        Tbx::Vec3 p0, p1;
+        int ignore_vert; ///< triangles of this vertex are ignored (-1: none)
+    };
+
+    Tri_bvh() { }
+
+    /// @param tris vertex indices, three per triangle
+    Tri_bvh(const std::vector<Tbx::Vec3>& verts, const std::vector<int>& tris)
+    { build(verts, tris); }
+
+    void build(const std::vector<Tbx::Vec3>& verts, const std::vector<int>& tris);
+
+    /// @return true if a triangle crosses the segment [p0 p1]. Triangles
+    /// sharing the vertex 'ignore_vert' are skipped, use it when p0 lies on
+    /// the mesh.
+    bool occluded(const Tbx::Vec3& p0, const Tbx::Vec3& p1, int ignore_vert = -1) const;
+
+    /// Batch version, segments are spread over the threads.
+    /// hits[i] is set to 1 if segs[i] is occluded.
+    void occluded(const std::vector<Segment>& segs, std::vector<char>& hits) const;
+
+private:
+    std::vector<BVHNode>   _nodes;
+    std::vector<int>       _tris;  ///< triangle indices in leaf order
+    std::vector<Tbx::Vec3> _verts;
+    std::vector<int>       _faces; ///< three vertex indices per triangle
+};
+
+#endif // TRI_BVH_HPP__
@@ -367,8 +367,7 @@ void Skeleton::set_bone_radius(int i, float radius)
 
 void Skeleton::set_bone_hrbf_radius(int i, float radius)
 {
-	cout<<"set_bone_hrbf_radius"<<endl;
-	//_hrbf_radius[i] = radius;
+	_hrbf_radius[i] = radius;
 
 	//if(bone_type(i) == EBone::HRBF)
 	//{
@@ -391,7 +390,7 @@ void Skeleton::set_bone_hrbf_radius(int i, float radius)
 
 // -----------------------------------------------------------------------------
 
-float Skeleton::get_hrbf_radius(EBone::Id bone_id)
+float Skeleton::get_hrbf_radius(EBone::Id bone_id) const
 {
     return _hrbf_radius[bone_id];
 }
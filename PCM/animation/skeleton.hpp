@@ -303,7 +303,7 @@ struct Skeleton {
   /// if the bone is not an HRBF
   int get_hrbf_id(EBone::Id bone_id) const;
 
-  float get_hrbf_radius(EBone::Id bone_id);
+  float get_hrbf_radius(EBone::Id bone_id) const;
 
   /// Skeleton kinematic handler.
   /// Animate the skeleton through this interface
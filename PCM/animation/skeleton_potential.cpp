@@ -0,0 +1,270 @@
+#include "skeleton_potential.hpp"
+
+#include "skeleton.hpp"
+#include <algorithm>
+#include <fstream>
+
+using namespace Tbx;
+
+/// Analytic field of a bone expressed in its rest frame, sampled by bake()
+struct Skeleton_potential::Local_field {
+    Local_field(const Prim& p, const Transfo& frame) :
+        prim(p),
+        to_world(frame),
+        to_local(frame.fast_invert().get_mat3())
+    { }
+
+    float fngf(const Vec3& p, Vec3& gf) const {
+        Vec3 g;
+        const float f = prim_fngf(prim, (to_world * p.to_point3()).to_vec3(), g);
+        gf = to_local * g;
+        return f;
+    }
+
+    Prim    prim;
+    Transfo to_world;
+    Mat3    to_local;
+};
+
+// -----------------------------------------------------------------------------
+
+static bool same_bone(const Vec3& org0, const Vec3& dir0, float rad0,
+                      const Vec3& org1, const Vec3& dir1, float rad1)
+{
+    const float eps = 1e-4f * std::max(1.f, rad0);
+    return (org0 - org1).norm() <= eps &&
+           (dir0 - dir1).norm() <= eps &&
+           std::abs(rad0 - rad1) <= eps;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Skeleton_potential::rest_prim(const Skeleton& skel,
+                                   const std::vector<bool>& do_bone_deform,
+                                   int i,
+                                   Prim& p,
+                                   Grid_key& key) const
+{
+    if( skel.is_leaf(i) ) return false;
+    if( i < (int)do_bone_deform.size() && !do_bone_deform[i] ) return false;
+
+    const Bone_cu b = skel.get_bone_rest_pose(i);
+    const float len = b.length();
+    const float rad = skel.get_hrbf_radius(i) * _support_scale;
+    if( len <= 1e-6f || rad <= 0.f ) return false;
+
+    p.org        = b.org().to_vec3();
+    p.dir        = b.dir();
+    p.inv_len_sq = 1.f / (len * len);
+    p.rad_sq     = rad * rad;
+    p.inv_rad_sq = 1.f / p.rad_sq;
+    p.grid       = 0;
+
+    key.org = p.org;
+    key.dir = p.dir;
+    key.rad = rad;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Skeleton_potential::update(const Skeleton& skel,
+                                const std::vector<bool>& do_bone_deform,
+                                bool rest_pose)
+{
+    _prims.clear();
+    _prims.reserve( skel.nb_joints() );
+    for(int i = 0; i < skel.nb_joints(); ++i)
+    {
+        Prim p;
+        Grid_key key;
+        if( !rest_prim(skel, do_bone_deform, i, p, key) ) continue;
+
+        if( !rest_pose ){
+            const Bone_cu b = skel.get_bone(i)->get_bone_cu();
+            p.org = b.org().to_vec3();
+            p.dir = b.dir();
+        }
+
+        if( _use_grids && i < (int)_grids.size() && !_grids[i].is_empty() &&
+            same_bone(key.org, key.dir, key.rad, _grid_keys[i].org, _grid_keys[i].dir, _grid_keys[i].rad) )
+        {
+            const Transfo frame = rest_pose ? skel.bone_frame(i) : skel.bone_anim_frame(i);
+            p.grid     = &_grids[i];
+            p.to_local = frame.fast_invert();
+            p.to_world = frame.get_mat3();
+        }
+        _prims.push_back( p );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+float Skeleton_potential::prim_fngf(const Prim& b, const Vec3& p, Vec3& gf)
+{
+    const Vec3 op = p - b.org;
+    const float x = std::min(1.f, std::max(0.f, op.dot(b.dir) * b.inv_len_sq));
+    const Vec3 d = op - b.dir * x; // p minus its projection on the segment
+    const float d_sq = d.dot(d);
+    if( d_sq >= b.rad_sq ){
+        gf = Vec3(0.f, 0.f, 0.f);
+        return 0.f;
+    }
+
+    const float t = 1.f - d_sq * b.inv_rad_sq;
+    // d/dp (1 - |d|^2/R^2)^3 = -6 (1 - |d|^2/R^2)^2 / R^2 * d
+    gf = d * (-6.f * t * t * b.inv_rad_sq);
+    return t * t * t;
+}
+
+// -----------------------------------------------------------------------------
+
+float Skeleton_potential::fngf(const Vec3& p, Vec3& gf) const
+{
+    float f = 0.f;
+    gf = Vec3(0.f, 0.f, 0.f);
+    for(unsigned i = 0; i < _prims.size(); ++i)
+    {
+        const Prim& b = _prims[i];
+        Vec3  gi;
+        float fi;
+        const Vec3 pl = b.grid != 0 ? (b.to_local * p.to_point3()).to_vec3() : p;
+        if( b.grid != 0 && b.grid->contains(pl) )
+        {
+            fi = b.grid->fngf(pl, gi, _interp);
+            if( fi <= f ) continue;
+            gi = b.to_world * gi;
+        }
+        else
+        {
+            // No grid or outside of it
+            fi = prim_fngf(b, p, gi);
+            if( fi <= f ) continue;
+        }
+        f  = fi;
+        gf = gi;
+    }
+    return f;
+}
+
+// -----------------------------------------------------------------------------
+
+void Skeleton_potential::bake(const Skeleton& skel,
+                              const std::vector<bool>& do_bone_deform,
+                              int res)
+{
+    _grids.assign( skel.nb_joints(), Bone_grid() );
+    _grid_keys.resize( skel.nb_joints() );
+    res = std::max(res, 2);
+    for(int i = 0; i < skel.nb_joints(); ++i)
+    {
+        Prim p;
+        Grid_key key;
+        if( !rest_prim(skel, do_bone_deform, i, p, key) ) continue;
+
+        // The bone goes from the origin along x in its frame
+        const float rad = key.rad;
+        const float len = key.dir.norm();
+        _grids[i].bake(Local_field(p, skel.bone_frame(i)),
+                       Vec3(-rad, -rad, -rad),
+                       Vec3(len + rad, rad, rad),
+                       2.f * rad / (float)res);
+        _grid_keys[i] = key;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void Skeleton_potential::clear_grids()
+{
+    _grids.clear();
+    _grid_keys.clear();
+    // Prims may point to the grids
+    for(unsigned i = 0; i < _prims.size(); ++i)
+        _prims[i].grid = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+int Skeleton_potential::nb_grids() const
+{
+    int n = 0;
+    for(unsigned i = 0; i < _grids.size(); ++i)
+        n += _grids[i].is_empty() ? 0 : 1;
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+
+size_t Skeleton_potential::grids_memory_size() const
+{
+    size_t size = 0;
+    for(unsigned i = 0; i < _grids.size(); ++i)
+        size += _grids[i].memory_size();
+    return size;
+}
+
+// -----------------------------------------------------------------------------
+
+static const char g_grids_magic[4] = {'S', 'K', 'P', 'G'};
+static const int  g_grids_version  = 1;
+
+bool Skeleton_potential::save_grids(const std::string& path) const
+{
+    std::ofstream file(path.c_str(), std::ios::binary|std::ios::trunc);
+    if( !file.is_open() ) return false;
+
+    const int header[2] = { g_grids_version, (int)_grids.size() };
+    file.write(g_grids_magic, 4);
+    file.write((const char*)header, sizeof(header));
+    for(unsigned i = 0; i < _grids.size(); ++i)
+    {
+        const int baked = _grids[i].is_empty() ? 0 : 1;
+        file.write((const char*)&baked, sizeof(int));
+        if( !baked ) continue;
+
+        const Grid_key& k = _grid_keys[i];
+        const float key[7] = { k.org.x, k.org.y, k.org.z, k.dir.x, k.dir.y, k.dir.z, k.rad };
+        file.write((const char*)key, sizeof(key));
+        _grids[i].write( file );
+    }
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------
+
+bool Skeleton_potential::load_grids(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if( !file.is_open() ) return false;
+
+    char magic[4];
+    int header[2];
+    file.read(magic, 4);
+    file.read((char*)header, sizeof(header));
+    if( !file || !std::equal(magic, magic + 4, g_grids_magic) ||
+        header[0] != g_grids_version || header[1] < 0 )
+        return false;
+
+    std::vector<Bone_grid> grids( header[1] );
+    std::vector<Grid_key>  keys ( header[1] );
+    for(int i = 0; i < header[1]; ++i)
+    {
+        int baked = 0;
+        file.read((char*)&baked, sizeof(int));
+        if( !file ) return false;
+        if( !baked ) continue;
+
+        float key[7];
+        file.read((char*)key, sizeof(key));
+        keys[i].org = Vec3(key[0], key[1], key[2]);
+        keys[i].dir = Vec3(key[3], key[4], key[5]);
+        keys[i].rad = key[6];
+        if( !file || !grids[i].read( file ) ) return false;
+    }
+
+    clear_grids();
+    _grids.swap( grids );
+    _grid_keys.swap( keys );
+    return true;
+}
@@ -0,0 +1,142 @@
+#ifndef SKELETON_POTENTIAL_HPP__
+#define SKELETON_POTENTIAL_HPP__
+
+#include <vector>
+#include <string>
+#include "toolbox/maths/vec3.hpp"
+#include "toolbox/maths/mat3.hpp"
+#include "toolbox/maths/transfo.hpp"
+#include "bone_grid.hpp"
+
+struct Skeleton;
+
+/**
+  @class Skeleton_potential
+  @brief Host evaluation of the implicit surface wrapped around the skeleton
+
+  Snapshot of the skeleton's bones taken with update(). Each bone carries a
+  compactly supported field of the distance d to its segment:
+  @code
+  f(d) = (1 - (d/R)^2)^3   if d < R
+  f(d) = 0                 otherwise
+  @endcode
+  R is the bone's hrbf radius (farthest vertex of its cluster) enlarged by
+  'support_scale' so every vertex of the cluster gets a non null gradient.
+  The bones are combined with a union (max) which gives the sharp gradient
+  change the projection uses to detect contacts between limbs.
+
+  Leaves (zero length bones) and the bones which do not deform the mesh are
+  ignored. Evaluation is const and allocation free: every thread may call
+  fngf() concurrently.
+
+  bake() samples every bone's field once in its rest frame (@see Bone_grid).
+  The grids then follow the bones rigidly and replace the analytic field
+  inside their bounds. A grid is only used while its bone keeps the rest
+  position and support it was baked for; other bones use the analytic
+  field. Grids are saved and loaded with save_grids() and load_grids().
+*/
+class Skeleton_potential {
+public:
+    Skeleton_potential() :
+        _support_scale(1.5f),
+        _use_grids(true),
+        _interp(Bone_grid::TRILINEAR)
+    { }
+
+    /// Snapshot the bones
+    /// @param rest_pose use the bones in rest position instead of the
+    /// animated ones
+    /// @param do_bone_deform bones flagged false are ignored (may be empty)
+    void update(const Skeleton& skel,
+                const std::vector<bool>& do_bone_deform,
+                bool rest_pose);
+
+    /// Potential at 'p' and its gradient 'gf'
+    float fngf(const Tbx::Vec3& p, Tbx::Vec3& gf) const;
+
+    /// Potential at 'p'
+    float f(const Tbx::Vec3& p) const {
+        Tbx::Vec3 gf;
+        return fngf(p, gf);
+    }
+
+    int nb_prims() const { return (int)_prims.size(); }
+
+    void  set_support_scale(float s){ _support_scale = s;    }
+    float get_support_scale() const { return _support_scale; }
+
+    // -------------------------------------------------------------------------
+    /// @name Baked grids
+    // -------------------------------------------------------------------------
+
+    /// Bake the field of the bones of 'skel' in their rest frame.
+    /// update() must be called afterwards to use the grids.
+    /// @param res number of cells across the support diameter of a bone
+    void bake(const Skeleton& skel,
+              const std::vector<bool>& do_bone_deform,
+              int res);
+
+    void clear_grids();
+
+    /// Number of bones with a grid, valid or not
+    int nb_grids() const;
+
+    /// Use the grids in the next update(), the analytic field otherwise
+    void set_use_grids(bool s){ _use_grids = s; }
+
+    void set_interpolation(Bone_grid::Interpolation i){ _interp = i;    }
+    Bone_grid::Interpolation get_interpolation() const { return _interp; }
+
+    /// @return false if the file can't be written
+    bool save_grids(const std::string& path) const;
+
+    /// Replace the grids with the ones of 'path'
+    /// @return false if the file can't be read
+    bool load_grids(const std::string& path);
+
+    /// Bytes used by the grids
+    size_t grids_memory_size() const;
+
+private:
+    /// Bone segment and its support, stored for the evaluation
+    struct Prim {
+        Tbx::Vec3 org;
+        Tbx::Vec3 dir;     ///< org + dir is the end of the segment
+        float inv_len_sq;  ///< 1 / |dir|^2
+        float rad_sq;      ///< R^2
+        float inv_rad_sq;  ///< 1 / R^2
+
+        const Bone_grid* grid; ///< baked field or null
+        Tbx::Transfo to_local; ///< world to grid coordinates
+        Tbx::Mat3    to_world; ///< gradient from grid to world coordinates
+    };
+
+    /// Rest bone a grid was baked for
+    struct Grid_key {
+        Tbx::Vec3 org;
+        Tbx::Vec3 dir;
+        float rad;
+    };
+
+    /// Analytic field of a single bone
+    static float prim_fngf(const Prim& b, const Tbx::Vec3& p, Tbx::Vec3& gf);
+
+    /// Analytic field of bone 'i' in rest pose or false if it is ignored
+    bool rest_prim(const Skeleton& skel,
+                   const std::vector<bool>& do_bone_deform,
+                   int i,
+                   Prim& p,
+                   Grid_key& key) const;
+
+    struct Local_field;
+
+    std::vector<Prim> _prims;
+    float _support_scale;
+
+    bool _use_grids;
+    Bone_grid::Interpolation _interp;
+    std::vector<Bone_grid> _grids;     ///< per bone, empty if not baked
+    std::vector<Grid_key>  _grid_keys; ///< per bone
+};
+
+#endif // SKELETON_POTENTIAL_HPP__
@@ -4,7 +4,11 @@
 #include <QVector3D>
 #include <QQuaternion>
 #include <QSharedPointer>
+#include <QScopedPointer>
 #include <QImage>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QString>
 #include <vector>
 #include <set>
 #include <unordered_map>
@@ -28,8 +32,6 @@ namespace videoEditting
 	extern std::vector<QVector3D>     g_translations;
 	extern std::vector<QQuaternion>   g_rotations;
 	extern std::set<int>			  g_pose_key_frame;
-	extern std::vector<std::vector<QVector3D> > g_simulated_vertices;
-	extern std::vector<std::vector<QVector3D> > g_simulated_normals;
 	extern std::vector<std::vector<QVector2D> > g_tracked_textures;
 	extern std::vector<std::vector<int> >		g_tracked_isVisiable;  //1 if visiable 0 if not
 	extern std::vector<std::vector<int> >		g_simulated_isVisiable;
@@ -40,17 +42,102 @@ namespace videoEditting
 	extern std::vector<QImage>        g_cameraviewer_image_array;
 	extern 	std::vector<QImage>		  g_viewRenderImage;
 	void saveImageArray(std::vector<QImage>& images, QString path, QString name);
+
+	/*
+	  Baked frames of the soft body (node positions and normals).
+
+	  Frames are written in order by the bake thread and read back by the
+	  viewers while the bake is running. The last 'ring_capacity' frames stay in
+	  memory; when a cache directory is given every frame is also streamed to
+	  chunk files of 'chunk_frames' frames so that any frame can be read back
+	  without holding the whole sequence in RAM.
+	*/
+	class SimulationCache
+	{
+	public:
+		SimulationCache();
+		~SimulationCache();
+
+		/// Drop previous frames and allocate the ring.
+		/// @param cache_dir directory of the chunk files, empty to keep frames in the ring only
+		/// @return false if the cache directory can't be created
+		bool reset(int nb_frames, int nb_nodes, int ring_capacity, const QString& cache_dir = QString(), int chunk_frames = 64);
+		void clear();
+
+		/// Store a frame, 'data' holds nb_nodes() times x y z nx ny nz
+		void putFrame(int frame, const float* data);
+		/// Write the chunk being filled (partial chunks are rewritten once completed)
+		void flush();
+
+		/// @return false if the frame is not baked yet or has left the ring
+		bool getFrame(int frame, std::vector<QVector3D>& vertices, std::vector<QVector3D>& normals);
+		bool getNormals(int frame, std::vector<QVector3D>& normals);
+
+		int nbFrames() const { return m_nb_frames; }
+		int nbNodes() const { return m_nb_nodes; }
+		/// Number of frames stored so far
+		int bakedFrames() const { return m_baked.load(); }
+		bool isDiskBacked() const { return !m_cache_dir.isEmpty(); }
+		const QString& cacheDir() const { return m_cache_dir; }
+
+	private:
+		const float* findFrame(int frame);
+		bool writeChunk();
+		bool readChunk(int chunk);
+		QString chunkPath(int chunk) const;
+
+		QMutex m_mutex;
+		int m_nb_frames;
+		int m_nb_nodes;
+		int m_frame_size;               ///< floats per frame
+		QAtomicInt m_baked;
+
+		int m_ring_capacity;
+		std::vector<float> m_ring;      ///< m_ring_capacity frames, frame f in slot f % m_ring_capacity
+		std::vector<int>   m_ring_frame;///< frame held by each slot (-1 if empty)
+
+		QString m_cache_dir;
+		int m_chunk_frames;
+		std::vector<float> m_write_chunk; ///< chunk being filled by putFrame()
+		int m_write_chunk_id;
+		int m_write_chunk_count;        ///< frames in m_write_chunk
+		std::vector<int>   m_chunk_on_disk;   ///< frames written in each chunk file
+		std::vector<float> m_read_chunk;  ///< last chunk loaded by getFrame()
+		int m_read_chunk_id;
+	};
+	extern SimulationCache g_simulation_cache;
 }
+class SimulationBakeThread;
+class QTemporaryDir;
 class BulletInterface
 {
 public:
 	friend void pickingPreTickCallback(btDynamicsWorld *world, btScalar timeStep);
 	BulletInterface();
+	/// Stops the bake thread
+	~BulletInterface();
 //	void initWorld();
 	void setUpWorld();
-	void begin_simulate();
+	/// Bake g_total_frame frames into g_simulation_cache on a worker thread,
+	/// returns immediately. Large bakes stream to chunk files in 'cache_dir'
+	/// (a temporary directory owned by this object is used when empty).
+	void begin_simulate(const QString& cache_dir = QString());
+	/// Stop the bake after the current frame, the world keeps its state
+	void pause_simulate();
+	/// Resume a paused bake from the next frame
+	void continue_simulate();
+	/// Stop the bake and drop the baked frames, it can't be resumed
+	void cancel_simulate();
+	bool isSimulating() const;
+	/// Number of frames baked so far
+	int simulatedFrames() const { return videoEditting::g_simulation_cache.bakedFrames(); }
 	btRigidBody*localCreateRigidBody(float mass, const btTransform& startTransform, btCollisionShape* shape);
 private:
+	friend class SimulationBakeThread;
+	/// Bake loop run by the worker thread
+	void bake_frames();
+	void copy_frame(btSoftBody* pBody);
+
 	bool isWorldSetup;
 	QSharedPointer<btSoftRigidDynamicsWorld> pWorld;
 //	QSharedPointer<btSoftBodyRigidBodyCollisionConfiguration>  pCollisionConfiguration;
@@ -60,4 +147,13 @@ private:
 	//QSharedPointer<btConstraintSolver>                         pSolver;
 	btSoftBody*								   pSoftBody;
 	QVector < btRigidBody*>				       pRidgidBody;
+
+	SimulationBakeThread*                      pBakeThread;
+	QAtomicInt                                 cancelBake;
+	int                                        nextFrame;   ///< next frame to bake
+	/// Snapshot of the constraints taken by begin_simulate() (the UI may edit them while baking)
+	std::vector<std::unordered_map<int, QVector3D>> bakeConstraints;
+	float                                      bakeTimeStep;
+	QScopedPointer<QTemporaryDir>              bakeTempDir; ///< default directory of the chunk files, removed with this object
+	std::vector<float>                         frameBuffer; ///< node positions and normals of one frame
 };
\ No newline at end of file
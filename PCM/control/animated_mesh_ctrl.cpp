@@ -11,6 +11,7 @@
 #include "meshes/mesh_utils_loader.hpp"
 #include "meshes/mesh_utils.hpp"
 #include "parsers/obj_loader.hpp"
+#include "parsers/point_cache_export.hpp"
 
 #include <iostream>
 using std::cout;
@@ -207,6 +208,18 @@ void Animated_mesh_ctrl::set_implicit_skinning(bool s){
 void Animated_mesh_ctrl::switch_implicit_skinning(){
     _animesh->switch_implicit_skinning();
 }
+
+// -----------------------------------------------------------------------------
+
+void Animated_mesh_ctrl::benchmark_skinning(int nb_runs){
+    _animesh->benchmark_skinning((EAnimesh::Blending_type)_blending_type, nb_runs);
+}
+
+// -----------------------------------------------------------------------------
+
+void Animated_mesh_ctrl::benchmark_fitting(int nb_runs){
+    _animesh->benchmark_fitting((EAnimesh::Blending_type)_blending_type, nb_runs);
+}
 // -----------------------------------------------------------------------------
 
 void Animated_mesh_ctrl::update_base_potential()
@@ -238,6 +251,15 @@ void Animated_mesh_ctrl::deform_mesh(bool refresh)
         _animesh->transform_vertices_incr( refresh );
     else
         _animesh->transform_vertices((EAnimesh::Blending_type)get_blending_type(), refresh);
+
+    // Recording (Toolbar_frames): stream the deformed mesh to the point cache
+    if( g_save_anim && g_anim_cache != 0 && g_anim_cache->is_open() )
+    {
+        std::vector<float> frame;
+        _animesh->get_anim_vertices_aifo( frame );
+        if( (int)frame.size() == g_anim_cache->nb_points() * 3 )
+            g_anim_cache->add_frame( &frame[0] );
+    }
 }
 
 // -----------------------------------------------------------------------------
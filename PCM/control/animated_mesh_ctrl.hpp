@@ -127,6 +127,13 @@ public:
     void set_implicit_skinning(bool s);
     void switch_implicit_skinning();
 
+    /// Time the scalar, threaded and SIMD skinning backends with the current
+    /// blending type and print their deviation from the scalar one
+    void benchmark_skinning(int nb_runs = 50);
+    /// Time the implicit skinning projection and smoothing with the current
+    /// blending type
+    void benchmark_fitting(int nb_runs = 50);
+
     //--------------------------------------------------------------------------
     /// @name SSD weights
     //--------------------------------------------------------------------------
@@ -21,6 +21,7 @@ public:
         _raphson(false),
         _collision_threshold(0.9f),
         _propagation_factor(1.f),
+        _collision_depth(0.f),
         _smooth1_iter(7),
         _smooth2_iter(1),
         _smooth1_force(1.f),
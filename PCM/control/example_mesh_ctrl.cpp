@@ -1,6 +1,8 @@
 #include "example_mesh_ctrl.h"
 #include "ebpd/ExampleWeightSover.h"
+#include "example_skinning.h"
 #include "VTP_source_code/caculateGeodistance.h"
+#include "VTP_source_code/geodesic_context.h"
 #include "VTP_source_code/geodesic_mesh.h"
 #include "toolbox/maths/transfo.hpp"
 #include "toolbox/maths/quat_cu.hpp"
@@ -55,6 +57,42 @@ void rebuildExampleSover()
 
 }
 
+ExampleSkinning* exampleSkinning = NULL;
+
+// the example transformations are converted once per rig
+void rebuildExampleSkinning()
+{
+	if(exampleSkinning)
+		delete exampleSkinning;
+	exampleSkinning = new ExampleSkinning( g_inputVertices,g_numVertices,
+		g_transfos,g_numBone,g_numExample,g_numIndices,
+		g_boneWeights,g_boneWightIdx);
+}
+
+geodesic::GeodesicContext* geodesicContext = NULL;
+// HEAT trades accuracy for speed: kernels only look inside a small radius.
+// Selected through Example_mesh_ctrl::setHeatGeodesic()
+static geodesic::GeodesicContext::Engine g_geodesicEngine = geodesic::GeodesicContext::EXACT;
+
+void rebuildGeodesicContext()
+{
+	if(geodesicContext)
+		delete geodesicContext;
+	std::vector<double> inputVertice(g_inputVertices.begin(), g_inputVertices.end());
+	std::vector<unsigned> faces(g_faces.begin(), g_faces.end());
+	geodesicContext = new geodesic::GeodesicContext( inputVertice, faces);
+}
+
+void Example_mesh_ctrl::setHeatGeodesic(bool use_heat)
+{
+	g_geodesicEngine = use_heat ? geodesic::GeodesicContext::HEAT : geodesic::GeodesicContext::EXACT;
+}
+
+bool Example_mesh_ctrl::isHeatGeodesic() const
+{
+	return g_geodesicEngine == geodesic::GeodesicContext::HEAT;
+}
+
 
 
 void GetRigFromFile(std::vector<Tbx::Transfo>& transfos ,
@@ -174,6 +212,8 @@ void WriteAnimationToFile(std::string file_paths,
 }
 
 
+// reference implementation of ExampleSkinning::blend(), converts every example
+// transformation for every vertex and influence
 bool genetatedVertice( std::vector<float>& OutputVetices , const std::vector<float>& inputVertices, int numVertices,
 					  const std::vector<Tbx::Transfo>& transfosOfExamples,int numBone, int numExample,int numbIndices,
 					  const std::vector<float>& boneWeights,
@@ -458,44 +498,28 @@ void drawBack( geodesic::Mesh& mesh , int idex)
 
 }
 
-static void findKNearest( int nearDepth ,std::map<int,std::map<int,float> >& distanceOfVertex ,std::vector<int>& targetVertexIdx)
+static void findKNearest( int nearDepth ,std::map<int,std::map<int,float> >& distanceOfVertex ,std::vector<int>& targetVertexIdx,
+						 geodesic::GeodesicContext::Engine engine = geodesic::GeodesicContext::EXACT)
 {
-	// std::vector<int> a;
-	//for each (auto i_vertex in a)
-	//{
+	if(!geodesicContext)
+		rebuildGeodesicContext();
 
-	//}
-	std::vector<float> distance;
-	std::vector<double> inputVertice(g_inputVertices.size());
-	std::vector<unsigned> faces(g_faces.size());
-	for (int i = 0; i < g_inputVertices.size(); i++)
-	{
-		inputVertice[i] = g_inputVertices[i];
-	}
-	for (int i = 0; i < g_faces.size(); i++)
-	{
-		faces[i] = g_faces[i];
-	}
+	std::vector<unsigned> sources(targetVertexIdx.begin(), targetVertexIdx.end());
+	std::vector<std::vector<float> > distances;
 	clock_t start = clock();
-	for( int i_vertx:targetVertexIdx)
+	geodesicContext->distances( sources, distances, nearDepth, engine);
+	for (int i_source = 0; i_source < sources.size(); i_source++)
 	{
-		caculteGeodistance( inputVertice,faces,i_vertx,distance,nearDepth,drawBack,0);
+		int i_vertx = targetVertexIdx[i_source];
+		const std::vector<float>& distance = distances[i_source];
 		for (int i = 0; i < distance.size(); i++)
 		{
 			distanceOfVertex[i_vertx][i] = distance[i];
 		}
-		
 	}
 	clock_t stop = clock();
 	float m_time_consumed = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
 	std::cout<<"caculteGeodistance "<<m_time_consumed<<std::endl;
-	//for each (int i_vertex in targetVertexIdx)
-	//{
-
-	//}
-	//int i_vertx = targetVertexIdx;
-
-
 }
 
 inline float kernelFunction(float kernelRadius , float distance)
@@ -517,7 +541,7 @@ inline float kernelFunction(float kernelRadius , float distance)
 static void writeColorGeoDistance( std::vector<int>& i_vertexs, std::string path)
 {
 	std::map<int,std::map<int,float> > distanceOfVertex;
-	findKNearest( 100, distanceOfVertex ,i_vertexs);
+	findKNearest( 100, distanceOfVertex ,i_vertexs, g_geodesicEngine);
 
 	std::stringstream ss;
 
@@ -589,7 +613,7 @@ static void propagateExampleWeight(std::map<int, std::vector<float> >& delta_exa
 	#ifdef Debug_Time
 		clock_t start = clock();
 	#endif // DEBUG
-	findKNearest( depth , distanceOfVertex ,targetVertexIdx);
+	findKNearest( depth , distanceOfVertex ,targetVertexIdx, g_geodesicEngine);
 	#ifdef Debug_Time
 		clock_t stop = clock();
 		float m_time_consumed = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
@@ -637,11 +661,13 @@ void Example_mesh_ctrl::genertateVertices(std::string _file_paths,std::string na
 	std::string file_paths;
 	using namespace std;
 	importObj( g_inputVertices,g_faces,input_mesh_path);
+	rebuildGeodesicContext();
 	g_numVertices = g_inputVertices.size()/3;
 
 	GetRigFromFile(g_transfos ,
 		g_boneWightIdx ,g_boneWeights ,g_numVertices,g_numBone, g_numExample,g_numIndices,
 		rig_path);
+	rebuildExampleSkinning();
 	std::vector<float> OutputVetices;
 	if(!g_exampleWeights.size())
 	{
@@ -653,11 +679,7 @@ void Example_mesh_ctrl::genertateVertices(std::string _file_paths,std::string na
 			g_exampleWeights[i+2*g_numVertices]  = 0.0f;
 		}
 	}
-	genetatedVertice(  OutputVetices , g_inputVertices, g_numVertices,
-		g_transfos ,g_numBone, g_numExample,g_numIndices,
-		g_boneWeights,
-		g_boneWightIdx,
-		g_exampleWeights);
+	exampleSkinning->blend( g_exampleWeights, OutputVetices);
 	exportObj( OutputVetices,g_faces,output_mesh_path);
 	std::vector<int> i_vertexs;
 	//i_vertexs.push_back(0);
@@ -720,11 +742,7 @@ void Example_mesh_ctrl::genertateVertices(std::string _file_paths,std::string na
 
 
 
-		genetatedVertice(  OutputVetices , g_inputVertices, g_numVertices,
-			g_transfos ,g_numBone, g_numExample,g_numIndices,
-			g_boneWeights,
-			g_boneWightIdx,
-			g_exampleWeights);
+		exampleSkinning->blend( g_exampleWeights, OutputVetices);
 		stringstream ss;
 		ss<<_file_paths<<name<<"_out"<<i<<".obj";
 		string outputpath;
@@ -751,6 +769,7 @@ void Example_mesh_ctrl::load_example(std::string _file_paths, std::string name)
 	using namespace std;
 	//load first example
 	importObj(g_inputVertices, g_faces, input_mesh_path);
+	rebuildGeodesicContext();
 	SampleSet& smpset = (*Global_SampleSet);
 	Sample* new_sample = smpset.add_sample_Fromfile(input_mesh_path);
 
@@ -758,6 +777,7 @@ void Example_mesh_ctrl::load_example(std::string _file_paths, std::string name)
 	GetRigFromFile(g_transfos,
 		g_boneWightIdx, g_boneWeights, g_numVertices, g_numBone, g_numExample, g_numIndices,
 		rig_path);
+	rebuildExampleSkinning();
 
 	//convert format
 	g_transfos_2.clear();
@@ -808,11 +828,7 @@ void Example_mesh_ctrl::load_example(std::string _file_paths, std::string name)
 				g_exampleWeights[i + j * g_numVertices] = 1.0f;
 			}
 			//assume the last sample to be what we will manipulate
-			genetatedVertice(OutputVetices, g_inputVertices, g_numVertices,
-				g_transfos, g_numBone, g_numExample, g_numIndices,
-				g_boneWeights,
-				g_boneWightIdx,
-				g_exampleWeights);
+			exampleSkinning->blend( g_exampleWeights, OutputVetices);
 			Sample* sample_manipulate = NULL;
 			SampleSet& smpset = (*Global_SampleSet);
 			sample_manipulate = smpset.add_sample_FromArray(OutputVetices, g_faces);
@@ -836,11 +852,7 @@ void Example_mesh_ctrl::load_example(std::string _file_paths, std::string name)
 			g_exampleWeights[i + j * g_numVertices] = 1.0f;
 		}
 	}
-	genetatedVertice(OutputVetices, g_inputVertices, g_numVertices,
-		g_transfos, g_numBone, g_numExample, g_numIndices,
-		g_boneWeights,
-		g_boneWightIdx,
-		g_exampleWeights);
+	exampleSkinning->blend( g_exampleWeights, OutputVetices);
 	Sample* sample_manipulate;
 	sample_manipulate = smpset.add_sample_FromArray(OutputVetices, g_faces);
 	for (int i = 0; i < g_MeshControl.size(); ++i)
@@ -858,11 +870,13 @@ void Example_mesh_ctrl::setupExample(std::string _file_paths,std::string name)
 	std::string file_paths;
 	using namespace std;
 	importObj( g_inputVertices,g_faces,input_mesh_path);
+	rebuildGeodesicContext();
 	g_numVertices = g_inputVertices.size()/3;
 
 	GetRigFromFile(g_transfos ,
 		g_boneWightIdx ,g_boneWeights ,g_numVertices,g_numBone, g_numExample,g_numIndices,
 		rig_path);
+	rebuildExampleSkinning();
 	std::vector<float> OutputVetices;
 	if(!g_exampleWeights.size())
 	{
@@ -879,14 +893,17 @@ void Example_mesh_ctrl::setupExample(std::string _file_paths,std::string name)
 
 void Example_mesh_ctrl::genertateVertices(std::vector<float>& inputVertices ,std::vector<int>& faces, const std::vector<int>& vertex_idexs, const std::vector<float>& impulses ,float mass,float delta_t,float belta)
 {
+	if (!exampleSkinning)
+	{
+		// no rig loaded yet
+		if (!g_numVertices || g_transfos.empty())
+			return;
+		rebuildExampleSkinning();
+	}
 	static int count=0;
 	if ( vertex_idexs.size() < 1 || 1 == count)
 	{
-		genetatedVertice(  inputVertices , g_inputVertices, g_numVertices,
-			g_transfos ,g_numBone, g_numExample,g_numIndices,
-			g_boneWeights,
-			g_boneWightIdx,
-			g_exampleWeights);
+		exampleSkinning->blend( g_exampleWeights, inputVertices);
 		faces = g_faces;
 		return;
 	}
@@ -976,11 +993,7 @@ void Example_mesh_ctrl::genertateVertices(std::vector<float>& inputVertices ,std
 
 
 
-		genetatedVertice(  inputVertices , g_inputVertices, g_numVertices,
-			g_transfos ,g_numBone, g_numExample,g_numIndices,
-			g_boneWeights,
-			g_boneWightIdx,
-			g_exampleWeights);
+		exampleSkinning->blend( g_exampleWeights, inputVertices);
 
 		exportObj( inputVertices,g_faces,"./resource/meshes/keg3/bullet_1.obj");
 
@@ -991,14 +1004,11 @@ void Example_mesh_ctrl::genertateVertices(std::vector<float>& inputVertices ,std
 void Example_mesh_ctrl::processCollide(SampleSet& smpset, std::vector<ManipulatedObject*>& selected_obj)
 {
 	int idx_to_manipulate = smpset.size()-1;
-	if (idx_to_manipulate < 0)return;
+	if (idx_to_manipulate < 0 || !exampleSkinning)return;
 
+	// copied out of the engine's buffer, the blend after the collision reuses it
 	std::vector<float> vertices_beforCollide;
-	genetatedVertice(vertices_beforCollide, g_inputVertices, g_numVertices,
-		g_transfos, g_numBone, g_numExample, g_numIndices,
-		g_boneWeights,
-		g_boneWightIdx,
-		g_exampleWeights);
+	exampleSkinning->blend( g_exampleWeights, vertices_beforCollide);
 
 	std::map<int, std::vector<float> > delta_exampleWeightsOfVertex;
 	std::map<int, std::vector<float> > ori_exampleWeights;
@@ -1062,7 +1072,6 @@ void Example_mesh_ctrl::processCollide(SampleSet& smpset, std::vector<Manipulate
 
 	float lamda = 0.1f;
 	int fade_count = 1;
-	std::vector<float> vertices_afterCollide;
 	for (int i = 0; i < fade_count; i++)
 	{
 		for (int i_vertex = 0; i_vertex < g_numVertices; i_vertex++)
@@ -1107,11 +1116,7 @@ void Example_mesh_ctrl::processCollide(SampleSet& smpset, std::vector<Manipulate
 			}
 		}
 
-		genetatedVertice(vertices_afterCollide, g_inputVertices, g_numVertices,
-			g_transfos, g_numBone, g_numExample, g_numIndices,
-			g_boneWeights,
-			g_boneWightIdx,
-			g_exampleWeights);
+		const std::vector<float>& vertices_afterCollide = exampleSkinning->blend( g_exampleWeights);
 		//
 		Sample& smp= smpset[idx_to_manipulate];
 		for ( int i = 0 ; i <smp.num_vertices() ; ++i)
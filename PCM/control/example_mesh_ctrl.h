@@ -15,6 +15,9 @@ public:
 	void setupExample(std::string _file_paths,std::string name);
 	void genertateVertices(std::vector<float>& inputVertices ,std::vector<int>& faces, const std::vector<int>& vertex_idex, const std::vector<float>& impulses ,float mass, float delta_t,float belta );
 	void processCollide(SampleSet& smpset, std::vector<ManipulatedObject*>& selected_obj);
+	// geodesic distances of the weight propagation: heat method (approximate, faster) or exact
+	void setHeatGeodesic(bool use_heat);
+	bool isHeatGeodesic() const;
 
 
 
@@ -0,0 +1,110 @@
+#include "example_skinning.h"
+#include "toolbox/maths/quat_cu.hpp"
+#include "toolbox/maths/vec3.hpp"
+#include <xmmintrin.h>
+#include <cassert>
+#include <cmath>
+
+ExampleSkinning::ExampleSkinning(
+	const std::vector<float>& inputVertices, int numVertices,
+	const std::vector<Tbx::Transfo>& transfosOfExamples,int numBone, int numExample,int numbIndices,
+	const std::vector<float>& boneWeights,
+	const std::vector<int>& boneWightIdx )
+{
+	assert( inputVertices.size() == 3 * numVertices );
+	assert( transfosOfExamples.size() == numBone * numExample );
+	m_inputVertices = inputVertices;
+	m_numVertices = numVertices;
+	m_numBone = numBone;
+	m_numExample = numExample;
+	m_numbIndices = numbIndices;
+	m_boneWeights = boneWeights;
+	m_boneWightIdx = boneWightIdx;
+
+	// the conversion genetatedVertice() did for every vertex and influence
+	m_exampleTransfos.resize( numBone * numExample * 8, 0.0f);
+	for (int i_example = 0; i_example < numExample; ++i_example)
+	{
+		for (int i_bone = 0; i_bone < numBone; ++i_bone)
+		{
+			const Tbx::Transfo& transfo = transfosOfExamples[i_example*numBone+i_bone];
+			Tbx::Quat_cu rotate_quat(transfo);
+			Tbx::Vec3 translate = transfo.get_translation();
+
+			float* dst = &m_exampleTransfos[(i_bone*numExample + i_example) * 8];
+			dst[0] = rotate_quat.w();
+			dst[1] = rotate_quat.i();
+			dst[2] = rotate_quat.j();
+			dst[3] = rotate_quat.k();
+			dst[4] = translate.x;
+			dst[5] = translate.y;
+			dst[6] = translate.z;
+		}
+	}
+}
+
+const std::vector<float>& ExampleSkinning::blend(const std::vector<float>& exampleWeights)
+{
+	blend( exampleWeights, m_output);
+	return m_output;
+}
+
+void ExampleSkinning::blend(const std::vector<float>& exampleWeights, std::vector<float>& outputVertices) const
+{
+	assert( exampleWeights.size() == m_numVertices * m_numExample );
+	outputVertices.resize( m_inputVertices.size());
+	if( m_exampleTransfos.empty() )
+		return;
+
+	const float* transfos = &m_exampleTransfos[0];
+	const int numVertices = m_numVertices;
+	const int numExample = m_numExample;
+	const int numbIndices = m_numbIndices;
+
+	#pragma omp parallel for schedule(static)
+	for( int i_vertex = 0; i_vertex < numVertices; ++i_vertex)
+	{
+		const float x = m_inputVertices[3*i_vertex];
+		const float y = m_inputVertices[3*i_vertex+1];
+		const float z = m_inputVertices[3*i_vertex+2];
+		float acc_x = 0.0f, acc_y = 0.0f, acc_z = 0.0f;
+
+		for (int i_indice= 0; i_indice < numbIndices ;++i_indice)
+		{
+			const int i_bone = m_boneWightIdx[i_vertex*numbIndices+i_indice];
+			const float bone_weight = m_boneWeights[i_vertex*numbIndices+i_indice];
+			const float* bone_transfos = transfos + i_bone*numExample*8;
+
+			// blend quaternions and translations of every example
+			__m128 acc_quat = _mm_setzero_ps();
+			__m128 acc_translate = _mm_setzero_ps();
+			for (int i_example = 0 ;i_example< numExample ;++i_example)
+			{
+				const __m128 w = _mm_set1_ps( exampleWeights[i_example* numVertices + i_vertex] );
+				acc_quat      = _mm_add_ps( acc_quat,      _mm_mul_ps( w, _mm_loadu_ps( bone_transfos + 8*i_example ) ) );
+				acc_translate = _mm_add_ps( acc_translate, _mm_mul_ps( w, _mm_loadu_ps( bone_transfos + 8*i_example + 4 ) ) );
+			}
+			float q[4], t[4];
+			_mm_storeu_ps( q, acc_quat);
+			_mm_storeu_ps( t, acc_translate);
+
+			// qlerp then rotate: p + 2w (v x p) + 2 v x (v x p)
+			const float inv_norm = 1.0f / std::sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+			const float qw = q[0]*inv_norm, qi = q[1]*inv_norm, qj = q[2]*inv_norm, qk = q[3]*inv_norm;
+			const float cx = qj*z - qk*y;
+			const float cy = qk*x - qi*z;
+			const float cz = qi*y - qj*x;
+			const float rx = x + 2.0f * (qw*cx + qj*cz - qk*cy);
+			const float ry = y + 2.0f * (qw*cy + qk*cx - qi*cz);
+			const float rz = z + 2.0f * (qw*cz + qi*cy - qj*cx);
+
+			acc_x += bone_weight * (rx + t[0]);
+			acc_y += bone_weight * (ry + t[1]);
+			acc_z += bone_weight * (rz + t[2]);
+		}
+
+		outputVertices[3*i_vertex] = acc_x;
+		outputVertices[3*i_vertex+1] = acc_y;
+		outputVertices[3*i_vertex+2] = acc_z;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef _EXAMPLE_SKINNING_
+#define _EXAMPLE_SKINNING_
+#include "toolbox/maths/transfo.hpp"
+#include <vector>
+
+/*
+	Example based skinning, same result as genetatedVertice():
+	for every bone influence of a vertex the example transformations are blended
+	(quaternion lerp + translation), then the bone results are blended with the
+	bone weights.
+
+	Every example/bone transformation is converted to quaternion + translation
+	once in the constructor, so a new engine must be built each time the rig changes.
+	blend() only reads this data: the vertices are spread over the threads and the
+	example blending is done with SSE.
+
+	transfosOfExamples = numBone x numExample
+	boneWeights = numIndices x numVertices
+	boneWightIdx = numIndices x numVertices
+	exampleWeights = numVertices x numExample (first every vertex of example 0, then example 1...)
+*/
+class ExampleSkinning
+{
+public:
+	ExampleSkinning(
+		const std::vector<float>& inputVertices, int numVertices,
+		const std::vector<Tbx::Transfo>& transfosOfExamples,int numBone, int numExample,int numbIndices,
+		const std::vector<float>& boneWeights,
+		const std::vector<int>& boneWightIdx );
+
+	// skin the rest pose into the internal buffer and return it, the buffer is
+	// reused (and overwritten) by the next call
+	const std::vector<float>& blend(const std::vector<float>& exampleWeights);
+
+	// same, written into the caller's buffer
+	void blend(const std::vector<float>& exampleWeights, std::vector<float>& outputVertices) const;
+
+	int numVertices() const { return m_numVertices; }
+
+private:
+	std::vector<float> m_inputVertices;
+	int m_numVertices;
+	int m_numBone;
+	int m_numExample;
+	int m_numbIndices;
+	std::vector<float> m_boneWeights;
+	std::vector<int> m_boneWightIdx;
+
+	// 8 floats per (bone, example): quaternion w i j k, translation x y z, padding.
+	// Examples of the same bone are contiguous: m_exampleTransfos[(bone*numExample + example)*8]
+	std::vector<float> m_exampleTransfos;
+	std::vector<float> m_output;
+};
+
+#endif
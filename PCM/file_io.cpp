@@ -6,8 +6,12 @@
 #include "triangle.h"
 #include "rendering/render_types.h"
 #include "GlobalObject.h"
+#include "parsers/mapped_file.hpp"
+#include "parsers/text_parser.hpp"
+#include "parsers/ply_loader.hpp"
 #include <fstream>
 #include <string>
+#include <cmath>
 using namespace pcm;
 namespace FileIO
 {
@@ -64,186 +68,250 @@ namespace FileIO
 		return load_point_cloud_file(new_sample, new_sample->file_path ,new_sample->file_type);
 	}
 
-	bool load_point_cloud_file(Sample* new_sample, std::string filename ,FILE_TYPE type)
+	/*
+		Points and triangles of a chunk of lines of a xyz or obj file.
+		Chunks are parsed in parallel then appended in the file order.
+	*/
+	struct PointChunk
 	{
-		FILE* in_file = fopen(filename.c_str(), "r");
-
-		if(in_file==NULL)
-			return false;
-		//		ScalarType vx0,vy0,vz0;
-		// 		bool first_vertex = true;
-
-		if( type == FileIO::XYZ)
+		PointChunk():nb_normals(0){}
+		std::vector<float>		points;		// x y z r g b a, a < 0 when the line has no color
+		std::vector<float>		normals;	// nx ny nz
+		std::vector<int>		faces;		// 3 vertex indices per triangle (obj)
+		std::vector<size_t>		relative;	// faces entries relative to the chunk's first vertex
+		size_t					nb_normals;
+	};
+
+	/* x y z [nx ny nz [r g b]] per line, colors in [0 255] */
+	static void parse_xyz_chunk(const char* p, const char* end, PointChunk& c)
+	{
+		using namespace Loader::Text;
+		for ( ; p < end; p = next_line(p, end))
 		{
-			while ( true )
+			float v[9];
+			int n = 0;
+			const char* q = p;
+			while (n < 9 && parse_float(q, end, v[n]))
+				++n;
+			if (n < 3)
+				continue;	// empty line or comment
+
+			c.points.insert(c.points.end(), v, v + 3);
+			if (n >= 9)
 			{
-
-				ScalarType vx,vy,vz,nx,ny,nz,cx,cy,cz;
-				int status = fscanf(in_file, "%f %f %f %f %f %f %f %f %f\n",&vx,&vy,&vz,
-					&nx,&ny,&nz,
-					&cx,&cy,&cz);
-				if(status==EOF)break;
-				// 			if ( first_vertex )
-				// 			{
-				// 				vx0 = vx,vy0 = vy, vz0 = vz;
-				// 				PointType v(0.,0.,0.);
-				// 				ColorType cv(cx/255.,cy/255.,cz/255.,1.);
-				// 				NormalType nv(nx,ny,nz);
-				// 				new_sample->add_vertex(v, nv, cv);
-				// 				first_vertex = false;
-				// 				continue;
-				// 			}
-				// 			PointType v(vx - vx0,vy - vy0,vz - vz0);
-				PointType v(vx,vy,vz);
-				ColorType cv(cx/255.,cy/255.,cz/255.,1.);
-				NormalType nv(nx,ny,nz);
-
-				new_sample->add_vertex(v, nv, cv);
-
-
+				const float col[4] = { v[6] / 255.f, v[7] / 255.f, v[8] / 255.f, 1.f };
+				c.points.insert(c.points.end(), col, col + 4);
 			}
-
-		}
-		else if( type == FileIO::PLY){
-			int vcount=0;
-			int fcount=0;
-			fscanf(in_file,"ply\nformat ascii 1.0\nelement vertex %d\n",&vcount);
-			fscanf(in_file,"property float x\nproperty float y\nproperty float z\nproperty float nx\nproperty float ny\nproperty float nz\nproperty uchar red\nproperty uchar green\nproperty uchar blue\n");
-			fscanf(in_file,"end_header\n");
-			while(true){
-
-				ScalarType vx,vy,vz,nx,ny,nz,cx,cy,cz;
-				int status = fscanf(in_file, "%f %f %f %f %f %f %f %f %f\n",&vx,&vy,&vz,
-					&nx,&ny,&nz,
-					&cx,&cy,&cz);
-				if(status==EOF)break;
-
-				PointType v(vx,vy,vz);
-				ColorType cv(cx/255.,cy/255.,cz/255.,1.);
-				NormalType nv(nx,ny,nz);
-
-				new_sample->add_vertex(v, nv, cv);
+			else
+			{
+				const float no_col[4] = { 0.f, 0.f, 0.f, -1.f };
+				c.points.insert(c.points.end(), no_col, no_col + 4);
 			}
-
+			const float no_n[3] = { 0.f, 0.f, 0.f };
+			c.normals.insert(c.normals.end(), n >= 6 ? v + 3 : no_n, n >= 6 ? v + 6 : no_n + 3);
+			++c.nb_normals;
 		}
-		else if(type = FileIO::OBJ)
+	}
+
+	/* v x y z [r g b], vn and f lines of an obj file, faces are triangulated */
+	static void parse_obj_chunk(const char* p, const char* end, PointChunk& c)
+	{
+		using namespace Loader::Text;
+		std::vector<int> poly;
+		std::vector<bool> rel;
+		for ( ; p < end; p = next_line(p, end))
 		{
-			char pref[3];
-			new_sample->clear();
-			FILE* fd = in_file ;
-		//	FILE* fd = get_mesh_model_scale( filename.c_str(), &(new_sample->n_vertex),&(new_sample->n_normal),&(new_sample->n_triangle) );
-		//	Logger<<"nvertex "<<new_sample->n_vertex<<"nnormal "<<new_sample->n_normal<<"ntriangle"<<new_sample->n_triangle<<std::endl;
-			if(fd)
+			const char* line_end = next_line(p, end);
+			const char* k = skip_blanks(p, line_end);
+			const char* q = skip_token(k, line_end);
+			const size_t len = q - k;
+			if (len == 1 && k[0] == 'v')
+			{
+				float v[6];
+				int n = 0;
+				while (n < 6 && parse_float(q, line_end, v[n]))
+					++n;
+				if (n < 3)
+					continue;
+				c.points.insert(c.points.end(), v, v + 3);
+				const float col[4] = { v[3], v[4], v[5], n == 6 ? 1.f : -1.f };
+				c.points.insert(c.points.end(), col, col + 4);
+			}
+			else if (len == 2 && k[0] == 'v' && k[1] == 'n')
 			{
-				ScalarType vx,vy,vz,nx,ny,nz,cx,cy,cz;
-				std::vector<PointType> v;
-				std::vector<ColorType> cv;
-				std::vector<NormalType> nv;
-				//std::vector<TriangleType*> ttv;
-				int faces_idx = 0;
-				while( fscanf(fd ,"%2s",pref) != EOF)
+				float n[3] = { 0.f, 0.f, 0.f };
+				parse_float(q, line_end, n[0]);
+				parse_float(q, line_end, n[1]);
+				parse_float(q, line_end, n[2]);
+				const float norm = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (norm > 0.f)
 				{
-					if(strcmp(pref,"v")==0)
-					{
-						fscanf(fd, "%f %f %f",&vx,&vy,&vz);
-						v.push_back(PointType(vx,vy,vz));
-					}else if(strcmp(pref,"vn") ==0)
-					{
-						fscanf(fd,"%f %f %f",&(nx),&(ny),&(nz));
-						ScalarType square_num = sqrt(nx*nx + ny*ny + nz*nz);
-						nv.push_back( NormalType(nx/square_num,ny/square_num,nz/square_num));
-					}else if( strcmp(pref,"f")==0)
-					{   
-						TriangleType* tt = new TriangleType(*new_sample, faces_idx);
-						for(int i_v = 0; i_v<3 ; i_v++)
-						{
-							IndexType i_temp_v;
-							IndexType i_temp_n;
-							fscanf(fd, "%d",&i_temp_v);
-							tt->set_i_vetex(i_v ,i_temp_v);
-							if((pref[0] = (char)getc(fd)) ==' ')
-							{
-								while( (pref[0] = (char)getc(fd)) ==' ');
-								if( pref[0] == '\n'||pref[0]==EOF )
-								{
-
-								}else
-								{
-									ungetc(pref[0],fd);
-								}
-							}
-							else if(pref[0] =='/')
-							{
-
-								if( (pref[0] = (char)getc(fd))!='/')
-								{
-									//while((char)get(fd) ==" ");
-									ungetc(pref[0],fd);
-									int nouse;
-									fscanf(fd ,"%d", &nouse);
-									if( (pref[0] = (char)getc(fd))!='/')
-									{
-										fscanf(fd,"%d",&i_temp_n);
-										tt->set_i_normal(i_v ,i_temp_n);
-									}
-
-								}else{
-									fscanf(fd,"%d",&i_temp_n);
-									tt->set_i_normal(i_v ,i_temp_n);
-								}								
-
-							}
-
-						}
-						for( int i = 0 ; i < 3 ;++i)
-						{
-							tt->set_i_vetex(i, tt->get_i_vertex(i) - 1);
-							tt->set_i_normal(i ,tt->get_i_vertex(i));  //tricky
-						}
-						new_sample->add_triangle(*tt);
-						delete tt;
-						faces_idx++;
-						//					ttv.push_back(tt);
-					}else if(pref[0] =='#')
-					{
-						skip_this_line(fd);
-					}
-					else skip_this_line(fd);
+					n[0] /= norm; n[1] /= norm; n[2] /= norm;
+				}
+				c.normals.insert(c.normals.end(), n, n + 3);
+				++c.nb_normals;
+			}
+			else if (len == 1 && k[0] == 'f')
+			{
+				// v, v/t, v//n or v/t/n: only the vertex index is kept
+				poly.clear();
+				rel.clear();
+				int idx;
+				while (parse_int(q, line_end, idx))
+				{
+					// obj indices are 1 based, negative ones count back from the last vertex
+					const bool r = idx < 0;
+					poly.push_back(r ? (int)(c.points.size() / 7) + idx : idx - 1);
+					rel.push_back(r);
+					q = skip_token(q, line_end);
 				}
-				for(int i = 0 ; i< v.size();++i)
+				for (size_t i = 2; i < poly.size(); ++i)
 				{
-					if( i+1 <= nv.size() && i+1 <= cv.size())
-						new_sample->add_vertex(v[i], nv[i], cv[i]);
-					else if(i+1 <= nv.size())
+					const size_t f[3] = { 0, i - 1, i };
+					for (int j = 0; j < 3; ++j)
 					{
-						new_sample->add_vertex(v[i], nv[i], RED_COLOR);
+						if (rel[f[j]])
+							c.relative.push_back(c.faces.size());
+						c.faces.push_back(poly[f[j]]);
 					}
-					else if(i+1 <= cv.size())
-						new_sample->add_vertex(v[i], NULL_NORMAL, cv[i]);
-					else
-						new_sample->add_vertex(v[i], NULL_NORMAL, RED_COLOR);
 				}
-				//	new_sample->add_triangle(triangle_array= ttv;
-				fclose(fd);
 			}
-			else //fd == NULL
-			{		
-				return false;
+		}
+	}
+
+	/* Parse the mapped 'file' by chunks of lines in parallel */
+	static void parse_chunks(const Loader::Mapped_file& file,
+		void(*parse)(const char*, const char*, PointChunk&),
+		std::vector<PointChunk>& chunks)
+	{
+		std::vector<const char*> bounds;
+		Loader::Text::split_lines(file.data(), file.end(), Loader::Text::nb_chunks(file.size()), bounds);
+		const int nb_chunks = (int)bounds.size() - 1;
+		chunks.clear();
+		chunks.resize(nb_chunks);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i = 0; i < nb_chunks; ++i)
+			parse(bounds[i], bounds[i + 1], chunks[i]);
+	}
+
+	/* Append the points of the chunks to the sample */
+	static void add_chunks(Sample* new_sample, std::vector<PointChunk>& chunks)
+	{
+		size_t nb_points = 0, nb_normals = 0;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			nb_points += chunks[i].points.size() / 7;
+			nb_normals += chunks[i].nb_normals;
+		}
+		new_sample->reserve(nb_points);
+
+		// obj normals are listed apart from the vertices: vertex i takes the normal i
+		std::vector<float> normals;
+		normals.reserve(3 * nb_normals);
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+			std::vector<float>().swap(chunks[i].normals);
+		}
+
+		IndexType vtx = 0;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			const std::vector<float>& pts = chunks[i].points;
+			for (size_t p = 0; p < pts.size(); p += 7, ++vtx)
+			{
+				const float* v = &pts[p];
+				const NormalType n = (size_t)vtx < nb_normals ?
+					NormalType(normals[3 * vtx], normals[3 * vtx + 1], normals[3 * vtx + 2]) : NULL_NORMAL;
+				const ColorType c = v[6] < 0.f ? RED_COLOR : ColorType(v[3], v[4], v[5], v[6]);
+				new_sample->add_vertex(PointType(v[0], v[1], v[2]), n, c);
 			}
+		}
+
+		IndexType faces_idx = 0;
+		IndexType first_vtx = 0;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			std::vector<int>& faces = chunks[i].faces;
+			for (size_t r = 0; r < chunks[i].relative.size(); ++r)
+				faces[chunks[i].relative[r]] += first_vtx;
+			first_vtx += (IndexType)(chunks[i].points.size() / 7);
+
+			for (size_t f = 0; f + 2 < faces.size(); f += 3)
+			{
+				TriangleType tt(*new_sample, faces_idx++);
+				for (int j = 0; j < 3; ++j)
+				{
+					tt.set_i_vetex(j, faces[f + j]);
+					tt.set_i_normal(j, faces[f + j]);	//tricky
+				}
+				new_sample->add_triangle(tt);
+			}
+		}
+	}
+
+	/* Vertices (position, normal, color) and faces of a ply file */
+	static bool load_ply(Sample* new_sample, const std::string& filename)
+	{
+		Loader::Ply_file ply;
+		if (!ply.import_file(filename))
+			return false;
+
+		Loader::Abs_mesh mesh;
+		ply.get_mesh(mesh);
+		const std::vector<float>& colors = ply.get_colors();
+		const size_t nb_vertices = mesh._vertices.size();
+		new_sample->reserve(nb_vertices);
+		for (size_t i = 0; i < nb_vertices; ++i)
+		{
+			const Loader::Vertex& v = mesh._vertices[i];
+			const NormalType n = mesh._normals.size() == nb_vertices ?
+				NormalType(mesh._normals[i].x, mesh._normals[i].y, mesh._normals[i].z) : NULL_NORMAL;
+			const ColorType c = colors.size() ?
+				ColorType(colors[4 * i], colors[4 * i + 1], colors[4 * i + 2], colors[4 * i + 3]) : RED_COLOR;
+			new_sample->add_vertex(PointType(v.x, v.y, v.z), n, c);
+		}
 
+		for (size_t f = 0; f < mesh._triangles.size(); ++f)
+		{
+			TriangleType tt(*new_sample, (int)f);
+			for (int j = 0; j < 3; ++j)
+			{
+				tt.set_i_vetex(j, mesh._triangles[f].v[j]);
+				tt.set_i_normal(j, mesh._triangles[f].v[j]);
+			}
+			new_sample->add_triangle(tt);
 		}
-		else if (type = FileIO::PCMSCENE)
+		return true;
+	}
+
+	bool load_point_cloud_file(Sample* new_sample, std::string filename ,FILE_TYPE type)
+	{
+		if (type == FileIO::PCMSCENE)
 		{
 			new_sample->clear();
 			new_sample->load_scene(filename);
 		}
-		else{
-			fclose(in_file);
-			return false;
+		else if (type == FileIO::PLY)
+		{
+			new_sample->clear();
+			if (!load_ply(new_sample, filename))
+				return false;
 		}
+		else if (type == FileIO::XYZ || type == FileIO::OBJ)
+		{
+			// The file is mapped and cut in chunks of lines parsed in parallel
+			Loader::Mapped_file file;
+			if (!file.open(filename))
+				return false;
 
-		fclose(in_file);
-
+			new_sample->clear();
+			std::vector<PointChunk> chunks;
+			parse_chunks(file, type == FileIO::XYZ ? parse_xyz_chunk : parse_obj_chunk, chunks);
+			add_chunks(new_sample, chunks);
+		}
+		else
+			return false;
 
 		//give the new sample a color
 		new_sample->set_visble(false);
@@ -0,0 +1,269 @@
+#include "flat_bvh.h"
+#include <algorithm>
+namespace
+{
+	const int SAH_BINS = 16;
+	const int MAX_LEAF_SIZE = 4;		// leaves are only made bigger when SAH says so
+	const int FORCED_LEAF_SIZE = 16;	// above, always split
+	const int PARALLEL_SUBTREE_SIZE = 4096;
+	const int PARALLEL_TOP_DEPTH = 8;
+
+	// Node before flattening. count == -1: placeholder for the root of the subtree built
+	// by the parallel job 'left'
+	struct BuildNode
+	{
+		BVHBox box;
+		int left, right;
+		int first, count;
+		int axis;
+	};
+
+	class BVHBuilder
+	{
+	public:
+		BVHBuilder(const std::vector<BVHBox>& boxes, const std::vector<float>& centroids, std::vector<int>& prims)
+			:boxes_(boxes), centroids_(centroids), prims_(prims){}
+
+		BVHBox bound(int begin, int end) const
+		{
+			BVHBox box;
+			box.reset();
+			for (int i = begin; i < end; ++i)
+				box.expand(boxes_[prims_[i]]);
+			return box;
+		}
+
+		// Binned SAH split of [begin, end), false when a leaf is cheaper
+		bool split(int begin, int end, const BVHBox& box, int& mid, int& axis) const
+		{
+			const int count = end - begin;
+			if (count <= 1)
+				return false;
+			BVHBox cbox;
+			cbox.reset();
+			for (int i = begin; i < end; ++i)
+				cbox.expand(&centroids_[3 * prims_[i]]);
+
+			float best_cost = FLT_MAX;
+			int best_bin = -1;
+			axis = -1;
+			for (int a = 0; a < 3; ++a)
+			{
+				const float extent = cbox.bmax[a] - cbox.bmin[a];
+				if (extent <= 0.0f)
+					continue;
+				const float scale = SAH_BINS / extent;
+				BVHBox bins[SAH_BINS];
+				int bin_count[SAH_BINS];
+				for (int b = 0; b < SAH_BINS; ++b)
+				{
+					bins[b].reset();
+					bin_count[b] = 0;
+				}
+				for (int i = begin; i < end; ++i)
+				{
+					int b = std::min(SAH_BINS - 1, (int)((centroids_[3 * prims_[i] + a] - cbox.bmin[a])*scale));
+					bins[b].expand(boxes_[prims_[i]]);
+					++bin_count[b];
+				}
+				// sweep from the right, then from the left
+				float right_area[SAH_BINS];
+				int right_count[SAH_BINS];
+				BVHBox acc;
+				acc.reset();
+				int n = 0;
+				for (int b = SAH_BINS - 1; b > 0; --b)
+				{
+					acc.expand(bins[b]);
+					n += bin_count[b];
+					right_area[b] = acc.area();
+					right_count[b] = n;
+				}
+				acc.reset();
+				n = 0;
+				for (int b = 0; b < SAH_BINS - 1; ++b)
+				{
+					acc.expand(bins[b]);
+					n += bin_count[b];
+					if (n == 0 || right_count[b + 1] == 0)
+						continue;
+					float cost = n * acc.area() + right_count[b + 1] * right_area[b + 1];
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_bin = b;
+						axis = a;
+					}
+				}
+			}
+
+			if (axis < 0)
+			{
+				// every centroid at the same place, only split big sets, in the middle
+				if (count <= FORCED_LEAF_SIZE)
+					return false;
+				axis = 0;
+				mid = begin + count / 2;
+				return true;
+			}
+			const float leaf_cost = count * box.area();
+			const float split_cost = box.area() + best_cost;
+			if (count <= FORCED_LEAF_SIZE && (count <= MAX_LEAF_SIZE ? split_cost >= leaf_cost * 0.5f : split_cost >= leaf_cost))
+				return false;
+
+			const float scale = SAH_BINS / (cbox.bmax[axis] - cbox.bmin[axis]);
+			const float offset = cbox.bmin[axis];
+			const int a = axis;
+			const std::vector<float>& centroids = centroids_;
+			int* m = std::partition(&prims_[0] + begin, &prims_[0] + end, [&](int p)
+			{
+				return std::min(SAH_BINS - 1, (int)((centroids[3 * p + a] - offset)*scale)) <= best_bin;
+			});
+			mid = (int)(m - &prims_[0]);
+			if (mid == begin || mid == end)
+				mid = begin + count / 2;
+			return true;
+		}
+
+		// Whole subtree of [begin, end) in 'pool', its root being at 'depth' in the
+		// tree, returns the index of its root
+		int build(std::vector<BuildNode>& pool, int begin, int end, int depth) const
+		{
+			const int idx = (int)pool.size();
+			pool.push_back(BuildNode());
+			pool[idx].box = bound(begin, end);
+			int mid, axis;
+			if (depth >= BVH_MAX_DEPTH || !split(begin, end, pool[idx].box, mid, axis))
+			{
+				pool[idx].first = begin;
+				pool[idx].count = end - begin;
+				return idx;
+			}
+			pool[idx].count = 0;
+			pool[idx].axis = axis;
+			int left = build(pool, begin, mid, depth + 1);
+			int right = build(pool, mid, end, depth + 1);
+			pool[idx].left = left;
+			pool[idx].right = right;
+			return idx;
+		}
+
+	private:
+		const std::vector<BVHBox>&	boxes_;
+		const std::vector<float>&	centroids_;
+		std::vector<int>&			prims_;
+	};
+
+	// Top of the tree, subtrees smaller than PARALLEL_SUBTREE_SIZE (or deeper than
+	// max_depth) become jobs, 'job_depths' holds the depth of their root
+	int build_top(const BVHBuilder& builder, std::vector<BuildNode>& top, std::vector<std::pair<int, int> >& jobs,
+		std::vector<int>& job_depths, int begin, int end, int depth, int max_depth)
+	{
+		const int idx = (int)top.size();
+		top.push_back(BuildNode());
+		if (end - begin < PARALLEL_SUBTREE_SIZE || depth >= max_depth)
+		{
+			top[idx].count = -1;
+			top[idx].left = (int)jobs.size();
+			jobs.push_back(std::make_pair(begin, end));
+			job_depths.push_back(depth);
+			return idx;
+		}
+		top[idx].box = builder.bound(begin, end);
+		int mid, axis;
+		if (!builder.split(begin, end, top[idx].box, mid, axis))
+		{
+			top[idx].first = begin;
+			top[idx].count = end - begin;
+			return idx;
+		}
+		top[idx].count = 0;
+		top[idx].axis = axis;
+		int left = build_top(builder, top, jobs, job_depths, begin, mid, depth + 1, max_depth);
+		int right = build_top(builder, top, jobs, job_depths, mid, end, depth + 1, max_depth);
+		top[idx].left = left;
+		top[idx].right = right;
+		return idx;
+	}
+
+	// pools[0] is the top, pools[j+1] the subtree of job j
+	int flatten(const std::vector<std::vector<BuildNode> >& pools, int pool, int idx, std::vector<BVHNode>& nodes)
+	{
+		const BuildNode& b = pools[pool][idx];
+		if (b.count == -1)
+			return flatten(pools, b.left + 1, 0, nodes);
+		const int out = (int)nodes.size();
+		nodes.push_back(BVHNode());
+		for (int k = 0; k < 3; ++k)
+		{
+			nodes[out].bmin[k] = b.box.bmin[k];
+			nodes[out].bmax[k] = b.box.bmax[k];
+		}
+		if (b.count > 0)
+		{
+			nodes[out].offset = b.first;
+			nodes[out].count = b.count;
+			return out;
+		}
+		flatten(pools, pool, b.left, nodes);
+		int right = flatten(pools, pool, b.right, nodes);
+		nodes[out].offset = right;
+		nodes[out].count = -(b.axis + 1);
+		return out;
+	}
+}
+
+void build_bvh(const std::vector<BVHBox>& boxes, const std::vector<float>& centroids,
+	std::vector<int>& prims, std::vector<BVHNode>& nodes)
+{
+	const int nb_prims = (int)boxes.size();
+	nodes.clear();
+	prims.resize(nb_prims);
+	if (!nb_prims)
+		return;
+	for (int i = 0; i < nb_prims; ++i)
+		prims[i] = i;
+
+	BVHBuilder builder(boxes, centroids, prims);
+	std::vector<std::vector<BuildNode> > pools(1);
+	std::vector<std::pair<int, int> > jobs;
+	std::vector<int> job_depths;
+	build_top(builder, pools[0], jobs, job_depths, 0, nb_prims, 0, PARALLEL_TOP_DEPTH);
+	pools.resize(jobs.size() + 1);
+	#pragma omp parallel for schedule(dynamic)
+	for (int j = 0; j < (int)jobs.size(); ++j)
+		builder.build(pools[j + 1], jobs[j].first, jobs[j].second, job_depths[j]);
+
+	nodes.reserve(2 * nb_prims);
+	flatten(pools, 0, 0, nodes);
+}
+
+void refit_bvh(const std::vector<BVHBox>& boxes, std::vector<BVHNode>& nodes)
+{
+	// children are stored after their parent
+	for (int i = (int)nodes.size() - 1; i >= 0; --i)
+	{
+		BVHNode& node = nodes[i];
+		BVHBox box;
+		box.reset();
+		if (node.is_leaf())
+		{
+			for (int t = node.offset; t < node.offset + node.count; ++t)
+				box.expand(boxes[t]);
+		}
+		else
+		{
+			const BVHNode& left = nodes[i + 1];
+			const BVHNode& right = nodes[node.offset];
+			box.expand(left.bmin);
+			box.expand(left.bmax);
+			box.expand(right.bmin);
+			box.expand(right.bmax);
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			node.bmin[k] = box.bmin[k];
+			node.bmax[k] = box.bmax[k];
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <cfloat>
+/*
+	Flat triangle BVH shared by the ray caster (KDTree) and the visibility tester of
+	the rig (Tri_bvh). Built with binned SAH, the top of the tree is split serially and
+	the subtrees are built in parallel. Only the tree is built here, each user keeps its
+	own triangle data in the primitive order returned by build_bvh().
+*/
+const int BVH_MAX_DEPTH = 60;					// deeper nodes become leaves, bounds the traversal stacks
+const int BVH_STACK_SIZE = BVH_MAX_DEPTH + 4;
+
+// Node of the flattened BVH, depth first order: the left child of an inner node
+// directly follows it, 'offset' is the right child. Leaves store 'count' triangles
+// starting at 'offset' in the BVH triangle order. 32 bytes, two nodes per cache line.
+struct BVHNode
+{
+	float	bmin[3];
+	float	bmax[3];
+	int		offset;
+	int		count;		// > 0 for leaves, -(split axis + 1) for inner nodes
+	bool is_leaf() const { return count > 0; }
+	int	 axis() const { return -count - 1; }
+};
+
+struct BVHBox
+{
+	float bmin[3];
+	float bmax[3];
+	void reset()
+	{
+		bmin[0] = bmin[1] = bmin[2] = FLT_MAX;
+		bmax[0] = bmax[1] = bmax[2] = -FLT_MAX;
+	}
+	void expand(const float* p)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			bmin[k] = bmin[k] < p[k] ? bmin[k] : p[k];
+			bmax[k] = bmax[k] > p[k] ? bmax[k] : p[k];
+		}
+	}
+	void expand(const BVHBox& b)
+	{
+		expand(b.bmin);
+		expand(b.bmax);
+	}
+	float area() const
+	{
+		float dx = bmax[0] - bmin[0], dy = bmax[1] - bmin[1], dz = bmax[2] - bmin[2];
+		if (dx < 0)
+			return 0.0f;
+		return 2.0f * (dx*dy + dy*dz + dz*dx);
+	}
+};
+
+// 'boxes' and 'centroids' (3 floats each) per triangle. 'prims' gets the triangle
+// order of the leaves, 'nodes' the flattened tree (empty when there is no triangle)
+void build_bvh(const std::vector<BVHBox>& boxes, const std::vector<float>& centroids,
+	std::vector<int>& prims, std::vector<BVHNode>& nodes);
+
+// Triangles moved: recompute the node boxes bottom up, the tree is kept.
+// 'boxes' holds one box per triangle, in the BVH triangle order
+void refit_bvh(const std::vector<BVHBox>& boxes, std::vector<BVHNode>& nodes);
+
+// Entry distance of the ray in the box, FLT_MAX if it misses it or enters after max_t
+inline float bvh_slab(const BVHNode& node, const float* o, const float* inv_d, float max_t)
+{
+	float t0 = 0.0f, t1 = max_t;
+	for (int k = 0; k < 3; ++k)
+	{
+		float tn = (node.bmin[k] - o[k]) * inv_d[k];
+		float tf = (node.bmax[k] - o[k]) * inv_d[k];
+		// NaN (0 * inf): the ray is parallel to the axis and starts on a slab
+		// plane, it stays inside the slab so the axis does not clip the range
+		if (tn != tn || tf != tf)
+			continue;
+		if (tn > tf) { float tmp = tn; tn = tf; tf = tmp; }
+		t0 = tn > t0 ? tn : t0;
+		t1 = tf < t1 ? tf : t1;
+	}
+	return t0 <= t1 ? t0 : FLT_MAX;
+}
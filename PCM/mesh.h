@@ -1,6 +1,7 @@
 #pragma once
 #include "basic_types.h"
 #include "rendering/render_types.h"
+#include "vertex_store.h"
 #include "QGLViewer/frame.h"
 #include <vector>
 #include <string>
@@ -22,12 +23,14 @@ namespace pcm
 	class Mesh
 	{
 	public:
-		Mesh() :opengl_mesh_(NULL)
+		Mesh() :vertex_store_(NULL), opengl_mesh_(NULL)
 		{
 
 		}
-		Mesh(std::vector<Vertex*>&	_vertices, std::vector<TriangleType*>&  _triangle_array, std::vector<Texture*>& _textures)
+		/* '_vertices' are views of '_store', the mesh takes ownership of both */
+		Mesh(VertexStore* _store, std::vector<Vertex*>&	_vertices, std::vector<TriangleType*>&  _triangle_array, std::vector<Texture*>& _textures)
 		{
+			vertex_store_ = _store;
 			vertices_ = _vertices;
 			triangle_array_ = _triangle_array;
 			textures_ = _textures;
@@ -44,6 +47,8 @@ namespace pcm
 				delete vertices_[i];
 			}
 			vertices_.clear();
+			delete vertex_store_;
+			vertex_store_ = NULL;
 			for (int i = 0; i < triangle_array_.size(); ++i)
 			{
 				delete triangle_array_[i];
@@ -82,6 +87,7 @@ namespace pcm
 	
 	private:
 		qglviewer::Frame m_frame;
+		VertexStore*			vertex_store_;	// columns behind vertices_
 		std::vector<Vertex*>	vertices_;
 		std::vector<TriangleType*>  triangle_array_;
 		std::vector<Texture*> textures_;
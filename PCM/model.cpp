@@ -37,21 +37,24 @@ namespace pcm
 		vector<TriangleType*> indices;
 		vector<Texture*> textures;
 
+		// One store for the whole mesh, the vertices are views into it like in Sample
+		VertexStore* store = new VertexStore;
+		store->reserve(_mesh->mNumVertices);
+		vertices.reserve(_mesh->mNumVertices);
 		// Walk through each of the mesh's vertices
 		for (GLuint i = 0; i < _mesh->mNumVertices; i++)
 		{
-			Vertex* vertex = new Vertex(i);
 			pcm::PointType vector; // We declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
 								   // Positions
 			vector(0) = _mesh->mVertices[i].x;
 			vector(1) = _mesh->mVertices[i].y;
 			vector(2) = _mesh->mVertices[i].z;
-			vertex->set_position(vector);
 			// Normals
-			vector(0) = _mesh->mNormals[i].x;
-			vector(1) = _mesh->mNormals[i].y;
-			vector(2) = _mesh->mNormals[i].z;
-			vertex->set_normal(vector);
+			pcm::NormalType normal;
+			normal(0) = _mesh->mNormals[i].x;
+			normal(1) = _mesh->mNormals[i].y;
+			normal(2) = _mesh->mNormals[i].z;
+			Vertex* vertex = new Vertex(store, store->push_back(vector, normal, NULL_COLOR));
 			// Texture Coordinates
 			if (_mesh->mTextureCoords[0]) // Does the mesh contain texture coordinates?
 			{
@@ -118,7 +121,7 @@ namespace pcm
 		}
 
 
-		Mesh* mesh = new Mesh(vertices, indices, textures);
+		Mesh* mesh = new Mesh(store, vertices, indices, textures);
 		return mesh;
 
 	}
@@ -0,0 +1,209 @@
+#include "normal_estimator.h"
+#include "sample.h"
+#include "vertex.h"
+#include <algorithm>
+#include <queue>
+
+using namespace pcm;
+
+namespace
+{
+	struct MstEdge
+	{
+		MstEdge(ScalarType _w, IndexType _to, IndexType _from) :w(_w), to(_to), from(_from){}
+		ScalarType	w;
+		IndexType	to;
+		IndexType	from;
+	};
+	struct greater_weight
+	{
+		bool operator()(const MstEdge& lhs, const MstEdge& rhs) const
+		{
+			return lhs.w > rhs.w;
+		}
+	};
+	struct higher_point
+	{
+		higher_point(const VertexStore& s) :store(s){}
+		bool operator()(IndexType a, IndexType b) const
+		{
+			return store.position(a)[2] > store.position(b)[2];
+		}
+		const VertexStore& store;
+	};
+}
+
+NormalEstimator::NormalEstimator(Sample& smp, IndexType k) :smp_(smp), k_(k)
+{
+}
+
+void NormalEstimator::compute(const NormalType& baseline, Orientation orient)
+{
+	const IndexType n = smp_.num_vertices();
+	k_ = std::min(k_, n);
+	neighbours_.resize((size_t)n * k_);
+	normals_.resize(n);
+	curvatures_.resize(n);
+	planarities_.resize(n);
+	if (!n)
+		return;
+
+	fit();
+	if (orient == ORIENT_MST)
+		orient_mst(baseline);
+	else
+		orient_baseline(baseline);
+}
+
+// knn query and plane fit of every point
+void NormalEstimator::fit()
+{
+	const IndexType n = smp_.num_vertices();
+	const IndexType k = k_;
+	const VertexStore& store = smp_.vertex_store();
+	smp_.build_kdtree();
+
+	#pragma omp parallel
+	{
+		std::vector<ScalarType> dist(k);
+		#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < n; ++i)
+		{
+			IndexType* nb = &neighbours_[(size_t)i * k];
+			if (!smp_.neighbours(i, k, nb, &dist[0]))
+			{
+				std::fill(nb, nb + k, i);
+				normals_[i] = NULL_NORMAL;
+				curvatures_[i] = planarities_[i] = 0;
+				continue;
+			}
+
+			Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+			for (IndexType j = 0; j < k; ++j)
+			{
+				const ScalarType* p = store.position(nb[j]);
+				mean += Eigen::Vector3d(p[0], p[1], p[2]);
+			}
+			mean /= k;
+			Eigen::Matrix3d cov = Eigen::Matrix3d::Zero();
+			for (IndexType j = 0; j < k; ++j)
+			{
+				const ScalarType* p = store.position(nb[j]);
+				Eigen::Vector3d d = Eigen::Vector3d(p[0], p[1], p[2]) - mean;
+				cov += d * d.transpose();
+			}
+
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+			solver.computeDirect(cov);
+			const Eigen::Vector3d& l = solver.eigenvalues();
+			Eigen::Vector3d nv = solver.eigenvectors().col(0);
+			normals_[i] = NormalType((ScalarType)nv(0), (ScalarType)nv(1), (ScalarType)nv(2));
+			normals_[i].normalize();
+
+			const double l0 = std::max(l(0), 0.);
+			const double sum = l0 + l(1) + l(2);
+			curvatures_[i] = sum > 0 ? (ScalarType)(l0 / sum) : 0;
+			planarities_[i] = l(2) > 0 ? (ScalarType)((l(1) - l0) / l(2)) : 0;
+		}
+	}
+}
+
+void NormalEstimator::orient_baseline(const NormalType& baseline)
+{
+	const IndexType n = smp_.num_vertices();
+	#pragma omp parallel for
+	for (int i = 0; i < n; ++i)
+	{
+		if (baseline.dot(normals_[i]) < 0)
+			normals_[i] = -normals_[i];
+	}
+}
+
+void NormalEstimator::orient_mst(const NormalType& baseline)
+{
+	const IndexType n = smp_.num_vertices();
+	const IndexType k = k_;
+	const VertexStore& store = smp_.vertex_store();
+
+	// the knn graph made symmetric, in compressed rows
+	std::vector<IndexType> offset(n + 1, 0);
+	for (IndexType i = 0; i < n; ++i)
+	{
+		for (IndexType j = 0; j < k; ++j)
+		{
+			IndexType nb = neighbours_[(size_t)i * k + j];
+			if (nb == i)
+				continue;
+			++offset[i + 1];
+			++offset[nb + 1];
+		}
+	}
+	for (IndexType i = 0; i < n; ++i)
+		offset[i + 1] += offset[i];
+	std::vector<IndexType> adjacency(offset[n]);
+	std::vector<IndexType> fill(offset.begin(), offset.end() - 1);
+	for (IndexType i = 0; i < n; ++i)
+	{
+		for (IndexType j = 0; j < k; ++j)
+		{
+			IndexType nb = neighbours_[(size_t)i * k + j];
+			if (nb == i)
+				continue;
+			adjacency[fill[i]++] = nb;
+			adjacency[fill[nb]++] = i;
+		}
+	}
+
+	// every point not yet reached is the highest one of its connected part
+	std::vector<IndexType> seeds(n);
+	for (IndexType i = 0; i < n; ++i)
+		seeds[i] = i;
+	std::sort(seeds.begin(), seeds.end(), higher_point(store));
+
+	const NormalType up(0., 0., 1.);
+	const NormalType& seed_dir = baseline.squaredNorm() > 0 ? baseline : up;
+	std::vector<char> visited(n, 0);
+	std::priority_queue<MstEdge, std::vector<MstEdge>, greater_weight> heap;
+	for (IndexType s = 0; s < n; ++s)
+	{
+		IndexType seed = seeds[s];
+		if (visited[seed])
+			continue;
+		if (seed_dir.dot(normals_[seed]) < 0)
+			normals_[seed] = -normals_[seed];
+		heap.push(MstEdge(0, seed, seed));
+
+		// Prim: the orientation follows the edges of smallest normal change first
+		while (!heap.empty())
+		{
+			MstEdge e = heap.top();
+			heap.pop();
+			if (visited[e.to])
+				continue;
+			visited[e.to] = 1;
+			if (normals_[e.from].dot(normals_[e.to]) < 0)
+				normals_[e.to] = -normals_[e.to];
+			const NormalType& nv = normals_[e.to];
+			for (IndexType a = offset[e.to]; a < offset[e.to + 1]; ++a)
+			{
+				IndexType nb = adjacency[a];
+				if (!visited[nb])
+					heap.push(MstEdge(1 - std::fabs(nv.dot(normals_[nb])), nb, e.to));
+			}
+		}
+	}
+}
+
+void NormalEstimator::apply()
+{
+	VertexStore& store = smp_.vertex_store();
+	const IndexType n = (IndexType)normals_.size();
+	#pragma omp parallel for
+	for (int i = 0; i < n; ++i)
+	{
+		ScalarType* p = store.normal(i);
+		p[0] = normals_[i](0);
+		p[1] = normals_[i](1);
+		p[2] = normals_[i](2);
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef _NORMAL_ESTIMATOR_H
+#define _NORMAL_ESTIMATOR_H
+#include "basic_types.h"
+#include <vector>
+
+class Sample;
+
+/*
+	PCA normals of a point only sample.
+
+	Every point queries its k nearest neighbours and fits a plane to them in the same
+	pass (the points are spread over the threads): the 3x3 covariance is accumulated in
+	double and solved in closed form, the normal is the eigenvector of the smallest
+	eigenvalue l0 (l0 <= l1 <= l2). By-products:
+
+		curvature	l0 / (l0 + l1 + l2)		(surface variation, 0 on a plane, 1/3 at most)
+		planarity	(l1 - l0) / l2
+
+	Orientation:
+		ORIENT_BASELINE		flip every normal facing away from 'baseline' (old behaviour)
+		ORIENT_MST			propagate the orientation along a minimum spanning tree of the
+							k-nn graph weighted by 1 - |ni.nj| (Hoppe 92). The seed of each
+							connected part is its highest point, oriented along 'baseline',
+							or towards +z when baseline is null.
+*/
+class NormalEstimator
+{
+public:
+	enum Orientation { ORIENT_BASELINE, ORIENT_MST };
+
+	NormalEstimator(Sample& smp, IndexType k = 36);
+
+	void compute(const pcm::NormalType& baseline, Orientation orient = ORIENT_BASELINE);
+	// write the normals into the sample
+	void apply();
+
+	const std::vector<pcm::NormalType>&	normals() const		{ return normals_; }
+	const std::vector<ScalarType>&		curvatures() const	{ return curvatures_; }
+	const std::vector<ScalarType>&		planarities() const	{ return planarities_; }
+	// k nearest neighbours of point i (itself included), valid after compute()
+	const IndexType* neighbours(IndexType i) const { return &neighbours_[(size_t)i * k_]; }
+	IndexType k() const { return k_; }
+
+private:
+	void fit();
+	void orient_baseline(const pcm::NormalType& baseline);
+	void orient_mst(const pcm::NormalType& baseline);
+
+	Sample&							smp_;
+	IndexType						k_;
+	std::vector<IndexType>			neighbours_;	// k_ x N
+	std::vector<pcm::NormalType>	normals_;
+	std::vector<ScalarType>			curvatures_;
+	std::vector<ScalarType>			planarities_;
+};
+
+#endif
@@ -14,6 +14,8 @@ int   (*big_long)     ( int i   ) = 0;
 int   (*little_long)  ( int i   ) = 0;
 float (*big_float)    ( float f ) = 0;
 float (*little_float) ( float f ) = 0;
+double (*big_double)    ( double d ) = 0;
+double (*little_double) ( double d ) = 0;
 
 // -----------------------------------------------------------------------------
 
@@ -96,6 +98,29 @@ float float_no_swap( float f )
 
 // -----------------------------------------------------------------------------
 
+double double_swap( double d )
+{
+  union
+  {
+    double d;
+    unsigned char b[8];
+  } dat1, dat2;
+
+  dat1.d = d;
+  for(int i = 0; i < 8; i++)
+    dat2.b[i] = dat1.b[7 - i];
+  return dat2.d;
+}
+
+// -----------------------------------------------------------------------------
+
+double double_no_swap( double d )
+{
+  return d;
+}
+
+// -----------------------------------------------------------------------------
+
 void init()
 {
     //set func pointers to correct funcs
@@ -108,6 +133,8 @@ void init()
         little_long  = long_no_swap;
         big_float    = float_swap;
         little_float = float_no_swap;
+        big_double    = double_swap;
+        little_double = double_no_swap;
     }
     else
     {
@@ -116,8 +143,10 @@ void init()
         little_short = short_swap;
         big_long     = long_no_swap;
         little_long  = long_swap;
-        big_float    = float_swap;
-        little_float = float_no_swap;
+        big_float    = float_no_swap;
+        little_float = float_swap;
+        big_double    = double_no_swap;
+        little_double = double_swap;
     }
 }
 
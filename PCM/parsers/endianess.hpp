@@ -31,6 +31,10 @@ extern int   (*little_long)  ( int i   );
 extern float (*big_float)    ( float f );
 /// @return a little endian float
 extern float (*little_float) ( float f );
+/// @return a big endian double
+extern double (*big_double)    ( double d );
+/// @return a little endian double
+extern double (*little_double) ( double d );
 
 }
 // =============================================================================
@@ -3,6 +3,7 @@
 //#include "parsers/fbx_loader.hpp"
 #include "parsers/obj_loader.hpp"
 #include "parsers/off_loader.hpp"
+#include "parsers/ply_loader.hpp"
 #include "parsers/graph_loader.hpp"
 #include "toolbox/std_utils/string.hpp"
 
@@ -39,6 +40,8 @@ Base_loader* make_loader(const std::string& file_name)
         return new Loader::Obj_file(file_name);
     else if( ext == ".off")
         return new Loader::Off_file(file_name);
+    else if( ext == ".ply")
+        return new Loader::Ply_file(file_name);
     else if( ext == ".skel")
         return new Loader::Graph_file(file_name);
     else
@@ -27,7 +27,7 @@
   One can add new loaders by inheriting from Base_loader.
   Don't forget to update the make_loader() to take into acount your new loader
 
-  @see Generic_file Obj_file Off_file Fbx_file
+  @see Generic_file Obj_file Off_file Ply_file Fbx_file
 */
 
 // =============================================================================
@@ -83,7 +83,7 @@ public:
 
 /// Factory method
 /// Allocate the correct loader given the file type and parse the file
-/// @note supported formats : .obj, .off, .skel and .fbx
+/// @note supported formats : .obj, .off, .ply, .skel and .fbx
 Base_loader* make_loader(const std::string& file_name);
 
 } // END namespace Loader ======================================================
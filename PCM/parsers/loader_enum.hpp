@@ -13,6 +13,7 @@ enum Loader_t {
     OBJ,          ///< .obj
     OFF,          ///< .off
     SKEL,         ///< .skel
+    PLY,          ///< .ply
     NOT_HANDLED
 };
 
@@ -0,0 +1,130 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+Mapped_file::Mapped_file() :
+    _data(0),
+    _size(0),
+    _is_open(false)
+#ifdef _WIN32
+    , _file(0)
+    , _mapping(0)
+#endif
+{
+}
+
+// -----------------------------------------------------------------------------
+
+Mapped_file::~Mapped_file()
+{
+    close();
+}
+
+// -----------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+bool Mapped_file::open(const std::string& path)
+{
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if( file == INVALID_HANDLE_VALUE ) return false;
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx(file, &size) ){
+        CloseHandle( file );
+        return false;
+    }
+
+    _file    = file;
+    _size    = (size_t)size.QuadPart;
+    _is_open = true;
+    // Mapping an empty file fails
+    if( _size == 0 ) return true;
+
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if( mapping == 0 ){
+        close();
+        return false;
+    }
+    _mapping = mapping;
+    _data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if( _data == 0 ){
+        close();
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Mapped_file::close()
+{
+    if( _data    != 0 ) UnmapViewOfFile( _data );
+    if( _mapping != 0 ) CloseHandle( (HANDLE)_mapping );
+    if( _file    != 0 ) CloseHandle( (HANDLE)_file );
+    _data    = 0;
+    _mapping = 0;
+    _file    = 0;
+    _size    = 0;
+    _is_open = false;
+}
+
+#else
+
+bool Mapped_file::open(const std::string& path)
+{
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if( fd < 0 ) return false;
+
+    struct stat st;
+    if( fstat(fd, &st) != 0 ){
+        ::close( fd );
+        return false;
+    }
+
+    _size = (size_t)st.st_size;
+    if( _size > 0 )
+    {
+        void* data = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if( data == MAP_FAILED ){
+            ::close( fd );
+            _size = 0;
+            return false;
+        }
+        madvise(data, _size, MADV_SEQUENTIAL);
+        _data = (const char*)data;
+    }
+    // The mapping stays valid once the descriptor is closed
+    ::close( fd );
+    _is_open = true;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Mapped_file::close()
+{
+    if( _data != 0 ) munmap( (void*)_data, _size );
+    _data    = 0;
+    _size    = 0;
+    _is_open = false;
+}
+
+#endif
+
+}// END Loader =================================================================
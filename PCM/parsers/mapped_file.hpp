@@ -0,0 +1,53 @@
+#ifndef MAPPED_FILE_HPP__
+#define MAPPED_FILE_HPP__
+
+#include <string>
+#include <cstddef>
+
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+/**
+ * @class Mapped_file
+ * @brief Read only memory mapping of a whole file
+ *
+ * The file content is accessed through data() without any copy, pages are
+ * loaded by the system on first access. Several threads can read the
+ * mapping concurrently. The pointer is valid until close() or the
+ * destruction of the object. An empty file opens fine with data() == 0.
+*/
+class Mapped_file {
+public:
+    Mapped_file();
+    ~Mapped_file();
+
+    /// Map 'path', closes the previous mapping if any
+    /// @return false if the file can't be opened or mapped
+    bool open(const std::string& path);
+
+    void close();
+
+    bool is_open() const { return _is_open; }
+
+    const char* data() const { return _data; }
+    const char* end () const { return _data + _size; }
+    size_t      size() const { return _size; }
+
+private:
+    // Non copyable
+    Mapped_file(const Mapped_file&);
+    Mapped_file& operator=(const Mapped_file&);
+
+    const char* _data;
+    size_t _size;
+    bool _is_open;
+#ifdef _WIN32
+    void* _file;    ///< HANDLE of the file
+    void* _mapping; ///< HANDLE of the mapping
+#endif
+};
+
+}// END Loader =================================================================
+
+#endif // MAPPED_FILE_HPP__
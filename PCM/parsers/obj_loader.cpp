@@ -9,6 +9,8 @@
 //------------------------------------------------------------------------------
 
 #include "parsers/obj_loader.hpp"
+#include "parsers/mapped_file.hpp"
+#include "parsers/text_parser.hpp"
 #include <algorithm>
 #include <string>
 #include <math.h> // TODO: use cmath
@@ -860,6 +862,205 @@ struct Wavefront_data {
     std::vector<In::Line>         _lines;
 };
 
+// Parallel parsing ============================================================
+
+/// Is the line ending right before 'p' continued by a backslash
+/// @param begin first character of that line
+static bool is_continued(const char* begin, const char* p)
+{
+    // 'p' follows a new line
+    const char* c = p - 2;
+    if( c >= begin && *c == '\r' ) --c;
+    return c >= begin && *c == '\\';
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+  @struct Obj_chunk
+  @brief The vertices, normals, tex coords and faces of a chunk of lines
+
+  These statements are the bulk of a file and don't depend on the previous
+  lines. Everything else (groups, materials, relative indices, continued
+  lines, points, lines...) is kept as a Statement and read in order by
+  Obj_file when the chunks are concatenated.
+*/
+struct Obj_chunk {
+
+    struct Counts { size_t _verts, _normals, _tex, _faces; };
+
+    struct Statement {
+        const char* _begin; ///< first character of the line
+        const char* _end;   ///< after the last new line of the statement
+        unsigned _line;     ///< line number in the chunk
+        Counts _counts;     ///< number of elements of the chunk before it
+    };
+
+    Obj_chunk() : _nb_lines(0) { }
+
+    Counts counts() const {
+        Counts c = {_vertices.size(), _normals.size(), _texCoords.size(), _triangles.size()};
+        return c;
+    }
+
+    /// Append to 'mesh' the elements between the counts 'from' and 'to'
+    void append(Wavefront_mesh& mesh, const Counts& from, const Counts& to) const
+    {
+        mesh._vertices. insert(mesh._vertices. end(), _vertices. begin() + from._verts,   _vertices. begin() + to._verts  );
+        mesh._normals.  insert(mesh._normals.  end(), _normals.  begin() + from._normals, _normals.  begin() + to._normals);
+        mesh._texCoords.insert(mesh._texCoords.end(), _texCoords.begin() + from._tex,     _texCoords.begin() + to._tex    );
+        mesh._triangles.insert(mesh._triangles.end(), _triangles.begin() + from._faces,   _triangles.begin() + to._faces  );
+    }
+
+    void swap(Obj_chunk& c)
+    {
+        _vertices.  swap( c._vertices   );
+        _normals.   swap( c._normals    );
+        _texCoords. swap( c._texCoords  );
+        _triangles. swap( c._triangles  );
+        _statements.swap( c._statements );
+        std::swap(_nb_lines, c._nb_lines);
+    }
+
+    std::vector<In::Vert>      _vertices;
+    std::vector<In::Normal>    _normals;
+    std::vector<In::Tex_coord> _texCoords;
+    std::vector<In::Face>      _triangles;
+    std::vector<Statement>     _statements;
+    unsigned _nb_lines;
+};
+
+// -----------------------------------------------------------------------------
+
+/// Parse 'nb' floats of the line [p, end) which must end afterwards
+static bool parse_floats(const char* p, const char* end, float* vals, int nb)
+{
+    for(int i = 0; i < nb; ++i)
+        if( !Text::parse_float(p, end, vals[i]) ) return false;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Parse the vertex indices of a face "v v/t v//n v/t/n ..." and add its
+/// triangles to 'c'.
+/// @return false for the faces left to Obj_file::read_face(): relative
+/// indices or unexpected syntax
+static bool parse_face(const char* p, const char* end, Obj_chunk& c,
+                       std::vector<int>& verts,
+                       std::vector<int>& norms,
+                       std::vector<int>& uvs)
+{
+    verts.clear();
+    norms.clear();
+    uvs.clear();
+    while( !Text::is_eol(p, end) )
+    {
+        int v, t = 0, n = 0;
+        if( !Text::parse_int(p, end, v) ) return false;
+        if( p < end && *p == '/' )
+        {
+            ++p;
+            if( p < end && *p == '/' ){
+                ++p;
+                if( !Text::parse_int(p, end, n) ) return false;
+            } else {
+                Text::parse_int(p, end, t);
+                if( p < end && *p == '/' ){
+                    ++p;
+                    Text::parse_int(p, end, n);
+                }
+            }
+        }
+        if( p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' )
+            return false;
+        if( v <= 0 || t < 0 || n < 0 ) return false;
+
+        // obj indices are 1 based, change them to zero based indices
+        verts.push_back(v - 1);
+        norms.push_back(n - 1);
+        uvs.  push_back(t - 1);
+    }
+
+    // construct triangles from indices
+    for(unsigned i = 2; i < verts.size(); ++i)
+    {
+        In::Face f;
+        f.v[0] = verts[0];   f.n[0] = norms[0];   f.t[0] = uvs[0];
+        f.v[1] = verts[i-1]; f.n[1] = norms[i-1]; f.t[1] = uvs[i-1];
+        f.v[2] = verts[i];   f.n[2] = norms[i];   f.t[2] = uvs[i];
+        c._triangles.push_back(f);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Parse the lines [begin, end) into 'c'
+static void parse_chunk(const char* begin, const char* end, Obj_chunk& c)
+{
+    using namespace Text;
+    std::vector<int> verts, norms, uvs;
+    const char* p = begin;
+    while( p < end )
+    {
+        const unsigned line = c._nb_lines;
+        // Logical line: new lines after a backslash are part of it
+        const char* line_end = next_line(p, end);
+        ++c._nb_lines;
+        bool continued = false;
+        while( line_end < end && is_continued(p, line_end) ){
+            line_end = next_line(line_end, end);
+            ++c._nb_lines;
+            continued = true;
+        }
+
+        const char* k     = skip_blanks(p, line_end);
+        const char* k_end = skip_token (k, line_end);
+        const size_t len  = k_end - k;
+        float vals[3];
+        bool done;
+        if( len == 0 || *k == '#' ) // empty line or comment
+            done = true;
+        else if( continued )
+            done = false;
+        else if( len == 1 && k[0] == 'v' )
+        {
+            done = parse_floats(k_end, line_end, vals, 3);
+            if( done ) c._vertices.push_back( In::Vert(vals[0], vals[1], vals[2]) );
+        }
+        else if( len == 2 && k[0] == 'v' && k[1] == 'n' )
+        {
+            done = parse_floats(k_end, line_end, vals, 3);
+            if( done ) c._normals.push_back( In::Normal(vals[0], vals[1], vals[2]) );
+        }
+        else if( len == 2 && k[0] == 'v' && k[1] == 't' )
+        {
+            done = parse_floats(k_end, line_end, vals, 2);
+            if( done ) c._texCoords.push_back( In::Tex_coord(vals[0], vals[1]) );
+        }
+        else if( (len == 1 && k[0] == 'f') || (len == 2 && k[0] == 'f' && k[1] == 'o') )
+        {
+            const size_t nb_faces = c._triangles.size();
+            done = parse_face(k_end, line_end, c, verts, norms, uvs);
+            if( !done ) c._triangles.resize( nb_faces );
+        }
+        else
+            done = false;
+
+        if( !done )
+        {
+            Obj_chunk::Statement st;
+            st._begin  = k;
+            st._end    = line_end;
+            st._line   = line + 1;
+            st._counts = c.counts();
+            c._statements.push_back( st );
+        }
+        p = line_end;
+    }
+}
+
 // CLASS Obj_File ==============================================================
 
 std::string Obj_file::read_chunk(std::istream& ifs)
@@ -1256,6 +1457,88 @@ std::string Obj_file::eat_line(std::istream& ifs)
 
 //------------------------------------------------------------------------------
 
+void Obj_file::read_statement(const std::string& s, std::istream& ifs, unsigned line)
+{
+    if(s.size() == 0)
+        return;
+    else if(s[0]=='#') // comment, skip line
+        eat_line(ifs);
+    else if(s=="deg")
+        std::cerr << "[ERROR] Unable to handle deg yet. Sorry! RB.\n";
+    else if(s=="cstype")  // a new group of faces, ie a seperate mesh
+        std::cerr << "[ERROR] Unable to handle cstype yet. Sorry! RB.\n";
+    else if(s=="bzp") // a new group of faces, ie a seperate mesh
+    {
+        In::Bezier_patch bzp;
+        std::string text = read_chunk(ifs);
+
+        sscanf(text.c_str(),"%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d",
+               &bzp._vertex_indices[0][0],
+               &bzp._vertex_indices[0][1],
+               &bzp._vertex_indices[0][2],
+               &bzp._vertex_indices[0][3],
+
+               &bzp._vertex_indices[1][0],
+               &bzp._vertex_indices[1][1],
+               &bzp._vertex_indices[1][2],
+               &bzp._vertex_indices[1][3],
+
+               &bzp._vertex_indices[2][0],
+               &bzp._vertex_indices[2][1],
+               &bzp._vertex_indices[2][2],
+               &bzp._vertex_indices[2][3],
+
+               &bzp._vertex_indices[3][0],
+               &bzp._vertex_indices[3][1],
+               &bzp._vertex_indices[3][2],
+               &bzp._vertex_indices[3][3]);
+
+        // subtract 1 from all indices
+        for(unsigned i=0;i!=4;++i)
+            for(unsigned j=0;j!=4;++j)
+                --bzp._vertex_indices[i][j];
+    }
+    else if(s=="g") // a new group of faces, ie a seperate mesh
+        read_group(ifs);
+    else if(s=="f"||s=="fo") // face
+        read_face(ifs);
+    else if(s=="p") // points
+        read_points(ifs);
+    else if(s=="l") // lines
+        read_line(ifs);
+    else if(s=="vt") // texture coord
+        _mesh->_texCoords.push_back( In::Tex_coord(ifs) );
+    else if(s=="vn") // normal
+        _mesh->_normals.push_back( In::Normal(ifs) );
+    else if(s=="v") // vertex
+        _mesh->_vertices.push_back( In::Vert(ifs) );
+    else if(s=="vp") // vertex parameter
+        _data->_vertexParams.push_back( In::Vertex_param(ifs) );
+    else if(s=="mtllib") // material library
+        read_material_lib(ifs);
+    else if(s=="usemtl") // material to apply
+        read_use_material(ifs);
+    else if(s=="end"  || s=="parm"|| s=="stech"|| s=="ctech"|| s=="curv"||
+            s=="curv2"|| s=="surf"|| s=="bmat" || s=="res"  || s=="sp"  ||
+            s=="trim" || s=="hole")
+    {
+
+        std::cerr << "[ERROR] Unable to handle " << s << " outside of cstype/end pair\n";
+        std::cerr << "[ERROR] Unable to handle cstype yet. Sorry! RB.\n";
+        read_chunk(ifs);
+    }
+    else
+    {
+        std::string field = s + eat_line(ifs);
+
+        std::cerr << "WARNING line " << line << ": the field '"<< field;
+        std::cerr << "' could not be read in file ";
+        std::cerr << _file_path << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+
 bool Obj_file::import_file(const std::string& file_path)
 {
     Loader::Base_loader::update_paths( file_path );
@@ -1264,95 +1547,63 @@ bool Obj_file::import_file(const std::string& file_path)
     release();
     init();
 
-    std::ifstream ifs( file_path.c_str() );
-    if (!ifs) return false;
+    Mapped_file file;
+    if( !file.open(file_path) ) return false;
 
-    // loop through the file to the end
-    unsigned line = 0;
-    while(!ifs.eof())
+    // The vertices and faces are parsed in parallel over chunks of lines
+    std::vector<const char*> bounds;
+    Text::split_lines(file.data(), file.end(), Text::nb_chunks(file.size()), bounds);
+    const int nb_chunks = (int)bounds.size() - 1;
+    for(int c = 1; c < nb_chunks; ++c)
     {
-        std::string s;
-
-        ifs >> s;
-
-        line++;
-        if(s.size() == 0)
-            continue;
-        else if(s[0]=='#') // comment, skip line
-            eat_line(ifs);
-        else if(s=="deg")
-            std::cerr << "[ERROR] Unable to handle deg yet. Sorry! RB.\n";
-        else if(s=="cstype")  // a new group of faces, ie a seperate mesh
-            std::cerr << "[ERROR] Unable to handle cstype yet. Sorry! RB.\n";
-        else if(s=="bzp") // a new group of faces, ie a seperate mesh
-        {
-            In::Bezier_patch bzp;
-            std::string text = read_chunk(ifs);
-
-            sscanf(text.c_str(),"%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d",
-                   &bzp._vertex_indices[0][0],
-                   &bzp._vertex_indices[0][1],
-                   &bzp._vertex_indices[0][2],
-                   &bzp._vertex_indices[0][3],
-
-                   &bzp._vertex_indices[1][0],
-                   &bzp._vertex_indices[1][1],
-                   &bzp._vertex_indices[1][2],
-                   &bzp._vertex_indices[1][3],
-
-                   &bzp._vertex_indices[2][0],
-                   &bzp._vertex_indices[2][1],
-                   &bzp._vertex_indices[2][2],
-                   &bzp._vertex_indices[2][3],
-
-                   &bzp._vertex_indices[3][0],
-                   &bzp._vertex_indices[3][1],
-                   &bzp._vertex_indices[3][2],
-                   &bzp._vertex_indices[3][3]);
-
-            // subtract 1 from all indices
-            for(unsigned i=0;i!=4;++i)
-                for(unsigned j=0;j!=4;++j)
-                    --bzp._vertex_indices[i][j];
-        }
-        else if(s=="g") // a new group of faces, ie a seperate mesh
-            read_group(ifs);
-        else if(s=="f"||s=="fo") // face
-            read_face(ifs);
-        else if(s=="p") // points
-            read_points(ifs);
-        else if(s=="l") // lines
-            read_line(ifs);
-        else if(s=="vt") // texture coord
-            _mesh->_texCoords.push_back( In::Tex_coord(ifs) );
-        else if(s=="vn") // normal
-            _mesh->_normals.push_back( In::Normal(ifs) );
-        else if(s=="v") // vertex
-            _mesh->_vertices.push_back( In::Vert(ifs) );
-        else if(s=="vp") // vertex parameter
-            _data->_vertexParams.push_back( In::Vertex_param(ifs) );
-        else if(s=="mtllib") // material library
-            read_material_lib(ifs);
-        else if(s=="usemtl") // material to apply
-            read_use_material(ifs);
-        else if(s=="end"  || s=="parm"|| s=="stech"|| s=="ctech"|| s=="curv"||
-                s=="curv2"|| s=="surf"|| s=="bmat" || s=="res"  || s=="sp"  ||
-                s=="trim" || s=="hole")
-        {
+        // Don't cut a statement continued on the next line
+        const char* b = std::max(bounds[c], bounds[c-1]);
+        while( b < file.end() && is_continued(file.data(), b) )
+            b = Text::next_line(b, file.end());
+        bounds[c] = b;
+    }
 
-            std::cerr << "[ERROR] Unable to handle " << s << " outside of cstype/end pair\n";
-            std::cerr << "[ERROR] Unable to handle cstype yet. Sorry! RB.\n";
-            read_chunk(ifs);
-        }
-        else
+    std::vector<Obj_chunk> chunks(nb_chunks);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int c = 0; c < nb_chunks; ++c)
+        parse_chunk(bounds[c], bounds[c+1], chunks[c]);
+
+    size_t nb_verts = 0, nb_normals = 0, nb_tex = 0, nb_faces = 0;
+    for(int c = 0; c < nb_chunks; ++c){
+        nb_verts   += chunks[c]._vertices. size();
+        nb_normals += chunks[c]._normals.  size();
+        nb_tex     += chunks[c]._texCoords.size();
+        nb_faces   += chunks[c]._triangles.size();
+    }
+    _mesh->_vertices. reserve( nb_verts   );
+    _mesh->_normals.  reserve( nb_normals );
+    _mesh->_texCoords.reserve( nb_tex     );
+    _mesh->_triangles.reserve( nb_faces   );
+
+    // Concatenate the chunks, the other statements are read in between in
+    // the file order since groups, materials and relative indices depend
+    // on what was read before them
+    unsigned line = 0;
+    for(int c = 0; c < nb_chunks; ++c)
+    {
+        Obj_chunk& ch = chunks[c];
+        Obj_chunk::Counts done = {0, 0, 0, 0};
+        for(unsigned e = 0; e < ch._statements.size(); ++e)
         {
-            std::string field = s + eat_line(ifs);
-
-            std::cerr << "WARNING line " << line << ": the field '"<< field;
-            std::cerr << "' could not be read in file ";
-            std::cerr << file_path << std::endl;
+            const Obj_chunk::Statement& st = ch._statements[e];
+            ch.append(*_mesh, done, st._counts);
+            done = st._counts;
+
+            std::istringstream ifs( std::string(st._begin, st._end) );
+            std::string s;
+            ifs >> s;
+            read_statement(s, ifs, line + st._line);
         }
-    }// END WHILE( END_OF_FILE )
+        ch.append(*_mesh, done, ch.counts());
+        line += ch._nb_lines;
+        // Release the chunk memory as we go
+        Obj_chunk().swap( ch );
+    }
 
     // if groups exist, terminate it.
     if(_mesh->_groups.size())
@@ -190,6 +190,11 @@ private:
     /// a utility function to parse a use material statement
     void read_use_material(std::istream& ifs);
 
+    /// Parse the statement starting with the keyword 's' already extracted
+    /// from 'ifs'
+    /// @param line line number for the warnings
+    void read_statement(const std::string& s, std::istream& ifs, unsigned line);
+
      // ------------------------------------------------------------------------
     /// @name Attributes
     // -------------------------------------------------------------------------
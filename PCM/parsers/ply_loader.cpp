@@ -0,0 +1,730 @@
+#include "ply_loader.hpp"
+
+#include "parsers/mapped_file.hpp"
+#include "parsers/text_parser.hpp"
+#include "parsers/endianess.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+/// Vertex properties we read, other properties are skipped
+enum Channel {
+    CX, CY, CZ, CNX, CNY, CNZ, CRED, CGREEN, CBLUE, CALPHA,
+    NB_CHANNELS
+};
+
+// -----------------------------------------------------------------------------
+
+static Ply_file::Scalar scalar_type(const std::string& s)
+{
+    if( s == "char"   || s == "int8"    ) return Ply_file::CHAR;
+    if( s == "uchar"  || s == "uint8"   ) return Ply_file::UCHAR;
+    if( s == "short"  || s == "int16"   ) return Ply_file::SHORT;
+    if( s == "ushort" || s == "uint16"  ) return Ply_file::USHORT;
+    if( s == "int"    || s == "int32"   ) return Ply_file::INT;
+    if( s == "uint"   || s == "uint32"  ) return Ply_file::UINT;
+    if( s == "float"  || s == "float32" ) return Ply_file::FLOAT;
+    if( s == "double" || s == "float64" ) return Ply_file::DOUBLE;
+    return Ply_file::NO_SCALAR;
+}
+
+// -----------------------------------------------------------------------------
+
+static int scalar_size(Ply_file::Scalar t)
+{
+    switch(t){
+    case Ply_file::CHAR:   case Ply_file::UCHAR:  return 1;
+    case Ply_file::SHORT:  case Ply_file::USHORT: return 2;
+    case Ply_file::INT:    case Ply_file::UINT:
+    case Ply_file::FLOAT:                         return 4;
+    case Ply_file::DOUBLE:                        return 8;
+    default:                                      return 0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Value of the binary scalar at 'p' stored with the file endianess
+static double read_binary(const char* p, Ply_file::Scalar t, bool big)
+{
+    using namespace Endianess;
+    switch(t){
+    case Ply_file::CHAR:  return (double)*(const signed char*)p;
+    case Ply_file::UCHAR: return (double)*(const unsigned char*)p;
+    case Ply_file::SHORT:
+    case Ply_file::USHORT:
+    {
+        short s;
+        memcpy(&s, p, 2);
+        s = big ? big_short(s) : little_short(s);
+        return t == Ply_file::SHORT ? (double)s : (double)(unsigned short)s;
+    }
+    case Ply_file::INT:
+    case Ply_file::UINT:
+    {
+        int i;
+        memcpy(&i, p, 4);
+        i = big ? big_long(i) : little_long(i);
+        return t == Ply_file::INT ? (double)i : (double)(unsigned)i;
+    }
+    case Ply_file::FLOAT:
+    {
+        // Swap the bits as an int: a swapped float may not survive a
+        // float register
+        int i;
+        memcpy(&i, p, 4);
+        i = big ? big_long(i) : little_long(i);
+        float f;
+        memcpy(&f, &i, 4);
+        return f;
+    }
+    case Ply_file::DOUBLE:
+    {
+        double d;
+        memcpy(&d, p, 8);
+        return big ? big_double(d) : little_double(d);
+    }
+    default: return 0.;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// How to store each property of an element
+struct Layout {
+    std::vector<int>   _channel; ///< Channel or -1 to skip the property
+    std::vector<float> _scale;   ///< color normalization
+    int _stride;                 ///< record size in bytes, 0 if it has lists
+
+    Layout(const Ply_file::Element& e) : _stride(0)
+    {
+        const int nb = (int)e._props.size();
+        _channel.assign(nb, -1);
+        _scale.assign(nb, 1.f);
+        bool has_list = false;
+        for(int i = 0; i < nb; ++i)
+        {
+            const Ply_file::Property& p = e._props[i];
+            has_list = has_list || p._count_type != Ply_file::NO_SCALAR;
+            _stride += scalar_size(p._type);
+            if( p._count_type != Ply_file::NO_SCALAR ) continue;
+
+            const std::string& n = p._name;
+            int c = -1;
+            if     ( n == "x"  ) c = CX;
+            else if( n == "y"  ) c = CY;
+            else if( n == "z"  ) c = CZ;
+            else if( n == "nx" ) c = CNX;
+            else if( n == "ny" ) c = CNY;
+            else if( n == "nz" ) c = CNZ;
+            else if( n == "red"   || n == "diffuse_red"   ) c = CRED;
+            else if( n == "green" || n == "diffuse_green" ) c = CGREEN;
+            else if( n == "blue"  || n == "diffuse_blue"  ) c = CBLUE;
+            else if( n == "alpha" ) c = CALPHA;
+            _channel[i] = c;
+
+            // Integral colors are normalized to [0 1]
+            if( c >= CRED ){
+                if     ( p._type == Ply_file::UCHAR  ) _scale[i] = 1.f / 255.f;
+                else if( p._type == Ply_file::USHORT ) _scale[i] = 1.f / 65535.f;
+            }
+        }
+        if( has_list ) _stride = 0;
+    }
+
+    bool has(int c) const {
+        return std::find(_channel.begin(), _channel.end(), c) != _channel.end();
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+/// Parse one ascii record at 'p' into 'vals'
+/// @return the position after the record
+static const char* read_ascii_record(const Ply_file::Element& e,
+                                     const Layout& l,
+                                     const char* p,
+                                     const char* end,
+                                     float* vals)
+{
+    for(unsigned i = 0; i < e._props.size(); ++i)
+    {
+        if( e._props[i]._count_type != Ply_file::NO_SCALAR )
+        {
+            int n = 0;
+            Text::parse_int(p, end, n);
+            for(int k = 0; k < n; ++k)
+                p = Text::skip_token(Text::skip_blanks(p, end), end);
+            continue;
+        }
+
+        float v = 0.f;
+        Text::parse_float(p, end, v);
+        if( l._channel[i] >= 0 ) vals[ l._channel[i] ] = v * l._scale[i];
+    }
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Parse one binary record at 'p' into 'vals'
+/// @return the position after the record or 0 if it's truncated
+static const char* read_binary_record(const Ply_file::Element& e,
+                                      const Layout& l,
+                                      const char* p,
+                                      const char* end,
+                                      bool big,
+                                      float* vals)
+{
+    for(unsigned i = 0; i < e._props.size(); ++i)
+    {
+        const Ply_file::Property& prop = e._props[i];
+        if( prop._count_type != Ply_file::NO_SCALAR )
+        {
+            const int cs = scalar_size(prop._count_type);
+            if( end - p < cs ) return 0;
+            const int n = (int)read_binary(p, prop._count_type, big);
+            p += cs;
+            const long long size = (long long)n * scalar_size(prop._type);
+            if( n < 0 || end - p < size ) return 0;
+            p += size;
+            continue;
+        }
+
+        const int s = scalar_size(prop._type);
+        if( end - p < s ) return 0;
+        if( l._channel[i] >= 0 )
+            vals[ l._channel[i] ] = (float)read_binary(p, prop._type, big) * l._scale[i];
+        p += s;
+    }
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Move 'p' after 'count' lines
+/// @return false if the file has less lines
+static bool skip_lines(const char*& p, const char* end, int count)
+{
+    for(int i = 0; i < count; ++i){
+        if( p >= end ) return false;
+        p = Text::next_line(p, end);
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Number of lines starting in [begin, end)
+static int count_lines(const char* begin, const char* end)
+{
+    int n = 0;
+    for(const char* p = begin; p < end; p = Text::next_line(p, end))
+        ++n;
+    return n;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Fan triangulation of the polygon 'poly' of 'n' vertices
+static void add_polygon(const int* poly, int n,
+                        std::vector<Tri_face>& tris,
+                        std::vector<Quad_face>& quads)
+{
+    if( n == 4 )
+    {
+        Quad_face q;
+        for(int k = 0; k < 4; ++k) q.v[k] = poly[k];
+        quads.push_back( q );
+        return;
+    }
+    for(int k = 2; k < n; ++k)
+    {
+        Tri_face f;
+        f.v[0] = poly[0];
+        f.v[1] = poly[k-1];
+        f.v[2] = poly[k];
+        tris.push_back( f );
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/// Index of the list of vertex indices of a face element or -1
+static int face_list(const Ply_file::Element& e)
+{
+    for(unsigned i = 0; i < e._props.size(); ++i)
+        if( e._props[i]._count_type != Ply_file::NO_SCALAR &&
+            (e._props[i]._name == "vertex_indices" || e._props[i]._name == "vertex_index") )
+            return i;
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Parse the header at the beginning of [p, end)
+/// @return the beginning of the body or 0 if the header is invalid
+static const char* read_header(const char* p,
+                               const char* end,
+                               Ply_file::Format& format,
+                               std::vector<Ply_file::Element>& elements)
+{
+    elements.clear();
+    bool has_format = false;
+    bool first = true;
+    while( p < end )
+    {
+        const char* next = Text::next_line(p, end);
+        std::istringstream line( std::string(p, next) );
+        p = next;
+
+        std::string key;
+        line >> key;
+        if( first ){
+            if( key != "ply" ) return 0;
+            first = false;
+        }
+        else if( key == "format" )
+        {
+            std::string f;
+            line >> f;
+            if     ( f == "ascii"                ) format = Ply_file::ASCII;
+            else if( f == "binary_little_endian" ) format = Ply_file::BINARY_LITTLE_ENDIAN;
+            else if( f == "binary_big_endian"    ) format = Ply_file::BINARY_BIG_ENDIAN;
+            else return 0;
+            has_format = true;
+        }
+        else if( key == "element" )
+        {
+            Ply_file::Element e;
+            line >> e._name >> e._count;
+            if( !line || e._count < 0 ) return 0;
+            elements.push_back( e );
+        }
+        else if( key == "property" )
+        {
+            if( elements.size() == 0 ) return 0;
+            Ply_file::Property prop;
+            std::string t;
+            line >> t;
+            if( t == "list" )
+            {
+                std::string ct;
+                line >> ct >> t;
+                prop._count_type = scalar_type(ct);
+                if( prop._count_type == Ply_file::NO_SCALAR ) return 0;
+            }
+            else
+                prop._count_type = Ply_file::NO_SCALAR;
+
+            prop._type = scalar_type(t);
+            line >> prop._name;
+            if( prop._type == Ply_file::NO_SCALAR ) return 0;
+            elements.back()._props.push_back( prop );
+        }
+        else if( key == "end_header" )
+            return has_format ? p : 0;
+        // 'comment' 'obj_info' and unknown lines are ignored
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Read the 'vertex' element 'e' at 'p'
+/// @return the end of the element or 0 if the file is truncated
+static const char* read_vertices(const Ply_file::Element& e,
+                                 Ply_file::Format format,
+                                 const char* p,
+                                 const char* end,
+                                 std::vector<float>& vals)
+{
+    const Layout l(e);
+    const int n = e._count;
+    vals.resize( (size_t)n * NB_CHANNELS );
+    // Missing channels: opaque and null normals
+    for(int i = 0; i < n; ++i){
+        float* v = &vals[(size_t)i * NB_CHANNELS];
+        std::fill(v, v + NB_CHANNELS, 0.f);
+        v[CALPHA] = 1.f;
+    }
+    if( n == 0 ) return p;
+
+    if( format == Ply_file::ASCII )
+    {
+        const char* block_end = p;
+        if( !skip_lines(block_end, end, n) ) return 0;
+
+        // Cut the block in chunks of whole lines and find the index of the
+        // first vertex of each chunk
+        std::vector<const char*> bounds;
+        Text::split_lines(p, block_end, Text::nb_chunks(block_end - p), bounds);
+        const int nb_chunks = (int)bounds.size() - 1;
+        std::vector<int> first(nb_chunks + 1, 0);
+        #pragma omp parallel for schedule(dynamic, 1)
+        for(int c = 0; c < nb_chunks; ++c)
+            first[c + 1] = count_lines(bounds[c], bounds[c + 1]);
+        for(int c = 0; c < nb_chunks; ++c)
+            first[c + 1] += first[c];
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for(int c = 0; c < nb_chunks; ++c)
+        {
+            const char* q = bounds[c];
+            for(int i = first[c]; i < first[c + 1] && i < n; ++i)
+            {
+                read_ascii_record(e, l, q, bounds[c + 1], &vals[(size_t)i * NB_CHANNELS]);
+                q = Text::next_line(q, bounds[c + 1]);
+            }
+        }
+        return block_end;
+    }
+
+    const bool big = format == Ply_file::BINARY_BIG_ENDIAN;
+    if( l._stride > 0 )
+    {
+        // Fixed size records are decoded in parallel
+        if( (end - p) / l._stride < n ) return 0;
+        const int stride = l._stride;
+        #pragma omp parallel for schedule(static)
+        for(int i = 0; i < n; ++i)
+            read_binary_record(e, l, p + (size_t)i * stride, end, big, &vals[(size_t)i * NB_CHANNELS]);
+        return p + (size_t)n * stride;
+    }
+
+    for(int i = 0; i < n && p != 0; ++i)
+        p = read_binary_record(e, l, p, end, big, &vals[(size_t)i * NB_CHANNELS]);
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Read the 'face' element 'e' at 'p'
+/// @return the end of the element or 0 if the file is truncated
+static const char* read_faces(const Ply_file::Element& e,
+                              Ply_file::Format format,
+                              const char* p,
+                              const char* end,
+                              std::vector<Tri_face>& tris,
+                              std::vector<Quad_face>& quads)
+{
+    const int list = face_list(e);
+    const int n = e._count;
+    if( n == 0 ) return p;
+
+    if( format == Ply_file::ASCII )
+    {
+        const char* block_end = p;
+        if( !skip_lines(block_end, end, n) ) return 0;
+        if( list < 0 ) return block_end;
+
+        std::vector<const char*> bounds;
+        Text::split_lines(p, block_end, Text::nb_chunks(block_end - p), bounds);
+        const int nb_chunks = (int)bounds.size() - 1;
+        std::vector< std::vector<Tri_face>  > chunk_tris (nb_chunks);
+        std::vector< std::vector<Quad_face> > chunk_quads(nb_chunks);
+
+        #pragma omp parallel
+        {
+            std::vector<int> poly;
+            #pragma omp for schedule(dynamic, 1)
+            for(int c = 0; c < nb_chunks; ++c)
+            {
+                const char* chunk_end = bounds[c + 1];
+                for(const char* q = bounds[c]; q < chunk_end; q = Text::next_line(q, chunk_end))
+                {
+                    const char* line_end = Text::next_line(q, chunk_end);
+                    const char* t = q;
+                    int nb = 0;
+                    for(int i = 0; i < list; ++i) // properties before the list
+                        t = Text::skip_token(Text::skip_blanks(t, line_end), line_end);
+                    if( !Text::parse_int(t, line_end, nb) || nb < 3 ) continue;
+                    // An index takes at least a digit and a blank: drop faces
+                    // whose count doesn't fit in the rest of the line
+                    if( nb > (line_end - t + 1) / 2 ) continue;
+
+                    poly.resize( nb );
+                    for(int k = 0; k < nb; ++k)
+                        Text::parse_int(t, line_end, poly[k]);
+                    add_polygon(&poly[0], nb, chunk_tris[c], chunk_quads[c]);
+                }
+            }
+        }
+
+        for(int c = 0; c < nb_chunks; ++c){
+            tris. insert(tris. end(), chunk_tris [c].begin(), chunk_tris [c].end());
+            quads.insert(quads.end(), chunk_quads[c].begin(), chunk_quads[c].end());
+        }
+        return block_end;
+    }
+
+    // Binary records have variable sizes, they are walked through in order
+    const bool big = format == Ply_file::BINARY_BIG_ENDIAN;
+    tris.reserve( n );
+    std::vector<int> poly;
+    for(int f = 0; f < n; ++f)
+    {
+        for(int i = 0; i < (int)e._props.size(); ++i)
+        {
+            const Ply_file::Property& prop = e._props[i];
+            const int s = scalar_size(prop._type);
+            if( prop._count_type == Ply_file::NO_SCALAR ){
+                if( end - p < s ) return 0;
+                p += s;
+                continue;
+            }
+
+            const int cs = scalar_size(prop._count_type);
+            if( end - p < cs ) return 0;
+            const int nb = (int)read_binary(p, prop._count_type, big);
+            p += cs;
+            if( nb < 0 || end - p < (long long)nb * s ) return 0;
+            if( i == list && nb >= 3 )
+            {
+                poly.resize( nb );
+                for(int k = 0; k < nb; ++k)
+                    poly[k] = (int)read_binary(p + k * s, prop._type, big);
+                add_polygon(&poly[0], nb, tris, quads);
+            }
+            p += nb * s;
+        }
+    }
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Move 'p' after the element 'e'
+/// @return the end of the element or 0 if the file is truncated
+static const char* skip_element(const Ply_file::Element& e,
+                                Ply_file::Format format,
+                                const char* p,
+                                const char* end)
+{
+    if( format == Ply_file::ASCII )
+        return skip_lines(p, end, e._count) ? p : 0;
+
+    const Layout l(e);
+    if( l._stride > 0 )
+        return (end - p) / l._stride < e._count ? 0 : p + (size_t)e._count * l._stride;
+
+    const bool big = format == Ply_file::BINARY_BIG_ENDIAN;
+    float vals[NB_CHANNELS];
+    for(int i = 0; i < e._count && p != 0; ++i)
+        p = read_binary_record(e, l, p, end, big, vals);
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Ply_file::import_file(const std::string& file_path)
+{
+    Base_loader::update_paths( file_path );
+    _mesh.clear();
+    _mesh._mesh_path = _path;
+    _colors.clear();
+    _elements.clear();
+
+    Mapped_file file;
+    if( !file.open(file_path) ){
+        std::cout << "error loading file : " << file_path << std::endl;
+        return false;
+    }
+
+    const char* end = file.end();
+    const char* p = read_header(file.data(), end, _format, _elements);
+    if( p == 0 ){
+        std::cerr << "ERROR: invalid ply header in " << file_path << std::endl;
+        _elements.clear();
+        return false;
+    }
+
+    if( _format != ASCII && Endianess::little_long == 0 )
+        Endianess::init();
+
+    std::vector<float> vals;
+    bool has_vertices = false;
+    std::vector<Tri_face>&  tris  = _mesh._render_faces._tris;
+    std::vector<Quad_face>& quads = _mesh._render_faces._quads;
+    for(unsigned i = 0; i < _elements.size() && p != 0; ++i)
+    {
+        const Element& e = _elements[i];
+        if( e._name == "vertex" && !has_vertices ){
+            p = read_vertices(e, _format, p, end, vals);
+            has_vertices = true;
+            const Layout l(e);
+            const int n = e._count;
+            const bool normals = l.has(CNX) || l.has(CNY) || l.has(CNZ);
+            const bool colors  = l.has(CRED) || l.has(CGREEN) || l.has(CBLUE);
+            _mesh._vertices.resize( n );
+            if( normals ) _mesh._normals.resize( n );
+            if( colors  ) _colors.resize( (size_t)n * 4 );
+            for(int v = 0; v < n; ++v)
+            {
+                const float* c = &vals[(size_t)v * NB_CHANNELS];
+                _mesh._vertices[v] = Vertex(c[CX], c[CY], c[CZ]);
+                if( normals ) _mesh._normals[v] = Normal(c[CNX], c[CNY], c[CNZ]);
+                if( colors  ) std::copy(c + CRED, c + CALPHA + 1, &_colors[(size_t)v * 4]);
+            }
+        }
+        else if( e._name == "face" && tris.size() == 0 && quads.size() == 0 )
+            p = read_faces(e, _format, p, end, tris, quads);
+        else
+            p = skip_element(e, _format, p, end);
+    }
+
+    if( p == 0 ){
+        std::cerr << "ERROR: truncated ply file " << file_path << std::endl;
+        _mesh.clear();
+        _colors.clear();
+        return false;
+    }
+
+    // Faces pointing outside the vertex element are dropped, negative
+    // indices wrapped to large unsigned values
+    const unsigned nb_verts = (unsigned)_mesh._vertices.size();
+    unsigned nb_tris_ok = 0, nb_quads_ok = 0;
+    for(unsigned i = 0; i < tris.size(); ++i)
+    {
+        const unsigned* v = tris[i].v;
+        if( v[0] < nb_verts && v[1] < nb_verts && v[2] < nb_verts )
+            tris[nb_tris_ok++] = tris[i];
+    }
+    for(unsigned i = 0; i < quads.size(); ++i)
+    {
+        const unsigned* v = quads[i].v;
+        if( v[0] < nb_verts && v[1] < nb_verts && v[2] < nb_verts && v[3] < nb_verts )
+            quads[nb_quads_ok++] = quads[i];
+    }
+    const int nb_dropped = (int)(tris.size() - nb_tris_ok + quads.size() - nb_quads_ok);
+    tris. resize( nb_tris_ok  );
+    quads.resize( nb_quads_ok );
+    if( nb_dropped > 0 )
+        std::cerr << "WARNING: " << nb_dropped << " faces with invalid vertex indices skipped in "
+                  << file_path << std::endl;
+
+    // Vertex normals share the vertex indices
+    const bool normals = _mesh._normals.size() > 0;
+    if( normals ){
+        for(unsigned i = 0; i < tris.size(); ++i)
+            for(int k = 0; k < 3; ++k) tris[i].n[k] = tris[i].v[k];
+        for(unsigned i = 0; i < quads.size(); ++i)
+            for(int k = 0; k < 4; ++k) quads[i].n[k] = quads[i].v[k];
+    }
+
+    const int nb_tris  = tris. size();
+    const int nb_quads = quads.size();
+    _mesh._triangles.resize( nb_tris + nb_quads * 2 );
+    for(int i = 0; i < nb_tris; ++i)
+        _mesh._triangles[i] = tris[i];
+
+    for(int i = 0; i < nb_quads; ++i)
+    {
+        Tri_face f0, f1;
+        quads[i].triangulate(f0, f1);
+        _mesh._triangles[nb_tris + i*2    ] = f0;
+        _mesh._triangles[nb_tris + i*2 + 1] = f1;
+    }
+
+    // Push everything in the same group/material group
+    const int s = _mesh._triangles.size();
+    _mesh._materials.push_back( Material() );
+    _mesh._groups.push_back( Group("", 0, s) );
+    _mesh._groups[0]._assigned_mats.push_back( Material_group(0, 0, s) );
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Append the little endian bytes of 'i'
+static inline void put_le_int(std::string& buf, int i)
+{
+    i = Endianess::little_long( i );
+    buf.append((const char*)&i, 4);
+}
+
+/// Append the little endian bytes of 'f', swapped as an int like read_binary()
+static inline void put_le_float(std::string& buf, float f)
+{
+    int i;
+    memcpy(&i, &f, 4);
+    put_le_int(buf, i);
+}
+
+// -----------------------------------------------------------------------------
+
+bool Ply_file::export_file(const std::string& file_path)
+{
+    Base_loader::update_paths( file_path );
+    if( Endianess::little_long == 0 )
+        Endianess::init();
+
+    std::ofstream file(file_path.c_str(), std::ios::binary);
+    if( !file.is_open() ){
+        std::cerr << "ERROR: can't write ply file " << file_path << std::endl;
+        return false;
+    }
+
+    // Polygons as they were read, the triangulated faces for a mesh given
+    // through set_mesh() without render faces
+    const Abs_mesh::Render_faces& rf = _mesh._render_faces;
+    const bool polygons = rf._tris.size() + rf._quads.size() > 0;
+    const int nb_verts = (int)_mesh._vertices.size();
+    const int nb_faces = polygons ? (int)(rf._tris.size() + rf._quads.size()) : (int)_mesh._triangles.size();
+    const bool normals = nb_verts > 0 && _mesh._normals.size() == _mesh._vertices.size();
+    const bool colors  = nb_verts > 0 && _colors.size() == (size_t)nb_verts * 4;
+
+    file << "ply\n"
+         << "format binary_little_endian 1.0\n"
+         << "element vertex " << nb_verts << "\n"
+         << "property float x\nproperty float y\nproperty float z\n";
+    if( normals )
+        file << "property float nx\nproperty float ny\nproperty float nz\n";
+    if( colors )
+        file << "property uchar red\nproperty uchar green\nproperty uchar blue\nproperty uchar alpha\n";
+    file << "element face " << nb_faces << "\n"
+         << "property list uchar int vertex_indices\n"
+         << "end_header\n";
+
+    std::string buf;
+    buf.reserve( (size_t)nb_verts * (normals ? 28 : 16) + (size_t)nb_faces * 17 );
+    for(int v = 0; v < nb_verts; ++v)
+    {
+        const Vertex& p = _mesh._vertices[v];
+        put_le_float(buf, p.x); put_le_float(buf, p.y); put_le_float(buf, p.z);
+        if( normals ){
+            const Normal& n = _mesh._normals[v];
+            put_le_float(buf, n.x); put_le_float(buf, n.y); put_le_float(buf, n.z);
+        }
+        if( colors ){
+            for(int c = 0; c < 4; ++c){
+                const float f = std::min(std::max(_colors[(size_t)v * 4 + c], 0.f), 1.f);
+                buf.push_back( (char)(unsigned char)(f * 255.f + 0.5f) );
+            }
+        }
+    }
+
+    const std::vector<Tri_face>& tris = polygons ? rf._tris : _mesh._triangles;
+    for(unsigned f = 0; f < tris.size(); ++f){
+        buf.push_back( (char)3 );
+        for(int k = 0; k < 3; ++k) put_le_int(buf, (int)tris[f].v[k]);
+    }
+    if( polygons ){
+        for(unsigned f = 0; f < rf._quads.size(); ++f){
+            buf.push_back( (char)4 );
+            for(int k = 0; k < 4; ++k) put_le_int(buf, (int)rf._quads[f].v[k]);
+        }
+    }
+
+    file.write(buf.data(), buf.size());
+    return file.good();
+}
+
+}// END Loader =================================================================
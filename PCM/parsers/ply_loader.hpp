@@ -0,0 +1,98 @@
+#ifndef PLY_LOADER_HPP__
+#define PLY_LOADER_HPP__
+
+#include "parsers/loader.hpp"
+
+/**
+  @file ply_loader.hpp
+  @brief Holds data structure and utilities to parse a PLY file
+*/
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+/**
+  @brief Utility to parse a mesh or a point cloud in 'ply' file format
+
+  Ascii, binary little endian and binary big endian files are read, with any
+  list of properties: elements and properties are described by the header.
+  The file is memory mapped, the vertices (and the faces of ascii files) are
+  parsed in parallel. From the 'vertex' element we read x y z, nx ny nz and
+  red green blue alpha, from the 'face' element the 'vertex_indices' list
+  (polygons are triangulated). Other elements and properties are skipped.
+  Faces with an index outside the vertex element are dropped.
+
+  export_file() writes a binary little endian file with the same vertex
+  properties and the faces as read (or the triangles of set_mesh()).
+*/
+class Ply_file : public Base_loader {
+public:
+    enum Format {
+        ASCII,
+        BINARY_LITTLE_ENDIAN,
+        BINARY_BIG_ENDIAN
+    };
+
+    /// Scalar types of the properties
+    enum Scalar {
+        CHAR, UCHAR, SHORT, USHORT, INT, UINT, FLOAT, DOUBLE,
+        NO_SCALAR
+    };
+
+    struct Property {
+        std::string _name;
+        Scalar _type;       ///< type of the value or of the list items
+        Scalar _count_type; ///< NO_SCALAR if the property is not a list
+    };
+
+    struct Element {
+        std::string _name;
+        int _count;
+        std::vector<Property> _props;
+    };
+
+    Ply_file() : _format(BINARY_LITTLE_ENDIAN) { }
+
+    Ply_file(const std::string& file_name) : Base_loader( file_name )
+    { import_file(file_name);  }
+
+    /// The loader type
+    Loader_t type() const { return PLY; }
+
+    bool import_file(const std::string& file_path);
+    bool export_file(const std::string& file_path);
+
+    /// PLY files have no animation frame 'anims will be returned empty'
+    void get_anims(std::vector<Base_anim_eval*>& anims) const { anims.clear(); }
+
+    /// transform internal representation into generic representation
+    void get_mesh(Abs_mesh& mesh) const {
+        mesh.clear();
+        mesh = _mesh;
+    }
+
+    /// transform generic representation into internal representation
+    /// (vertices, normals when there is one per vertex, faces)
+    void set_mesh(const Abs_mesh& mesh) { _mesh = mesh; }
+
+    /// Vertex colors r g b a in [0 1], empty if the file has none
+    const std::vector<float>& get_colors() const { return _colors; }
+    /// Colors to export, 4 per vertex or empty
+    void set_colors(const std::vector<float>& colors) { _colors = colors; }
+
+    bool has_normals() const { return _mesh._normals.size() > 0; }
+
+    Format get_format() const { return _format; }
+    const std::vector<Element>& get_elements() const { return _elements; }
+
+private:
+    Abs_mesh _mesh;
+    std::vector<float> _colors;
+    Format _format;
+    std::vector<Element> _elements; ///< header description
+};
+
+}// END Loader =================================================================
+
+
+#endif //PLY_LOADER_HPP__
@@ -1,45 +1,13 @@
 #include "parsers/point_cache_export.hpp"
 
 #include <iostream>
-#include <fstream>
 #include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
 #include <algorithm>
 
 #include "endianess.hpp"
-#include "toolbox/maths/vec3.hpp"////////
-
-// =============================================================================
-namespace Loader {
-// =============================================================================
-using namespace Tbx;
-Point_cache_file::Point_cache_file(int nb_points, int nb_frame_hint)
-{
-    assert(nb_points > 0);
-    if(nb_frame_hint > 0)
-    {
-        _nb_points = nb_points;
-        _frames.reserve(nb_frame_hint);
-//        for(int i = 0; i < nb_frame_hint; i++)
-//            _frames[i].resize(nb_points);
-    }
-}
-
-// -----------------------------------------------------------------------------
-
-void Point_cache_file::add_frame(float* points, int offset, int stride)
-{
-    _frames.push_back(std::vector<float>());
-    const int frame_idx = _frames.size()-1;
-    _frames[frame_idx].resize(_nb_points*3);
-    for(int i = offset, j = 0; i < (_nb_points + offset); i++, j++)
-    {
-        _frames[frame_idx][j*3  ] = points[i*(3+stride)  ];
-        _frames[frame_idx][j*3+1] = points[i*(3+stride)+1];
-        _frames[frame_idx][j*3+2] = points[i*(3+stride)+2];
-    }
-}
-
-// -----------------------------------------------------------------------------
 
 /*
 MDD file format
@@ -73,149 +41,620 @@ while(!totalframes)
     }
     frame++;
 }
+
+PC2 file format (little endian)
+
+char  cacheSignature[12]; // "POINTCACHE2\0"
+int   fileVersion;        // 1
+int   numPoints;
+float startFrame;
+float sampleRate;         // frames between two samples
+int   numSamples;
+float points[numSamples][numPoints][3];
+
+PCQ file format (little endian)
+
+char  magic[4];           // "PCMQ"
+int   version;            // 1
+int   numPoints;
+int   numFrames;
+int   deltaRef;           // 0: rest pose (first frame) 1: previous frame
+int   keyInterval;        // with deltaRef == 1 frames multiple of keyInterval
+                          // are stored in full
+float fps;
+int   reserved;
+int   tableOffset[2];     // low and high 32 bits of the frame table offset
+frames...
+long long table[numFrames]; // offset of each frame (low and high 32 bits)
+
+A full frame is float points[numPoints][3], the first frame is always full.
+Other frames store deltas d quantized on 16 bits per axis:
+float min[3];
+float step[3];
+unsigned short q[numPoints][3]; // d = min + q * step
+Deltas are computed against the frame the reader reconstructs (rest pose or
+previous frame) so that quantization errors do not accumulate.
 */
 
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+static const char  s_pc2_signature[12] = "POINTCACHE2";
+static const char  s_pcq_magic[4] = {'P', 'C', 'M', 'Q'};
+static const int   s_pcq_header_size = 40;
+static const int   s_pc2_header_size = 32;
+static const float s_quant_max = 65535.f;
+
 // -----------------------------------------------------------------------------
 
-float filter(int frame)
+static inline void init_endianess()
+{
+    if( Endianess::little_long == 0 )
+        Endianess::init();
+}
+
+static inline void put_int(char*& p, int v)
+{
+    memcpy(p, &v, 4);
+    p += 4;
+}
+
+static inline void put_float(char*& p, float v)
+{
+    memcpy(p, &v, 4);
+    p += 4;
+}
+
+static inline int get_int(const char* p)
+{
+    int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline float get_float(const char* p)
+{
+    float v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline int   le_int  (const char* p) { return Endianess::little_long ( get_int  (p) ); }
+static inline int   be_int  (const char* p) { return Endianess::big_long    ( get_int  (p) ); }
+static inline float le_float(const char* p) { return Endianess::little_float( get_float(p) ); }
+static inline float be_float(const char* p) { return Endianess::big_float   ( get_float(p) ); }
+
+static inline long long le_offset(const char* p)
+{
+    const unsigned lo = (unsigned)le_int(p);
+    const unsigned hi = (unsigned)le_int(p + 4);
+    return (long long)(((unsigned long long)hi << 32) | lo);
+}
+
+static inline void put_le_offset(char*& p, long long off)
 {
-    float x = (float)frame;
-    return exp( - (x*x)/100.f );
+    const unsigned long long u = (unsigned long long)off;
+    put_int(p, Endianess::little_long( (int)(unsigned)(u & 0xFFFFFFFFu) ));
+    put_int(p, Endianess::little_long( (int)(unsigned)(u >> 32) ));
+}
+
+// =============================================================================
+// Point_cache_file
+// =============================================================================
+
+Point_cache_file::Point_cache_file(int nb_points, int nb_frame_hint) :
+    _nb_points(nb_points),
+    _nb_frames(0),
+    _nb_frame_hint(nb_frame_hint),
+    _is_open(false),
+    _format(MDD),
+    _ref(REST_POSE),
+    _key_interval(0),
+    _fps(24.f)
+{
+    assert(nb_points > 0);
 }
 
 // -----------------------------------------------------------------------------
 
-static Vec3 to_point(int p, const std::vector<float>& points )
+Point_cache_file::~Point_cache_file()
 {
-    return Vec3( points[p*3], points[p*3 + 1], points[p*3 + 2] );
+    close();
 }
 
 // -----------------------------------------------------------------------------
 
-static void denoise_frames(const std::vector< std::vector<float> >& frames,
-                           std::vector< std::vector<float> >& smooth_frames)
+bool Point_cache_file::open(const std::string& path,
+                            Format format,
+                            float fps,
+                            Delta_ref ref,
+                            int key_interval)
 {
-    for(int f = 1; f < ((int)frames.size() - 1); f++)
+    close();
+    init_endianess();
+
+    _path         = path;
+    _format       = format;
+    _fps          = fps > 0.f ? fps : 24.f;
+    _ref          = ref;
+    _key_interval = ref == PREVIOUS_FRAME ? std::max(key_interval, 1) : 0;
+    _nb_frames    = 0;
+    _offsets.clear();
+
+    const std::string file_path = format == MDD ? path + ".part" : path;
+    _file.clear();
+    _file.open(file_path.c_str(), std::ios::binary|std::ios::trunc);
+    if( !_file.is_open() )
     {
-        std::cout << "frame:" << f << std::endl;
+        std::cerr << "ERROR: can't create/open " << file_path << std::endl;
+        return false;
+    }
 
-        for(int p = 0; p < (int)frames[f].size()/3; p++)
-        {
-            Vec3 avg_pos = to_point(p, frames[f]);
-            int acc = 1;
-            float sum = filter(0);
-            float val = 0.f;
+    // Headers are patched with the number of frames by close()
+    if( format == PC2 )
+    {
+        _buff.resize( s_pc2_header_size );
+        char* p = &(_buff[0]);
+        memcpy(p, s_pc2_signature, 12); p += 12;
+        put_int  (p, Endianess::little_long ( 1     ));
+        put_int  (p, Endianess::little_long ( _nb_points ));
+        put_float(p, Endianess::little_float( 0.f   ));
+        put_float(p, Endianess::little_float( 1.f   ));
+        put_int  (p, Endianess::little_long ( 0     ));
+        _file.write(&(_buff[0]), s_pc2_header_size);
+    }
+    else if( format == PCQ )
+    {
+        _buff.assign(s_pcq_header_size, 0);
+        _file.write(&(_buff[0]), s_pcq_header_size);
+        if( _nb_frame_hint > 0 ) _offsets.reserve( _nb_frame_hint );
+    }
 
-            // ignore central point
-#if 1
-            avg_pos = Vec3::zero();
-            sum = 0.f;
-#endif
+    _frame.resize( _nb_points * 3 );
+    _is_open = _file.good();
+    return _is_open;
+}
 
-            while( (val = filter(acc)) > 0.01f || (acc >  (int)frames[f].size()) )
-            {
-                Vec3 pos1 = to_point(p, frames[ std::min(f + acc, (int)frames.size() - 1) ]);
-                Vec3 pos2 = to_point(p, frames[ std::max(f - acc, 0)                      ]);
+// -----------------------------------------------------------------------------
 
-                avg_pos += pos1 * val;
-                avg_pos += pos2 * val;
+void Point_cache_file::add_frame(float* points, int offset, int stride)
+{
+    if( !_is_open ) return;
+
+    for(int i = offset, j = 0; i < (_nb_points + offset); i++, j++)
+    {
+        _frame[j*3  ] = points[i*(3+stride)  ];
+        _frame[j*3+1] = points[i*(3+stride)+1];
+        _frame[j*3+2] = points[i*(3+stride)+2];
+    }
 
-                sum += val * 2.f;
+    switch( _format ){
+    case MDD: write_mdd_frame(); break;
+    case PC2: write_pc2_frame(); break;
+    case PCQ: write_pcq_frame(); break;
+    }
+    _nb_frames++;
+}
 
-                acc++;
-            }
+// -----------------------------------------------------------------------------
 
-            avg_pos /= sum;
+void Point_cache_file::write_mdd_frame()
+{
+    const int n = _nb_points * 3;
+    _buff.resize( n * 4 );
+    char* p = &(_buff[0]);
+    for(int i = 0; i < n; i++)
+        put_float(p, Endianess::big_float( _frame[i] ));
+    _file.write(&(_buff[0]), _buff.size());
+}
 
-            smooth_frames[f][p*3 + 0] = avg_pos.x;
-            smooth_frames[f][p*3 + 1] = avg_pos.y;
-            smooth_frames[f][p*3 + 2] = avg_pos.z;
-        }
-    }
+// -----------------------------------------------------------------------------
 
+void Point_cache_file::write_pc2_frame()
+{
+    const int n = _nb_points * 3;
+    _buff.resize( n * 4 );
+    char* p = &(_buff[0]);
+    for(int i = 0; i < n; i++)
+        put_float(p, Endianess::little_float( _frame[i] ));
+    _file.write(&(_buff[0]), _buff.size());
 }
 
-void Point_cache_file::export_mdd(const std::string& path_name)
+// -----------------------------------------------------------------------------
+
+void Point_cache_file::write_pcq_frame()
 {
+    const int n = _nb_points * 3;
+    _offsets.push_back( (long long)_file.tellp() );
+
+    const bool key = _nb_frames == 0 ||
+                     (_ref == PREVIOUS_FRAME && (_nb_frames % _key_interval) == 0);
+    if( key )
     {
-        std::ofstream file(path_name.c_str(), std::ios::binary|std::ios::trunc);
+        _buff.resize( n * 4 );
+        char* p = &(_buff[0]);
+        for(int i = 0; i < n; i++)
+            put_float(p, Endianess::little_float( _frame[i] ));
+        _file.write(&(_buff[0]), _buff.size());
+        _ref_frame = _frame;
+        return;
+    }
 
-        if(!file.is_open())
-        {
-            std::cout << "ERROR: can't create/open " << path_name << std::endl;
-            return;
-        }
+    // Range of the deltas
+    float mn[3] = { _frame[0] - _ref_frame[0],
+                    _frame[1] - _ref_frame[1],
+                    _frame[2] - _ref_frame[2] };
+    float mx[3] = { mn[0], mn[1], mn[2] };
+    for(int i = 0; i < n; i++)
+    {
+        const int a = i % 3;
+        const float d = _frame[i] - _ref_frame[i];
+        mn[a] = std::min(mn[a], d);
+        mx[a] = std::max(mx[a], d);
+    }
+    float step[3];
+    for(int a = 0; a < 3; a++)
+        step[a] = (mx[a] - mn[a]) / s_quant_max;
+
+    _buff.resize( 6*4 + n * 2 );
+    char* p = &(_buff[0]);
+    for(int a = 0; a < 3; a++) put_float(p, Endianess::little_float( mn[a]   ));
+    for(int a = 0; a < 3; a++) put_float(p, Endianess::little_float( step[a] ));
+
+    char* q_buff = p;
+    const bool update_ref = _ref == PREVIOUS_FRAME;
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        const int a = i % 3;
+        const float d = _frame[i] - _ref_frame[i];
+        float q = step[a] > 0.f ? std::floor((d - mn[a]) / step[a] + 0.5f) : 0.f;
+        q = std::min(std::max(q, 0.f), s_quant_max);
+        const unsigned short u = (unsigned short)q;
+        const short s = Endianess::little_short( (short)u );
+        memcpy(q_buff + i * 2, &s, 2);
+        // Reconstruct the frame exactly as the reader will
+        if( update_ref )
+            _ref_frame[i] = _ref_frame[i] + (mn[a] + (float)u * step[a]);
+    }
+    _file.write(&(_buff[0]), _buff.size());
+}
 
-        int ibuff = Endianess::big_long( (int)_frames.size() );
-        file.write((char*)&ibuff, 4);
-        ibuff = Endianess::big_long( (int)(_nb_points)  );
-        file.write((char*)&ibuff, 4);
+// -----------------------------------------------------------------------------
 
-        float fbuff[3] = {Endianess::big_float(0.1f), 0.f, 0.f};
-        for(unsigned f = 0; f < _frames.size(); f++)
-            file.write((char*)fbuff, 4);
+bool Point_cache_file::close()
+{
+    if( !_is_open ) return true;
+    _is_open = false;
 
-        for(unsigned f = 0; f < _frames.size(); f++)
+    bool ok = _file.good();
+    if( ok )
+    {
+        switch( _format ){
+        case MDD: ok = close_mdd(); break;
+        case PC2:
         {
-            for(int p = 0; p < _nb_points; p++)
-            {
-                fbuff[0] = Endianess::big_float( _frames[f][p*3    ] );
-                fbuff[1] = Endianess::big_float( _frames[f][p*3 + 1] );
-                fbuff[2] = Endianess::big_float( _frames[f][p*3 + 2] );
-                file.write((char*)fbuff, 4*3);
-            }
+            _file.seekp( 28 );
+            const int nb = Endianess::little_long( _nb_frames );
+            _file.write((const char*)&nb, 4);
+            ok = _file.good();
+        } break;
+        case PCQ: ok = close_pcq(); break;
         }
-        file.close();
     }
+    _file.close();
+    if( _format == MDD ) std::remove( (_path + ".part").c_str() );
+
+    if( !ok ) std::cerr << "ERROR: failed to write " << _path << std::endl;
+
+    // Release the frame buffers
+    std::vector<float>().swap( _frame );
+    std::vector<float>().swap( _ref_frame );
+    std::vector<char>().swap( _buff );
+    std::vector<long long>().swap( _offsets );
+    return ok;
+}
 
+// -----------------------------------------------------------------------------
 
-    // HACK write smooth out frames: ////////////////////////////////////////////////
+bool Point_cache_file::close_mdd()
+{
+    // Now that the number of frames is known write the header and the times
+    // table, then append the points data
+    _file.close();
+    std::ifstream part( (_path + ".part").c_str(), std::ios::binary );
+    std::ofstream file( _path.c_str(), std::ios::binary|std::ios::trunc );
+    if( !part.is_open() || !file.is_open() )
+        return false;
+
+    int ibuff = Endianess::big_long( _nb_frames );
+    file.write((char*)&ibuff, 4);
+    ibuff = Endianess::big_long( _nb_points );
+    file.write((char*)&ibuff, 4);
+    for(int f = 0; f < _nb_frames; f++)
     {
-        std::vector< std::vector<float> > smooth_frames( _frames.size() );
-        for( int i = 0; i < (int)_frames.size(); i++ )
-            smooth_frames[i] = _frames[i];
+        const float t = Endianess::big_float( (float)f / _fps );
+        file.write((const char*)&t, 4);
+    }
 
-        std::cout << "pipo" << std::endl;
-        denoise_frames( _frames, smooth_frames );
-        std::cout << "popo" << std::endl;
+    std::vector<char> chunk(1 << 20);
+    while( part )
+    {
+        part.read(&(chunk[0]), chunk.size());
+        file.write(&(chunk[0]), part.gcount());
+    }
+    return file.good();
+}
 
-        std::cout << path_name << std::endl;
+// -----------------------------------------------------------------------------
 
-        std::string new_path = path_name.substr(0, path_name.size()-4)+"_smooth.mdd";
+bool Point_cache_file::close_pcq()
+{
+    const long long table_offset = (long long)_file.tellp();
+
+    _buff.resize( _offsets.size() * 8 );
+    char* p = _buff.size() > 0 ? &(_buff[0]) : 0;
+    for(unsigned f = 0; f < _offsets.size(); f++)
+        put_le_offset(p, _offsets[f]);
+    if( _buff.size() > 0 )
+        _file.write(&(_buff[0]), _buff.size());
+
+    _buff.resize( s_pcq_header_size );
+    p = &(_buff[0]);
+    memcpy(p, s_pcq_magic, 4); p += 4;
+    put_int  (p, Endianess::little_long ( 1             ));
+    put_int  (p, Endianess::little_long ( _nb_points    ));
+    put_int  (p, Endianess::little_long ( _nb_frames    ));
+    put_int  (p, Endianess::little_long ( (int)_ref     ));
+    put_int  (p, Endianess::little_long ( _key_interval ));
+    put_float(p, Endianess::little_float( _fps          ));
+    put_int  (p, 0);
+    put_le_offset(p, table_offset);
+    _file.seekp( 0 );
+    _file.write(&(_buff[0]), s_pcq_header_size);
+    return _file.good();
+}
 
-        std::cout << new_path << std::endl;
+// =============================================================================
+// Point_cache_reader
+// =============================================================================
 
+Point_cache_reader::Point_cache_reader() :
+    _format(Point_cache_file::MDD),
+    _ref(Point_cache_file::REST_POSE),
+    _nb_points(0),
+    _nb_frames(0),
+    _fps(24.f),
+    _data_offset(0),
+    _key_interval(0),
+    _cache_frame(-1)
+{
+}
 
-        std::ofstream file( (new_path).c_str(), std::ios::binary|std::ios::trunc);
+// -----------------------------------------------------------------------------
 
-        if( !file.is_open() )
-        {
-            std::cout << "ERROR: can't create/open " << path_name << std::endl;
-            return;
-        }
+bool Point_cache_reader::open(const std::string& path)
+{
+    close();
+    init_endianess();
+    if( !_file.open(path) )
+    {
+        std::cerr << "ERROR: can't open " << path << std::endl;
+        return false;
+    }
 
-        int ibuff = Endianess::big_long( (int)smooth_frames.size() );
-        file.write((char*)&ibuff, 4);
-        ibuff = Endianess::big_long( (int)(_nb_points)  );
-        file.write((char*)&ibuff, 4);
+    bool ok = false;
+    if( _file.size() >= (size_t)s_pc2_header_size &&
+        memcmp(_file.data(), s_pc2_signature, 12) == 0 )
+    {
+        _format = Point_cache_file::PC2;
+        ok = open_pc2();
+    }
+    else if( _file.size() >= (size_t)s_pcq_header_size &&
+             memcmp(_file.data(), s_pcq_magic, 4) == 0 )
+    {
+        _format = Point_cache_file::PCQ;
+        ok = open_pcq();
+    }
+    else
+    {
+        _format = Point_cache_file::MDD;
+        ok = open_mdd();
+    }
 
-        float fbuff[3] = {Endianess::big_float(0.1f), 0.f, 0.f};
-        for(unsigned f = 0; f < smooth_frames.size(); f++)
-            file.write((char*)fbuff, 4);
+    if( !ok )
+    {
+        std::cerr << "ERROR: " << path << " is not a valid point cache" << std::endl;
+        close();
+    }
+    return ok;
+}
 
-        for(unsigned f = 0; f < smooth_frames.size(); f++)
-        {
-            for(int p = 0; p < _nb_points; p++)
-            {
-                fbuff[0] = Endianess::big_float( smooth_frames[f][p*3    ] );
-                fbuff[1] = Endianess::big_float( smooth_frames[f][p*3 + 1] );
-                fbuff[2] = Endianess::big_float( smooth_frames[f][p*3 + 2] );
-                file.write((char*)fbuff, 4*3);
-            }
+// -----------------------------------------------------------------------------
+
+bool Point_cache_reader::open_mdd()
+{
+    if( _file.size() < 8 ) return false;
+    const char* data = _file.data();
+    _nb_frames = be_int( data     );
+    _nb_points = be_int( data + 4 );
+    if( _nb_frames < 0 || _nb_points <= 0 ) return false;
+
+    const unsigned long long expected = 8ull + 4ull * _nb_frames +
+            12ull * (unsigned long long)_nb_frames * _nb_points;
+    if( expected != (unsigned long long)_file.size() ) return false;
+
+    _data_offset = 8 + 4 * (size_t)_nb_frames;
+    _fps = 24.f;
+    if( _nb_frames > 1 )
+    {
+        const float dt = be_float(data + 12) - be_float(data + 8);
+        if( dt > 0.f ) _fps = 1.f / dt;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Point_cache_reader::open_pc2()
+{
+    const char* data = _file.data();
+    _nb_points = le_int( data + 16 );
+    _nb_frames = le_int( data + 28 );
+    if( _nb_frames < 0 || _nb_points <= 0 ) return false;
+
+    const unsigned long long expected = (unsigned long long)s_pc2_header_size +
+            12ull * (unsigned long long)_nb_frames * _nb_points;
+    if( expected > (unsigned long long)_file.size() ) return false;
+
+    _data_offset = s_pc2_header_size;
+    // pc2 files don't store the frame rate
+    _fps = 24.f;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Point_cache_reader::open_pcq()
+{
+    const char* data = _file.data();
+    if( le_int(data + 4) != 1 ) return false;
+    _nb_points = le_int  ( data +  8 );
+    _nb_frames = le_int  ( data + 12 );
+    _ref       = le_int  ( data + 16 ) == 0 ? Point_cache_file::REST_POSE :
+                                              Point_cache_file::PREVIOUS_FRAME;
+    const int key_interval = le_int( data + 20 );
+    _fps       = le_float( data + 24 );
+    const long long table_offset = le_offset( data + 32 );
+    if( _nb_frames < 0 || _nb_points <= 0 ) return false;
+    if( _ref == Point_cache_file::PREVIOUS_FRAME && key_interval <= 0 ) return false;
+    if( table_offset < s_pcq_header_size ||
+        (unsigned long long)table_offset + 8ull * _nb_frames > (unsigned long long)_file.size() )
+        return false;
+
+    _key_interval = key_interval;
+    _offsets.resize( _nb_frames );
+    const size_t key_size   = (size_t)_nb_points * 12;
+    const size_t delta_size = 24 + (size_t)_nb_points * 6;
+    for(int f = 0; f < _nb_frames; f++)
+    {
+        _offsets[f] = le_offset( data + table_offset + 8 * f );
+        const size_t size = is_key(f) ? key_size : delta_size;
+        if( _offsets[f] < s_pcq_header_size ||
+            (unsigned long long)_offsets[f] + size > (unsigned long long)table_offset )
+            return false;
+    }
+
+    _cache.resize( _nb_points * 3 );
+    _cache_frame = -1;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void Point_cache_reader::close()
+{
+    _file.close();
+    _nb_points   = 0;
+    _nb_frames   = 0;
+    _data_offset  = 0;
+    _key_interval = 0;
+    _cache_frame  = -1;
+    std::vector<long long>().swap( _offsets );
+    std::vector<float>().swap( _cache );
+}
+
+// -----------------------------------------------------------------------------
+
+bool Point_cache_reader::is_key(int f) const
+{
+    if( f == 0 ) return true;
+    return _ref == Point_cache_file::PREVIOUS_FRAME && (f % _key_interval) == 0;
+}
+
+// -----------------------------------------------------------------------------
+
+void Point_cache_reader::decode_pcq(int f, const float* ref, float* points) const
+{
+    const int n = _nb_points * 3;
+    const char* data = _file.data() + _offsets[f];
+    if( is_key(f) )
+    {
+        #pragma omp parallel for schedule(static)
+        for(int i = 0; i < n; i++)
+            points[i] = le_float( data + i * 4 );
+        return;
+    }
+
+    float mn[3], step[3];
+    for(int a = 0; a < 3; a++){
+        mn  [a] = le_float( data +      a * 4 );
+        step[a] = le_float( data + 12 + a * 4 );
+    }
+    const char* q_buff = data + 24;
+    #pragma omp parallel for schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        short s;
+        memcpy(&s, q_buff + i * 2, 2);
+        const unsigned short u = (unsigned short)Endianess::little_short( s );
+        points[i] = ref[i] + (mn[i % 3] + (float)u * step[i % 3]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool Point_cache_reader::get_frame(int f, float* points)
+{
+    if( !is_open() || f < 0 || f >= _nb_frames ) return false;
+
+    const int n = _nb_points * 3;
+    if( _format != Point_cache_file::PCQ )
+    {
+        const char* data = _file.data() + _data_offset + (size_t)f * n * 4;
+        const bool big = _format == Point_cache_file::MDD;
+        #pragma omp parallel for schedule(static)
+        for(int i = 0; i < n; i++)
+            points[i] = big ? be_float( data + i * 4 ) : le_float( data + i * 4 );
+        return true;
+    }
+
+    if( _ref == Point_cache_file::REST_POSE )
+    {
+        // '_cache' holds the rest pose
+        if( _cache_frame != 0 ){
+            decode_pcq(0, 0, &(_cache[0]));
+            _cache_frame = 0;
         }
-        file.close();
+        if( f == 0 ) std::copy(_cache.begin(), _cache.end(), points);
+        else         decode_pcq(f, &(_cache[0]), points);
+        return true;
     }
 
+    // Deltas against the previous frame: decode from the last key frame or
+    // from the cached frame when it's closer
+    const int key = f - (f % _key_interval);
+    int start = key;
+    if( _cache_frame >= key && _cache_frame <= f )
+        start = _cache_frame + 1;
+    else
+        decode_pcq(key, 0, &(_cache[0]));
+
+    for(int g = std::max(start, key + 1); g <= f; g++)
+        decode_pcq(g, &(_cache[0]), &(_cache[0]));
+    _cache_frame = f;
+
+    std::copy(_cache.begin(), _cache.end(), points);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+bool Point_cache_reader::get_frame(int f, std::vector<float>& points)
+{
+    points.resize( _nb_points * 3 );
+    return points.size() > 0 && get_frame(f, &(points[0]));
 }
 
 }// END Loader =================================================================
@@ -3,6 +3,9 @@
 
 #include <vector>
 #include <string>
+#include <fstream>
+
+#include "parsers/mapped_file.hpp"
 
 // =============================================================================
 namespace Loader {
@@ -12,43 +15,164 @@ namespace Loader {
  * @brief Handling export of mesh point frame by frame
  * Point cache frame files enables to save at each frame the position of every
  * vertices of a mesh. It's an easy way to export a whole animation as the
- * format is largely supported by other animation software. The file is
- * rapidely too large to fit in memory though...
- * Don't record hours of sequences!
+ * format is largely supported by other animation software.
+ *
+ * Frames are streamed to disk as they are added, only one frame is kept in
+ * memory so long sequences can be recorded:
+ * @code
+ * Point_cache_file cache(nb_verts);
+ * cache.open("anim.pc2", Point_cache_file::PC2);
+ * for(each frame)
+ *     cache.add_frame( verts );
+ * cache.close();
+ * @endcode
+ *
+ * Besides 'mdd' and 'pc2' the 'pcq' format stores quantized deltas
+ * (16 bits per coordinate) against the rest pose (first frame) or against the
+ * previous frame, about half the size of a float cache. Use
+ * Point_cache_reader to read it back.
 */
 class Point_cache_file{
 public:
+    enum Format {
+        MDD, ///< Big endian floats, the times table is written by close()
+        PC2, ///< Little endian floats, streamed directly
+        PCQ  ///< Quantized deltas
+    };
+
+    /// What the quantized deltas of the PCQ format are relative to
+    enum Delta_ref {
+        REST_POSE,     ///< delta against the first frame (random access is cheap)
+        PREVIOUS_FRAME ///< delta against the previous frame (smaller errors)
+    };
+
+    /// @param nb_frame_hint expected number of frames (to reserve the frame
+    /// table of the PCQ format)
+    Point_cache_file(int nb_points, int nb_frame_hint = 0);
 
+    /// Closes the file if still open
+    ~Point_cache_file();
 
-    Point_cache_file(int nb_points, int nb_frame_hint = 0);
+    /// Create the file 'path' and start recording.
+    /// @param fps frame rate stored in the file header
+    /// @param ref reference of the deltas with the PCQ format
+    /// @param key_interval with PREVIOUS_FRAME a full frame is stored every
+    /// 'key_interval' frames so that the reader doesn't have to decode from
+    /// the first frame.
+    /// @return false if the file can't be created
+    bool open(const std::string& path,
+              Format format = MDD,
+              float fps = 24.f,
+              Delta_ref ref = REST_POSE,
+              int key_interval = 32);
+
+    /// Finish the file (header, frame tables)
+    /// @return false if an IO error occured while recording
+    bool close();
+
+    bool is_open() const { return _is_open; }
 
     /// Add a new frame given the list of points coordinates points.
+    /// The frame is directly written to the file, nothing is done if it's not
+    /// open.
     /// @param points array of points with x y z coordinates contigus
     /// @param offset The number of elements to ignore and begin to read the
     /// array 'points'
     /// @param stride number of elements to ignore between each points
     void add_frame(float* points, int offset=0, int stride=0);
 
-    /// Write out a mdd file
-    void export_mdd(const std::string& path_name);
-
-
-    // TODO:
-    //void export_pc2(const std::string& path_name);
-    //void import_pc2(const std::string& path_name,
-    //                const std::vector< std::vector<float> >& frames);
-
+    /// Number of frames written since open()
+    int nb_frames() const { return _nb_frames; }
 
+    int nb_points() const { return _nb_points; }
 
 private:
-    /// list of frame. Each frame stores the object vertex coordinates.
-    /// X Y Z coordinates are contigus.
-    /// _frames[num_frame][list_points]
-    std::vector< std::vector<float> > _frames;
+    void write_mdd_frame();
+    void write_pc2_frame();
+    void write_pcq_frame();
+    bool close_mdd();
+    bool close_pcq();
 
     /// Number of points the cached object is.
     int _nb_points;
+    int _nb_frames;
+    int _nb_frame_hint;
+
+    bool        _is_open;
+    Format      _format;
+    Delta_ref   _ref;
+    int         _key_interval;
+    float       _fps;
+    std::string _path;
+    /// Output file (point data of mdd files go to a temporary file
+    /// '_path.part' until close() knows the number of frames)
+    std::ofstream _file;
+
+    /// Current frame X Y Z coordinates contigus
+    std::vector<float> _frame;
+    /// PCQ reference of the deltas as decoded by the reader
+    std::vector<float> _ref_frame;
+    /// Encoded frame
+    std::vector<char> _buff;
+    /// PCQ offset of every frame in the file
+    std::vector<long long> _offsets;
+};
+
+// =============================================================================
+
+/**
+ * @brief Random access to the frames of a 'mdd', 'pc2' or 'pcq' file
+ *
+ * The file is memory mapped, only the requested frames are read (and
+ * converted). For 'pcq' files recorded relatively to the previous frame the
+ * last decoded frame is kept so that reading frames in order is as fast as
+ * random access with the other formats.
+*/
+class Point_cache_reader {
+public:
+    Point_cache_reader();
 
+    /// The format is guessed from the file content
+    /// @return false if the file can't be opened or is not a point cache
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return _file.is_open(); }
+
+    int nb_frames() const { return _nb_frames; }
+    int nb_points() const { return _nb_points; }
+    float fps() const { return _fps; }
+    Point_cache_file::Format get_format() const { return _format; }
+
+    /// Get the points of the frame 'f' in [0 nb_frames()-1]
+    /// @param points X Y Z coordinates contigus (nb_points()*3 floats)
+    bool get_frame(int f, float* points);
+    bool get_frame(int f, std::vector<float>& points);
+
+private:
+    bool open_mdd();
+    bool open_pc2();
+    bool open_pcq();
+    /// Decode the pcq frame 'f' given the reference frame 'ref'
+    void decode_pcq(int f, const float* ref, float* points) const;
+    bool is_key(int f) const;
+
+    Mapped_file _file;
+    Point_cache_file::Format    _format;
+    Point_cache_file::Delta_ref _ref;
+    int   _nb_points;
+    int   _nb_frames;
+    float _fps;
+    /// Offset in bytes of the first frame (mdd and pc2)
+    size_t _data_offset;
+    /// PCQ frames multiple of '_key_interval' are full frames
+    int _key_interval;
+    /// PCQ offset of every frame in the file
+    std::vector<long long> _offsets;
+
+    /// Last decoded pcq frame
+    std::vector<float> _cache;
+    int _cache_frame;
 };
 
 }// END Loader =================================================================
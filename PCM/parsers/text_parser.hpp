@@ -0,0 +1,203 @@
+#ifndef TEXT_PARSER_HPP__
+#define TEXT_PARSER_HPP__
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+/**
+    @file text_parser.hpp
+    @brief Number parsing over a memory buffer for the text file loaders
+
+    Unlike scanf or streams these don't need a null terminated string (they
+    work directly on a Mapped_file), don't depend on the locale and don't
+    lock anything, so lines can be parsed from several threads.
+    Every function takes the current position and the end of the buffer.
+*/
+
+// =============================================================================
+namespace Loader {
+// =============================================================================
+
+// =============================================================================
+namespace Text {
+// =============================================================================
+
+static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+/// Skip spaces, tabs and carriage returns (not the new lines)
+static inline const char* skip_blanks(const char* p, const char* end)
+{
+    while( p < end && (*p == ' ' || *p == '\t' || *p == '\r') ) ++p;
+    return p;
+}
+
+/// @return true if 'p' is at the end of the line (or buffer) once the blanks
+/// are skipped
+static inline bool is_eol(const char* p, const char* end)
+{
+    p = skip_blanks(p, end);
+    return p >= end || *p == '\n';
+}
+
+/// @return the first character of the next line or 'end'
+static inline const char* next_line(const char* p, const char* end)
+{
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    return nl == 0 ? end : nl + 1;
+}
+
+/// Skip the current token (up to a blank or a new line)
+static inline const char* skip_token(const char* p, const char* end)
+{
+    while( p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' ) ++p;
+    return p;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Integer after the blanks at 'p'
+/// @return false if there is no number, 'p' is left unchanged then.
+/// Otherwise 'p' is moved after the number.
+static inline bool parse_int(const char*& p, const char* end, int& out)
+{
+    const char* c = skip_blanks(p, end);
+    bool neg = false;
+    if( c < end && (*c == '-' || *c == '+') ) neg = (*c++ == '-');
+    if( c >= end || !is_digit(*c) ) return false;
+
+    int v = 0;
+    for(; c < end && is_digit(*c); ++c)
+        v = v * 10 + (*c - '0');
+    out = neg ? -v : v;
+    p = c;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Exact powers of ten representable by a double
+static inline double pow10(int e)
+{
+    static const double table[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    return e <= 22 ? table[e] : std::pow(10., e);
+}
+
+/// Floating point number after the blanks at 'p' (same syntax as strtod:
+/// sign, digits, decimal point, exponent, 'inf' and 'nan')
+/// @return false if there is no number, 'p' is left unchanged then.
+/// Otherwise 'p' is moved after the number.
+static inline bool parse_float(const char*& p, const char* end, float& out)
+{
+    const char* c = skip_blanks(p, end);
+    const char* start = c;
+    bool neg = false;
+    if( c < end && (*c == '-' || *c == '+') ) neg = (*c++ == '-');
+
+    // The first 19 significant digits fit in the mantissa, others only
+    // shift the exponent
+    unsigned long long mant = 0;
+    int  nb_digits = 0;
+    int  exp10 = 0;
+    bool any = false;
+    for(; c < end && is_digit(*c); ++c, any = true){
+        if( nb_digits < 19 ){
+            mant = mant * 10 + (*c - '0');
+            if( mant != 0 ) ++nb_digits;
+        } else
+            ++exp10;
+    }
+    if( c < end && *c == '.' )
+    {
+        ++c;
+        for(; c < end && is_digit(*c); ++c, any = true){
+            if( nb_digits < 19 ){
+                mant = mant * 10 + (*c - '0');
+                if( mant != 0 ) ++nb_digits;
+                --exp10;
+            }
+        }
+    }
+
+    if( !any )
+    {
+        // 'inf', 'nan' and the like: rare enough to go through strtod
+        char buff[32];
+        const int len = (int)std::min((size_t)(end - start), sizeof(buff) - 1);
+        memcpy(buff, start, len);
+        buff[len] = '\0';
+        char* stop = 0;
+        const double v = strtod(buff, &stop);
+        if( stop == buff ) return false;
+        out = (float)v;
+        p = start + (stop - buff);
+        return true;
+    }
+
+    if( c < end && (*c == 'e' || *c == 'E') )
+    {
+        const char* e = c + 1;
+        bool eneg = false;
+        if( e < end && (*e == '-' || *e == '+') ) eneg = (*e++ == '-');
+        if( e < end && is_digit(*e) )
+        {
+            int x = 0;
+            for(; e < end && is_digit(*e); ++e)
+                if( x < 10000 ) x = x * 10 + (*e - '0');
+            exp10 += eneg ? -x : x;
+            c = e;
+        }
+    }
+
+    double v = (double)mant;
+    if( mant != 0 && exp10 != 0 )
+        v = exp10 < 0 ? v / pow10(-exp10) : v * pow10(exp10);
+    out = (float)(neg ? -v : v);
+    p = c;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+/// Cut [begin, end) in about 'nb_chunks' pieces starting on a new line.
+/// 'bounds' gets nb_chunks + 1 pointers, chunk i is [bounds[i], bounds[i+1])
+/// and may be empty when lines are longer than the chunks.
+static inline void split_lines(const char* begin,
+                               const char* end,
+                               int nb_chunks,
+                               std::vector<const char*>& bounds)
+{
+    nb_chunks = std::max(nb_chunks, 1);
+    bounds.resize( nb_chunks + 1 );
+    bounds[0] = begin;
+    const size_t size = end - begin;
+    for(int i = 1; i < nb_chunks; ++i)
+    {
+        const char* p = begin + (size_t)((double)size * i / nb_chunks);
+        // Start right after the previous new line
+        p = std::max(p, bounds[i-1]);
+        if( p > begin && p[-1] != '\n' ) p = next_line(p, end);
+        bounds[i] = p;
+    }
+    bounds[nb_chunks] = end;
+}
+
+/// Number of chunks worth parsing in parallel for 'size' bytes. Enough to
+/// balance the threads with a dynamic schedule, big enough to amortize the
+/// per chunk buffers.
+static inline int nb_chunks(size_t size)
+{
+    const size_t chunk_size = 1 << 18;
+    return (int)std::min((size_t)1024, std::max((size_t)1, size / chunk_size));
+}
+
+}// END Text ===================================================================
+
+}// END Loader =================================================================
+
+#endif // TEXT_PARSER_HPP__
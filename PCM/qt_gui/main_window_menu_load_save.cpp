@@ -11,6 +11,8 @@
 #include <QFileDialog>
 #include <QColorDialog>
 #include <QMessageBox>
+#include <QDirIterator>
+#include <iostream>
 #include "qt_gui/tools/popup_ok_cancel.hpp"
 #include "videoediting/VideoEditingWindow.h"
 #include "videoediting\GLViewWidget.h"
@@ -554,6 +556,43 @@ void main_window::on_actionSkeleton_triggered()
 	}
 }
 
+void main_window::on_actionBenchmark_skinning_triggered()
+{
+	if( !Cuda_ctrl::is_animesh_loaded() ){
+		QMessageBox::information(this, "Error", "No animated mesh loaded");
+		return;
+	}
+	// results go to the console
+	Cuda_ctrl::_anim_mesh->benchmark_skinning();
+}
+
+void main_window::on_actionBenchmark_meshes_triggered()
+{
+	// every model (.ism) bundled in resource/meshes, one after the other
+	QStringList models;
+	QDirIterator it("./resource/meshes", QStringList() << "*.ism", QDir::Files, QDirIterator::Subdirectories);
+	while( it.hasNext() )
+		models << it.next();
+	models.sort();
+	if( models.isEmpty() ){
+		QMessageBox::information(this, "Error", "No model found in ./resource/meshes");
+		return;
+	}
+
+	for(int i = 0; i < models.size(); ++i)
+	{
+		const Mesh* previous = Cuda_ctrl::is_animesh_loaded() ? Cuda_ctrl::_anim_mesh->get_mesh() : 0;
+		load_ism( models[i] );
+		if( !Cuda_ctrl::is_animesh_loaded() || Cuda_ctrl::_anim_mesh->get_mesh() == previous ){
+			std::cout << "benchmark: can't load " << models[i].toStdString() << std::endl;
+			continue;
+		}
+		std::cout << "benchmark: " << models[i].toStdString() << ", "
+				  << Cuda_ctrl::_anim_mesh->get_mesh()->get_nb_vertices() << " vertices" << std::endl;
+		Cuda_ctrl::_anim_mesh->benchmark_fitting();
+	}
+}
+
 void main_window::on_actionNew_VideoEditing_Scene_triggered()
 {
 	VideoEditingWindow& videoEditingWindow = VideoEditingWindow::getInstance();
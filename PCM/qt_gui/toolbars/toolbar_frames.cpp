@@ -4,6 +4,7 @@
 #include <QString>
 #include <QFileDialog>
 #include <limits>
+#include <algorithm>
 
 #include "toolbox/std_utils/string.hpp"
 #include "toolbox/std_utils/vector.hpp"
@@ -150,6 +151,15 @@ Toolbar_frames::Toolbar_frames(QWidget* parent) :
                      this       , SLOT(path_button_released()));
     this->addWidget(_path_button);
     // -----------------
+
+    // Setup combo box for the point cache format (same order as Anim_t)
+    _format_box = new QComboBox(this);
+    _format_box->addItem( QString("mdd") );
+    _format_box->addItem( QString("pc2") );
+    _format_box->addItem( QString("pcq") );
+    _format_box->setToolTip("Point cache format: mdd, pc2 or pcq (quantized)");
+    this->addWidget(_format_box);
+    // -----------------
 }
 
 // -----------------------------------------------------------------------------
@@ -227,12 +237,20 @@ void Toolbar_frames::update_scene()
 
 // -----------------------------------------------------------------------------
 
-enum Anim_t {MDD, PC2};
 void Toolbar_frames::export_anim(Anim_t t)
 {
-    std::string filepath = std::string(_line_edit->text().toLocal8Bit().constData())+"/anim_export.mdd";
+    // Frames are streamed to the file by Animated_mesh_ctrl::deform_mesh()
+    // until the recording stops
+    static const char* ext[] = { "/anim_export.mdd", "/anim_export.pc2", "/anim_export.pcq" };
+    static const Loader::Point_cache_file::Format format[] = {
+        Loader::Point_cache_file::MDD,
+        Loader::Point_cache_file::PC2,
+        Loader::Point_cache_file::PCQ
+    };
+    std::string filepath = std::string(_line_edit->text().toLocal8Bit().constData());
+    filepath += ext[t];
     if(g_anim_cache != 0)
-        g_anim_cache->export_mdd(filepath);
+        g_anim_cache->open(filepath, format[t], (float)_dSpinB_fps->value());
 }
 
 // -----------------------------------------------------------------------------
@@ -245,8 +263,9 @@ void Toolbar_frames::rec_button_released()
         _rec_button->setIcon( _ico_rec_off );
         _rec_state = false;
         g_shooting_state = false; // Disable screen shot
-        export_anim(MDD);
         g_save_anim = false;
+        if(g_anim_cache != 0)
+            g_anim_cache->close();
         //_spinB_frames->setValue(0);
     }
     else
@@ -255,6 +274,7 @@ void Toolbar_frames::rec_button_released()
         _rec_button->setIcon(_ico_rec_on);
         _rec_state = true;
         g_shooting_state = _shot_state;
+        export_anim( (Anim_t)std::max(0, _format_box->currentIndex()) );
         g_save_anim = true;
     }
 }
@@ -72,8 +72,10 @@ private:
     void set_play();
 
 
-    /// File formats to register the mesh position
-    enum Anim_t {MDD, PC2};
+    /// File formats to register the mesh position, in the order of
+    /// '_format_box'
+    enum Anim_t {MDD, PC2, PCQ};
+    /// Start streaming the recorded frames to the export directory
     void export_anim(Anim_t t);
 
     Widget_frame* _buttons;     ///< play/stop/etc. buttons
@@ -90,6 +92,7 @@ private:
     QToolButton*    _img_button;    ///< toogle screenshots
     QPushButton*    _path_button;
     QLineEdit*      _line_edit;     ///< Holds recorded files path
+    QComboBox*      _format_box;    ///< Point cache format of the recording
     QTimer          _timer_frame;   ///< Timer to play the animation
 
     bool _rec_state;             ///< wether we record the animation or not
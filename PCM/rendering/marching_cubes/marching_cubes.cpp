@@ -7,7 +7,7 @@
 #include "toolbox/gl_utils/glbuffer_object.hpp"
 #include "global_datas/g_paths.hpp"
 #include "rendering/marching_cubes/g_tables_mcubes.hpp"
-#include "rendering/marching_cubes/fill_grid_thread.hpp"
+#include "rendering/marching_cubes/sparse_grid.hpp"
 #include "toolbox/maths/vec3i.hpp"
 #include "toolbox/maths/vec3.hpp"
 #include "toolbox/containers/idx3.hpp"
@@ -97,53 +97,6 @@ void set_world_bbox(const Bbox3& abbox)
 
 // -----------------------------------------------------------------------------
 
-/// Fill the 3D marching cube grid with multiple threads.
-/// @param obj : implicit object we fill the grid with
-/// @param res : grid resolution for the marching cube
-/// @param depth : the octree's depth. World is divided using an octree of depth
-/// 'depth' each node is then filled with a thread (according to the resolution
-/// 'res')
-/// @param offset : a parameter for the recursive calls -> don't touch that!
-static void threaded_octree_fill(const Node_implicit_surface* obj,
-                                 Vec3i res,
-                                 int depth = 1,
-                                 Vec3i offset = Vec3i(0))
-{
-
-    depth--;
-    Vec3i sub_res = res / 2;
-    Vec3i curr_offset;
-    for(int i = 0; i < 8; ++i)
-    {
-        curr_offset = sub_res;
-        curr_offset.x *= (i      & 0x1);
-        curr_offset.y *= (i >> 1 & 0x1);
-        curr_offset.z *= (i >> 2 & 0x1);
-
-        curr_offset += offset;
-
-        if(depth > 0)
-        {
-            threaded_octree_fill(obj, sub_res, depth, curr_offset);
-        }
-        else
-        {
-            Fill_grid_thread* thread = new Fill_grid_thread(sub_res,
-                                                            curr_offset,
-                                                            g_world_resolution,
-                                                            g_world_box.pmin,
-                                                            get_world_step(),
-                                                            g_data_field,
-                                                            obj);
-            thread->setAutoDelete( true );
-            QThreadPool::globalInstance()->start( thread );
-        }
-    }
-
-}
-
-// -----------------------------------------------------------------------------
-
 void fill_3D_grid_with_scalar_field(const Node_implicit_surface* obj)
 {
     set_world_bbox( obj->get_bbox() );
@@ -161,8 +114,12 @@ void fill_3D_grid_with_scalar_field(const Node_implicit_surface* obj)
     }
 #else
 
-    threaded_octree_fill(obj, g_world_resolution, 2);
-    QThreadPool::globalInstance()->waitForDone();
+    // Only the blocks near the iso-surface are evaluated, the texture still
+    // needs every cell
+    const Vec3 step = get_world_step();
+    Sparse_grid grid;
+    grid.fill(obj, g_world_box.pmin + step * 0.5f, g_world_resolution, step, g_iso_level);
+    grid.to_dense( g_data_field );
 #endif
 
     // Upload the 3d texture to GPU for future tessalation with marching cubes
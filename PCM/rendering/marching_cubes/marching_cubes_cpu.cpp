@@ -7,9 +7,14 @@
 */
 
 #include "rendering/marching_cubes/g_tables_mcubes.hpp"
+#include "rendering/marching_cubes/fill_grid_thread.hpp"
 #include "toolbox/portable_includes/port_glew.h"
 #include "toolbox/containers/idx3.hpp"
 
+#include <QThreadPool>
+#include <QRunnable>
+#include <algorithm>
+
 // =============================================================================
 namespace Marching_cubes {
 // =============================================================================
@@ -24,121 +29,469 @@ Vec3 vert_lerp(float iso_lvl, Vec3 p0, Vec3 p1, float val0, float val1)
 
 // -----------------------------------------------------------------------------
 
-/**
-   Given a grid cell and an isolevel, calculate the triangular
-   facets required to represent the isosurface through the cell.
-   Return the number of triangular facets, the array "triangles"
-   will be loaded up with the vertices at most 5 triangular facets.
-    0 will be returned if the grid cell is either totally above
-   of totally below the isolevel.
-*/
-int polygonise(Cell &grid, float iso_lvl, Vec3* triangles)
+/// Number of slabs the grid is cut into along z, a few per thread so
+/// that uneven slabs still balance
+static int nb_slabs(int nb_layers)
 {
-   int cube_idx;
-   Vec3 vert_list[12];
-
-   // Determine the index into the edge table which
-   // tells us which vertices are inside of the surface
-   cube_idx = 0;
-   if(grid.val[0] < iso_lvl) cube_idx |= 1;
-   if(grid.val[1] < iso_lvl) cube_idx |= 2;
-   if(grid.val[2] < iso_lvl) cube_idx |= 4;
-   if(grid.val[3] < iso_lvl) cube_idx |= 8;
-   if(grid.val[4] < iso_lvl) cube_idx |= 16;
-   if(grid.val[5] < iso_lvl) cube_idx |= 32;
-   if(grid.val[6] < iso_lvl) cube_idx |= 64;
-   if(grid.val[7] < iso_lvl) cube_idx |= 128;
-
-   // Cube is entirely in/out of the surface
-   if(g_edge_table[cube_idx] == 0) return 0;
-
-   // Find the vertices where the surface intersects the cube
-   if(g_edge_table[cube_idx] & 1   ) vert_list[ 0] = vert_lerp(iso_lvl, grid.pos[0],grid.pos[1], grid.val[0], grid.val[1]);
-   if(g_edge_table[cube_idx] & 2   ) vert_list[ 1] = vert_lerp(iso_lvl, grid.pos[1],grid.pos[2], grid.val[1], grid.val[2]);
-   if(g_edge_table[cube_idx] & 4   ) vert_list[ 2] = vert_lerp(iso_lvl, grid.pos[2],grid.pos[3], grid.val[2], grid.val[3]);
-   if(g_edge_table[cube_idx] & 8   ) vert_list[ 3] = vert_lerp(iso_lvl, grid.pos[3],grid.pos[0], grid.val[3], grid.val[0]);
-   if(g_edge_table[cube_idx] & 16  ) vert_list[ 4] = vert_lerp(iso_lvl, grid.pos[4],grid.pos[5], grid.val[4], grid.val[5]);
-   if(g_edge_table[cube_idx] & 32  ) vert_list[ 5] = vert_lerp(iso_lvl, grid.pos[5],grid.pos[6], grid.val[5], grid.val[6]);
-   if(g_edge_table[cube_idx] & 64  ) vert_list[ 6] = vert_lerp(iso_lvl, grid.pos[6],grid.pos[7], grid.val[6], grid.val[7]);
-   if(g_edge_table[cube_idx] & 128 ) vert_list[ 7] = vert_lerp(iso_lvl, grid.pos[7],grid.pos[4], grid.val[7], grid.val[4]);
-   if(g_edge_table[cube_idx] & 256 ) vert_list[ 8] = vert_lerp(iso_lvl, grid.pos[0],grid.pos[4], grid.val[0], grid.val[4]);
-   if(g_edge_table[cube_idx] & 512 ) vert_list[ 9] = vert_lerp(iso_lvl, grid.pos[1],grid.pos[5], grid.val[1], grid.val[5]);
-   if(g_edge_table[cube_idx] & 1024) vert_list[10] = vert_lerp(iso_lvl, grid.pos[2],grid.pos[6], grid.val[2], grid.val[6]);
-   if(g_edge_table[cube_idx] & 2048) vert_list[11] = vert_lerp(iso_lvl, grid.pos[3],grid.pos[7], grid.val[3], grid.val[7]);
-
-   // Create the triangle
-   int nb_triangles = 0;
-   for( int i = 0; g_tri_table[cube_idx][i] != -1; i += 3)
-   {
-      triangles[nb_triangles    ] = vert_list[ g_tri_table[cube_idx][i    ] ];
-      triangles[nb_triangles + 1] = vert_list[ g_tri_table[cube_idx][i + 1] ];
-      triangles[nb_triangles + 2] = vert_list[ g_tri_table[cube_idx][i + 2] ];
-      nb_triangles += 3;
-   }
-
-   return nb_triangles;
+    int nb = QThreadPool::globalInstance()->maxThreadCount() * 4;
+    return std::max(1, std::min(nb, nb_layers));
 }
 
 // -----------------------------------------------------------------------------
 
-/// Software marching cubes polygonization
-/// SLow as hell since because we use direct mode rendering in addition of
-/// the CPU calculation...
-void direct_mode_render_marching_cubes(const Node_implicit_surface* node,
-                                       const Vec3 world_start,
-                                       Vec3i res,
-                                       Vec3 steps,
-                                       float iso_lvl)
+void fill_grid(const Node_implicit_surface* node,
+               const Vec3 world_start,
+               Vec3i res,
+               Vec3 steps,
+               std::vector<float>& field)
 {
-    // Note: if we were using a temporary buffer for the 3D we won't have to recompute a lot of values of the cells ...
+    const Vec3i pts(res.x + 1, res.y + 1, res.z + 1);
+    field.resize( pts.product() );
 
-    // We could use some threads too for filling and polygonising
+    // Fill_grid_thread samples the center of its cells: shift by half a step
+    // so that it samples the corners of ours
+    const Vec3 box_start = world_start - steps * 0.5f;
+    const int nb = nb_slabs( pts.z );
+    // Own pool: waitForDone() on the global one would also wait on unrelated
+    // tasks, and never return when called from one of its threads
+    QThreadPool pool;
+    for(int s = 0; s < nb; ++s)
+    {
+        int z0 = pts.z *  s      / nb;
+        int z1 = pts.z * (s + 1) / nb;
+        if( z1 == z0 ) continue;
+        Fill_grid_thread* thread = new Fill_grid_thread(Vec3i(pts.x, pts.y, z1 - z0),
+                                                        Vec3i(0, 0, z0),
+                                                        pts,
+                                                        box_start,
+                                                        steps,
+                                                        field,
+                                                        node);
+        thread->setAutoDelete( true );
+        pool.start( thread );
+    }
+    pool.waitForDone();
+}
 
-    // And VBOs of course
+// -----------------------------------------------------------------------------
 
-    // Then there is the version that walks onto the surface...
+/**
+ * @class Polygonise_slab
+ * @brief Marching cubes over the cell layers [z0, z1) of the grid.
+ *
+ * The cut edges of the current layer are cached in three arrays: x and y edges
+ * of the bottom and top planes, z edges between them. The top plane becomes the
+ * bottom one of the next layer, so every vertex is computed once per slab.
+ * The plane z1 belongs to the next slab: its edges are stored as deferred
+ * indices (-2 - edge key) and resolved against the next slab's 'bottom' cache.
+ */
+class Polygonise_slab : public QRunnable {
+public:
+    Polygonise_slab(const std::vector<float>& field_,
+                    Vec3 world_start_, Vec3i res_, Vec3 steps_, float iso_lvl_,
+                    int z0_, int z1_) :
+        field(field_), world_start(world_start_), steps(steps_), iso_lvl(iso_lvl_),
+        npx(res_.x + 1), npy(res_.y + 1), nb_layers(res_.z), z0(z0_), z1(z1_)
+    {
+        setAutoDelete( false );
+    }
 
-    std::vector<Vec3> triangles( 16 );
+    std::vector<Vec3> verts;  ///< vertices created by the slab
+    std::vector<int>  tris;   ///< local indices or deferred ones
+    std::vector<int>  bottom; ///< local index of the cut x/y edges of plane z0
 
-    for(Idx3 idx(res, 0); idx.is_in(); ++idx)
+protected:
+    void run()
     {
-        Vec3 pos( idx.to_vec3i() );
-        Vec3 org = world_start + pos * steps;
+        const int plane = npx * npy;
+        std::vector<int> cur( plane * 2 ), next( plane * 2 ), zc( plane );
+
+        cut_plane(z0, cur, false);
+        bottom = cur;
+        for(int z = z0; z < z1; ++z)
+        {
+            cut_plane(z + 1, next, z + 1 == z1 && z1 < nb_layers);
+            cut_z_edges(z, zc);
+            for(int y = 0; y < npy - 1; ++y)
+                for(int x = 0; x < npx - 1; ++x)
+                    polygonise_cell(x, y, z, cur, next, zc);
+            cur.swap( next );
+        }
+    }
+
+private:
+    float val(int x, int y, int z) const { return field[x + npx * (y + npy * z)]; }
 
-        Cell cell;
-        cell.pos[0] = Vec3(org.x          , org.y          , org.z          );
-        cell.pos[1] = Vec3(org.x + steps.x, org.y          , org.z          );
-        cell.pos[2] = Vec3(org.x + steps.x, org.y          , org.z + steps.z);
-        cell.pos[3] = Vec3(org.x          , org.y          , org.z + steps.z);
-        cell.pos[4] = Vec3(org.x          , org.y + steps.y, org.z          );
-        cell.pos[5] = Vec3(org.x + steps.x, org.y + steps.y, org.z          );
-        cell.pos[6] = Vec3(org.x + steps.x, org.y + steps.y, org.z + steps.z);
-        cell.pos[7] = Vec3(org.x          , org.y + steps.y, org.z + steps.z);
+    Vec3 corner(int x, int y, int z) const {
+        return world_start + Vec3((float)x, (float)y, (float)z).mult( steps );
+    }
 
-        for (int i = 0; i < 8; ++i)
-            cell.val[i] = node->f( cell.pos[i] );
+    int edge_key(int x, int y, int axis) const { return (x + npx * y) * 2 + axis; }
 
-        int nb_vert = polygonise(cell, iso_lvl, &(triangles[0]));
+    int cut(int x0, int y0, int z0_, int x1, int y1, int z1_)
+    {
+        const float v0 = val(x0, y0, z0_);
+        const float v1 = val(x1, y1, z1_);
+        if( (v0 < iso_lvl) == (v1 < iso_lvl) )
+            return -1;
+        verts.push_back( vert_lerp(iso_lvl, corner(x0, y0, z0_), corner(x1, y1, z1_), v0, v1) );
+        return (int)verts.size() - 1;
+    }
+
+    /// x and y edges of the plane z
+    void cut_plane(int z, std::vector<int>& cache, bool deferred)
+    {
+        for(int y = 0; y < npy; ++y)
+            for(int x = 0; x < npx; ++x)
+            {
+                const int kx = edge_key(x, y, 0);
+                const int ky = edge_key(x, y, 1);
+                if( deferred ){
+                    cache[kx] = -2 - kx;
+                    cache[ky] = -2 - ky;
+                    continue;
+                }
+                cache[kx] = x < npx - 1 ? cut(x, y, z, x + 1, y, z) : -1;
+                cache[ky] = y < npy - 1 ? cut(x, y, z, x, y + 1, z) : -1;
+            }
+    }
+
+    /// z edges between the planes z and z+1
+    void cut_z_edges(int z, std::vector<int>& zc)
+    {
+        for(int y = 0; y < npy; ++y)
+            for(int x = 0; x < npx; ++x)
+                zc[x + npx * y] = cut(x, y, z, x, y, z + 1);
+    }
 
-        Vec3 g;
-        glBegin(GL_TRIANGLES);
-        for(int n = 0; n < (nb_vert/3); n++)
+    void polygonise_cell(int x, int y, int z,
+                         const std::vector<int>& cur,
+                         const std::vector<int>& next,
+                         const std::vector<int>& zc)
+    {
+        // Same corner numbering as Paul Bourke's tables
+        int cube_idx = 0;
+        if(val(x    , y    , z    ) < iso_lvl) cube_idx |= 1;
+        if(val(x + 1, y    , z    ) < iso_lvl) cube_idx |= 2;
+        if(val(x + 1, y    , z + 1) < iso_lvl) cube_idx |= 4;
+        if(val(x    , y    , z + 1) < iso_lvl) cube_idx |= 8;
+        if(val(x    , y + 1, z    ) < iso_lvl) cube_idx |= 16;
+        if(val(x + 1, y + 1, z    ) < iso_lvl) cube_idx |= 32;
+        if(val(x + 1, y + 1, z + 1) < iso_lvl) cube_idx |= 64;
+        if(val(x    , y + 1, z + 1) < iso_lvl) cube_idx |= 128;
+
+        // Cube is entirely in/out of the surface
+        if(g_edge_table[cube_idx] == 0) return;
+
+        int vert_list[12];
+        vert_list[ 0] = cur [edge_key(x    , y    , 0)];
+        vert_list[ 1] = zc  [(x + 1) + npx *  y     ];
+        vert_list[ 2] = next[edge_key(x    , y    , 0)];
+        vert_list[ 3] = zc  [ x      + npx *  y     ];
+        vert_list[ 4] = cur [edge_key(x    , y + 1, 0)];
+        vert_list[ 5] = zc  [(x + 1) + npx * (y + 1)];
+        vert_list[ 6] = next[edge_key(x    , y + 1, 0)];
+        vert_list[ 7] = zc  [ x      + npx * (y + 1)];
+        vert_list[ 8] = cur [edge_key(x    , y    , 1)];
+        vert_list[ 9] = cur [edge_key(x + 1, y    , 1)];
+        vert_list[10] = next[edge_key(x + 1, y    , 1)];
+        vert_list[11] = next[edge_key(x    , y    , 1)];
+
+        for( int i = 0; g_tri_table[cube_idx][i] != -1; ++i)
+            tris.push_back( vert_list[ g_tri_table[cube_idx][i] ] );
+    }
+
+    const std::vector<float>& field;
+    Vec3  world_start;
+    Vec3  steps;
+    float iso_lvl;
+    int   npx, npy;
+    int   nb_layers;
+    int   z0, z1;
+};
+
+// -----------------------------------------------------------------------------
+
+/// Copy a slab into the final mesh and turn its indices into global ones
+class Gather_slab : public QRunnable {
+public:
+    Gather_slab(const Polygonise_slab* slab_, const Polygonise_slab* next_,
+                int vert_offset_, int next_offset_, int tri_offset_, Iso_mesh& mesh_) :
+        slab(slab_), next(next_),
+        vert_offset(vert_offset_), next_offset(next_offset_), tri_offset(tri_offset_),
+        mesh(mesh_)
+    {
+        setAutoDelete( true );
+    }
+
+protected:
+    void run()
+    {
+        std::copy(slab->verts.begin(), slab->verts.end(), mesh.vertices.begin() + vert_offset);
+        for(unsigned i = 0; i < slab->tris.size(); ++i)
         {
-            g = node->gf( triangles[n * 3 + 0]  );
-            glNormal3f(g.x, g.y, g.z);
-            glVertex3f( triangles[n * 3 + 0].x, triangles[n * 3 + 0].y, triangles[n * 3 + 0].z );
+            const int idx = slab->tris[i];
+            mesh.tris[tri_offset + i] = idx >= 0 ?
+                        vert_offset + idx :
+                        next_offset + next->bottom[-2 - idx];
+        }
+    }
 
-            g = node->gf( triangles[n * 3 + 1]  );
-            glNormal3f(g.x, g.y, g.z);
-            glVertex3f( triangles[n * 3 + 1].x, triangles[n * 3 + 1].y, triangles[n * 3 + 1].z );
+    const Polygonise_slab* slab;
+    const Polygonise_slab* next;
+    int vert_offset, next_offset, tri_offset;
+    Iso_mesh& mesh;
+};
 
-            g = node->gf( triangles[n * 3 + 2]  );
-            glNormal3f(g.x, g.y, g.z);
-            glVertex3f( triangles[n * 3 + 2].x, triangles[n * 3 + 2].y, triangles[n * 3 + 2].z );
+// -----------------------------------------------------------------------------
+
+void polygonise_grid(const std::vector<float>& field,
+                     const Vec3 world_start,
+                     Vec3i res,
+                     Vec3 steps,
+                     float iso_lvl,
+                     Iso_mesh& mesh)
+{
+    mesh.clear();
+    if( res.x <= 0 || res.y <= 0 || res.z <= 0 ) return;
+
+    const int nb = nb_slabs( res.z );
+    // Own pool, see fill_grid()
+    QThreadPool pool;
+    std::vector<Polygonise_slab*> slabs( nb );
+    for(int s = 0; s < nb; ++s)
+    {
+        slabs[s] = new Polygonise_slab(field, world_start, res, steps, iso_lvl,
+                                       res.z * s / nb, res.z * (s + 1) / nb);
+        pool.start( slabs[s] );
+    }
+    pool.waitForDone();
+
+    std::vector<int> vert_offset( nb + 1, 0 ), tri_offset( nb + 1, 0 );
+    for(int s = 0; s < nb; ++s)
+    {
+        vert_offset[s + 1] = vert_offset[s] + (int)slabs[s]->verts.size();
+        tri_offset [s + 1] = tri_offset [s] + (int)slabs[s]->tris.size();
+    }
+    mesh.vertices.resize( vert_offset[nb] );
+    mesh.tris.resize( tri_offset[nb] );
+
+    for(int s = 0; s < nb; ++s)
+    {
+        const Polygonise_slab* next = s + 1 < nb ? slabs[s + 1] : 0;
+        pool.start( new Gather_slab(slabs[s], next,
+                                    vert_offset[s],
+                                    vert_offset[s + 1],
+                                    tri_offset[s],
+                                    mesh) );
+    }
+    pool.waitForDone();
+
+    for(int s = 0; s < nb; ++s)
+        delete slabs[s];
+}
+
+// -----------------------------------------------------------------------------
+
+/// Corner of the lower end and axis of the 12 cube edges
+static const int g_edge_origin[12][3] = {
+    {0,0,0}, {1,0,0}, {0,0,1}, {0,0,0}, {0,1,0}, {1,1,0},
+    {0,1,1}, {0,1,0}, {0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}
+};
+static const int g_edge_axis[12] = { 0, 2, 0, 2, 0, 2, 0, 2, 1, 1, 1, 1 };
+
+/**
+ * @class Polygonise_blocks
+ * @brief Marching cubes over the cells starting in a range of refined blocks
+ *
+ * Cut edges are cached per block, every vertex keeps the key of its grid edge
+ * (sample index * 3 + axis) so that the blocks can be welded afterwards.
+ */
+class Polygonise_blocks : public QRunnable {
+public:
+    Polygonise_blocks(const Sparse_grid& grid_, float iso_lvl_, int first_, int last_) :
+        grid(grid_), iso_lvl(iso_lvl_), first(first_), last(last_)
+    {
+        setAutoDelete( false );
+    }
+
+    std::vector<Vec3> verts;
+    std::vector<unsigned long long> keys; ///< grid edge of every vertex
+    std::vector<int>  tris;               ///< indices in verts
+
+protected:
+    void run()
+    {
+        const int B  = Sparse_grid::BLOCK;
+        const int nc = B + 1;
+        const Vec3i n = grid.nb_samples();
+        std::vector<int> cache( nc * nc * nc * 3 );
+
+        for(int i = first; i < last; ++i)
+        {
+            std::fill(cache.begin(), cache.end(), -1);
+            const Vec3i b = grid.active_block(i);
+            const int x0 = b.x * B, y0 = b.y * B, z0 = b.z * B;
+            const int x1 = std::min(x0 + B, n.x - 1);
+            const int y1 = std::min(y0 + B, n.y - 1);
+            const int z1 = std::min(z0 + B, n.z - 1);
+
+            for(int z = z0; z < z1; ++z)
+                for(int y = y0; y < y1; ++y)
+                    for(int x = x0; x < x1; ++x)
+                    {
+                        float val[8];
+                        val[0] = grid.value(x    , y    , z    );
+                        val[1] = grid.value(x + 1, y    , z    );
+                        val[2] = grid.value(x + 1, y    , z + 1);
+                        val[3] = grid.value(x    , y    , z + 1);
+                        val[4] = grid.value(x    , y + 1, z    );
+                        val[5] = grid.value(x + 1, y + 1, z    );
+                        val[6] = grid.value(x + 1, y + 1, z + 1);
+                        val[7] = grid.value(x    , y + 1, z + 1);
+
+                        int cube_idx = 0;
+                        for(int c = 0; c < 8; ++c)
+                            if(val[c] < iso_lvl) cube_idx |= 1 << c;
+                        if(g_edge_table[cube_idx] == 0) continue;
+
+                        for( int t = 0; g_tri_table[cube_idx][t] != -1; ++t)
+                        {
+                            const int e = g_tri_table[cube_idx][t];
+                            const int ex = x + g_edge_origin[e][0];
+                            const int ey = y + g_edge_origin[e][1];
+                            const int ez = z + g_edge_origin[e][2];
+                            const int axis = g_edge_axis[e];
+                            int& v = cache[((ex - x0) + nc * ((ey - y0) + nc * (ez - z0))) * 3 + axis];
+                            if( v < 0 ) v = add_vertex(ex, ey, ez, axis, n);
+                            tris.push_back( v );
+                        }
+                    }
+        }
+    }
+
+private:
+    int add_vertex(int x, int y, int z, int axis, const Vec3i& n)
+    {
+        const int x1 = x + (axis == 0), y1 = y + (axis == 1), z1 = z + (axis == 2);
+        verts.push_back( vert_lerp(iso_lvl,
+                                   grid.position(x , y , z ), grid.position(x1, y1, z1),
+                                   grid.value   (x , y , z ), grid.value   (x1, y1, z1)) );
+        keys.push_back( ((unsigned long long)x + (unsigned long long)n.x * (y + (unsigned long long)n.y * z)) * 3 + axis );
+        return (int)verts.size() - 1;
+    }
+
+    const Sparse_grid& grid;
+    float iso_lvl;
+    int   first, last;
+};
+
+// -----------------------------------------------------------------------------
+
+void polygonise_sparse_grid(const Sparse_grid& grid,
+                            float iso_lvl,
+                            Iso_mesh& mesh)
+{
+    mesh.clear();
+    const int nb_blocks = grid.nb_active_blocks();
+    if( nb_blocks == 0 ) return;
+
+    const int nb = std::min(nb_blocks, QThreadPool::globalInstance()->maxThreadCount() * 4);
+    // Own pool, see fill_grid()
+    QThreadPool pool;
+    std::vector<Polygonise_blocks*> tasks( nb );
+    for(int t = 0; t < nb; ++t)
+    {
+        tasks[t] = new Polygonise_blocks(grid, iso_lvl, nb_blocks * t / nb, nb_blocks * (t + 1) / nb);
+        pool.start( tasks[t] );
+    }
+    pool.waitForDone();
+
+    // Weld: one vertex per grid edge, ordered by edge key so the output does
+    // not depend on the scheduling
+    std::vector< std::pair<unsigned long long, int> > order;
+    std::vector<int> offset( nb + 1, 0 );
+    for(int t = 0; t < nb; ++t)
+    {
+        offset[t + 1] = offset[t] + (int)tasks[t]->verts.size();
+        for(unsigned v = 0; v < tasks[t]->keys.size(); ++v)
+            order.push_back( std::make_pair(tasks[t]->keys[v], offset[t] + (int)v) );
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<int> welded( offset[nb] );
+    for(unsigned i = 0; i < order.size(); ++i)
+    {
+        if( i == 0 || order[i].first != order[i - 1].first )
+        {
+            const int id = order[i].second;
+            int t = (int)(std::upper_bound(offset.begin(), offset.end(), id) - offset.begin()) - 1;
+            mesh.vertices.push_back( tasks[t]->verts[id - offset[t]] );
         }
-        glEnd();
+        welded[order[i].second] = (int)mesh.vertices.size() - 1;
+    }
 
+    for(int t = 0; t < nb; ++t)
+    {
+        for(unsigned i = 0; i < tasks[t]->tris.size(); ++i)
+            mesh.tris.push_back( welded[offset[t] + tasks[t]->tris[i]] );
+        delete tasks[t];
     }
 }
 
+// -----------------------------------------------------------------------------
+
+void polygonise_scalar_field(const Node_implicit_surface* node,
+                             const Vec3 world_start,
+                             Vec3i res,
+                             Vec3 steps,
+                             float iso_lvl,
+                             Iso_mesh& mesh,
+                             bool compute_normals,
+                             bool dense)
+{
+    if( dense )
+    {
+        std::vector<float> field;
+        fill_grid(node, world_start, res, steps, field);
+        polygonise_grid(field, world_start, res, steps, iso_lvl, mesh);
+    }
+    else
+    {
+        Sparse_grid grid;
+        grid.fill(node, world_start, Vec3i(res.x + 1, res.y + 1, res.z + 1), steps, iso_lvl);
+        polygonise_sparse_grid(grid, iso_lvl, mesh);
+    }
+
+    if( !compute_normals ) return;
+    const int nb_verts = (int)mesh.vertices.size();
+    mesh.normals.resize( nb_verts );
+    #pragma omp parallel for schedule(dynamic, 256)
+    for(int i = 0; i < nb_verts; ++i)
+        mesh.normals[i] = node->gf( mesh.vertices[i] );
+}
+
+// -----------------------------------------------------------------------------
+
+/// Software marching cubes polygonization
+/// The mesh is built on CPU then drawn with vertex arrays
+void direct_mode_render_marching_cubes(const Node_implicit_surface* node,
+                                       const Vec3 world_start,
+                                       Vec3i res,
+                                       Vec3 steps,
+                                       float iso_lvl)
+{
+    Iso_mesh mesh;
+    polygonise_scalar_field(node, world_start, res, steps, iso_lvl, mesh);
+    if( mesh.tris.empty() ) return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, &(mesh.vertices[0]));
+    glNormalPointer(GL_FLOAT, 0, &(mesh.normals[0]));
+    glDrawElements(GL_TRIANGLES, (GLsizei)mesh.tris.size(), GL_UNSIGNED_INT, &(mesh.tris[0]));
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
 }// END MARCHING_CUBE ==========================================================
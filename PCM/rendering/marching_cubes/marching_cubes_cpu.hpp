@@ -4,6 +4,8 @@
 #include "scene_tree/implicit_surfaces/node_implicit_surface.hpp"
 #include "toolbox/maths/vec3.hpp"
 #include "toolbox/maths/vec3i.hpp"
+#include "rendering/marching_cubes/sparse_grid.hpp"
+#include <vector>
 
 // =============================================================================
 namespace Marching_cubes {
@@ -15,9 +17,61 @@ public:
     Vec3 pos[8]; ///< cube positions
 };
 
-/// Software marching cubes polygonization
-/// Slow as hell because we use gl direct mode in addition of
-/// the CPU calculation...
+/// Indexed triangle mesh from the CPU marching cubes. The vertex on a grid
+/// edge is shared by the (up to four) cells around that edge.
+struct Iso_mesh{
+    std::vector<Vec3> vertices;
+    std::vector<Vec3> normals;   ///< field gradient at each vertex (may be empty)
+    std::vector<int>  tris;      ///< three vertex indices per triangle
+
+    void clear(){ vertices.clear(); normals.clear(); tris.clear(); }
+    int nb_tris() const { return (int)tris.size() / 3; }
+};
+
+/// Evaluate 'node' once at every corner of the res.x * res.y * res.z cells
+/// starting at 'world_start' (corner (i,j,k) lies at world_start + (i,j,k) * steps).
+/// Slabs of the grid are filled by Fill_grid_thread on a local QThreadPool.
+/// @param field : (res.x+1) * (res.y+1) * (res.z+1) values, x varies first
+void fill_grid(const Node_implicit_surface* node,
+               const Vec3 world_start,
+               Vec3i res,
+               Vec3 steps,
+               std::vector<float>& field);
+
+/// Polygonise a grid filled by fill_grid(). Slabs of cells are processed in
+/// parallel, each one caches the vertices of the edges it already cut, the
+/// vertices of the planes between two slabs are welded at the end.
+/// No OpenGL call, mesh.normals is left empty.
+void polygonise_grid(const std::vector<float>& field,
+                     const Vec3 world_start,
+                     Vec3i res,
+                     Vec3 steps,
+                     float iso_lvl,
+                     Iso_mesh& mesh);
+
+/// Polygonise the refined blocks of a sparse grid (the others hold no surface).
+/// Blocks are spread over the threads, the vertices shared by two blocks are
+/// welded by grid edge at the end. mesh.normals is left empty.
+void polygonise_sparse_grid(const Sparse_grid& grid,
+                            float iso_lvl,
+                            Iso_mesh& mesh);
+
+/// Sparse_grid::fill() + polygonise_sparse_grid(), then the normals are set to
+/// node->gf() at every vertex (once per welded vertex). Only the blocks near
+/// the surface are evaluated. Can run without a GL context.
+/// @param dense : fill_grid() + polygonise_grid() instead, every sample is
+/// evaluated so no feature thinner than a Sparse_grid block can be missed
+void polygonise_scalar_field(const Node_implicit_surface* node,
+                             const Vec3 world_start,
+                             Vec3i res,
+                             Vec3 steps,
+                             float iso_lvl,
+                             Iso_mesh& mesh,
+                             bool compute_normals = true,
+                             bool dense = false);
+
+/// Software marching cubes polygonization drawn with vertex arrays
+/// (polygonise_scalar_field() then glDrawElements())
 void direct_mode_render_marching_cubes(const Node_implicit_surface* node,
                                        const Vec3 world_start,
                                        Vec3i res,
@@ -0,0 +1,160 @@
+#include "rendering/marching_cubes/sparse_grid.hpp"
+
+#include "rendering/marching_cubes/fill_grid_thread.hpp"
+#include "toolbox/maths/bbox3.hpp"
+
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+
+// =============================================================================
+namespace Marching_cubes {
+// =============================================================================
+
+Sparse_grid::Sparse_grid() :
+    _nb_samples(0),
+    _nb_blocks(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+
+void Sparse_grid::fill(const Node_implicit_surface* node,
+                       const Vec3& origin,
+                       const Vec3i& nb_samples,
+                       const Vec3& step,
+                       float iso_lvl)
+{
+    _origin     = origin;
+    _step       = step;
+    _nb_samples = nb_samples;
+    _nb_blocks  = Vec3i((nb_samples.x + BLOCK - 1) / BLOCK,
+                        (nb_samples.y + BLOCK - 1) / BLOCK,
+                        (nb_samples.z + BLOCK - 1) / BLOCK);
+    _blocks.clear();
+    _active.clear();
+
+    classify_blocks(node, iso_lvl);
+
+    // Own pool: waitForDone() on the global one would also wait on unrelated
+    // tasks, and never return when called from one of its threads
+    QThreadPool pool;
+    _blocks.resize( _active.size() );
+    for(unsigned i = 0; i < _active.size(); ++i)
+    {
+        const Vec3i b = _active[i];
+        const Vec3i first(b.x * BLOCK, b.y * BLOCK, b.z * BLOCK);
+        const Vec3i sub_res(std::min(BLOCK, _nb_samples.x - first.x),
+                            std::min(BLOCK, _nb_samples.y - first.y),
+                            std::min(BLOCK, _nb_samples.z - first.z));
+        _blocks[i].resize( BLOCK * BLOCK * BLOCK, _coarse[block_idx(b.x, b.y, b.z)] );
+
+        // Fill_grid_thread samples the center of its cells
+        Fill_grid_thread* thread = new Fill_grid_thread(sub_res,
+                                                        Vec3i(0),
+                                                        Vec3i(BLOCK),
+                                                        position(first.x, first.y, first.z) - _step * 0.5f,
+                                                        _step,
+                                                        _blocks[i],
+                                                        node);
+        thread->setAutoDelete( true );
+        pool.start( thread );
+    }
+    pool.waitForDone();
+}
+
+// -----------------------------------------------------------------------------
+
+void Sparse_grid::classify_blocks(const Node_implicit_surface* node, float iso_lvl)
+{
+    const Vec3i nb = _nb_blocks;
+    const Vec3i nc(nb.x + 1, nb.y + 1, nb.z + 1);
+    const int nb_corners = nc.product();
+    std::vector<float> val( nb_corners );
+    std::vector<float> grad( nb_corners );
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for(int i = 0; i < nb_corners; ++i)
+    {
+        const int x = i % nc.x, y = (i / nc.x) % nc.y, z = i / (nc.x * nc.y);
+        const Vec3 p = position(x * BLOCK, y * BLOCK, z * BLOCK);
+        val [i] = node->f( p );
+        grad[i] = node->gf( p ).norm();
+    }
+
+    const Bbox3 bbox = node->get_bbox();
+    const Vec3  block_len = _step * (float)BLOCK;
+    const float half_diag = 0.5f * block_len.norm();
+
+    const int nb_blocks = nb.product();
+    std::vector<char> near_surface( nb_blocks, 0 );
+    _coarse.assign( nb_blocks, 0.f );
+    #pragma omp parallel for
+    for(int b = 0; b < nb_blocks; ++b)
+    {
+        const int bx = b % nb.x, by = (b / nb.x) % nb.y, bz = b / (nb.x * nb.y);
+        float mean = 0.f, max_grad = 0.f, min_dist = 1e30f;
+        int   nb_in = 0;
+        for(int c = 0; c < 8; ++c)
+        {
+            const int i = (bx + (c & 1)) + nc.x * ((by + (c >> 1 & 1)) + nc.y * (bz + (c >> 2 & 1)));
+            mean    += val[i];
+            max_grad = std::max(max_grad, grad[i]);
+            min_dist = std::min(min_dist, std::abs(val[i] - iso_lvl));
+            nb_in   += val[i] < iso_lvl;
+        }
+        _coarse[b] = mean / 8.f;
+
+        const Vec3 pmin = position(bx * BLOCK, by * BLOCK, bz * BLOCK);
+        const Vec3 pmax = pmin + block_len;
+        const bool in_bbox = pmax.x >= bbox.pmin.x - _step.x && pmin.x <= bbox.pmax.x + _step.x &&
+                             pmax.y >= bbox.pmin.y - _step.y && pmin.y <= bbox.pmax.y + _step.y &&
+                             pmax.z >= bbox.pmin.z - _step.z && pmin.z <= bbox.pmax.z + _step.z;
+        near_surface[b] = in_bbox &&
+                ((nb_in > 0 && nb_in < 8) || min_dist <= 2.f * max_grad * half_diag);
+    }
+
+    // Refine the blocks near the surface and their neighbours
+    _block_map.assign( nb_blocks, -1 );
+    for(int bz = 0; bz < nb.z; ++bz)
+        for(int by = 0; by < nb.y; ++by)
+            for(int bx = 0; bx < nb.x; ++bx)
+            {
+                bool refine = false;
+                for(int dz = -1; dz <= 1 && !refine; ++dz)
+                    for(int dy = -1; dy <= 1 && !refine; ++dy)
+                        for(int dx = -1; dx <= 1 && !refine; ++dx)
+                        {
+                            const int x = bx + dx, y = by + dy, z = bz + dz;
+                            if( x < 0 || y < 0 || z < 0 || x >= nb.x || y >= nb.y || z >= nb.z )
+                                continue;
+                            refine = near_surface[block_idx(x, y, z)] != 0;
+                        }
+                if( !refine ) continue;
+                _block_map[block_idx(bx, by, bz)] = (int)_active.size();
+                _active.push_back( Vec3i(bx, by, bz) );
+            }
+}
+
+// -----------------------------------------------------------------------------
+
+void Sparse_grid::to_dense(std::vector<float>& field) const
+{
+    const Vec3i n = _nb_samples;
+    field.resize( n.product() );
+    #pragma omp parallel for
+    for(int z = 0; z < n.z; ++z)
+        for(int y = 0; y < n.y; ++y)
+            for(int x = 0; x < n.x; ++x)
+                field[x + n.x * (y + n.y * z)] = value(x, y, z);
+}
+
+// -----------------------------------------------------------------------------
+
+size_t Sparse_grid::memory_size() const
+{
+    return _blocks.size() * BLOCK * BLOCK * BLOCK * sizeof(float) +
+           _block_map.size() * (sizeof(int) + sizeof(float));
+}
+
+}// END MARCHING_CUBE ==========================================================
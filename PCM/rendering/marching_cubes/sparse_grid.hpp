@@ -0,0 +1,93 @@
+#ifndef SPARSE_GRID_HPP__
+#define SPARSE_GRID_HPP__
+
+#include "scene_tree/implicit_surfaces/node_implicit_surface.hpp"
+#include "toolbox/maths/vec3.hpp"
+#include "toolbox/maths/vec3i.hpp"
+#include <vector>
+
+// =============================================================================
+namespace Marching_cubes {
+// =============================================================================
+
+/**
+ * @class Sparse_grid
+ * @brief Scalar field sampled on a regular grid, stored only near the iso-surface
+ *
+ * The grid is cut into blocks of BLOCK^3 samples. fill() first evaluates the
+ * field and its gradient at the corners of the blocks. A block is refined
+ * (every sample evaluated) when its corners straddle the iso-level, or when the
+ * nearest corner value is closer to the iso-level than the field can vary inside
+ * the block (2 * max |gf| of the corners * half the block diagonal). Blocks
+ * outside the node's bounding box are never refined. The refined set is dilated
+ * by one block to catch features thinner than the coarse estimate.
+ *
+ * Refined blocks are filled with Fill_grid_thread on a local QThreadPool and
+ * stored in a sparse block map; the other blocks only keep the mean of their
+ * corners, which is on the right side of the iso-level.
+ * Memory and fill time follow the surface area instead of the volume.
+ */
+class Sparse_grid {
+public:
+    /// Samples per block side
+    static const int BLOCK = 8;
+
+    Sparse_grid();
+
+    /// Sample 'node' at origin + (i, j, k) * step for 0 <= (i, j, k) < nb_samples
+    void fill(const Node_implicit_surface* node,
+              const Vec3& origin,
+              const Vec3i& nb_samples,
+              const Vec3& step,
+              float iso_lvl);
+
+    /// Field value at sample (x, y, z), the coarse value outside refined blocks
+    float value(int x, int y, int z) const
+    {
+        const int b = block_idx(x / BLOCK, y / BLOCK, z / BLOCK);
+        const int slot = _block_map[b];
+        if( slot < 0 ) return _coarse[b];
+        const int lx = x % BLOCK, ly = y % BLOCK, lz = z % BLOCK;
+        return _blocks[slot][lx + BLOCK * (ly + BLOCK * lz)];
+    }
+
+    Vec3 position(int x, int y, int z) const {
+        return _origin + Vec3((float)x, (float)y, (float)z).mult( _step );
+    }
+
+    /// Write every sample in a dense grid (x varies first)
+    void to_dense(std::vector<float>& field) const;
+
+    int   nb_active_blocks() const { return (int)_active.size(); }
+    /// Block coordinates of the i-th refined block
+    Vec3i active_block(int i) const { return _active[i]; }
+    bool  is_active_block(int bx, int by, int bz) const { return _block_map[block_idx(bx, by, bz)] >= 0; }
+
+    const Vec3i& nb_samples() const { return _nb_samples; }
+    const Vec3i& nb_blocks()  const { return _nb_blocks;  }
+
+    /// Bytes used by the samples and the block map
+    size_t memory_size() const;
+
+private:
+    int block_idx(int bx, int by, int bz) const {
+        return bx + _nb_blocks.x * (by + _nb_blocks.y * bz);
+    }
+
+    /// Coarse pass: select the blocks to refine and set their coarse value
+    void classify_blocks(const Node_implicit_surface* node, float iso_lvl);
+
+    Vec3  _origin;
+    Vec3  _step;
+    Vec3i _nb_samples;
+    Vec3i _nb_blocks;
+
+    std::vector<int>   _block_map;  ///< per block: slot in _blocks or -1
+    std::vector<float> _coarse;     ///< per block: mean of its corner values
+    std::vector< std::vector<float> > _blocks; ///< BLOCK^3 samples per refined block
+    std::vector<Vec3i> _active;     ///< coordinates of the refined blocks
+};
+
+}// END MARCHING_CUBE ==========================================================
+
+#endif // SPARSE_GRID_HPP__
@@ -14,11 +14,47 @@
 #include "MeshOpenGL.h"
 #include "KdTreeForRaycast.h"
 #include "scene.h"
+#include <QThread>
+#include <QMutexLocker>
 extern bool isShowKdtree;
 using namespace pcm;
+
+// Builds a PointIndex on a snapshot of the positions, off the calling thread
+class PointIndexBuilder :public QThread
+{
+public:
+	PointIndexBuilder(const VertexStore::Matrix3XMap& points, unsigned generation)
+		:points_(points), result_(NULL), generation_(generation){}
+	~PointIndexBuilder()
+	{
+		wait();
+		delete result_;
+	}
+	PointIndex* take_result()
+	{
+		PointIndex* result = result_;
+		result_ = NULL;
+		return result;
+	}
+	// vertex generation of the snapshot
+	unsigned generation() const { return generation_; }
+protected:
+	void run()
+	{
+		result_ = new PointIndex(points_);
+		points_.resize(0, 0);
+	}
+private:
+	Matrix3X	points_;
+	PointIndex*	result_;
+	unsigned	generation_;
+};
+
 Sample::Sample() :vertices_(),allocator_(),kd_tree_(nullptr),
 	kd_tree_should_rebuild_(true),
-	kd_tree_raycast_(NULL),
+	kd_tree_builder_(NULL),
+	vertex_generation_(0), kd_tree_generation_(0),
+	kd_tree_raycast_(NULL),kd_tree_raycast_should_rebuild_(true),
 	mutex_(QMutex::NonRecursive),clayerDepth_(0)
 {
 	file_type = FileIO::NONE;
@@ -46,13 +82,22 @@ void Sample::clear()
 {
 	isload_ = false;
 	vertices_.clear();
+	vertex_store_.clear();
+	++vertex_generation_;
 	triangle_array.clear();
 	allocator_.free_all(); 
+	if (kd_tree_builder_)
+		delete kd_tree_builder_;
+	kd_tree_builder_ = NULL;
+	free_retired_kdtrees();
 	if(kd_tree_)
 		delete	kd_tree_;
 	kd_tree_ = NULL;
+	kd_tree_raycast_should_rebuild_ = true;
 	lb_wrapbox_.clear();
 	wrap_box_link_.clear();
+	curvatures_.clear();
+	planarities_.clear();
 	if (scene_)
 		scene_->clear();
 	
@@ -61,27 +106,28 @@ Vertex* Sample::add_vertex(const PointType& pos = NULL_POINT,
 						const NormalType& n = NULL_NORMAL, 
 						const ColorType& c = NULL_COLOR)
 {
-	int vtx_idx = this->num_vertices();
+	IndexType slot = vertex_store_.push_back(pos, n, c);
 	Vertex*	new_space = allocator_.allocate<Vertex>();
-	Vertex* new_vtx = new(new_space)Vertex(vtx_idx);
+	Vertex* new_vtx = new(new_space)Vertex(&vertex_store_, slot);
 	if ( !new_vtx )
 	{
 		return nullptr;
 	}
-	int a = sizeof(Vertex);
-	int b = sizeof(SelectableItem);
-	new_vtx->set_position(pos);
-	new_vtx->set_normal(n);
-	new_vtx->set_color(c);
-	new_vtx->set_idx(vertices_.size());
 	vertices_.push_back(new_vtx);
 
 	box_.expand( pos );
 	kd_tree_should_rebuild_ = true;
+	++vertex_generation_;
 
 	return new_vtx;
 }
 
+void Sample::reserve(size_t n)
+{
+	vertices_.reserve(n);
+	vertex_store_.reserve(n);
+}
+
 TriangleType* Sample::add_triangle(const TriangleType& tt)
 {
 	TriangleType*	new_triangle_space = allocator_.allocate<TriangleType>();
@@ -393,7 +439,7 @@ void Sample::draw( RenderMode::WhichColorMode& wcm ,RenderMode::RenderType& r,co
 				update_openglMeshColor();
 			opengl_mesh_->draw(wcm, r);
 			if (isShowKdtree)
-				kd_tree_raycast_->drawKdTree();
+				raycast_tree()->drawKdTree();
 		}
 
 	}
@@ -544,55 +590,17 @@ void Sample::draw_with_name()
 	}
 
 }
-void Sample::caculateNorm(NormalType& baseline  )
+void Sample::caculateNorm(NormalType& baseline, NormalEstimator::Orientation orient)
 {
+	curvatures_.clear();
+	planarities_.clear();
 	if (!this->num_triangles())  //only have points
 	{
-		const IndexType k = 36;
-		for (IndexType i = 0; i < this->num_vertices(); i++)
-		{
-
-			MatrixX3	k_nearest_verts(k, 3);
-			IndexType		neighbours[k];
-			ScalarType dist[k];
-			this->neighbours(i, k, neighbours, dist);
-			for (IndexType j = 0; j<k; j++)
-			{
-				IndexType neighbour_idx = neighbours[j];
-
-				k_nearest_verts.row(j) << (*this)[neighbour_idx].x(), (*this)[neighbour_idx].y(), (*this)[neighbour_idx].z();
-			}
-
-			MatrixX3 vert_mean = k_nearest_verts.colwise().mean();
-			MatrixX3 Q(k, 3);
-			for (IndexType j = 0; j<k; j++)
-			{
-				Q.row(j) = k_nearest_verts.row(j) - vert_mean;
-			}
-
-			Matrix33 sigma = Q.transpose() * Q;
-
-			Eigen::EigenSolver<Matrix33> eigen_solver(sigma, Eigen::ComputeFullU | Eigen::ComputeFullV);
-
-			auto ev = eigen_solver.eigenvectors();
-			auto eval = eigen_solver.eigenvalues();
-			ScalarType tmp[3] = { eval(0).real(),eval(1).real(),eval(2).real() };
-			IndexType min_idx = std::min_element(tmp, tmp + 3) - tmp;
-			NormalType nv;
-			nv(0) = (ev.col(min_idx))(0).real();
-			nv(1) = (ev.col(min_idx))(1).real();
-			nv(2) = (ev.col(min_idx))(2).real();
-
-			nv.normalize();
-			if ((baseline).dot(nv) < 0)
-			{
-				nv = -nv;
-			}
-
-			(*this)[i].set_normal(nv);
-
-		}
-
+		NormalEstimator estimator(*this);
+		estimator.compute(baseline, orient);
+		estimator.apply();
+		curvatures_ = estimator.curvatures();
+		planarities_ = estimator.planarities();
 	}
 	else
 	{ //has face
@@ -675,36 +683,118 @@ void Sample::caculateTangent()
 
 void Sample::build_kdtree()
 {
+	// safe point: no query can still be running on a replaced index
+	install_kdtree(false);
+	free_retired_kdtrees();
 	if( !kd_tree_should_rebuild_  || vertices_.size() == 0 )
 	{
 		return;
 	}
 
+	kd_tree_should_rebuild_ = false;
+	kd_tree_raycast_should_rebuild_ = true;
 
-	if (kd_tree_)
+	if (!kd_tree_)
 	{
-		delete kd_tree_;
+		kd_tree_ = new PointIndex(vertex_store_.positions_matrix());
+		kd_tree_generation_ = vertex_generation_;
+		return;
 	}
-	if (kd_tree_raycast_)
-		delete kd_tree_raycast_;
+	// a rebuild still running describes an older vertex set
+	install_kdtree(true);
+	QMutexLocker locker(&kd_tree_mutex_);
+	kd_tree_builder_ = new PointIndexBuilder(vertex_store_.positions_matrix(), vertex_generation_);
+	kd_tree_builder_->start();
+}
 
-	size_t n_vtx = vertices_.size();
-	vtx_matrix_ = Matrix3X( 3, n_vtx );
+void Sample::refit_kdtree()
+{
+	if (kd_tree_should_rebuild_)
+	{
+		build_kdtree();
+		return;
+	}
+	++vertex_generation_;
+	int n_vtx = vertex_store_.size();
+	box_ = Box();
+	for (int v_idx = 0; v_idx < n_vtx; v_idx++)
+	{
+		const ScalarType* p = vertex_store_.position(v_idx);
+		box_.expand(PointType(p[0], p[1], p[2]));
+	}
+	refit_index();
+}
 
-	//reconstruct vtx_matrix
-	for ( IndexType v_idx = 0; v_idx < n_vtx; v_idx++ )
+// the store holds the moved positions of the same vertices
+void Sample::refit_index()
+{
+	install_kdtree(true);
+	free_retired_kdtrees();
+	if (!kd_tree_ || kd_tree_->points.cols() != (IndexType)vertex_store_.size())
 	{
-		Vertex*	pv = vertices_[v_idx];
-		vtx_matrix_.col(v_idx) << pv->x() , pv->y() , pv->z();
+		kd_tree_should_rebuild_ = true;
+		build_kdtree();
+		return;
 	}
+	kd_tree_->points = vertex_store_.positions_matrix();
+	kd_tree_->tree.refit();
+	kd_tree_generation_ = vertex_generation_;
+	if (kd_tree_raycast_ && !kd_tree_raycast_should_rebuild_)
+		kd_tree_raycast_->refit();
+}
 
-	kd_tree_ = new nanoflann::KDTreeAdaptor<Matrix3X, 3>(vtx_matrix_);
-	kd_tree_raycast_ = new KDTree(*this);
-	kd_tree_raycast_->build();
+// Swap in the index built in background. The replaced one may still be read by queries
+// running in other threads, it is only freed at the next build_kdtree()/update()
+void Sample::install_kdtree(bool wait)
+{
+	QMutexLocker locker(&kd_tree_mutex_);
+	install_kdtree_locked(wait);
+}
 
-	kd_tree_should_rebuild_ = false;
+// kd_tree_mutex_ held
+void Sample::install_kdtree_locked(bool wait)
+{
+	if (!kd_tree_builder_ || (!wait && !kd_tree_builder_->isFinished()))
+		return;
+	kd_tree_builder_->wait();
+	if (kd_tree_)
+		retired_kd_trees_.push_back(kd_tree_);
+	kd_tree_ = kd_tree_builder_->take_result();
+	kd_tree_generation_ = kd_tree_builder_->generation();
+	delete kd_tree_builder_;
+	kd_tree_builder_ = NULL;
+}
 
+void Sample::free_retired_kdtrees()
+{
+	for (size_t i = 0; i < retired_kd_trees_.size(); i++)
+		delete retired_kd_trees_[i];
+	retired_kd_trees_.clear();
+}
 
+// Index matching the current vertices, NULL if there is none. Called by queries
+// from several threads: an index built on an older generation is never returned
+PointIndex* Sample::current_kdtree()
+{
+	QMutexLocker locker(&kd_tree_mutex_);
+	if (kd_tree_builder_ && (!kd_tree_ || kd_tree_generation_ != vertex_generation_))
+		install_kdtree_locked(true);
+	if (!kd_tree_ || kd_tree_generation_ != vertex_generation_)
+		return NULL;
+	return kd_tree_;
+}
+
+KDTree* Sample::raycast_tree()
+{
+	if (kd_tree_raycast_should_rebuild_ || !kd_tree_raycast_)
+	{
+		if (kd_tree_raycast_)
+			delete kd_tree_raycast_;
+		kd_tree_raycast_ = new KDTree(*this);
+		kd_tree_raycast_->build();
+		kd_tree_raycast_should_rebuild_ = false;
+	}
+	return kd_tree_raycast_;
 }
 
 IndexType Sample::closest_vtx( const PointType& query_point ) 
@@ -798,16 +888,15 @@ Matrix44 Sample::inverse_matrix_to_scene_coord()
 
 bool Sample::neighbours(const IndexType query_point_idx, const IndexType num_closet, IndexType* out_indices)
 {
-	if (kd_tree_should_rebuild_)
+	PointIndex* index = current_kdtree();
+	if (!index)
 	{
 		return false;
 	}
 
 	ScalarType* out_distances = new ScalarType[num_closet];
-	ScalarType	qp[3] = {vertices_[query_point_idx]->x(), 
-						vertices_[query_point_idx]->y(), 
-						vertices_[query_point_idx]->z() };
-	kd_tree_->query( qp, num_closet, out_indices, out_distances);
+	const ScalarType* qp = vertex_store_.position(query_point_idx);
+	index->tree.query( qp, num_closet, out_indices, out_distances);
 
 	delete out_distances;
 
@@ -817,15 +906,14 @@ bool Sample::neighbours(const IndexType query_point_idx, const IndexType num_clo
 bool Sample::neighbours(const IndexType query_point_idx, const IndexType num_closet,
 						IndexType* out_indices,ScalarType* out_distances)
 {
-	if (kd_tree_should_rebuild_)
+	PointIndex* index = current_kdtree();
+	if (!index)
 	{
 		return false;
 	}
 
-	ScalarType	qp[3] = {vertices_[query_point_idx]->x(), 
-		vertices_[query_point_idx]->y(), 
-		vertices_[query_point_idx]->z() };
-	kd_tree_->query( qp, num_closet, out_indices, out_distances);
+	const ScalarType* qp = vertex_store_.position(query_point_idx);
+	index->tree.query( qp, num_closet, out_indices, out_distances);
 
 	return true;
 }
@@ -836,20 +924,8 @@ void Sample::update()
 	{
 		return;
 	}
-	assert( vtx_matrix_.cols() == vertices_.size() );
-	IndexType v_idx = 0;
-	box_ = Box();
-	for ( vtx_iterator v_iter = begin();
-			v_iter != end(); v_iter++,v_idx++ )
-	{
-		PointType p( vtx_matrix_(0, v_idx),
-					vtx_matrix_(1, v_idx),
-					vtx_matrix_(2, v_idx));
-		(*v_iter)->set_position( p );
-		box_.expand( p );
-	}
-	kd_tree_should_rebuild_ = true;
-	build_kdtree();
+	// vertices_matrix() is the position array itself, nothing to copy back
+	refit_kdtree();
 	update_openglMesh();
 }
 
@@ -861,28 +937,28 @@ void Sample::delete_vertex_group(const std::vector<IndexType>& idx_grp )
 	{
 		return;
 	}
-	for ( std::vector<Vertex*>::iterator iter = vertices_.begin();
-		iter != vertices_.end(); i++)
+	vertex_store_.erase(idx_grp);
+	IndexType n_vtx = vertices_.size();
+	IndexType dst = 0;
+	for ( ; i < n_vtx; i++)
 	{
-		if ( i == idx_grp[j] )
+		if ( j < size && i == idx_grp[j] )
 		{
 			//This is the node to delete
 			//we do not explicitly delete the memory,because we use poolallocator to manage it
-			iter = vertices_.erase( iter );
 			j++;
-			if ( j>=size )
-			{
-				break;
-			}
-		}
-		else
-		{
-			iter++;
+			continue;
 		}
+		// the remaining views follow their data, get_idx() keeps the old index
+		vertices_[dst] = vertices_[i];
+		vertices_[dst]->set_slot(dst);
+		dst++;
 	}
+	vertices_.resize(dst);
 
 	//kdtree dirty
 	kd_tree_should_rebuild_ = true;
+	++vertex_generation_;
 	build_kdtree();
 	update_openglMesh();
 }
@@ -1024,7 +1100,7 @@ bool Sample::castray(Ray& world_ray, HitResult& result)
 	worldRaytoLocal(world_ray, locaray);
 	float t;
 	float min;
-	if (kd_tree_raycast_->hit(locaray, t, min, result))
+	if (raycast_tree()->hit(locaray, t, min, result))
 	{
 
 
@@ -1033,13 +1109,20 @@ bool Sample::castray(Ray& world_ray, HitResult& result)
 	return false;
 
 }
+void Sample::castrays(const std::vector<Ray>& world_rays, std::vector<HitResult>& results, std::vector<char>& hits)
+{
+	std::vector<Ray> local_rays(world_rays.size());
+	for (size_t i = 0; i < world_rays.size(); i++)
+		worldRaytoLocal(world_rays[i], local_rays[i]);
+	raycast_tree()->hit_batch(local_rays, results, hits);
+}
 void Sample::clearKdTreeRayBuffer()
 {
-	kd_tree_raycast_->clearHitray();
+	raycast_tree()->clearHitray();
 }
 void Sample::updateHitrayBuffer()
 {
-	kd_tree_raycast_->updateHitrayBuffer();
+	raycast_tree()->updateHitrayBuffer();
 }
 
 
@@ -10,6 +10,7 @@
 #include "basic_types.h"
 #include "rendering/render_types.h"
 #include "file_io.h"
+#include "normal_estimator.h"
 #include <QMutex>
 #include <set>
 #include <vertex.h>
@@ -18,6 +19,7 @@ class TriangleType;
 class LinkNode;
 class KDTree;
 class HitResult;
+class PointIndexBuilder;
 namespace MyOpengl
 {
 	class MeshOpengl;
@@ -27,6 +29,17 @@ namespace pcm
 	class Scene;
 }
 
+/*
+	Point kd-tree of a sample with its own copy of the positions, so a new one can be
+	built in a thread while the current one keeps answering queries.
+*/
+struct PointIndex
+{
+	template<class Derived>
+	PointIndex(const Eigen::MatrixBase<Derived>& _points) :points(_points), tree(points){}
+	Matrix3X								points;
+	nanoflann::KDTreeAdaptor<Matrix3X, 3>	tree;
+};
 
 class Sample:public SelectableItem
 {
@@ -46,6 +59,8 @@ public:
 	}
 	Vertex* add_vertex( const pcm::PointType& pos,const pcm::NormalType& n,
 		const pcm::ColorType& c);
+	/* Preallocate 'n' vertices before a series of add_vertex() */
+	void reserve(size_t n);
 	TriangleType* add_triangle(const TriangleType& tt);
 	pcm::Scene*  load_scene(std::string path);
 
@@ -82,7 +97,12 @@ public:
 	//}
 	
 	void draw_with_name();
-	void caculateNorm(pcm::NormalType& baseline = NULL_NORMAL);
+	/* Point only samples: PCA normals over the 36 nearest neighbours, see NormalEstimator */
+	void caculateNorm(pcm::NormalType& baseline = NULL_NORMAL,
+		NormalEstimator::Orientation orient = NormalEstimator::ORIENT_BASELINE);
+	/* by-products of the last caculateNorm() of a point only sample, empty otherwise */
+	const std::vector<ScalarType>& curvatures() const { return curvatures_; }
+	const std::vector<ScalarType>& planarities() const { return planarities_; }
 	void caculateTangent();
 	size_t num_vertices() const { return vertices_.size(); }
 	size_t num_triangles() const { return triangle_array.size(); }
@@ -92,8 +112,16 @@ public:
 	inline vtx_iterator begin(){ return vertices_.begin(); }
 	inline vtx_iterator end(){ return vertices_.end(); }
 
-	//Every time vertex change, the kdtree should rebuild
+	/*
+		Every time the vertex set changes (add/delete) the kdtree should rebuild.
+		The first index is built right away, later ones in a background thread. Each
+		index records the vertex generation it was built or refitted on, queries wait
+		for the rebuild when it is older than the vertices. The raycast tree is rebuilt
+		on the next cast.
+	*/
 	void	build_kdtree();
+	/* Vertices moved through Vertex::set_position(): refit both trees instead of rebuilding */
+	void	refit_kdtree();
 
 	IndexType closest_vtx( const pcm::PointType& query_point );
 	bool		neighbours(const IndexType query_point_idx, const IndexType num_closet, IndexType* out_indices);
@@ -104,16 +132,18 @@ public:
 	*/
 	inline Matrix44 matrix_to_scene_coord(  );
 	Matrix44 inverse_matrix_to_scene_coord();
-	/* Green channel to get all vertex position information */
-	inline  Matrix3X&	vertices_matrix()
+	/* Green channel to get all vertex position information, maps the position array of the store (no copy) */
+	inline  VertexStore::Matrix3XMap	vertices_matrix()
 	{	
 		if (kd_tree_should_rebuild_)
 		{
 			build_kdtree();
 		}
-		return vtx_matrix_; 
+		return vertex_store_.positions_matrix(); 
 	}
-	/*Update vertex position according vertex matrix*/
+	/* Columnar arrays behind the vertices, for loops over every point */
+	inline VertexStore& vertex_store(){ return vertex_store_; }
+	/*Update box, trees and opengl mesh after the positions were written through vertices_matrix()*/
 	void	update();
 
 	inline void lock(){ mutex_.lock(); }
@@ -173,11 +203,14 @@ public:
 
 	RenderMode::WeightColorMode color_mode;
 	std::vector<pcm::ColorType> colors_;
+	std::vector<ScalarType>		curvatures_;
+	std::vector<ScalarType>		planarities_;
 	
 private:
 	qglviewer::Frame m_frame;
 	bool isload_;
-	std::vector<Vertex*>	vertices_;
+	VertexStore				vertex_store_;
+	std::vector<Vertex*>	vertices_;		// views over vertex_store_, allocated from allocator_
 	std::vector<TriangleType*>  triangle_array;
 public:
 	void update_openglMesh();
@@ -209,9 +242,18 @@ public:
 	void worldRaytoLocal(const Ray& world_ray, Ray& local_ray);
 	void localRayToWorld(const Ray& local_ray, Ray&world_ray);
 	bool castray(Ray& world_ray,HitResult& result);
+	// Trace all the rays at once, hits[i] tells if results[i] is valid
+	void castrays(const std::vector<Ray>& world_rays, std::vector<HitResult>& results, std::vector<char>& hits);
 	void clearKdTreeRayBuffer();
 	void updateHitrayBuffer();
 private:
+	void		install_kdtree(bool wait);
+	void		install_kdtree_locked(bool wait);
+	void		free_retired_kdtrees();
+	void		refit_index();
+	PointIndex*	current_kdtree();
+	KDTree*		raycast_tree();
+
 	bool isScaledToUniform_;
 	bool isOpenglMeshUpdated;
 	bool isOpenglMeshColorUpdated;
@@ -226,11 +268,15 @@ private:
 	//added by huayun
 	
 	 
-	Matrix3X									vtx_matrix_; // 3 * NumOfVtx
-	//Attention: kdtree is just a adapter, it means it use the reference of its data source
-	nanoflann::KDTreeAdaptor<Matrix3X, 3>*		kd_tree_;
+	PointIndex*									kd_tree_;
+	PointIndexBuilder*							kd_tree_builder_;	// rebuild running in background
+	std::vector<PointIndex*>					retired_kd_trees_;	// replaced, freed once no query can use them
+	QMutex										kd_tree_mutex_;	// guards kd_tree_, kd_tree_builder_ and their generation
+	unsigned									vertex_generation_;	// bumped when vertices are added, deleted or moved
+	unsigned									kd_tree_generation_;	// vertex_generation_ kd_tree_ was built on
 	KDTree*										kd_tree_raycast_;
 	bool										kd_tree_should_rebuild_;
+	bool										kd_tree_raycast_should_rebuild_;
 	QMutex										mutex_;
 public:
 	std::vector< std::map<IndexType,Vertex*>>				lb_wrapbox_;
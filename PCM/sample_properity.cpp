@@ -27,72 +27,21 @@ void compute_normal( IndexType selected_smp,  NormalType& baseline )
 
 	Sample& smp = (*Global_SampleSet)[selected_smp];
 
-	for ( IndexType i=0; i < smp.num_vertices(); i++ )
-	{
-		MatrixX3	k_nearest_verts(k, 3);
-		IndexType		neighbours[k];
-		ScalarType dist[k];
-		smp.neighbours( i, k, neighbours, dist );
-		for ( IndexType j=0; j<k; j++ )
-		{
-			IndexType neighbour_idx = neighbours[j];
-
-			k_nearest_verts.row(j) << smp[neighbour_idx].x(), smp[neighbour_idx].y(), smp[neighbour_idx].z();
-		}
-
-		MatrixX3 vert_mean = k_nearest_verts.colwise().mean();
-		MatrixX3 Q(k, 3);
-		for (  IndexType j=0; j<k;j++)
-		{
-			Q.row(j) = k_nearest_verts.row(j) - vert_mean;
-		}
-
-		Matrix33 sigma = Q.transpose() * Q;
-
-		Eigen::EigenSolver<Matrix33> eigen_solver(sigma, Eigen::ComputeFullU | Eigen::ComputeFullV);
-
-		auto ev = eigen_solver.eigenvectors();
-		auto eval = eigen_solver.eigenvalues();
-		ScalarType tmp[3] = { eval(0).real(),eval(1).real(),eval(2).real() };
-		IndexType min_idx = std::min_element(tmp,tmp+3) - tmp;
-		NormalType nv; 
-		nv(0) = (ev.col(min_idx))(0).real();
-		nv(1) = (ev.col(min_idx))(1).real();
-		nv(2) = (ev.col(min_idx))(2).real();
-
-		nv.normalize();
-		if ( (baseline).dot(nv) < 0 )
-		{
-			nv = - nv;
-		}
-
-		smp[i].set_normal( nv );
+	NormalEstimator estimator(smp, k);
+	estimator.compute(baseline);
+	estimator.apply();
 
        ///calculate curvature
 
 
 #ifdef USE_ALL_CURVATURE
-		ScalarType cur = 0.;
-		ScalarType deno = tmp[0] + tmp[1] + tmp[2];
-
-		if (min_idx == 0)
-		{
-			cur = tmp[0]/deno;
-		}else if(min_idx == 1)
-		{
-			cur = tmp[1]/deno;
-		}else
-		{
-			cur =  tmp[2]/deno;
-		}
-
-		cur = max(cur,0.015f);
+	for ( IndexType i=0; i < smp.num_vertices(); i++ )
+	{
+		ScalarType cur = max(estimator.curvatures()[i], 0.015f);
 
 		smp[i].set_value(3*cur);
-#endif
-
-
 	}
+#endif
 }
 
  void computerMinMax(IndexType selected_smp)
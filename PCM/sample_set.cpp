@@ -89,39 +89,38 @@ bool SampleSet::castray(int sourcesample_idx, std::vector<HitResult>& result)
 	if (sourcesample_idx > -1 && sourcesample_idx < size())
 	{
 		Sample& source_sample = (*this)[sourcesample_idx];
-		for (size_t source_vtx_idx = 0; source_vtx_idx < (*this)[sourcesample_idx].num_vertices(); source_vtx_idx++)
+		const size_t nb_rays = source_sample.num_vertices();
+		std::vector<Ray> worldrays(nb_rays);
+		for (size_t source_vtx_idx = 0; source_vtx_idx < nb_rays; source_vtx_idx++)
 		{
-			PointType& p = source_sample[source_vtx_idx].get_position();
-			Ray localray, worldray;
-			localray.origin = p;
+			Ray localray;
+			localray.origin = source_sample[source_vtx_idx].get_position();
 			localray.dir = pcm::Vec3(0.0f, 0.0f, 1.0f);
+			source_sample.localRayToWorld(localray, worldrays[source_vtx_idx]);
+		}
 
-			source_sample.localRayToWorld(localray, worldray);
-			
+		// every target traces the whole batch, results are then gathered in the
+		// vertex major order of the per ray version
+		std::vector<std::vector<HitResult> > target_results(size());
+		std::vector<std::vector<char> > target_hits(size());
+		for (size_t target_smp_idx = 0; target_smp_idx < size(); target_smp_idx++)
+		{
+			if (target_smp_idx == sourcesample_idx)
+				continue;
+			(*this)[target_smp_idx].castrays(worldrays, target_results[target_smp_idx], target_hits[target_smp_idx]);
+		}
+		for (size_t source_vtx_idx = 0; source_vtx_idx < nb_rays; source_vtx_idx++)
+		{
 			for (size_t target_smp_idx = 0; target_smp_idx < size(); target_smp_idx++)
 			{
-				if (target_smp_idx == sourcesample_idx)
+				if (target_smp_idx == sourcesample_idx || !target_hits[target_smp_idx][source_vtx_idx])
 					continue;
-				HitResult hitresult;
-				Sample& target_sample = (*this)[target_smp_idx];
-				if (target_sample.castray(worldray, hitresult))
-				{
-					hitresult.source_sample_idx = sourcesample_idx;
-					hitresult.source_vtx_idx = source_vtx_idx;
-					result.push_back(hitresult);
-				}
-
+				HitResult& hitresult = target_results[target_smp_idx][source_vtx_idx];
+				hitresult.source_sample_idx = sourcesample_idx;
+				hitresult.source_vtx_idx = source_vtx_idx;
+				result.push_back(hitresult);
 			}
-
-
-
-
 		}
-
-
-
-
-
 	}
 	for (size_t i = 0; i < size(); i++)
 	{
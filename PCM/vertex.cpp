@@ -5,32 +5,32 @@
 #include "glut.h"
 using namespace pcm;
 void Vertex::draw(){
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
-	glColor4f( color_(0), color_(1), color_(2), color_(3) );
+	glColor4f( r(), g(), b(), alpha() );
 	draw_without_color();
 };
 
 void Vertex::draw_without_color()
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
 
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	glVertex3f(position_(0), position_(1), position_(2));
+	glNormal3f( nx(), ny(), nz());
+	glVertex3f( x(), y(), z());
 }
 
 void  Vertex::draw( const Matrix44& adjust_matrix )
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
-	glColor4f( color_(0), color_(1), color_(2), color_(3) );
+	glColor4f( r(), g(), b(), alpha() );
 	draw_without_color(adjust_matrix);
 }
 
@@ -39,13 +39,13 @@ void  Vertex::draw_without_color( const Matrix44& adjust_matrix)
 
 
 
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
 
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp2(position_(0), position_(1), position_(2),1.);
+	glNormal3f( nx(), ny(), nz());
+	Vec4	tmp2(x(), y(), z(), 1.);
 	Vec4	point_to_show2 = adjust_matrix * tmp2;
 	glVertex3f( point_to_show2(0), point_to_show2(1), point_to_show2(2) );
 	return;
@@ -71,7 +71,7 @@ void  Vertex::draw_without_color( const Matrix44& adjust_matrix)
 	glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, qaBlack);
 	glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 50.0);
 
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	//glVertex3f( point_to_show(0)+bias(0), point_to_show(1)+bias(1), point_to_show(2)+bias(2) );
 	glMatrixMode(GL_MODELVIEW);
@@ -84,23 +84,23 @@ void  Vertex::draw_without_color( const Matrix44& adjust_matrix)
 
 void Vertex::draw( const Matrix44& adjust_matrix, const Vec3& bias )
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
-	glColor4f( color_(0), color_(1), color_(2), color_(3) );
+	glColor4f( r(), g(), b(), alpha() );
 	draw_without_color(adjust_matrix, bias);
 }
 
 void Vertex::draw_without_color(const Matrix44& adjust_matrix, const Vec3& bias)
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
 
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	glNormal3f( nx(), ny(), nz());
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	glVertex3f( point_to_show(0) + bias(0), 
 		point_to_show(1) + bias(1), 
@@ -110,7 +110,7 @@ void Vertex::draw_without_color(const Matrix44& adjust_matrix, const Vec3& bias)
 void Vertex::draw_with_name(unsigned int idx, const Matrix44& adjust_matrix)
 {
 	glPushName(idx);
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	glRasterPos3f(point_to_show(0), point_to_show(1), point_to_show(2));
 	glPopName();
@@ -119,7 +119,7 @@ void Vertex::draw_with_name(unsigned int idx, const Matrix44& adjust_matrix)
 
 void Vertex::draw_with_label( const Matrix44& adjust_matrix )
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
@@ -128,12 +128,12 @@ void Vertex::draw_with_label( const Matrix44& adjust_matrix )
 	//static const IndexType color_step = 47;
 	//IndexType	label_color = (label_ * color_step) % 255;
 	//ColorType color = Color_Utility::color_from_table(label_color);
-	ColorType color = Color_Utility::span_color_from_table(label_); 
+	ColorType color = Color_Utility::span_color_from_table(label()); 
 
 	glColor4f( color(0),color(1),color(2),color(3) );
 	//glColor4f( color(0)/255.0,color(1)/255.0,color(2)/255.0,color(3) );
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	glNormal3f( nx(), ny(), nz());
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	glVertex3f( point_to_show(0), point_to_show(1), point_to_show(2) );
 
@@ -141,7 +141,7 @@ void Vertex::draw_with_label( const Matrix44& adjust_matrix )
 
 void Vertex::draw_with_label( const Matrix44& adjust_matrix, const Vec3& bias )
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
@@ -150,16 +150,16 @@ void Vertex::draw_with_label( const Matrix44& adjust_matrix, const Vec3& bias )
 	//static const IndexType color_step = 47;
 	//IndexType	label_color = (label_ * color_step) % 255;
 	//ColorType color = Color_Utility::color_from_table(label_color);
-//	ColorType color = Color_Utility::span_color_from_table(label_);//ӻǩ 7-28 
-	ColorType color = Color_Utility::span_color_from_table(label_); 
+//	ColorType color = Color_Utility::span_color_from_table(label());//ӻǩ 7-28 
+	ColorType color = Color_Utility::span_color_from_table(label()); 
 
 	glColor4f( color(0),color(1),color(2),color(3) );
 //	ColorType color = Color_Utility::span_color_from_hy_table(label_);
 	//ColorType color = Color_Utility::color_map_one(val_);//ӻ
 
 //	glColor4f( color(0)/255.0,color(1)/255.0,color(2)/255.0,color(3) );
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	glNormal3f( nx(), ny(), nz());
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	glVertex3f( point_to_show(0)+bias(0), point_to_show(1)+bias(1), point_to_show(2)+bias(2) );
 
@@ -178,7 +178,7 @@ void Vertex::draw_with_Graph_wrapbox( const Matrix44& adjust_matrix ,const Vec3&
 
 void Vertex::draw_with_edgepoints( const Matrix44& adjust_matrix )
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
@@ -188,23 +188,23 @@ void Vertex::draw_with_edgepoints( const Matrix44& adjust_matrix )
 	//IndexType	label_color = (label_ * color_step) % 255;
 	//ColorType color = Color_Utility::color_from_table(label_color);
 	ColorType color;
-	if( is_edge_points_){
-		color = Color_Utility::span_color_from_table_with_edge(label_);
+	if( is_edge_point()){
+		color = Color_Utility::span_color_from_table_with_edge(label());
 	}else{
-		color = Color_Utility::span_color_from_table(label_); 
+		color = Color_Utility::span_color_from_table(label()); 
 	}
 
 
 	glColor4f( color(0),color(1),color(2),color(3) );
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	glNormal3f( nx(), ny(), nz());
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	glVertex3f( point_to_show(0), point_to_show(1), point_to_show(2) );
 
 }
 void Vertex::draw_with_edgepoints( const Matrix44& adjust_matrix , const Vec3& bias)
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
@@ -214,8 +214,8 @@ void Vertex::draw_with_edgepoints( const Matrix44& adjust_matrix , const Vec3& b
 	//IndexType	label_color = (label_ * color_step) % 255;
 	//ColorType color = Color_Utility::color_from_table(label_color);
 	ColorType color;
-	if( is_edge_points_){
-		if(is_edgePointWithSmallLabel_){
+	if( is_edge_point()){
+		if(is_edgePointWithSmallLabel()){
 			ScalarType r = 0.0f;
 			ScalarType g = 1.0f;
 			ScalarType b = 0.0f;
@@ -228,13 +228,13 @@ void Vertex::draw_with_edgepoints( const Matrix44& adjust_matrix , const Vec3& b
 		}
 		
 	}else{
-		color = Color_Utility::span_color_from_table(label_); 
+		color = Color_Utility::span_color_from_table(label()); 
 	}
 
 
 	glColor4f( color(0),color(1),color(2),color(3) );
-	glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	glNormal3f( nx(), ny(), nz());
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	glVertex3f( point_to_show(0)+bias(0), point_to_show(1)+bias(1), point_to_show(2)+bias(2) );
 
@@ -242,7 +242,7 @@ void Vertex::draw_with_edgepoints( const Matrix44& adjust_matrix , const Vec3& b
 
 void Vertex::draw_with_sphere( const Matrix44& adjust_matrix , const Vec3& bias)
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
@@ -276,8 +276,8 @@ void Vertex::draw_with_sphere( const Matrix44& adjust_matrix , const Vec3& bias)
 	//glLightfv(GL_LIGHT0, GL_AMBIENT, qaLowAmbient);
 	//glMaterialfv(GL_FRONT_AND_BACK ,GL_EMISSION , emission);
 	//glColor4f( color(0),color(1),color(2),color(3) );
-	//glNormal3f( normal_(0), normal_(1), normal_(2));
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	//glNormal3f( nx(), ny(), nz());
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	//glVertex3f( point_to_show(0)+bias(0), point_to_show(1)+bias(1), point_to_show(2)+bias(2) );
 	
@@ -287,7 +287,7 @@ void Vertex::draw_with_sphere( const Matrix44& adjust_matrix , const Vec3& bias)
 	//glLoadIdentity();
 	glPushMatrix();
 	glTranslatef(point_to_show(0)+bias(0),point_to_show(1)+bias(1), point_to_show(2)+bias(2));
-	ColorType color2 = Color_Utility::span_color_from_table(label_); 
+	ColorType color2 = Color_Utility::span_color_from_table(label()); 
 	glColor3f( color2(0) ,color2(1) ,color2(2));
 	glutSolidSphere(0.001* Paint_Param::g_point_size, 10, 10);
 	glPopMatrix();
@@ -295,13 +295,13 @@ void Vertex::draw_with_sphere( const Matrix44& adjust_matrix , const Vec3& bias)
 }
 void Vertex::drawNormal( const Matrix44& adjust_matrix , const Vec3& bias)
 {
-	if (!visible_)
+	if (!is_visible())
 	{
 		return;
 	}
 	glColor3f( 0.0f , 0.0f ,1.0f );
-	PointType point_end = position_ + 0.5*normal_;
-	Vec4	tmp(position_(0), position_(1), position_(2),1.);
+	PointType point_end = get_position() + 0.5*get_normal();
+	Vec4	tmp(x(), y(), z(), 1.);
 	Vec4	point_to_show = adjust_matrix * tmp;
 	Vec4	tmp1(point_end(0),point_end(1), point_end(2),1.);
 	Vec4	point_to_show2 = adjust_matrix * tmp1;
@@ -2,14 +2,30 @@
 #define _VERTEX_H
 #include "windows.h"
 #include "selectable_item.h"
+#include "vertex_store.h"
 #include <iostream>
 
-class Vertex : public SelectableItem
+/*
+	View of one vertex of a VertexStore: every accessor reads or writes the columns of
+	the store, a Vertex holds no point data itself (16 bytes). Sample allocates one view
+	per vertex from its pool, the address of a view stays valid while its slot follows
+	the vertex when the store is compacted.
+	Vertex(idx) creates a standalone vertex owning a one point store.
+*/
+class Vertex
 {
 public:
-	Vertex(IndexType _idx):position_(NULL_POINT), idx_(_idx),
-		normal_(NULL_NORMAL), texture_(NULL_TEXTURE),label_(0),val_(0),is_edge_points_(0),is_wrapbox_(0) ,is_edgePointWithSmallLabel_(-1){};
-	~Vertex(){};
+	Vertex(IndexType _idx):store_(new VertexStore), slot_(0), idx_(_idx)
+	{
+		store_->set_standalone(true);
+		store_->push_back(NULL_POINT, NULL_NORMAL, NULL_COLOR);
+	}
+	Vertex(VertexStore* _store, IndexType _slot):store_(_store), slot_(_slot), idx_(_slot){}
+	~Vertex()
+	{
+		if (store_->is_standalone())
+			delete store_;
+	}
 
 	void set_idx(IndexType _idx)
 	{
@@ -19,77 +35,111 @@ public:
 	{
 		return idx_;
 	}
+	// the store moved this vertex (Sample::delete_vertex_group)
+	void set_slot(IndexType _slot)
+	{
+		slot_ = _slot;
+	}
 	void set_position( const pcm::PointType& pos )
 	{
-		position_ = pos;
+		ScalarType* p = store_->position(slot_);
+		p[0] = pos(0); p[1] = pos(1); p[2] = pos(2);
 	}
 
 	void set_normal( const pcm::NormalType& n )
 	{
-		normal_ = n;
+		ScalarType* p = store_->normal(slot_);
+		p[0] = n(0); p[1] = n(1); p[2] = n(2);
 	}
 	void set_texture(const pcm::TextureType& t)
 	{
-		texture_ = t;
+		store_->set_texture(slot_, t);
 	}
 	void set_tangent(const pcm::NormalType& t)
 	{
-		tangent_ = t;
+		store_->set_tangent(slot_, t);
 	}
 	void set_bi_tangent(const pcm::NormalType& t)
 	{
-		bi_tangent_ = t;
+		store_->set_bi_tangent(slot_, t);
 	}
-	pcm::PointType get_position()
+	pcm::PointType get_position() const
 	{
-		return position_;
+		const ScalarType* p = store_->position(slot_);
+		return pcm::PointType(p[0], p[1], p[2]);
 	}
-	pcm::NormalType get_normal()
+	pcm::NormalType get_normal() const
 	{
-		return normal_;
+		const ScalarType* p = store_->normal(slot_);
+		return pcm::NormalType(p[0], p[1], p[2]);
 	}
-	pcm::TextureType get_texture()
+	pcm::TextureType get_texture() const
 	{
-		return texture_;
+		return store_->texture(slot_);
 	}
-	pcm::NormalType get_tangent()
+	pcm::NormalType get_tangent() const
 	{
-		return tangent_;
+		return store_->tangent(slot_);
 	}
-	pcm::NormalType get_bi_tangent()
+	pcm::NormalType get_bi_tangent() const
 	{
-		return bi_tangent_;
+		return store_->bi_tangent(slot_);
 	}
-	void set_label( IndexType l ){ label_ = l; }
+	void set_label( IndexType l ){ store_->label(slot_) = l; }
 
-	void set_value(ScalarType v_){ val_ = v_;}
+	void set_value(ScalarType v_){ store_->set_value(slot_, v_);}
 
 	// added by huayun
-	void set_edge_point(IndexType l){is_edge_points_ = l;}
-	void set_edgePointWithSmallLabel(IndexType l){ is_edgePointWithSmallLabel_ = l;}
+	void set_edge_point(IndexType l){ store_->set_edge_point(slot_, l);}
+	void set_edgePointWithSmallLabel(IndexType l){ store_->set_edge_point_small_label(slot_, l);}
 
-	void set_wrapbox(IndexType l){is_wrapbox_ = l;}
+	void set_wrapbox(IndexType l){ store_->set_wrapbox(slot_, l);}
+	IndexType is_edge_point() const { return store_->edge_point(slot_); }
+	IndexType is_edgePointWithSmallLabel() const { return store_->edge_point_small_label(slot_); }
+	IndexType is_wrapbox() const { return store_->wrapbox(slot_); }
 
-	ScalarType x() const { return position_(0); }
-	ScalarType y() const { return position_(1); }
-	ScalarType z() const { return position_(2); }
-	ScalarType nx() const { return normal_(0); }
-	ScalarType ny() const { return normal_(1); }
-	ScalarType nz() const { return normal_(2); }
-	ScalarType r() const { return color_(0); }
-	ScalarType g() const { return color_(1); }
-	ScalarType b() const { return color_(2); }
-	ScalarType alpha() const { return color_(3); }
-	ScalarType tex_x() const { return texture_(0); }
-	ScalarType tex_y() const { return texture_(1); }
-	ScalarType tangent_x() const { return tangent_(0); }
-	ScalarType tangent_y() const { return tangent_(1); }
-	ScalarType tangent_z() const { return tangent_(2); }
-	ScalarType bi_tangent_x() const { return bi_tangent_(0); }
-	ScalarType bi_tangent_y() const { return bi_tangent_(1); }
-	ScalarType bi_tangent_z() const { return bi_tangent_(2); }
-	IndexType label() const {return label_;}
-	ScalarType value_() const {return val_;} 
+	/* same interface as SelectableItem */
+	void set_color( const pcm::ColorType& c )
+	{
+		ScalarType* p = store_->color(slot_);
+		p[0] = c(0); p[1] = c(1); p[2] = c(2); p[3] = c(3);
+	}
+	const pcm::ColorType color()
+	{
+		if (is_selected())
+			return SELECTED_COLOR;
+		else if( is_hightlighted() )
+			return HIGHTLIGHTED_COLOR;
+		else
+			return raw_color();
+	}
+	bool is_visible() const { return store_->flag(slot_, VertexStore::VISIBLE); }
+	void set_visble(const bool v) { store_->set_flag(slot_, VertexStore::VISIBLE, v); }
+	bool is_selected() const { return store_->flag(slot_, VertexStore::SELECTED); }
+	void set_selected( const bool s ){ store_->set_flag(slot_, VertexStore::SELECTED, s); }
+	bool is_hightlighted() const { return store_->flag(slot_, VertexStore::HIGHLIGHTED); }
+	void set_hightlighted( const bool h ){ store_->set_flag(slot_, VertexStore::HIGHLIGHTED, h); }
+
+	ScalarType x() const { return store_->position(slot_)[0]; }
+	ScalarType y() const { return store_->position(slot_)[1]; }
+	ScalarType z() const { return store_->position(slot_)[2]; }
+	ScalarType nx() const { return store_->normal(slot_)[0]; }
+	ScalarType ny() const { return store_->normal(slot_)[1]; }
+	ScalarType nz() const { return store_->normal(slot_)[2]; }
+	ScalarType r() const { return store_->color(slot_)[0]; }
+	ScalarType g() const { return store_->color(slot_)[1]; }
+	ScalarType b() const { return store_->color(slot_)[2]; }
+	ScalarType alpha() const { return store_->color(slot_)[3]; }
+	ScalarType tex_x() const { return get_texture()(0); }
+	ScalarType tex_y() const { return get_texture()(1); }
+	ScalarType tangent_x() const { return get_tangent()(0); }
+	ScalarType tangent_y() const { return get_tangent()(1); }
+	ScalarType tangent_z() const { return get_tangent()(2); }
+	ScalarType bi_tangent_x() const { return get_bi_tangent()(0); }
+	ScalarType bi_tangent_y() const { return get_bi_tangent()(1); }
+	ScalarType bi_tangent_z() const { return get_bi_tangent()(2); }
+	IndexType label() const {return store_->label(slot_);}
+	ScalarType value_() const {return store_->value(slot_);} 
 	/*
 		Without adjust_matrix is not recommend,
 		which would display sample's original position,
@@ -114,19 +164,18 @@ public:
 	void draw_with_name(unsigned int idx, const Matrix44& adjust_matrix);
 	void draw_with_sphere( const Matrix44& adjust_matrix , const Vec3& bias);
 	void drawNormal( const Matrix44& adjust_matrix , const Vec3& bias);
-protected:
-	pcm::PointType position_;
-	pcm::NormalType normal_;
-	pcm::TextureType texture_;
-	pcm::NormalType tangent_;
-	pcm::NormalType bi_tangent_;
-	IndexType	label_;
-	ScalarType  val_;
-	IndexType	is_edge_points_;
-	IndexType   is_edgePointWithSmallLabel_;
-	IndexType	is_wrapbox_;
-	IndexType   idx_;  //the idx in vertices ,may make mistakes when erased
+private:
+	Vertex(const Vertex&);
+	Vertex& operator=(const Vertex&);
+	pcm::ColorType raw_color() const
+	{
+		const ScalarType* p = store_->color(slot_);
+		return pcm::ColorType(p[0], p[1], p[2], p[3]);
+	}
 
+	VertexStore*	store_;
+	IndexType		slot_;
+	IndexType		idx_;  //the idx in vertices
 };
 
 
@@ -0,0 +1,145 @@
+#include "vertex_store.h"
+
+// every array of the store, the sparse ones may be empty
+template<class Array>
+static void erase_columns(Array& a, int dim, const std::vector<IndexType>& idx, size_t n)
+{
+	if (a.empty())
+		return;
+	size_t dst = 0;
+	size_t j = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (j < idx.size() && (size_t)idx[j] == i)
+		{
+			++j;
+			continue;
+		}
+		if (dst != i)
+		{
+			for (int k = 0; k < dim; ++k)
+				a[dim * dst + k] = a[dim * i + k];
+		}
+		++dst;
+	}
+	a.resize(dim * dst);
+}
+
+void VertexStore::reserve(size_t n)
+{
+	positions_.reserve(3 * n);
+	normals_.reserve(3 * n);
+	colors_.reserve(4 * n);
+	labels_.reserve(n);
+	flags_.reserve(n);
+}
+
+void VertexStore::clear()
+{
+	positions_.clear();
+	normals_.clear();
+	colors_.clear();
+	labels_.clear();
+	flags_.clear();
+	textures_.clear();
+	tangents_.clear();
+	bi_tangents_.clear();
+	values_.clear();
+	edge_points_.clear();
+	edge_point_small_label_.clear();
+	wrapboxes_.clear();
+}
+
+IndexType VertexStore::push_back(const pcm::PointType& p, const pcm::NormalType& n, const pcm::ColorType& c)
+{
+	IndexType idx = (IndexType)size();
+	for (int k = 0; k < 3; ++k)
+	{
+		positions_.push_back(p(k));
+		normals_.push_back(n(k));
+	}
+	for (int k = 0; k < 4; ++k)
+		colors_.push_back(c(k));
+	labels_.push_back(0);
+	flags_.push_back(VISIBLE);
+
+	// sparse attributes already in use grow with the others
+	if (!textures_.empty())
+		textures_.resize(2 * size(), 0);
+	if (!tangents_.empty())
+		tangents_.resize(3 * size(), 0);
+	if (!bi_tangents_.empty())
+		bi_tangents_.resize(3 * size(), 0);
+	if (!values_.empty())
+		values_.resize(size(), 0);
+	if (!edge_points_.empty())
+		edge_points_.resize(size(), 0);
+	if (!edge_point_small_label_.empty())
+		edge_point_small_label_.resize(size(), -1);
+	if (!wrapboxes_.empty())
+		wrapboxes_.resize(size(), 0);
+	return idx;
+}
+
+void VertexStore::erase(const std::vector<IndexType>& idx)
+{
+	const size_t n = size();
+	erase_columns(positions_, 3, idx, n);
+	erase_columns(normals_, 3, idx, n);
+	erase_columns(colors_, 4, idx, n);
+	erase_columns(labels_, 1, idx, n);
+	erase_columns(flags_, 1, idx, n);
+	erase_columns(textures_, 2, idx, n);
+	erase_columns(tangents_, 3, idx, n);
+	erase_columns(bi_tangents_, 3, idx, n);
+	erase_columns(values_, 1, idx, n);
+	erase_columns(edge_points_, 1, idx, n);
+	erase_columns(edge_point_small_label_, 1, idx, n);
+	erase_columns(wrapboxes_, 1, idx, n);
+}
+
+pcm::TextureType VertexStore::texture(IndexType i) const
+{
+	if (textures_.empty())
+		return NULL_TEXTURE;
+	return pcm::TextureType(textures_[2 * i], textures_[2 * i + 1]);
+}
+
+void VertexStore::set_texture(IndexType i, const pcm::TextureType& t)
+{
+	if (textures_.empty())
+		textures_.resize(2 * size(), 0);
+	textures_[2 * i] = t(0);
+	textures_[2 * i + 1] = t(1);
+}
+
+void VertexStore::set_value(IndexType i, ScalarType v)
+{
+	if (values_.empty())
+	{
+		if (v == 0)
+			return;
+		values_.resize(size(), 0);
+	}
+	values_[i] = v;
+}
+
+void VertexStore::set_vec3(ScalarArray& a, IndexType i, const pcm::NormalType& v)
+{
+	if (a.empty())
+		a.resize(3 * size(), 0);
+	a[3 * i] = v(0);
+	a[3 * i + 1] = v(1);
+	a[3 * i + 2] = v(2);
+}
+
+void VertexStore::set_marker(std::vector<IndexType>& a, IndexType i, IndexType v, IndexType def)
+{
+	if (a.empty())
+	{
+		if (v == def)
+			return;
+		a.resize(size(), def);
+	}
+	a[i] = v;
+}
@@ -0,0 +1,109 @@
+#ifndef _VERTEX_STORE_H
+#define _VERTEX_STORE_H
+#include "basic_types.h"
+#include <Eigen/StdVector>
+#include <vector>
+
+/*
+	Columnar storage of the points of a sample. Each attribute is one contiguous array
+	indexed by the vertex index:
+
+		positions	3 x N	(positions_matrix() maps it as a Matrix3X, no copy)
+		normals		3 x N
+		colors		4 x N	(same layout as a GL RGBA float buffer)
+		labels		N
+		flags		N		(visible / selected / highlighted bits)
+
+	Attributes only a few samples use (texture coordinates, tangents, value and the
+	edge / wrapbox markers) are allocated on their first write, reads before return
+	the defaults of the old Vertex.
+	Vertex is a view (store, slot) over these arrays.
+*/
+class VertexStore
+{
+public:
+	enum { VISIBLE = 1, SELECTED = 2, HIGHLIGHTED = 4 };
+	typedef std::vector<ScalarType, Eigen::aligned_allocator<ScalarType> >	ScalarArray;
+	typedef Eigen::Map<Matrix3X>											Matrix3XMap;
+
+	VertexStore():standalone_(false){}
+
+	size_t size() const { return labels_.size(); }
+	void reserve(size_t n);
+	void clear();
+	// Append a vertex, returns its index
+	IndexType push_back(const pcm::PointType& p, const pcm::NormalType& n, const pcm::ColorType& c);
+	// Remove the vertices of 'idx' (ascending), the others move down keeping their order
+	void erase(const std::vector<IndexType>& idx);
+
+	/* dense attributes */
+	ScalarType*			position(IndexType i)		{ return &positions_[3 * i]; }
+	const ScalarType*	position(IndexType i) const	{ return &positions_[3 * i]; }
+	ScalarType*			normal(IndexType i)			{ return &normals_[3 * i]; }
+	const ScalarType*	normal(IndexType i) const	{ return &normals_[3 * i]; }
+	ScalarType*			color(IndexType i)			{ return &colors_[4 * i]; }
+	const ScalarType*	color(IndexType i) const	{ return &colors_[4 * i]; }
+	IndexType&			label(IndexType i)			{ return labels_[i]; }
+	IndexType			label(IndexType i) const	{ return labels_[i]; }
+
+	bool flag(IndexType i, unsigned char f) const { return (flags_[i] & f) != 0; }
+	void set_flag(IndexType i, unsigned char f, bool on)
+	{
+		if (on) flags_[i] |= f;
+		else flags_[i] &= ~f;
+	}
+
+	Matrix3XMap positions_matrix()	{ return Matrix3XMap(size() ? &positions_[0] : NULL, 3, size()); }
+	Matrix3XMap normals_matrix()	{ return Matrix3XMap(size() ? &normals_[0] : NULL, 3, size()); }
+	const ScalarType* positions_data() const	{ return size() ? &positions_[0] : NULL; }
+	const ScalarType* normals_data() const		{ return size() ? &normals_[0] : NULL; }
+	const ScalarType* colors_data() const		{ return size() ? &colors_[0] : NULL; }
+	const IndexType*  labels_data() const		{ return size() ? &labels_[0] : NULL; }
+
+	/* sparse attributes */
+	pcm::TextureType	texture(IndexType i) const;
+	void				set_texture(IndexType i, const pcm::TextureType& t);
+	pcm::NormalType		tangent(IndexType i) const		{ return vec3(tangents_, i); }
+	void				set_tangent(IndexType i, const pcm::NormalType& t)		{ set_vec3(tangents_, i, t); }
+	pcm::NormalType		bi_tangent(IndexType i) const	{ return vec3(bi_tangents_, i); }
+	void				set_bi_tangent(IndexType i, const pcm::NormalType& t)	{ set_vec3(bi_tangents_, i, t); }
+	ScalarType			value(IndexType i) const	{ return values_.empty() ? 0 : values_[i]; }
+	void				set_value(IndexType i, ScalarType v);
+	IndexType			edge_point(IndexType i) const	{ return edge_points_.empty() ? 0 : edge_points_[i]; }
+	void				set_edge_point(IndexType i, IndexType v)	{ set_marker(edge_points_, i, v, 0); }
+	IndexType			edge_point_small_label(IndexType i) const	{ return edge_point_small_label_.empty() ? -1 : edge_point_small_label_[i]; }
+	void				set_edge_point_small_label(IndexType i, IndexType v)	{ set_marker(edge_point_small_label_, i, v, -1); }
+	IndexType			wrapbox(IndexType i) const	{ return wrapboxes_.empty() ? 0 : wrapboxes_[i]; }
+	void				set_wrapbox(IndexType i, IndexType v)	{ set_marker(wrapboxes_, i, v, 0); }
+
+	// store of a single vertex created outside of any sample, owned by its view
+	bool is_standalone() const { return standalone_; }
+	void set_standalone(bool s) { standalone_ = s; }
+
+private:
+	pcm::NormalType vec3(const ScalarArray& a, IndexType i) const
+	{
+		if (a.empty())
+			return NULL_NORMAL;
+		return pcm::NormalType(a[3 * i], a[3 * i + 1], a[3 * i + 2]);
+	}
+	void set_vec3(ScalarArray& a, IndexType i, const pcm::NormalType& v);
+	void set_marker(std::vector<IndexType>& a, IndexType i, IndexType v, IndexType def);
+
+	ScalarArray				positions_;
+	ScalarArray				normals_;
+	ScalarArray				colors_;
+	std::vector<IndexType>	labels_;
+	std::vector<unsigned char>	flags_;
+
+	ScalarArray				textures_;
+	ScalarArray				tangents_;
+	ScalarArray				bi_tangents_;
+	ScalarArray				values_;
+	std::vector<IndexType>	edge_points_;
+	std::vector<IndexType>	edge_point_small_label_;
+	std::vector<IndexType>	wrapboxes_;
+	bool					standalone_;
+};
+
+#endif
@@ -154,18 +154,10 @@ namespace videoEditting
 //		glPushMatrix();
 
 
-		int tmp_cur_fram = g_current_frame;
-		std::vector<std::vector<QVector3D>> tmp_simulated_vertices = g_simulated_vertices;
-		std::vector<std::vector<QVector3D>> tmp_simulated_normal = g_simulated_normals;
-		std::vector<QVector3D> tmp_translation = g_translations;
-		std::vector<QQuaternion> tmp_rotation = g_rotations;
-		if (g_current_frame < g_simulated_vertices.size() && g_current_frame>=0)
+		std::vector<QVector3D> simulateObj;
+		std::vector<QVector3D> simulateObjNormal;
+		if (g_simulation_cache.getFrame(g_current_frame, simulateObj, simulateObjNormal))
 		{
-			std::vector<QVector3D>& simulateObj= g_simulated_vertices[g_current_frame];
-			std::vector<QVector3D> simulateObjNormal;
-			if(g_current_frame < g_simulated_normals.size())
-				simulateObjNormal = g_simulated_normals[g_current_frame];
-			
 			int vtx_size = simulateObj.size();
 			glColor3f(1.0f, 0.5f, 0.5f);
 
@@ -252,9 +244,11 @@ namespace videoEditting
 					glPopMatrix();
 
 					//draw corresponding vtx in simulate data
+					if (vtx_id >= simulateObj.size())
+						continue;
 					glPushMatrix();
 
-					QVector3D pos2 = g_simulated_vertices[g_current_frame][vtx_id];
+					QVector3D pos2 = simulateObj[vtx_id];
 					QMatrix4x4 tr2;
 					tr2.translate(pos2);
 					glMultMatrixf(tr2.constData());
@@ -297,19 +291,11 @@ namespace videoEditting
 
 		camera.applyGLMatrices();
 
-		int tmp_cur_fram = g_current_frame;
-		std::vector<std::vector<QVector3D>> tmp_simulated_vertices = g_simulated_vertices;
-		std::vector<std::vector<QVector3D>> tmp_simulated_normal = g_simulated_normals;
-		std::vector<std::vector<QVector2D>> tmp_tracked_textures = g_tracked_textures;
-		std::vector<QVector3D> tmp_translation = g_translations;
-		std::vector<QQuaternion> tmp_rotation = g_rotations;
-		if (g_current_frame < g_simulated_vertices.size() && g_current_frame >= 0)
+		std::vector<QVector3D> simulateObj;
+		std::vector<QVector3D> simulateObjNormal;
+		if (g_simulation_cache.getFrame(g_current_frame, simulateObj, simulateObjNormal))
 		{
-			std::vector<QVector3D>& simulateObj = g_simulated_vertices[g_current_frame];
-			std::vector<QVector3D> simulateObjNormal;
 			std::vector<QVector2D> track_texture;
-			if (g_current_frame < g_simulated_normals.size())
-				simulateObjNormal = g_simulated_normals[g_current_frame];
 			if (g_current_frame < g_tracked_textures.size())
 				track_texture = g_tracked_textures[g_current_frame];
 			int vtx_size = simulateObj.size();
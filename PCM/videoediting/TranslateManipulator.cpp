@@ -17,7 +17,6 @@ namespace videoEditting
 	extern QQuaternion                g_init_rotation;
 	extern std::vector<QVector3D>     g_translations;
 	extern std::vector<QQuaternion>   g_rotations;
-	extern std::vector<std::vector<QVector3D> > g_simulated_vertices;
 	extern std::vector<std::unordered_map<int, QVector3D>> g_position_constraint; //this constraint the position of vertices of frames
 	extern int g_total_frame;//total frame 
 	extern int g_current_frame;
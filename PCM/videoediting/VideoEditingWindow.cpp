@@ -13,7 +13,14 @@
 #include "Viewdatabase.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
 #include <fstream>
+#include <deque>
+#include <map>
+#include <functional>
 
 
 using namespace cv;
@@ -86,11 +93,164 @@ inline Mat mattingMethod(const Mat& trimapMat, Mat& srcMat, Mat& alphaMat , Mat&
 	return compositeResult;
 }
 
+/*
+  Batch matting pipeline. A reader thread decodes the frames ahead, a pool of
+  workers runs mattingMethod on several frames at once and a writer thread
+  stores the results in frame order. At most 'depth' frames are in flight
+  (decoded but not yet written) whatever the stage that holds them.
+*/
+struct MattingJob
+{
+	MattingJob() : index(-1) {}
+	int index;
+	Mat src, trimap;
+	Mat result, alpha;
+};
+
+/// Bounded FIFO between two stages, pop() returns false once closed and empty
+class MattingQueue
+{
+public:
+	MattingQueue(int capacity) : m_capacity(capacity), m_closed(false) {}
+
+	void push(const MattingJob& job)
+	{
+		QMutexLocker lock(&m_mutex);
+		while ((int)m_jobs.size() >= m_capacity)
+			m_notFull.wait(&m_mutex);
+		m_jobs.push_back(job);
+		m_notEmpty.wakeOne();
+	}
+
+	bool pop(MattingJob& job)
+	{
+		QMutexLocker lock(&m_mutex);
+		while (m_jobs.empty() && !m_closed)
+			m_notEmpty.wait(&m_mutex);
+		if (m_jobs.empty())
+			return false;
+		job = m_jobs.front();
+		m_jobs.pop_front();
+		m_notFull.wakeOne();
+		return true;
+	}
+
+	void close()
+	{
+		QMutexLocker lock(&m_mutex);
+		m_closed = true;
+		m_notEmpty.wakeAll();
+	}
+
+private:
+	QMutex m_mutex;
+	QWaitCondition m_notEmpty, m_notFull;
+	std::deque<MattingJob> m_jobs;
+	int m_capacity;
+	bool m_closed;
+};
+
+class MattingStageThread : public QThread
+{
+public:
+	MattingStageThread(const std::function<void()>& stage) : m_stage(stage) {}
+protected:
+	void run() { m_stage(); }
+private:
+	std::function<void()> m_stage;
+};
+
+/*
+  Matte 'nb_frames' frames, 'load' is called in frame order from the reader
+  thread (it may read a video sequentially), 'store' in frame order from the
+  writer thread. Frames 'load' fails on are skipped. Returns once every frame
+  is written.
+*/
+void mattingPipeline(int nb_frames,
+	const std::function<bool(int, Mat&, Mat&)>& load,
+	const std::function<void(int, const Mat&, const Mat&)>& store,
+	Mat& back_ground)
+{
+	const int nb_workers = std::max(1, QThread::idealThreadCount());
+	const int depth = 2 * nb_workers + 2;
+
+	QSemaphore in_flight(depth);
+	MattingQueue decoded(depth), matted(depth);
+	QAtomicInt running_workers(nb_workers);
+
+	MattingStageThread reader([&]()
+	{
+		for (int i = 0; i < nb_frames; ++i)
+		{
+			in_flight.acquire();
+			MattingJob job;
+			job.index = i;
+			if (!load(i, job.src, job.trimap))
+				job.src = Mat();
+			decoded.push(job);
+		}
+		decoded.close();
+	});
+
+	std::vector<MattingStageThread*> workers(nb_workers);
+	for (int w = 0; w < nb_workers; ++w)
+	{
+		workers[w] = new MattingStageThread([&]()
+		{
+			MattingJob job;
+			while (decoded.pop(job))
+			{
+				if (!job.src.empty() && !job.trimap.empty())
+					job.result = mattingMethod(job.trimap, job.src, job.alpha, back_ground);
+				job.src.release();
+				job.trimap.release();
+				matted.push(job);
+			}
+			// the last worker out ends the writer
+			if (!running_workers.deref())
+				matted.close();
+		});
+	}
+
+	MattingStageThread writer([&]()
+	{
+		// out of order frames wait here until the previous ones are written
+		std::map<int, MattingJob> pending;
+		int next = 0;
+		MattingJob job;
+		while (matted.pop(job))
+		{
+			pending[job.index] = job;
+			for (auto itr = pending.find(next); itr != pending.end(); itr = pending.find(next))
+			{
+				if (!itr->second.result.empty())
+					store(next, itr->second.result, itr->second.alpha);
+				pending.erase(itr);
+				++next;
+				in_flight.release();
+			}
+		}
+	});
+
+	writer.start();
+	for (int w = 0; w < nb_workers; ++w)
+		workers[w]->start();
+	reader.start();
+
+	reader.wait();
+	for (int w = 0; w < nb_workers; ++w)
+	{
+		workers[w]->wait();
+		delete workers[w];
+	}
+	writer.wait();
+}
+
 
 
 VideoEditingWindow::VideoEditingWindow(QWidget *parent /*= 0*/):
 	preprocessThread(&preprocessor), cameraWidget(NULL), rfWidget(NULL), currentFrame(NULL),
-	timer(NULL), transformEditor(NULL), cur_active_viewer(NULL), world_viewer(NULL), camera_viewer(NULL)
+	timer(NULL), simulate_timer(NULL), simulate_progress(NULL), transformEditor(NULL), cur_active_viewer(NULL), world_viewer(NULL), camera_viewer(NULL)
 {
 	ui_.setupUi(this);
 	transformEditor = new videoEditting::ObjectInfoWidget(ui_);
@@ -238,6 +398,8 @@ void VideoEditingWindow::setUpToolbox()
 	timer = new QTimer(this);
 
 	connect(timer, SIGNAL(timeout()), this, SLOT(nextFrame()));
+	simulate_timer = new QTimer(this);
+	connect(simulate_timer, SIGNAL(timeout()), this, SLOT(update_simulate_progress()));
 	connect(ui_.actionOpen, SIGNAL(triggered()), this, SLOT(openFile()));
 	connect(ui_.actionSave_as, SIGNAL(triggered()), this, SLOT(saveas()));
 	connect(ui_.actionClose, SIGNAL(triggered()), this, SLOT(closeFile()));
@@ -456,7 +618,6 @@ void VideoEditingWindow::openFile()
 	//
 	videoEditting::g_translations.resize(totalFrameNumber);
 	videoEditting::g_rotations.resize(totalFrameNumber);
-	videoEditting::g_simulated_vertices.resize(totalFrameNumber);
 	videoEditting::g_position_constraint.resize(totalFrameNumber);
 	videoEditting::g_time_step = delay/1000.0f;
 
@@ -651,8 +812,6 @@ void VideoEditingWindow::matting()
 	QString cur_dir = "./";
 	QString filepath = QFileDialog::getExistingDirectory(this, "Get existing directory", cur_dir);
 
-	Mat src, trimap, tmap;
-
 	if (!filepath.isEmpty())
 	{
 		QMessageBox::information(this, "Information", "Bat Matting begin!", QMessageBox::Ok);
@@ -677,7 +836,6 @@ void VideoEditingWindow::matting()
 		string src_file_path = srcFilepath.toStdString();
 
 		QFileInfoList trimapList;
-		QFileInfo trimapFileInfo;
 		QDir trimapDir(trimapFilepath);
 		trimapDir.setFilter(QDir::Files | QDir::NoSymLinks);
 		trimapDir.setSorting(QDir::Name);
@@ -692,60 +850,29 @@ void VideoEditingWindow::matting()
 		cv::resize(back_ground, back_ground, Size(forsize.cols, forsize.rows), 0, 0, CV_INTER_LINEAR);
 
 
-		for (int i = 0; i < srcList.size(); ++i)
-		{
-			srcFileInfo = srcList.at(i);
-			string srcFilename = src_file_path;
-			srcFilename.append(srcFileInfo.fileName().toLocal8Bit().constData());
-			src = imread(srcFilename);
-
-			trimapFileInfo = trimapList.at(i);
-			string trimapFilename = trimap_file_path;
-			trimapFilename.append(trimapFileInfo.fileName().toLocal8Bit().constData());
-			tmap = imread(trimapFilename);
-
-			//trimap=Mat(tmap.rows,tmap.cols,CV_8UC1, cv::Scalar(0));
-			//if (tmap.channels() == 3)
-			//{
-			//	cv::cvtColor(tmap, tmap, CV_RGB2GRAY);
-			//}
-			//else if (tmap.channels() == 1)
-			//{
-			//	tmap = tmap.clone();
-			//}
-
-			//for (int y = 0; y < tmap.rows; y++)
-			//{
-			//	for (int x = 0; x < tmap.cols; x++)
-			//	{
-			//		uchar v = tmap.at<uchar>(y, x);
-			//		if (v < 20)	//if background
-			//		{
-			//			trimap.at<uchar>(y, x) = MASK_BACKGROUND;
-			//		}
-			//		else if (v >245)	//if foreground
-			//		{
-			//			trimap.at<uchar>(y, x) =  MASK_FOREGROUND;
-			//		}
-			//		else	// if unknown
-			//		{
-			//			trimap.at<uchar>(y, x)  = MASK_COMPUTE;
-			//		}
-			//	}
-			//}
-
-
-			Mat alphaMat;
-
-			// 			cv::imshow("result", resultForeground);
-			// 			cv::waitKey(0);
-			string resultFilename = resultFilepath.toStdString() + "result";
-			string alphaFilename = alphaFilepath.toStdString() + "alpha";
-			resultFilename.append(srcFileInfo.fileName().toLocal8Bit().constData());
-			alphaFilename.append(srcFileInfo.fileName().toLocal8Bit().constData());
-			imwrite(resultFilename, mattingMethod(tmap, src, alphaMat,back_ground));
-			imwrite(alphaFilename, alphaMat);
-		}
+		//decode, matting and encode of consecutive frames overlap
+		string result_file_path = resultFilepath.toStdString();
+		string alpha_file_path = alphaFilepath.toStdString();
+		int nb_frames = std::min(srcList.size(), trimapList.size());
+		mattingPipeline(nb_frames,
+			[&](int i, Mat& src, Mat& tmap)
+			{
+				string srcFilename = src_file_path;
+				srcFilename.append(srcList.at(i).fileName().toLocal8Bit().constData());
+				src = imread(srcFilename);
+
+				string trimapFilename = trimap_file_path;
+				trimapFilename.append(trimapList.at(i).fileName().toLocal8Bit().constData());
+				tmap = imread(trimapFilename);
+				return !src.empty() && !tmap.empty();
+			},
+			[&](int i, const Mat& result, const Mat& alphaMat)
+			{
+				string name = srcList.at(i).fileName().toLocal8Bit().constData();
+				imwrite(result_file_path + "result" + name, result);
+				imwrite(alpha_file_path + "alpha" + name, alphaMat);
+			},
+			back_ground);
 
 		/*TCount = (double)cvGetTickCount()-TCount;
 		totalTime = TCount/(cvGetTickFrequency()*1000000);
@@ -1882,22 +2009,25 @@ void VideoEditingWindow::trimapInterpolation()
 void VideoEditingWindow::mattingVideo()
 {
 	QMessageBox::information(this, "Information", "Matting Video begin!", QMessageBox::Ok);
-	char fileName[200], alphaName[200];
-	Mat srcMat;
-	for (int i = 0; i < totalFrameNumber; i++)
-	{
-		capture.set(CV_CAP_PROP_POS_FRAMES, i);
-		capture >> srcMat;
-
-		Mat alphaMat;
-
-		const char* filePathCh = currentfilePath.c_str();
-		sprintf(fileName, "%sResult/compositeResult%.4d.jpg", filePathCh, i);
-		sprintf(alphaName, "%sAlpha/Aplha%.4d.jpg", filePathCh, i);
-		//sprintf(fileName,"G:\\Liya\\Task\\video matting\\Data\\Result\\compositeResult%.4d.jpg",i);
-		imwrite(fileName, mattingMethod(frame.at(i).trimap, srcMat, alphaMat, back_ground));
-		imwrite(alphaName, alphaMat);
-	}
+	const char* filePathCh = currentfilePath.c_str();
+	mattingPipeline(totalFrameNumber,
+		[&](int i, Mat& srcMat, Mat& trimap)
+		{
+			capture.set(CV_CAP_PROP_POS_FRAMES, i);
+			capture >> srcMat;
+			trimap = frame.at(i).trimap;
+			return !srcMat.empty();
+		},
+		[&](int i, const Mat& result, const Mat& alphaMat)
+		{
+			char fileName[200], alphaName[200];
+			sprintf(fileName, "%sResult/compositeResult%.4d.jpg", filePathCh, i);
+			sprintf(alphaName, "%sAlpha/Aplha%.4d.jpg", filePathCh, i);
+			//sprintf(fileName,"G:\\Liya\\Task\\video matting\\Data\\Result\\compositeResult%.4d.jpg",i);
+			imwrite(fileName, result);
+			imwrite(alphaName, alphaMat);
+		},
+		back_ground);
 	QMessageBox::information(this, "Information", "Matting Video finish!", QMessageBox::Ok);
 }
 
@@ -2551,7 +2681,8 @@ void VideoEditingWindow::caculateAllCorredTexture()
 
 
 			//ʹsimulate õnormal  
-			if (!g_init_normals.size() && g_simulated_normals.size()&& g_simulated_normals[0].size())
+			std::vector<QVector3D> first_normal_array;
+			if (!g_init_normals.size() && g_simulation_cache.getNormals(0, first_normal_array))
 			{
 				QMatrix4x4 inverse_first_obj_tr;
 				if (0 < g_total_frame)
@@ -2566,10 +2697,10 @@ void VideoEditingWindow::caculateAllCorredTexture()
 //					first_obj_tr *= m_rotMatrix;
 				}
 
-				g_init_normals.resize(g_simulated_normals[0].size());
+				g_init_normals.resize(first_normal_array.size());
 				for (size_t i = 0; i < g_init_normals.size(); i++)
 				{
-					g_init_normals[i] = inverse_first_obj_tr *g_simulated_normals[0][i];
+					g_init_normals[i] = inverse_first_obj_tr *first_normal_array[i];
 					g_init_normals[i].normalize();
 				}
 			}
@@ -2595,13 +2726,12 @@ void VideoEditingWindow::caculateAllCorredTexture()
 				}
 			}
 
-			if (c_frame < g_simulated_normals.size())
+			std::vector<QVector3D> simulated_normal_array;
+			if (g_simulation_cache.getNormals(c_frame, simulated_normal_array))
 			{
-				std::vector<QVector3D> simulated_normal_array;
-				simulated_normal_array = g_simulated_normals[c_frame];
 				simulated_isvisable.clear();
 				simulated_isvisable.resize(simulated_normal_array.size());
-				for (size_t i = 0; i < g_simulated_normals.size(); i++)
+				for (size_t i = 0; i < simulated_normal_array.size(); i++)
 				{
 					QVector4D converted_normal = viewproj * QVector4D(simulated_normal_array[i], 0);
 					QVector3D converted_normal_vec = QVector3D(converted_normal.x(), converted_normal.y(), converted_normal.z());
@@ -2786,15 +2916,57 @@ void  VideoEditingWindow::begin_simulate()
 
 
 
+	//the bake runs in background, frames show up in the viewers as they are simulated
 	bullet_wrapper->begin_simulate();
+	if (!simulate_progress)
+	{
+		simulate_progress = new QProgressDialog(tr("Simulating..."), tr("Cancel"), 0, 1, this);
+		simulate_progress->setWindowModality(Qt::NonModal);
+		simulate_progress->setAutoReset(false);
+		simulate_progress->setAutoClose(false);
+		connect(simulate_progress, SIGNAL(canceled()), this, SLOT(cancel_simulate()));
+	}
+	simulate_progress->setRange(0, std::max(videoEditting::g_total_frame, 1));
+	update_simulate_progress();
+	simulate_timer->start(200);
 }
 void  VideoEditingWindow::pause_simulate()
 {
-
+	if (bullet_wrapper)
+		bullet_wrapper->pause_simulate();
+	update_simulate_progress();
 }
 void  VideoEditingWindow::continuie_simulate()
 {
-
+	if (!bullet_wrapper)
+		return;
+	bullet_wrapper->continue_simulate();
+	update_simulate_progress();
+	simulate_timer->start(200);
+}
+void  VideoEditingWindow::cancel_simulate()
+{
+	//stops the bake and drops the frames, pause_simulate() keeps them
+	if (bullet_wrapper)
+		bullet_wrapper->cancel_simulate();
+	update_simulate_progress();
+}
+void  VideoEditingWindow::update_simulate_progress()
+{
+	bool running = bullet_wrapper && bullet_wrapper->isSimulating();
+	if (simulate_progress)
+	{
+		if (running)
+		{
+			simulate_progress->setValue(bullet_wrapper->simulatedFrames());
+			simulate_progress->show();
+		}
+		else
+			simulate_progress->hide();
+	}
+	if (!running)
+		simulate_timer->stop();
+	updateGLView();
 }
 void  VideoEditingWindow::restart()
 {
@@ -16,6 +16,7 @@
 #include <iterator>
 #include <algorithm>
 #include <QtWidgets/QMainWindow>
+#include <QtWidgets/QProgressDialog>
 
 class VideoEditingWindow;
 class PaintCanvas;
@@ -138,6 +139,8 @@ private slots:
 	void begin_simulate();
 	void pause_simulate();
 	void continuie_simulate();
+	void cancel_simulate();
+	void update_simulate_progress();
 	void restart();
 	void step_simulate();
 	void setStrongFaceConstraint();
@@ -171,6 +174,8 @@ private:
 	cv::VideoCapture capture;
 	cv::VideoWriter writer;
 	QTimer *timer;
+	QTimer *simulate_timer;		//polls the progress of the simulation bake
+	QProgressDialog *simulate_progress;
 	double rate;		//֡
 	float delay;		//֡
 	int currentframePos;	//ǰ֡
@@ -1,13 +1,16 @@
 #ifndef _CACULATE_GRODISTANCE
 #define  _CACULATE_GRODISTANCE
 #include <vector>
+#include <cstddef>
+#include "geodesic_context.h"
+// step_callback is called with the mesh after each vertex of the propagation is settled
 void caculteGeodistance(
 	const std::vector<double>& points,
 	const std::vector<unsigned>& faces,
 	int targetVertex,
 	std::vector<float>& distance,
 	int propagate_depth,
-	void* drawbackback =NULL ,int drawback_index = -1);
+	geodesic::GeodesicContext::StepCallback step_callback = NULL);
 
 
 
@@ -17,6 +17,7 @@ public:
 		m_edge_interval_lists_1(mesh->edges().size())
 	{
 		// initialize statistics
+		m_time_consumed       = 0;
 		m_queue_max_size      = 0;
 		m_windows_propagation = 0;
 		m_windows_wavefront   = 0;
@@ -181,6 +182,13 @@ protected:
 	std::vector<IntervalList> m_edge_interval_lists_0;		// windows propagated from adjacent_face[0] of the edge
 	std::vector<IntervalList> m_edge_interval_lists_1;		// windows propagated from adjacent_face[1] of the edge
 
+	// statistics, kept per instance so that several algorithms can propagate concurrently
+	double m_time_consumed;		//how much time does the propagation step takes
+	unsigned m_queue_max_size;			//used for statistics
+	unsigned m_windows_propagation; // how many time a window is propagated
+	unsigned m_windows_wavefront; // the number of windows on the wavefront
+	unsigned m_windows_peak; // the maximum number of windows, used to calculate the memory
+
 };
 
 inline double GeodesicAlgorithmBase::compute_positive_intersection(double start,
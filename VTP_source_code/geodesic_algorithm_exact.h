@@ -20,10 +20,14 @@ namespace geodesic {
 			m_memory_allocator(mesh->edges().size(), mesh->edges().size())
 		{};
 		~GeodesicAlgorithmExact() {};
-		void clear() { m_memory_allocator.clear(); };
+		void clear() { m_memory_allocator.rewind(); };
+
+		// called after each vertex popped from the queue, with the mesh and the step count (e.g. to dump the wavefront)
+		typedef void (*StepCallback)(Mesh& mesh, int step);
 
 		// main entry
-		void propagate(unsigned source,int depth,void* drawbackback =NULL ,int drawback_index = -1);
+		void propagate(unsigned source,int depth,StepCallback step_callback = NULL);
+		void propagate(const std::vector<unsigned>& sources,int depth,StepCallback step_callback = NULL);	// multiple sources share one wavefront
 
 		// print the resulting statistics
 		void print_statistics();
@@ -31,6 +35,7 @@ namespace geodesic {
 	private:
 
 		// simple functions
+		void reset_propagation_data();		// clear vertices, lists and queues left by a previous propagation
 		void initialize_propagation_data();
 		void create_pseudo_source_windows(vertex_pointer &v, bool UpdateFIFOQueue);
 		void erase_from_queue(vertex_pointer v);
@@ -53,21 +58,57 @@ namespace geodesic {
 		std::queue<list_pointer> m_list_queue;                // FIFO queue for lists
 		MemoryAllocator<Interval> m_memory_allocator;		  // quickly allocate and deallocate intervals 
 
-		unsigned m_source;
+		std::vector<unsigned> m_sources;
 	};
 
 	//----------------- simple functions ---------------------
-	inline void GeodesicAlgorithmExact::initialize_propagation_data()
+	inline void GeodesicAlgorithmExact::reset_propagation_data()
 	{
 		clear();
 
-		// initialize source's parameters
-		vertex_pointer source = &(this->mesh()->vertices()[m_source]);
-		source->geodesic_distance() = 0;
-		source->state() = Vertex::INSIDE;
+		m_vertex_queue.clear();
+		while (!m_list_queue.empty()) m_list_queue.pop();
+
+		for (unsigned i = 0; i < m_edge_interval_lists_0.size(); ++i)
+		{
+			m_edge_interval_lists_0[i].clear();
+			m_edge_interval_lists_1[i].clear();
+		}
 
-		// initialize windows around source
-		create_pseudo_source_windows(source, false);
+		std::vector<Vertex>& vertices = this->mesh()->vertices();
+		for (unsigned i = 0; i < vertices.size(); ++i)
+		{
+			vertices[i].geodesic_distance() = GEODESIC_INF;
+			vertices[i].state() = Vertex::OUTSIDE;
+			vertices[i].incident_face() = NULL;
+			vertices[i].incident_point() = 0;
+		}
+
+		// statistics
+		m_queue_max_size = 0;
+		m_windows_propagation = 0;
+		m_windows_wavefront = 0;
+		m_windows_peak = 0;
+	}
+
+	inline void GeodesicAlgorithmExact::initialize_propagation_data()
+	{
+		reset_propagation_data();
+
+		// initialize sources' parameters first, so no source enters M_VERTEX_QUEUE through a neighbouring source
+		for (unsigned i = 0; i < m_sources.size(); ++i)
+		{
+			vertex_pointer source = &(this->mesh()->vertices()[m_sources[i]]);
+			source->geodesic_distance() = 0;
+			source->state() = Vertex::INSIDE;
+		}
+
+		// initialize windows around sources
+		for (unsigned i = 0; i < m_sources.size(); ++i)
+		{
+			vertex_pointer source = &(this->mesh()->vertices()[m_sources[i]]);
+			create_pseudo_source_windows(source, false);
+		}
 	}
 
 	inline void GeodesicAlgorithmExact::erase_from_queue(vertex_pointer v)
@@ -112,7 +153,7 @@ namespace geodesic {
 			list_pointer list = (edge_it->adjacent_faces()[0] == face_it) ? list = interval_list_0(edge_it) : list = interval_list_1(edge_it);
 
 			// create a window
-			interval_pointer candidate = new Interval;
+			interval_pointer candidate = m_memory_allocator.allocate();
 
 			candidate->start() = 0;
 			candidate->stop() = edge_it->length();
@@ -295,7 +336,7 @@ namespace geodesic {
 				else
 				{
 					list->erase(w);
-					delete w;
+					m_memory_allocator.deallocate(w);
 					--m_windows_wavefront;
 				}
 				iter = iter_t;
@@ -326,14 +367,14 @@ namespace geodesic {
 				else
 				{
 					list->erase(w);
-					delete w;
+					m_memory_allocator.deallocate(w);
 					--m_windows_wavefront;
 				}
 				iter = iter_t;
 				break;
 
 			case PropagationDirection:: BOTH:
-				right_w = new Interval;
+				right_w = m_memory_allocator.allocate();
 				memcpy(right_w, w, sizeof(Interval));
 
 				ValidPropagation = compute_propagated_parameters(w->pseudo_x(),
@@ -354,7 +395,7 @@ namespace geodesic {
 				else
 				{
 					list->erase(w);
-					delete w;
+					m_memory_allocator.deallocate(w);
 					--m_windows_wavefront;
 				}
 				iter = iter_t;
@@ -385,7 +426,7 @@ namespace geodesic {
 				}
 				else
 				{
-					delete right_w;
+					m_memory_allocator.deallocate(right_w);
 				}
 				break;
 
@@ -428,7 +469,7 @@ namespace geodesic {
 			if (!w_survive)
 			{
 				list->erase(iter_t);
-				delete iter_t;
+				m_memory_allocator.deallocate(iter_t);
 				--m_windows_wavefront;
 			}
 		}
@@ -604,13 +645,13 @@ namespace geodesic {
 				}
 
 				list->erase(iter_t);
-				delete iter_t;
+				m_memory_allocator.deallocate(iter_t);
 				--m_windows_wavefront;
 				break;
 
 			case geodesic::w2_invalid:
 				list->erase(next);
-				delete next;
+				m_memory_allocator.deallocate(next);
 				--m_windows_wavefront;
 				break;
 
@@ -645,10 +686,15 @@ namespace geodesic {
 	}
 
 	//-------------------------- main entry --------------------------
-	inline void GeodesicAlgorithmExact::propagate(unsigned source,int propagate_depth,void* drawbackback,int drawback_index)
+	inline void GeodesicAlgorithmExact::propagate(unsigned source,int propagate_depth,StepCallback step_callback)
+	{
+		propagate(std::vector<unsigned>(1, source), propagate_depth, step_callback);
+	}
+
+	inline void GeodesicAlgorithmExact::propagate(const std::vector<unsigned>& sources,int propagate_depth,StepCallback step_callback)
 	{
 		// initialization
-		m_source = source;
+		m_sources = sources;
 		initialize_propagation_data();
 
 		clock_t start = clock();
@@ -754,8 +800,8 @@ namespace geodesic {
 				m_queue_max_size = m_vertex_queue.size();
 			++ count;
 //			printMesh(  *m_mesh ,"./data/","propagate_test", count);
-			//if( 0 == drawback_index )
-			//	( (void (*)(geodesic::Mesh&,int) )drawbackback)(*m_mesh ,count);
+			if (step_callback)
+				step_callback(*m_mesh, count);
 			if(count > propagate_depth)
 				break;
 		}
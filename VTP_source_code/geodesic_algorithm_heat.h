@@ -0,0 +1,265 @@
+#ifndef GEODESIC_ALGORITHM_HEAT
+#define GEODESIC_ALGORITHM_HEAT
+
+#include "stdafx.h"
+#include "geodesic_mesh.h"
+#include "geodesic_constants_and_simple_functions.h"
+#include <algorithm>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+namespace geodesic {
+
+	// Approximate geodesic distance with the heat method (Crane et al. 2013):
+	// heat is diffused from the sources for a short time t, its normalized
+	// gradient is integrated back with a Poisson solve. The cotan Laplacian
+	// and the mass matrix are factored once in the constructor, so every
+	// query costs two sparse back-substitutions. propagate() only reads the
+	// precomputed data and can be called from several threads at once.
+	// Vertices of connected components without any source are left at
+	// GEODESIC_INF, like the exact algorithm does.
+	class GeodesicAlgorithmHeat
+	{
+	public:
+		typedef Eigen::SparseMatrix<double> SparseMatrix;
+		typedef Eigen::SimplicialLDLT<SparseMatrix> Factorization;
+
+		// time_factor scales the diffusion time t = time_factor * h^2, h being the mean edge length
+		GeodesicAlgorithmHeat(geodesic::Mesh* mesh, double time_factor = 1.0);
+		~GeodesicAlgorithmHeat() {};
+
+		// main entry: distance to the nearest source for every vertex.
+		// There is no wavefront to stop, so a propagate_depth >= 0 is emulated by
+		// keeping only the propagate_depth + 1 nearest vertices (the exact algorithm
+		// settles one vertex per step), the others are set to GEODESIC_INF.
+		void propagate(const std::vector<unsigned>& sources, std::vector<double>& distance, int propagate_depth = -1) const;
+
+		bool valid() const { return m_valid; }
+
+	private:
+		struct HeatFace
+		{
+			unsigned v[3];		// vertex ids
+			double cot[3];		// cotangent of the corner angle at v[i]
+		};
+
+		void build_operators(geodesic::Mesh* mesh, double time_factor);
+		void build_components(geodesic::Mesh* mesh);
+
+		std::vector<Eigen::Vector3d> m_points;
+		std::vector<HeatFace> m_faces;
+		Eigen::VectorXd m_mass;				// lumped (barycentric) vertex areas
+		std::vector<unsigned> m_component;	// connected component of each vertex
+		unsigned m_num_components;
+
+		Factorization m_heat_solver;		// M + t * Lc
+		Factorization m_poisson_solver;		// Lc, slightly regularized
+
+		bool m_valid;
+	};
+
+	inline GeodesicAlgorithmHeat::GeodesicAlgorithmHeat(geodesic::Mesh* mesh, double time_factor)
+	{
+		build_operators(mesh, time_factor);
+		build_components(mesh);
+	}
+
+	inline void GeodesicAlgorithmHeat::build_components(geodesic::Mesh* mesh)
+	{
+		const unsigned num_vertices = mesh->vertices().size();
+		m_component.assign(num_vertices, num_vertices);
+		m_num_components = 0;
+
+		std::vector<unsigned> stack;
+		for (unsigned i = 0; i < num_vertices; ++i)
+		{
+			if (m_component[i] != num_vertices)
+				continue;
+			m_component[i] = m_num_components;
+			stack.push_back(i);
+			while (!stack.empty())
+			{
+				Vertex& v = mesh->vertices()[stack.back()];
+				stack.pop_back();
+				for (unsigned j = 0; j < v.adjacent_edges().size(); ++j)
+				{
+					unsigned n = v.adjacent_edges()[j]->opposite_vertex(&v)->id();
+					if (m_component[n] == num_vertices)
+					{
+						m_component[n] = m_num_components;
+						stack.push_back(n);
+					}
+				}
+			}
+			++m_num_components;
+		}
+	}
+
+	inline void GeodesicAlgorithmHeat::build_operators(geodesic::Mesh* mesh, double time_factor)
+	{
+		const unsigned num_vertices = mesh->vertices().size();
+		const unsigned num_faces = mesh->faces().size();
+
+		m_points.resize(num_vertices);
+		for (unsigned i = 0; i < num_vertices; ++i)
+		{
+			Vertex& v = mesh->vertices()[i];
+			m_points[i] = Eigen::Vector3d(v.x(), v.y(), v.z());
+		}
+
+		double mean_edge = 0;
+		for (unsigned i = 0; i < mesh->edges().size(); ++i)
+			mean_edge += mesh->edges()[i].length();
+		mean_edge /= std::max<std::size_t>(mesh->edges().size(), 1);
+
+		// cotan Laplacian (positive semi-definite) and lumped mass
+		std::vector<Eigen::Triplet<double> > laplacian;
+		laplacian.reserve(num_faces * 12);
+		m_mass = Eigen::VectorXd::Zero(num_vertices);
+		m_faces.resize(num_faces);
+		for (unsigned i = 0; i < num_faces; ++i)
+		{
+			Face& f = mesh->faces()[i];
+			HeatFace& hf = m_faces[i];
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				hf.v[j] = f.adjacent_vertices()[j]->id();
+				hf.cot[j] = 1.0 / tan(std::max(f.corner_angles()[j], 1e-8));
+			}
+
+			const Eigen::Vector3d& p0 = m_points[hf.v[0]];
+			double area = 0.5 * (m_points[hf.v[1]] - p0).cross(m_points[hf.v[2]] - p0).norm();
+
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				m_mass[hf.v[j]] += area / 3.0;
+
+				// the angle at v[j] weights the opposite edge (v[j+1], v[j+2])
+				unsigned a = hf.v[(j + 1) % 3];
+				unsigned b = hf.v[(j + 2) % 3];
+				double w = 0.5 * hf.cot[j];
+				laplacian.push_back(Eigen::Triplet<double>(a, b, -w));
+				laplacian.push_back(Eigen::Triplet<double>(b, a, -w));
+				laplacian.push_back(Eigen::Triplet<double>(a, a, w));
+				laplacian.push_back(Eigen::Triplet<double>(b, b, w));
+			}
+		}
+
+		SparseMatrix Lc(num_vertices, num_vertices);
+		Lc.setFromTriplets(laplacian.begin(), laplacian.end());
+
+		SparseMatrix M(num_vertices, num_vertices);
+		std::vector<Eigen::Triplet<double> > mass;
+		mass.reserve(num_vertices);
+		for (unsigned i = 0; i < num_vertices; ++i)
+			mass.push_back(Eigen::Triplet<double>(i, i, m_mass[i]));
+		M.setFromTriplets(mass.begin(), mass.end());
+
+		double t = time_factor * mean_edge * mean_edge;
+		SparseMatrix heat = M + t * Lc;
+		m_heat_solver.compute(heat);
+
+		// Lc is singular (constants are in its kernel), a tiny mass term keeps LDLT well defined
+		SparseMatrix poisson = Lc + 1e-8 * M;
+		m_poisson_solver.compute(poisson);
+
+		m_valid = (m_heat_solver.info() == Eigen::Success) && (m_poisson_solver.info() == Eigen::Success);
+		if (!m_valid)
+		{
+			std::cout << "heat method: factorization failed" << std::endl;
+		}
+	}
+
+	inline void GeodesicAlgorithmHeat::propagate(const std::vector<unsigned>& sources, std::vector<double>& distance, int propagate_depth) const
+	{
+		const unsigned num_vertices = m_points.size();
+		distance.assign(num_vertices, GEODESIC_INF);
+		if (!m_valid || sources.empty())
+			return;
+
+		// (1) diffuse heat from the sources
+		Eigen::VectorXd delta = Eigen::VectorXd::Zero(num_vertices);
+		for (unsigned i = 0; i < sources.size(); ++i)
+			delta[sources[i]] = 1.0;
+		Eigen::VectorXd u = m_heat_solver.solve(delta);
+
+		// (2) normalized negative gradient per face, accumulated as integrated divergence per vertex
+		Eigen::VectorXd divergence = Eigen::VectorXd::Zero(num_vertices);
+		for (unsigned i = 0; i < m_faces.size(); ++i)
+		{
+			const HeatFace& hf = m_faces[i];
+			const Eigen::Vector3d& p0 = m_points[hf.v[0]];
+			const Eigen::Vector3d& p1 = m_points[hf.v[1]];
+			const Eigen::Vector3d& p2 = m_points[hf.v[2]];
+
+			Eigen::Vector3d normal = (p1 - p0).cross(p2 - p0);
+			double double_area = normal.norm();
+			if (double_area < 1e-30)
+				continue;
+			normal /= double_area;
+
+			Eigen::Vector3d gradient = (u[hf.v[0]] * normal.cross(p2 - p1) +
+										u[hf.v[1]] * normal.cross(p0 - p2) +
+										u[hf.v[2]] * normal.cross(p1 - p0)) / double_area;
+			double length = gradient.norm();
+			if (length < 1e-30)
+				continue;
+			Eigen::Vector3d X = -gradient / length;
+
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				unsigned j1 = (j + 1) % 3;
+				unsigned j2 = (j + 2) % 3;
+				const Eigen::Vector3d& p = m_points[hf.v[j]];
+				Eigen::Vector3d e1 = m_points[hf.v[j1]] - p;
+				Eigen::Vector3d e2 = m_points[hf.v[j2]] - p;
+				divergence[hf.v[j]] += 0.5 * (hf.cot[j2] * e1.dot(X) + hf.cot[j1] * e2.dot(X));
+			}
+		}
+
+		// (3) recover the distance: Lc * phi = -div X
+		Eigen::VectorXd phi = m_poisson_solver.solve(-divergence);
+
+		// phi is known up to a constant per connected component: shift each
+		// component so that its nearest source is at 0, components without
+		// source stay unreached
+		std::vector<double> shift(m_num_components, GEODESIC_INF);
+		for (unsigned i = 0; i < sources.size(); ++i)
+		{
+			double& s = shift[m_component[sources[i]]];
+			s = std::min(s, phi[sources[i]]);
+		}
+
+		for (unsigned i = 0; i < num_vertices; ++i)
+		{
+			double s = shift[m_component[i]];
+			if (s < GEODESIC_INF)
+				distance[i] = std::max(0.0, phi[i] - s);
+		}
+
+		if (propagate_depth >= 0 && (unsigned)propagate_depth + 1 < num_vertices)
+		{
+			std::vector<double> sorted(distance);
+			std::nth_element(sorted.begin(), sorted.begin() + propagate_depth, sorted.end());
+			double cutoff = sorted[propagate_depth];
+			unsigned ties = propagate_depth + 1;		// vertices at the cutoff that can still be kept
+			for (unsigned i = 0; i < num_vertices; ++i)
+				if (distance[i] < cutoff)
+					--ties;
+			for (unsigned i = 0; i < num_vertices; ++i)
+			{
+				if (distance[i] < cutoff)
+					continue;
+				if (distance[i] == cutoff && ties > 0)
+					--ties;
+				else
+					distance[i] = GEODESIC_INF;
+			}
+		}
+	}
+
+}		//geodesic
+
+#endif
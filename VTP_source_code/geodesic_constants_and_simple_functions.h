@@ -13,13 +13,6 @@ namespace geodesic{
 
 double const GEODESIC_INF = 1e100;
 
-// statistics
-static double m_time_consumed;		//how much time does the propagation step takes
-static unsigned m_queue_max_size;			//used for statistics
-static unsigned m_windows_propagation; // how many time a window is propagated
-static unsigned m_windows_wavefront; // the number of windows on the wavefront
-static unsigned m_windows_peak; // the maximum number of windows, used to calculate the memory
-
 // two windows' states after checking
 enum windows_state
 {
@@ -0,0 +1,153 @@
+#include "geodesic_context.h"
+#include "geodesic_mesh.h"
+#include "geodesic_algorithm_exact.h"
+#include "geodesic_algorithm_heat.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace geodesic{
+
+const float GeodesicContext::MAX_DISTANCE = 1000.0f;
+
+GeodesicContext::Worker::Worker(const std::vector<double>& points, const std::vector<unsigned>& faces)
+{
+	mesh = new Mesh;
+	mesh->initialize_mesh_data(points, faces);		//create internal mesh data structure including edges
+	algorithm = new GeodesicAlgorithmExact(mesh);
+}
+
+GeodesicContext::Worker::~Worker()
+{
+	delete algorithm;
+	delete mesh;
+}
+
+GeodesicContext::GeodesicContext(const std::vector<double>& points,
+								 const std::vector<unsigned>& faces,
+								 int num_threads):
+	m_points(points),
+	m_faces(faces),
+	m_heat(NULL)
+{
+#ifdef _OPENMP
+	if(num_threads <= 0)
+		num_threads = omp_get_max_threads();
+#else
+	num_threads = 1;
+#endif
+	m_workers.resize(num_threads, NULL);
+
+	clock_t start = clock();
+	worker(0);
+	clock_t stop = clock();
+	float m_time_consumed = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
+	std::cout<<"Build Mesh "<<m_time_consumed<<std::endl;
+}
+
+GeodesicContext::~GeodesicContext()
+{
+	delete m_heat;
+	for(unsigned i = 0; i < m_workers.size(); ++i)
+		delete m_workers[i];
+}
+
+GeodesicContext::Worker& GeodesicContext::worker(int thread_id)
+{
+	if(!m_workers[thread_id])
+		m_workers[thread_id] = new Worker(m_points, m_faces);
+	return *m_workers[thread_id];
+}
+
+GeodesicAlgorithmHeat& GeodesicContext::heat()
+{
+	if(!m_heat)
+	{
+		clock_t start = clock();
+		m_heat = new GeodesicAlgorithmHeat(worker(0).mesh);
+		clock_t stop = clock();
+		float m_time_consumed = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
+		std::cout<<"Factor Heat Operators "<<m_time_consumed<<std::endl;
+	}
+	return *m_heat;
+}
+
+void GeodesicContext::copy_distance(Worker& w, std::vector<float>& distance)
+{
+	std::vector<Vertex>& vertices = w.mesh->vertices();
+	distance.resize(vertices.size());
+	for(unsigned i = 0; i < vertices.size(); ++i)
+	{
+		distance[i] = (float)vertices[i].geodesic_distance();
+		if (distance[i] > MAX_DISTANCE)
+		{
+			distance[i] = MAX_DISTANCE;
+		}
+	}
+}
+
+void GeodesicContext::copy_distance(const std::vector<double>& heat_distance, std::vector<float>& distance)
+{
+	distance.resize(heat_distance.size());
+	for(unsigned i = 0; i < heat_distance.size(); ++i)
+	{
+		distance[i] = (float)std::min(heat_distance[i], (double)MAX_DISTANCE);
+	}
+}
+
+void GeodesicContext::distance(unsigned source, std::vector<float>& distance, int propagate_depth, Engine engine, StepCallback step_callback)
+{
+	this->distance(std::vector<unsigned>(1, source), distance, propagate_depth, engine, step_callback);
+}
+
+void GeodesicContext::distance(const std::vector<unsigned>& sources, std::vector<float>& distance, int propagate_depth, Engine engine, StepCallback step_callback)
+{
+	if(engine == HEAT)
+	{
+		std::vector<double> heat_distance;
+		heat().propagate(sources, heat_distance, propagate_depth);
+		copy_distance(heat_distance, distance);
+		return;
+	}
+
+	Worker& w = worker(0);
+	w.algorithm->propagate(sources, propagate_depth, step_callback);
+	copy_distance(w, distance);
+}
+
+void GeodesicContext::distances(const std::vector<unsigned>& sources,
+								std::vector<std::vector<float> >& distances,
+								int propagate_depth,
+								Engine engine)
+{
+	distances.resize(sources.size());
+	const int num_sources = (int)sources.size();
+
+	if(engine == HEAT)
+	{
+		GeodesicAlgorithmHeat& heat_algorithm = heat();
+
+		#pragma omp parallel for schedule(dynamic) num_threads((int)m_workers.size())
+		for(int i = 0; i < num_sources; ++i)
+		{
+			std::vector<double> heat_distance;
+			heat_algorithm.propagate(std::vector<unsigned>(1, sources[i]), heat_distance, propagate_depth);
+			copy_distance(heat_distance, distances[i]);
+		}
+		return;
+	}
+
+	#pragma omp parallel for schedule(dynamic) num_threads((int)m_workers.size())
+	for(int i = 0; i < num_sources; ++i)
+	{
+#ifdef _OPENMP
+		Worker& w = worker(omp_get_thread_num());
+#else
+		Worker& w = worker(0);
+#endif
+		w.algorithm->propagate(sources[i], propagate_depth);
+		copy_distance(w, distances[i]);
+	}
+}
+
+}//geodesic
@@ -0,0 +1,87 @@
+#ifndef GEODESIC_CONTEXT
+#define GEODESIC_CONTEXT
+
+#include <vector>
+#include <cstddef>
+
+namespace geodesic{
+
+class Mesh;
+class GeodesicAlgorithmExact;
+class GeodesicAlgorithmHeat;
+
+// Keeps the mesh topology, edge data and window allocators alive between
+// queries, so many sources can be answered on the same mesh without
+// rebuilding it. Each thread owns its own copy of the mesh because the
+// propagation writes its state into the mesh vertices.
+// Queries pick their engine at runtime: EXACT runs the window propagation,
+// HEAT the prefactored heat method (approximate, propagate_depth keeps the
+// propagate_depth + 1 nearest vertices instead of stopping a wavefront).
+class GeodesicContext
+{
+public:
+	enum Engine
+	{
+		EXACT,
+		HEAT
+	};
+
+	// same as GeodesicAlgorithmExact::StepCallback, only called by EXACT queries
+	typedef void (*StepCallback)(Mesh& mesh, int step);
+
+	GeodesicContext(const std::vector<double>& points,
+					const std::vector<unsigned>& faces,
+					int num_threads = 0);		// 0 : use every available core
+	~GeodesicContext();
+
+	unsigned num_vertices() const { return (unsigned)(m_points.size() / 3); }
+
+	// distance from one source, same output as caculteGeodistance()
+	void distance(unsigned source,
+				  std::vector<float>& distance,
+				  int propagate_depth,
+				  Engine engine = EXACT,
+				  StepCallback step_callback = NULL);
+
+	// distance to the nearest of several sources, in a single propagation
+	void distance(const std::vector<unsigned>& sources,
+				  std::vector<float>& distance,
+				  int propagate_depth,
+				  Engine engine = EXACT,
+				  StepCallback step_callback = NULL);
+
+	// one independent propagation per source, spread over the threads
+	void distances(const std::vector<unsigned>& sources,
+				   std::vector<std::vector<float> >& distances,
+				   int propagate_depth,
+				   Engine engine = EXACT);
+
+	static const float MAX_DISTANCE;	// unreached vertices are clamped to this value
+
+private:
+	GeodesicContext(const GeodesicContext&);
+	GeodesicContext& operator=(const GeodesicContext&);
+
+	struct Worker
+	{
+		Worker(const std::vector<double>& points, const std::vector<unsigned>& faces);
+		~Worker();
+
+		Mesh* mesh;
+		GeodesicAlgorithmExact* algorithm;
+	};
+
+	Worker& worker(int thread_id);		// built on first use by the thread that owns it
+	GeodesicAlgorithmHeat& heat();		// factored on first HEAT query, shared by all threads
+	void copy_distance(Worker& w, std::vector<float>& distance);
+	void copy_distance(const std::vector<double>& heat_distance, std::vector<float>& distance);
+
+	std::vector<double>   m_points;
+	std::vector<unsigned> m_faces;
+	std::vector<Worker*>  m_workers;
+	GeodesicAlgorithmHeat* m_heat;
+};
+
+}//geodesic
+
+#endif
@@ -80,6 +80,13 @@ public:
 			  m_max_number_of_blocks);
 	}
 
+	void rewind()		//forget all allocated units but keep the blocks for the next use
+	{
+		m_current_block = 0;
+		m_current_position = 0;
+		m_deleted.clear();
+	}
+
 	void reset(unsigned block_size, 
 			   unsigned max_number_of_blocks)
 	{
@@ -89,6 +96,7 @@ public:
 		assert(m_block_size > 0);
 		assert(m_max_number_of_blocks > 0);
 
+		m_current_block = 0;
 		m_current_position = 0;
 
 		m_storage.reserve(max_number_of_blocks);
@@ -106,11 +114,15 @@ public:
 		{
 			if(m_current_position + 1 >= m_block_size)
 			{
-				m_storage.push_back( std::vector<T>() );
-				m_storage.back().resize(m_block_size);
+				++m_current_block;
+				if(m_current_block == m_storage.size())		//blocks kept by rewind() are reused first
+				{
+					m_storage.push_back( std::vector<T>() );
+					m_storage.back().resize(m_block_size);
+				}
 				m_current_position = 0;
 			}
-			result = & m_storage.back()[m_current_position];
+			result = & m_storage[m_current_block][m_current_position];
 			++m_current_position;
 		}
 		else
@@ -134,6 +146,7 @@ private:
 	std::vector<std::vector<T> > m_storage;
 	unsigned m_block_size;				//size of a single block
 	unsigned m_max_number_of_blocks;		//maximum allowed number of blocks
+	unsigned m_current_block;				//block that serves the next allocation
 	unsigned m_current_position;			//first unused element inside the current block
 
 	std::vector<pointer> m_deleted;			//pointers to deleted elemets
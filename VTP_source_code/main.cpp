@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "geodesic_mesh.h"
 #include "geodesic_algorithm_exact.h" 
+#include "geodesic_algorithm_heat.h"
 #include <sstream>
 #include <string>
 using namespace std;
@@ -27,6 +28,53 @@ void printMesh(  geodesic::Mesh& mesh ,std::string path,std::string filename, in
 }
 
 
+// time exact and heat-method distances from the same source and report the heat error against exact
+void benchmarkHeat(geodesic::Mesh& mesh, unsigned source)
+{
+	clock_t start = clock();
+	geodesic::GeodesicAlgorithmExact exact(&mesh);
+	exact.propagate(source, 300000);
+	clock_t stop = clock();
+	double exact_time = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
+
+	std::vector<double> exact_distance(mesh.vertices().size());
+	for(unsigned i=0; i<mesh.vertices().size(); ++i)
+		exact_distance[i] = mesh.vertices()[i].geodesic_distance();
+
+	start = clock();
+	geodesic::GeodesicAlgorithmHeat heat(&mesh);
+	stop = clock();
+	double factor_time = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
+
+	std::vector<double> heat_distance;
+	start = clock();
+	heat.propagate(std::vector<unsigned>(1, source), heat_distance);
+	stop = clock();
+	double heat_time = (static_cast<double>(stop) - static_cast<double>(start)) / CLOCKS_PER_SEC;
+
+	double max_distance = 0, mean_error = 0, max_error = 0;
+	unsigned count = 0;
+	for(unsigned i=0; i<exact_distance.size(); ++i)
+	{
+		if (exact_distance[i] >= geodesic::GEODESIC_INF)
+			continue;
+		double error = fabs(heat_distance[i] - exact_distance[i]);
+		max_distance = std::max(max_distance, exact_distance[i]);
+		max_error = std::max(max_error, error);
+		mean_error += error;
+		++count;
+	}
+	if (count) mean_error /= count;
+	if (max_distance <= 0) max_distance = 1;
+
+	cout << endl;
+	cout << "exact propagation " << exact_time << " seconds" << endl;
+	cout << "heat factorization " << factor_time << " seconds, per source " << heat_time << " seconds" << endl;
+	cout << "speedup per source " << (heat_time > 0 ? exact_time / heat_time : 0) << "x" << endl;
+	cout << "mean error " << mean_error << " (" << 100 * mean_error / max_distance << "% of max distance)" << endl;
+	cout << "max error " << max_error << " (" << 100 * max_error / max_distance << "% of max distance)" << endl;
+}
+
 int main(int argc, char **argv)
 {
 	if(argc == 1)
@@ -37,12 +85,14 @@ int main(int argc, char **argv)
 		cout << "-m [meshFile]: input model file." << endl << endl;
 		cout << "-s [src]: index of source." << endl << endl;
 		cout << "-o [outputFile]: output model file." << endl << endl;
+		cout << "-b: compare the heat method against exact propagation." << endl << endl;
 		return -1;
 	}
 
 	char file_name[255] = {'\0'};
 	char outputMesh[255] = {'\0'};
 	unsigned source_vertex_index = 0; // Source Vertex
+	bool benchmark = false;
 
 	for (int i = 1; i < argc;)
 	{
@@ -62,6 +112,10 @@ int main(int argc, char **argv)
 		{
 			strcpy_s(outputMesh, argv[i+1]); i+=2;
 		}
+		else if (strcmp(argv[i], "-b") == 0)
+		{
+			benchmark = true; ++i;
+		}
 		else ++i;
 	}
 
@@ -87,6 +141,12 @@ int main(int argc, char **argv)
 	mesh.initialize_mesh_data(points, faces);		//create internal mesh data structure including edges
 
 	std::cout << "Build Mesh Success..." << std::endl;
+
+	if (benchmark)
+	{
+		benchmarkHeat(mesh, source_vertex_index);
+		return 0;
+	}
 	
 	geodesic::GeodesicAlgorithmExact algorithm(&mesh);
 
@@ -3,6 +3,8 @@
 #include "solver/fadiff.h"
 #include "solver/badiff.h"
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 using std::cout;
 using std::endl;
@@ -58,7 +60,7 @@ std::vector< B<F<float>> > Skinning_function2( std::vector<B<F<float>> >& ori_ex
 
 
 
-bool ExampleSover::SolveVertices(const std::map<int,Tbx::Vec3>& delta_xi, std::map<int, std::vector<float> >& delta_exampleWeightsOfVertex, std::map<int, std::vector<float> >& ori_exampleWeights)
+bool ExampleSover::SolveVerticesFadbad(const std::map<int,Tbx::Vec3>& delta_xi, std::map<int, std::vector<float> >& delta_exampleWeightsOfVertex, std::map<int, std::vector<float> >& ori_exampleWeights)
 {
 	bool isQlerp = true;
 	auto iter = delta_xi.begin();
@@ -321,6 +323,28 @@ bool ExampleSover::generateSkinningVetex(int vertex_idex ,Tbx::Point3& vtx, cons
 	return true;
 }
 
+void ExampleSover::jacobianFadbad( int vertex_idex, const std::vector<float>& exampleWeights, bool isQlerp, std::vector<float>& jacobian)
+{
+	std::vector<B<F<float>> > fad__exampleWeights( m_numExample);
+	for (int i = 0; i < m_numExample; i++)
+	{
+		fad__exampleWeights[i] = exampleWeights[i];
+		fad__exampleWeights[i].x().diff(i,m_numExample);
+	}
+	std::vector<B<F<float>> > result = Skinning_function( fad__exampleWeights ,m_numExample ,vertex_idex  , isQlerp);
+	for (int i = 0; i < 3; i++)
+	{
+		result[i].diff(i,3);
+	}
+	jacobian.resize(3*m_numExample);
+	for (int i = 0; i < m_numExample; i++)
+	{
+		jacobian[i] = fad__exampleWeights[i].d(0).x();
+		jacobian[m_numExample+i] = fad__exampleWeights[i].d(1).x();
+		jacobian[2*m_numExample+i] = fad__exampleWeights[i].d(2).x();
+	}
+}
+
 bool ExampleSover::solver(int vertex_idex ,Tbx::Point3& vtx, Tbx::Vec3& delta , const std::vector<float>& ori_example ,std::vector<float>& delata_example,bool isQlerp)
 {
 
@@ -336,31 +360,11 @@ bool ExampleSover::solver(int vertex_idex ,Tbx::Point3& vtx, Tbx::Vec3& delta ,
 	{
 		++iter_count;
 		cout<<"itercount "<<iter_count<<endl;
-		std::vector<B<F<float>> > fad__exampleWeights( num_example);
-		for (int i = 0; i < m_numExample; i++)
-		{
-			fad__exampleWeights[i] = inter_oriexample[i];
-			cout<<"fad__exampleWeights"<<"["<<i<<"].x().x()"<< fad__exampleWeights[i].x().x()<< endl;
-			fad__exampleWeights[i].x().diff(i,m_numExample);
-		}
-		int k = 100;
-		std::vector<B<F<float>> > result = Skinning_function( fad__exampleWeights ,m_numExample ,vertex_idex  , isQlerp);
-		//std::vector<B<F<float>> > result = Skinning_function2( fad__exampleWeights,k);
-		for (int i = 0; i < 3; i++)
-		{
-			result[i].diff(i,3);
-			/*result[i].diff(0,1);*/
-			cout<< "result["<<i<<"]: "<<result[i].x().x()<<endl;
-		}
-		std::vector<float> jacobian_x(m_numExample);
-		std::vector<float> jacobian_y(m_numExample);
-		std::vector<float> jacobian_z(m_numExample);
-		for (int i = 0; i < m_numExample; i++)
-		{
-			jacobian_x[i] = fad__exampleWeights[i].d(0).x();
-			jacobian_y[i] = fad__exampleWeights[i].d(1).x();
-			jacobian_z[i] = fad__exampleWeights[i].d(2).x();
-		}
+		std::vector<float> jacobian;
+		jacobianFadbad( vertex_idex, inter_oriexample, isQlerp, jacobian);
+		const float* jacobian_x = &jacobian[0];
+		const float* jacobian_y = &jacobian[m_numExample];
+		const float* jacobian_z = &jacobian[2*m_numExample];
 
 		delata_example.resize(m_numExample,0.0f);
 		float alpha = 50.1f;   //alpha decide the step size
@@ -438,4 +442,203 @@ bool ExampleSover::solver(int vertex_idex ,Tbx::Point3& vtx, Tbx::Vec3& delta ,
 	return true;
 }
 
+void ExampleSover::buildExampleTransfos()
+{
+	m_exampleTransfos.assign( m_numBone * m_numExample * 8, 0.0f);
+	for (int i_example = 0; i_example < m_numExample; ++i_example)
+	{
+		for (int i_bone = 0; i_bone < m_numBone; ++i_bone)
+		{
+			const Tbx::Transfo& transfo = m_transfosOfExamples[i_example*m_numBone+i_bone];
+			Tbx::Quat_cu rotate_quat(transfo);
+			float* dst = &m_exampleTransfos[(i_bone*m_numExample + i_example) * 8];
+			dst[0] = rotate_quat.w();
+			dst[1] = rotate_quat.i();
+			dst[2] = rotate_quat.j();
+			dst[3] = rotate_quat.k();
+			dst[4] = transfo.m[3];
+			dst[5] = transfo.m[7];
+			dst[6] = transfo.m[11];
+		}
+	}
+}
+
+static inline void cross(const float a[3], const float b[3], float c[3])
+{
+	c[0] = a[1]*b[2] - a[2]*b[1];
+	c[1] = a[2]*b[0] - a[0]*b[2];
+	c[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+/*
+	For each bone influence: q = sum(w_e * q_e), u = q/|q|, p' = R(u) p + sum(w_e * t_e)
+	d p'/d w_e = dR(u)p/du * (I - u u^T)/|q| * q_e + t_e
+	R(u) p = p + 2 u_w (v x p) + 2 v x (v x p) with v = (u_i, u_j, u_k), its derivative
+	along the unit sphere is all the projection (I - u u^T) keeps.
+*/
+void ExampleSover::skinningJacobian( int vertex_idex, const float* exampleWeights, float point[3], float* jacobian) const
+{
+	const int i_vertex = vertex_idex;
+	const int num_example = m_numExample;
+	const float p[3] = { m_inputVertices[3*i_vertex], m_inputVertices[3*i_vertex+1], m_inputVertices[3*i_vertex+2] };
+	point[0] = point[1] = point[2] = 0.0f;
+	std::fill( jacobian, jacobian + 3*num_example, 0.0f);
+
+	for (int i_indice= 0; i_indice < m_numbIndices ;++i_indice)
+	{
+		const int i_bone = m_boneWightIdx[i_vertex*m_numbIndices+i_indice];
+		const float bone_weight = m_boneWeights[i_vertex*m_numbIndices+i_indice];
+		const float* transfos = &m_exampleTransfos[i_bone*num_example*8];
+
+		float q[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		float t[3] = {0.0f, 0.0f, 0.0f};
+		for (int i_example = 0 ;i_example< num_example ;++i_example)
+		{
+			const float* tr = transfos + 8*i_example;
+			const float w = exampleWeights[i_example];
+			for (int i = 0; i < 4; i++) q[i] += w*tr[i];
+			for (int i = 0; i < 3; i++) t[i] += w*tr[4+i];
+		}
+		const float norm = std::sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+		const float u[4] = { q[0]/norm, q[1]/norm, q[2]/norm, q[3]/norm };
+		const float v[3] = { u[1], u[2], u[3] };
+
+		float vxp[3], vxvxp[3];
+		cross( v, p, vxp);
+		cross( v, vxp, vxvxp);
+		for (int i = 0; i < 3; i++)
+			point[i] += bone_weight * (p[i] + 2.0f*u[0]*vxp[i] + 2.0f*vxvxp[i] + t[i]);
+
+		// dR(u)p/du, one column per quaternion coefficient
+		float d_rot[4][3];
+		for (int i = 0; i < 3; i++) d_rot[0][i] = 2.0f*vxp[i];
+		for (int a = 0; a < 3; a++)
+		{
+			float e[3] = {0.0f, 0.0f, 0.0f};
+			e[a] = 1.0f;
+			float exp_[3], exvxp[3], vxexp[3];
+			cross( e, p, exp_);
+			cross( e, vxp, exvxp);
+			cross( v, exp_, vxexp);
+			for (int i = 0; i < 3; i++)
+				d_rot[a+1][i] = 2.0f*u[0]*exp_[i] + 2.0f*(exvxp[i] + vxexp[i]);
+		}
+
+		for (int i_example = 0 ;i_example< num_example ;++i_example)
+		{
+			const float* tr = transfos + 8*i_example;
+			const float dot = u[0]*tr[0] + u[1]*tr[1] + u[2]*tr[2] + u[3]*tr[3];
+			float g[4];
+			for (int c = 0; c < 4; c++) g[c] = (tr[c] - u[c]*dot) / norm;
+			for (int i = 0; i < 3; i++)
+			{
+				const float d = d_rot[0][i]*g[0] + d_rot[1][i]*g[1] + d_rot[2][i]*g[2] + d_rot[3][i]*g[3];
+				jacobian[i*num_example + i_example] += bone_weight * (d + tr[4+i]);
+			}
+		}
+	}
+}
+
+bool ExampleSover::solverGaussNewton( int vertex_idex, const Tbx::Vec3& delta, const std::vector<float>& ori_example, std::vector<float>& delata_example) const
+{
+	const int num_example = m_numExample;
+	std::vector<float> weights(ori_example);
+	std::vector<float> jacobian(3*num_example);
+	std::vector<float> step(num_example);
+	float point[3];
+	skinningJacobian( vertex_idex, &weights[0], point, &jacobian[0]);
+	const float target[3] = { point[0] + delta.x, point[1] + delta.y, point[2] + delta.z };
+
+	for (int iter = 0; iter < m_maxIterations; ++iter)
+	{
+		const float residual[3] = { target[0] - point[0], target[1] - point[1], target[2] - point[2] };
+		if( std::sqrt( residual[0]*residual[0] + residual[1]*residual[1] + residual[2]*residual[2]) < m_tolerance)
+			break;
+
+		// keep the weights summing to one: only move along directions whose sum is zero
+		for (int i = 0; i < 3; i++)
+		{
+			float mean = 0.0f;
+			for (int e = 0; e < num_example; e++) mean += jacobian[i*num_example + e];
+			mean /= num_example;
+			for (int e = 0; e < num_example; e++) jacobian[i*num_example + e] -= mean;
+		}
+
+		// under determined system J step = residual, smallest step:
+		// step = J^T (J J^T + lambda I)^-1 residual
+		float A[3][3];
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+			{
+				A[i][j] = 0.0f;
+				for (int e = 0; e < num_example; e++)
+					A[i][j] += jacobian[i*num_example + e] * jacobian[j*num_example + e];
+			}
+		const float lambda = 1e-6f * (A[0][0] + A[1][1] + A[2][2]) + 1e-12f;
+		for (int i = 0; i < 3; i++) A[i][i] += lambda;
+
+		const float c00 = A[1][1]*A[2][2] - A[1][2]*A[2][1];
+		const float c01 = A[1][2]*A[2][0] - A[1][0]*A[2][2];
+		const float c02 = A[1][0]*A[2][1] - A[1][1]*A[2][0];
+		const float det = A[0][0]*c00 + A[0][1]*c01 + A[0][2]*c02;
+		if( std::abs(det) < 1e-30f )
+			break;
+		// A is symmetric, its inverse is the cofactor matrix over the determinant
+		const float inv[3][3] = {
+			{ c00, A[0][2]*A[2][1] - A[0][1]*A[2][2], A[0][1]*A[1][2] - A[0][2]*A[1][1] },
+			{ c01, A[0][0]*A[2][2] - A[0][2]*A[2][0], A[0][2]*A[1][0] - A[0][0]*A[1][2] },
+			{ c02, A[0][1]*A[2][0] - A[0][0]*A[2][1], A[0][0]*A[1][1] - A[0][1]*A[1][0] } };
+		float y[3];
+		for (int i = 0; i < 3; i++)
+			y[i] = (inv[i][0]*residual[0] + inv[i][1]*residual[1] + inv[i][2]*residual[2]) / det;
+
+		float weight_sum = 0.0f;
+		for (int e = 0; e < num_example; e++)
+		{
+			weights[e] += jacobian[e]*y[0] + jacobian[num_example + e]*y[1] + jacobian[2*num_example + e]*y[2];
+			weight_sum += weights[e];
+		}
+		if( std::abs(weight_sum) > 1e-7f )
+			for (int e = 0; e < num_example; e++) weights[e] /= weight_sum;
+
+		skinningJacobian( vertex_idex, &weights[0], point, &jacobian[0]);
+	}
+
+	delata_example.resize(num_example);
+	for (int e = 0; e < num_example; e++)
+		delata_example[e] = weights[e] - ori_example[e];
+	return true;
+}
+
+bool ExampleSover::SolveVertices(const std::map<int,Tbx::Vec3>& delta_xi, std::map<int, std::vector<float> >& delta_exampleWeightsOfVertex, std::map<int, std::vector<float> >& ori_exampleWeights)
+{
+	const int num_vertices = (int)delta_xi.size();
+	std::vector<int> vertices;
+	std::vector<Tbx::Vec3> deltas;
+	std::vector<const std::vector<float>*> ori_examples;
+	vertices.reserve(num_vertices);
+	deltas.reserve(num_vertices);
+	ori_examples.reserve(num_vertices);
+	for (auto iter = delta_xi.begin(); iter != delta_xi.end(); ++iter)
+	{
+		// no example weights for this vertex: leave it out of the solve
+		auto ori = ori_exampleWeights.find(iter->first);
+		if( ori == ori_exampleWeights.end() || (int)ori->second.size() != m_numExample || m_numExample == 0)
+			continue;
+		vertices.push_back(iter->first);
+		deltas.push_back(iter->second);
+		ori_examples.push_back( &ori->second );
+	}
+
+	const int num_solved = (int)vertices.size();
+	std::vector<std::vector<float> > results(num_solved);
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < num_solved; i++)
+	{
+		solverGaussNewton( vertices[i], deltas[i], *ori_examples[i], results[i]);
+	}
 
+	for (int i = 0; i < num_solved; i++)
+		delta_exampleWeightsOfVertex[vertices[i]].swap(results[i]);
+	return true;
+}
@@ -25,8 +25,17 @@ public:
 		m_numbIndices = numbIndices;
 		m_boneWeights =boneWeights;
 		m_boneWightIdx = boneWightIdx;
+		m_maxIterations = 5;
+		m_tolerance = 0.01f;
+		buildExampleTransfos();
 	}
+	// all displaced vertices are solved together and spread over the threads:
+	// damped Gauss-Newton steps with the analytic skinning jacobian
 	bool SolveVertices(const std::map<int,Tbx::Vec3>& delta_xi, std::map<int, std::vector<float> >& delta_exampleWeightsOfVertex, std::map<int, std::vector<float> >& ori_exampleWeights);
+	// previous solver, one vertex after the other with a fadbad jacobian
+	bool SolveVerticesFadbad(const std::map<int,Tbx::Vec3>& delta_xi, std::map<int, std::vector<float> >& delta_exampleWeightsOfVertex, std::map<int, std::vector<float> >& ori_exampleWeights);
+	void setMaxIterations(int max_iter) { m_maxIterations = max_iter; }
+	void setTolerance(float tolerance) { m_tolerance = tolerance; }
 
 
 private:
@@ -35,6 +44,12 @@ private:
 	bool generateSkinningVetex(int vertex_idex ,Tbx::Point3& vtx, const std::vector<float>& ori_exampleWeights , bool isQlerp);
 	std::vector< fadbad::B<fadbad::F<float>> > 
 		Skinning_function( std::vector<fadbad::B<fadbad::F<float>> >& ori_exampleWeights ,int num_example ,int vertex_idex , bool isQlerp);
+	// jacobian[r*m_numExample+e]: derivative of the skinned coordinate r by the weight of example e
+	void jacobianFadbad( int vertex_idex, const std::vector<float>& exampleWeights, bool isQlerp, std::vector<float>& jacobian);
+	// same with the analytic derivatives of the qlerp skinning, also returns the skinned point
+	void skinningJacobian( int vertex_idex, const float* exampleWeights, float point[3], float* jacobian) const;
+	bool solverGaussNewton( int vertex_idex, const Tbx::Vec3& delta, const std::vector<float>& ori_example, std::vector<float>& delata_example) const;
+	void buildExampleTransfos();
 	std::vector<float> m_inputVertices;
 	int m_numVertices;
 	std::vector<Tbx::Transfo> m_transfosOfExamples;
@@ -43,6 +58,11 @@ private:
 	int m_numbIndices;
 	std::vector<float> m_boneWeights;
 	std::vector<int> m_boneWightIdx;
+	// quaternion w i j k, translation x y z, padding for every (bone, example):
+	// m_exampleTransfos[(bone*m_numExample + example)*8]
+	std::vector<float> m_exampleTransfos;
+	int m_maxIterations;
+	float m_tolerance;	// stop when the vertex is closer than this to its target
 
 };
 
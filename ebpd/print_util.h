@@ -2,7 +2,7 @@
 #include "basic_types.h"
 #include <iostream>
 using namespace std;
-inline void printMatrix(MatrixXX& _in)
+inline void printMatrix(const MatrixXX& _in)
 {
 	int n_row = _in.rows();
 	int n_col = _in.cols();
@@ -42,69 +42,39 @@ class Skinning
 {
 
 public:
+	Skinning():m_verbose(false){}
+
+	// print the operands and the results through Logger, off by default
+	void setVerbose( bool verbose){ m_verbose = verbose;}
+
 	//ĬΪ
+	// new_weight is block diagonal: vertex i only reads row i of weight and column i of
+	// tf*oriVerts, so the product is evaluated vertex by vertex without building them
 	MatrixXX caculateTraditionalSkinng( MatrixXX& weight , MatrixXX& tf ,MatrixXX& original,int num_vertex , int num_bone)
 	{
-		Logger<<"weight"<<endl;
-		printMatrix( weight);
-		Logger<<"tf"<<endl;
-		printMatrix( tf);
-		Logger<<"original"<<endl;
-		printMatrix( original);
-
-//		weight.resize( num_vertex,num_bone);
-//		tf.resize(4*num_bone,4);
-//		original.resize( num_vertex,3);
-		MatrixXX oriVerts;
-		oriVerts.resize( 4 ,num_vertex);
-		for( int i = 0 ;i <num_vertex; ++i)
-	   {
-			oriVerts( 0,i) = original(i,0);
-			oriVerts( 1,i) = original(i,1);
-			oriVerts( 2,i) = original(i,2);
-			oriVerts( 3,i) = 1;
-		}
-		Logger<<"oriVerts"<<endl;
-		printMatrix( oriVerts);
-
-		MatrixXX oriTf = tf;
-		Logger<<"oriTf"<<endl;
-		printMatrix( oriTf);
-
-
-		MatrixXX  temp_vtx = oriTf*oriVerts;
-		Logger<<" temp_vtx"<<endl;
-		printMatrix( temp_vtx);
+		logMatrix( "weight", weight);
+		logMatrix( "tf", tf);
+		logMatrix( "original", original);
 
-		MatrixXX  temp_vtx2;
-		temp_vtx2.resize(num_bone*num_vertex,3);
+		MatrixXX new_vtxs;
+		new_vtxs.resize( num_vertex ,3);
 		for( int i = 0 ; i < num_vertex ; ++i)
 		{
+			const ScalarType x = original(i,0), y = original(i,1), z = original(i,2);
+			ScalarType acc[3] = {0, 0, 0};
 			for( int j = 0 ; j < num_bone ; ++j)
 			{
-				temp_vtx2(i*num_bone+j,0) = temp_vtx(j*4 ,i);
-				temp_vtx2(i*num_bone+j,1) = temp_vtx(j*4+1 ,i);
-				temp_vtx2(i*num_bone+j,2) = temp_vtx(j*4+2 ,i);
+				const ScalarType w = weight(i ,j);
+				if( w == 0)
+					continue;
+				for( int r = 0 ; r < 3 ; ++r)
+					acc[r] += w * ( tf(4*j+r,0)*x + tf(4*j+r,1)*y + tf(4*j+r,2)*z + tf(4*j+r,3) );
 			}
-			
+			new_vtxs(i,0) = acc[0];
+			new_vtxs(i,1) = acc[1];
+			new_vtxs(i,2) = acc[2];
 		}
-		Logger<<" temp_vtx2"<<endl;
-		printMatrix( temp_vtx2);
-		MatrixXX new_weight;
-		new_weight.resize(num_vertex ,num_vertex *num_bone);
-		new_weight.setZero();
-		for( int i= 0 ; i < num_vertex ;++i)
-		{
-			for( int j= 0 ; j < num_bone ;++j)
-			{
-				new_weight( i ,i*num_bone+j) =  weight(i ,j);
-			}
-		}
-		Logger<<" new weight"<<endl;
-		printMatrix( new_weight);
-		MatrixXX new_vtxs = new_weight* temp_vtx2;
-		Logger<<"new_vtxs"<<endl;
-		printMatrix( new_vtxs);
+		logMatrix( "new_vtxs", new_vtxs);
 		return new_vtxs;
 	}
 /*
@@ -141,403 +111,22 @@ T  [7B X E]
 */
 	MatrixXX caculateQLEPSkinng( MatrixXX& weight , MatrixXX& tf ,MatrixXX& original ,MatrixXX& eweight ,int num_vertex , int num_bone)
 	{
-		Logger<<"weight"<<endl;
-		printMatrix( weight);
-		Logger<<"tf"<<endl;
-		printMatrix( tf);
-		Logger<<"original"<<endl;
-		printMatrix( original);
-		Logger<<"eweight"<<endl;
-		printMatrix( eweight);
-
-		//		weight.resize( num_vertex,num_bone);
-		//		tf.resize(4*num_bone,4);
-		//		original.resize( num_vertex,3);
-		MatrixXX oriVerts;
-		oriVerts.resize( 4 * num_vertex,num_vertex);
-		oriVerts.setZero();
-		for( int i = 0 ;i <num_vertex; ++i)
-		{
-			oriVerts( 4*i+0,i) = original(i,0);
-			oriVerts( 4*i+1,i) = original(i,1);
-			oriVerts( 4*i+2,i) = original(i,2);
-			oriVerts( 4*i+3,i) = 1;
-		}
-		Logger<<"oriVerts"<<endl;
-		printMatrix( oriVerts);
-
-//tf Ϊ7B X E ľ
-
-		//ȡתĲ
-		MatrixXX qm;
-		int num_exam = eweight.cols();
-		qm.resize( 4*num_bone ,num_exam); //4B X E
-		for( int i  = 0 ; i < num_bone ; ++i)
-		{
-			for( int j = 0; j < num_exam ; ++j )
-			{
-				qm(4*i,j) = tf( 7* i ,j);
-				qm(4*i+1,j) = tf( 7* i+1 ,j);
-				qm(4*i+2,j) = tf( 7* i+2 ,j);
-				qm(4*i+3,j) = tf( 7* i+3 ,j);
-			}
-		}
-		Logger<<"qm"<<endl;
-		printMatrix( qm);
-		//3b*3N
-		MatrixXX rom = qlerp(qm,eweight);
-
-		//ȡƽƲ
-		MatrixXX tm;  //3B XE
-		tm.resize( 3*num_bone , num_exam); //ҰƽƾȻڷڣֻתҪΪ0
-		tm.setZero();
-/*
-		[1 0 0 Tx]
-		[0 1 0 Ty]
-		[0 0 1 Ty]
-		[0 0 0 1]
-*/
-		for( int i  = 0 ; i < num_bone ; ++i)
-		{
-
-			for( int j = 0; j < num_exam ; ++j )
-			{
-				tm(3*i,j) = tf( 7* i+4 ,j);
-				tm(3*i+1,j) = tf( 7* i+5 ,j);
-				tm(3*i+2,j) = tf( 7* i+6 ,j);
-			}
-		}
-		Logger<<"tm"<<endl;
-		printMatrix( tm);
-		//nxE  * EX3B = NX3B
-		MatrixXX traM = eweight * tm.transpose();
-		Logger<<"traM"<<endl;
-		printMatrix( traM);
-
-		traM.transposeInPlace();  //3BXN
-
-		Logger<<"traM"<<endl;
-		printMatrix( traM);
-		MatrixXX mergeM ;
-		mergeM.resize( 4*num_bone ,4 *num_vertex); //4B x4N
-		mergeM.setZero();
-		for( int i = 0 ; i< num_bone ;++i)
-		{
-			for( int j = 0 ; j< num_vertex; ++j)
-			{
-				mergeM( 4*i ,4*j+3) = traM(3*i ,j);
-				mergeM( 4*i+1 ,4*j+3)= traM(3*i+1 ,j);
-				mergeM( 4*i+2 ,4*j+3)= traM(3*i+2 ,j);
-				mergeM( 4*i+3 ,4*j+3)= 1;
-			}
-			for( int j = 0 ; j< num_vertex; ++j)
-			{
-				mergeM( 4*i ,4*j) = rom(3*i ,3*j);
-				mergeM( 4*i ,4*j+1) = rom(3*i ,3*j+1);
-				mergeM( 4*i ,4*j+2) = rom(3*i ,3*j+2);
-				mergeM( 4*i+1 ,4*j) = rom(3*i+1 ,3*j);
-				mergeM( 4*i+1 ,4*j+1) = rom(3*i+1 ,3*j+1);
-				mergeM( 4*i+1 ,4*j+2) = rom(3*i+1 ,3*j+2);
-				mergeM( 4*i+2 ,4*j) =  rom(3*i+2 ,3*j);
-				mergeM( 4*i+2 ,4*j+1) = rom(3*i+2 ,3*j+1);
-				mergeM( 4*i+2 ,4*j+2) = rom(3*i+2 ,3*j+2);
-			}
-		}
-
-		Logger<<"mergeM"<<endl;
-		printMatrix( mergeM);
-
-
-		//MatrixXX  temp_vtx = oriTf*oriVerts;
-		MatrixXX  temp_vtx =  mergeM*oriVerts;
-		Logger<<" temp_vtx"<<endl;
-		printMatrix( temp_vtx);
-
-		MatrixXX  temp_vtx2;
-		temp_vtx2.resize(num_bone*num_vertex,3);
-		for( int i = 0 ; i < num_vertex ; ++i)
-		{
-			for( int j = 0 ; j < num_bone ; ++j)
-			{
-				temp_vtx2(i*num_bone+j,0) = temp_vtx(j*4 ,i);
-				temp_vtx2(i*num_bone+j,1) = temp_vtx(j*4+1 ,i);
-				temp_vtx2(i*num_bone+j,2) = temp_vtx(j*4+2 ,i);
-			}
-
-		}
-		Logger<<" temp_vtx2"<<endl;
-		printMatrix( temp_vtx2);
-		MatrixXX new_weight;
-		new_weight.resize(num_vertex ,num_vertex *num_bone);
-		new_weight.setZero();
-		for( int i= 0 ; i < num_vertex ;++i)
-		{
-			for( int j= 0 ; j < num_bone ;++j)
-			{
-				new_weight( i ,i*num_bone+j) =  weight(i ,j);
-			}
-		}
-		Logger<<" new weight"<<endl;
-		printMatrix( new_weight);
-		MatrixXX new_vtxs = new_weight* temp_vtx2;
-		Logger<<"new_vtxs"<<endl;
-		printMatrix( new_vtxs);
-		return new_vtxs;
+		return qlerpSkinning( weight, tf, original, eweight, num_vertex, num_bone);
 	}
 	//4B X E * NXE' = 4BXN
 	//3B X3N
 	MatrixXX qlerp( MatrixXX& tbe , MatrixXX& Eie)
 	{
-		MatrixXX result ;
-		
-		int num_bone = tbe.rows()/4;
-		int num_sample = Eie.cols();
-		int num_vtx = Eie.rows();
-		result.resize( 4*num_bone,num_vtx);
-		MatrixXX q1; q1.resize(4,1);q1.setZero();
-		double a[4];
-		for( int i = 0 ; i < num_bone ; ++i)
-		{
-			for( int j = 0 ; j < num_vtx; ++j)
-			{
-				for( int k = 0 ; k < num_sample;++k )
-				{
-					a[0] += tbe( 4*i,k)* Eie( j ,k);
-					a[1] += tbe( 4*i+1,k)* Eie( j ,k);
-					a[2] += tbe( 4*i+1,k)* Eie( j ,k);
-					a[3] += tbe( 4*i+1,k)* Eie( j ,k);
-				}
-				result(4*i,j) = a[0]/ sqrt(a[0]*a[0]);
-				result(4*i+1,j) = a[1]/ sqrt(a[1]*a[1]);
-				result(4*i+2,j) = a[2]/ sqrt(a[10]*a[1]);
-				result(4*i+3,j) = a[3]/ sqrt(a[1]*a[1]);
-				a[0] = a[1] = a[2] = a[3] = 0;
-			}
-		}
-		Logger<<"result"<<endl;
-		printMatrix( result);
-		MatrixXX resultM;
-		resultM.resize( 3*num_bone , 3*num_vtx);
-		for( int i = 0 ; i < num_bone ; ++i )
-		{
-			for( int j = 0 ; j < num_vtx; ++j)
-			{
-				tdviewer::Quaternion q( result( 4* i, j) ,result( 4* i+1, j),result( 4* i+2, j),result( 4* i+3, j));
-				double RM[3][3];
-				q.getRotationMatrix(RM);
-				for( int i1 = 0 ; i1 < 3 ;++i1)
-				{
-					for( int i2 = 0; i2 < 3 ;++i2)
-					{
-						resultM( 3*i+i1 ,3*j+i2) = RM[i1][i2];
-					}
-				}
-
-			}
-		}
-		Logger<<"resultM"<<endl;
-		printMatrix( resultM);
-		return resultM;
+		return qlerpRotations( tbe, Eie);
 	}
 	MatrixXXF qlerpF( MatrixXXF& tbe , MatrixXXF& Eie)
 	{
-		MatrixXXF result ;
-
-		int num_bone = tbe.rows()/4;
-		int num_sample = Eie.cols();
-		int num_vtx = Eie.rows();
-		result.resize( 4*num_bone,num_vtx);
-		MatrixXXF q1; q1.resize(4,1);q1.setZero();
-		fadbad::F<double> a[4];
-		for( int i = 0 ; i < num_bone ; ++i)
-		{
-			for( int j = 0 ; j < num_vtx; ++j)
-			{
-				for( int k = 0 ; k < num_sample;++k )
-				{
-					a[0] += tbe( 4*i,k)* Eie( j ,k);
-					a[1] += tbe( 4*i+1,k)* Eie( j ,k);
-					a[2] += tbe( 4*i+1,k)* Eie( j ,k);
-					a[3] += tbe( 4*i+1,k)* Eie( j ,k);
-				}
-				result(4*i,j) = a[0]/ sqrt(a[0]*a[0]);
-				result(4*i+1,j) = a[1]/ sqrt(a[1]*a[1]);
-				result(4*i+2,j) = a[2]/ sqrt(a[10]*a[1]);
-				result(4*i+3,j) = a[3]/ sqrt(a[1]*a[1]);
-				a[0] = a[1] = a[2] = a[3] = 0;
-			}
-		}
-		Logger<<"result"<<endl;
-		printMatrix( result);
-		MatrixXXF resultM;
-		resultM.resize( 3*num_bone , 3*num_vtx);
-		for( int i = 0 ; i < num_bone ; ++i )
-		{
-			for( int j = 0 ; j < num_vtx; ++j)
-			{
-				tdviewer::Quaternion q( result( 4* i, j).val() ,result( 4* i+1, j).val(),result( 4* i+2, j).val(),result( 4* i+3, j).val());
-				double RM[3][3];
-				q.getRotationMatrix(RM);
-				for( int i1 = 0 ; i1 < 3 ;++i1)
-				{
-					for( int i2 = 0; i2 < 3 ;++i2)
-					{
-						resultM( 3*i+i1 ,3*j+i2) = RM[i1][i2];
-					}
-				}
-
-			}
-		}
-		Logger<<"resultM"<<endl;
-		printMatrix( resultM);
-		return resultM;
+		return qlerpRotations( tbe, Eie);
 	}
- 
 
 	MatrixXXF func(const MatrixXXF& weight , const MatrixXXF& tf ,const MatrixXXF& original ,MatrixXXF& eweight ,int num_vertex , int num_bone)
 	{
-		Logger<<"weight"<<endl;
-		printMatrix( weight);
-		Logger<<"tf"<<endl;
-		printMatrix( tf);
-		Logger<<"original"<<endl;
-		printMatrix( original);
-		Logger<<"eweight"<<endl;
-		printMatrix( eweight);
-
-		//		weight.resize( num_vertex,num_bone);
-		//		tf.resize(4*num_bone,4);
-		//		original.resize( num_vertex,3);
-		MatrixXXF oriVerts;
-		oriVerts.resize( 4 * num_vertex,num_vertex);
-		oriVerts.setZero();
-		for( int i = 0 ;i <num_vertex; ++i)
-		{
-			oriVerts( 4*i+0,i) = original(i,0);
-			oriVerts( 4*i+1,i) = original(i,1);
-			oriVerts( 4*i+2,i) = original(i,2);
-			oriVerts( 4*i+3,i) = 1;
-		}
-		Logger<<"oriVerts"<<endl;
-		printMatrix( oriVerts);
-
-//tf Ϊ7B X E ľ
-
-		//ȡתĲ
-		MatrixXXF qm;
-		int num_exam = eweight.cols();
-		qm.resize( 4*num_bone ,num_exam); //4B X E
-		for( int i  = 0 ; i < num_bone ; ++i)
-		{
-			for( int j = 0; j < num_exam ; ++j )
-			{
-				qm(4*i,j) = tf( 7* i ,j);
-				qm(4*i+1,j) = tf( 7* i+1 ,j);
-				qm(4*i+2,j) = tf( 7* i+2 ,j);
-				qm(4*i+3,j) = tf( 7* i+3 ,j);
-			}
-		}
-		Logger<<"qm"<<endl;
-		printMatrix( qm);
-		//3b*3N
-		MatrixXXF rom = qlerpF(qm,eweight);
-
-		//ȡƽƲ
-		MatrixXXF tm;  //3B XE
-		tm.resize( 3*num_bone , num_exam); //ҰƽƾȻڷڣֻתҪΪ0
-		tm.setZero();
-/*
-		[1 0 0 Tx]
-		[0 1 0 Ty]
-		[0 0 1 Ty]
-		[0 0 0 1]
-*/
-		for( int i  = 0 ; i < num_bone ; ++i)
-		{
-
-			for( int j = 0; j < num_exam ; ++j )
-			{
-				tm(3*i,j) = tf( 7* i+4 ,j);
-				tm(3*i+1,j) = tf( 7* i+5 ,j);
-				tm(3*i+2,j) = tf( 7* i+6 ,j);
-			}
-		}
-		Logger<<"tm"<<endl;
-		printMatrix( tm);
-		//nxE  * EX3B = NX3B
-		MatrixXXF traM = eweight * tm.transpose();
-		Logger<<"traM"<<endl;
-		printMatrix( traM);
-
-		traM.transposeInPlace();  //3BXN
-
-		Logger<<"traM"<<endl;
-		printMatrix( traM);
-		MatrixXXF mergeM ;
-		mergeM.resize( 4*num_bone ,4 *num_vertex); //4B x4N
-		mergeM.setZero();
-		for( int i = 0 ; i< num_bone ;++i)
-		{
-			for( int j = 0 ; j< num_vertex; ++j)
-			{
-				mergeM( 4*i ,4*j+3) = traM(3*i ,j);
-				mergeM( 4*i+1 ,4*j+3)= traM(3*i+1 ,j);
-				mergeM( 4*i+2 ,4*j+3)= traM(3*i+2 ,j);
-				mergeM( 4*i+3 ,4*j+3)= 1;
-			}
-			for( int j = 0 ; j< num_vertex; ++j)
-			{
-				mergeM( 4*i ,4*j) = rom(3*i ,3*j);
-				mergeM( 4*i ,4*j+1) = rom(3*i ,3*j+1);
-				mergeM( 4*i ,4*j+2) = rom(3*i ,3*j+2);
-				mergeM( 4*i+1 ,4*j) = rom(3*i+1 ,3*j);
-				mergeM( 4*i+1 ,4*j+1) = rom(3*i+1 ,3*j+1);
-				mergeM( 4*i+1 ,4*j+2) = rom(3*i+1 ,3*j+2);
-				mergeM( 4*i+2 ,4*j) =  rom(3*i+2 ,3*j);
-				mergeM( 4*i+2 ,4*j+1) = rom(3*i+2 ,3*j+1);
-				mergeM( 4*i+2 ,4*j+2) = rom(3*i+2 ,3*j+2);
-			}
-		}
-
-		Logger<<"mergeM"<<endl;
-		printMatrix( mergeM);
-
-
-		//MatrixXX  temp_vtx = oriTf*oriVerts;
-		MatrixXXF  temp_vtx =  mergeM*oriVerts;
-		Logger<<" temp_vtx"<<endl;
-		printMatrix( temp_vtx);
-
-		MatrixXXF  temp_vtx2;
-		temp_vtx2.resize(num_bone*num_vertex,3);
-		for( int i = 0 ; i < num_vertex ; ++i)
-		{
-			for( int j = 0 ; j < num_bone ; ++j)
-			{
-				temp_vtx2(i*num_bone+j,0) = temp_vtx(j*4 ,i);
-				temp_vtx2(i*num_bone+j,1) = temp_vtx(j*4+1 ,i);
-				temp_vtx2(i*num_bone+j,2) = temp_vtx(j*4+2 ,i);
-			}
-
-		}
-		Logger<<" temp_vtx2"<<endl;
-		printMatrix( temp_vtx2);
-		MatrixXXF new_weight;
-		new_weight.resize(num_vertex ,num_vertex *num_bone);
-		new_weight.setZero();
-		for( int i= 0 ; i < num_vertex ;++i)
-		{
-			for( int j= 0 ; j < num_bone ;++j)
-			{
-				new_weight( i ,i*num_bone+j) =  weight(i ,j);
-			}
-		}
-		Logger<<" new weight"<<endl;
-		printMatrix( new_weight);
-		MatrixXXF new_vtxs = new_weight* temp_vtx2;
-		Logger<<"new_vtxs"<<endl;
-		printMatrix( new_vtxs);
-		return new_vtxs;
+		return qlerpSkinning( weight, tf, original, eweight, num_vertex, num_bone);
 	}
 
 	void getJacobian(MatrixXX& out_, const MatrixXXF& weight , const MatrixXXF& tf ,const MatrixXXF& original ,MatrixXXF& eweight,
@@ -650,7 +239,117 @@ this change to nearby vertices using a smoothing kernel
 
 
 private:
-	
+	template<class Matrix>
+	void logMatrix( const char* name, const Matrix& m) const
+	{
+		if( !m_verbose)
+			return;
+		Logger<<name<<endl;
+		printMatrix( m);
+	}
+
+	// rotation matrix of the quaternion (x, y, z, w), same as tdviewer::Quaternion::getRotationMatrix()
+	template<class Scalar>
+	static void quaternionToRotation( const Scalar q[4], Scalar RM[3][3])
+	{
+		const Scalar q00 = 2.0 * q[0] * q[0];
+		const Scalar q11 = 2.0 * q[1] * q[1];
+		const Scalar q22 = 2.0 * q[2] * q[2];
+		const Scalar q01 = 2.0 * q[0] * q[1];
+		const Scalar q02 = 2.0 * q[0] * q[2];
+		const Scalar q03 = 2.0 * q[0] * q[3];
+		const Scalar q12 = 2.0 * q[1] * q[2];
+		const Scalar q13 = 2.0 * q[1] * q[3];
+		const Scalar q23 = 2.0 * q[2] * q[3];
+		RM[0][0] = 1.0 - q11 - q22; RM[0][1] =       q01 - q23; RM[0][2] =       q02 + q13;
+		RM[1][0] =       q01 + q23; RM[1][1] = 1.0 - q22 - q00; RM[1][2] =       q12 - q03;
+		RM[2][0] =       q02 - q13; RM[2][1] =       q12 + q03; RM[2][2] = 1.0 - q11 - q00;
+	}
+
+	// normalized blend of the quaternions of 'bone' (rows 4*bone of tbe, one column per
+	// example) with the example weights of 'vtx' (row vtx of Eie)
+	template<class Matrix>
+	static void blendQuaternion( const Matrix& tbe, int row, const Matrix& Eie, int vtx, typename Matrix::Scalar q[4])
+	{
+		using std::sqrt;
+		typedef typename Matrix::Scalar Scalar;
+		q[0] = q[1] = q[2] = q[3] = Scalar(0.0);
+		for( int k = 0 ; k < Eie.cols(); ++k)
+			for( int c = 0 ; c < 4; ++c)
+				q[c] += tbe( row+c ,k) * Eie( vtx ,k);
+		Scalar norm = sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+		for( int c = 0 ; c < 4; ++c)
+			q[c] = q[c] / norm;
+	}
+
+	template<class Matrix>
+	Matrix qlerpRotations( const Matrix& tbe , const Matrix& Eie) const
+	{
+		typedef typename Matrix::Scalar Scalar;
+		int num_bone = tbe.rows()/4;
+		int num_vtx = Eie.rows();
+		Matrix resultM;
+		resultM.resize( 3*num_bone , 3*num_vtx);
+		for( int i = 0 ; i < num_bone ; ++i )
+		{
+			for( int j = 0 ; j < num_vtx; ++j)
+			{
+				Scalar q[4];
+				blendQuaternion( tbe, 4*i, Eie, j, q);
+				Scalar RM[3][3];
+				quaternionToRotation( q, RM);
+				for( int i1 = 0 ; i1 < 3 ;++i1)
+					for( int i2 = 0; i2 < 3 ;++i2)
+						resultM( 3*i+i1 ,3*j+i2) = RM[i1][i2];
+			}
+		}
+		logMatrix( "resultM", resultM);
+		return resultM;
+	}
 
+	// new_weight * (mergeM * oriVerts) with mergeM and oriVerts block diagonal:
+	// every (vertex, bone) block is built on the fly, memory stays O(N)
+	template<class Matrix>
+	Matrix qlerpSkinning( const Matrix& weight , const Matrix& tf ,const Matrix& original ,const Matrix& eweight ,int num_vertex , int num_bone) const
+	{
+		typedef typename Matrix::Scalar Scalar;
+		logMatrix( "weight", weight);
+		logMatrix( "tf", tf);
+		logMatrix( "original", original);
+		logMatrix( "eweight", eweight);
+
+		//tf Ϊ7B X E ľ
+		const int num_exam = eweight.cols();
+		Matrix new_vtxs;
+		new_vtxs.resize( num_vertex ,3);
+		for( int j = 0 ; j < num_vertex ; ++j)
+		{
+			Scalar acc[3] = { Scalar(0.0), Scalar(0.0), Scalar(0.0) };
+			for( int i = 0 ; i < num_bone ; ++i)
+			{
+				if( weight(j ,i) == 0.0)
+					continue;
+				//ȡתĲ
+				Scalar q[4];
+				blendQuaternion( tf, 7*i, eweight, j, q);
+				Scalar RM[3][3];
+				quaternionToRotation( q, RM);
+
+				//ȡƽƲ
+				Scalar t[3] = { Scalar(0.0), Scalar(0.0), Scalar(0.0) };
+				for( int k = 0 ; k < num_exam ; ++k)
+					for( int r = 0 ; r < 3 ; ++r)
+						t[r] += tf( 7*i+4+r ,k) * eweight( j ,k);
+
+				for( int r = 0 ; r < 3 ; ++r)
+					acc[r] += weight(j ,i) * ( RM[r][0]*original(j,0) + RM[r][1]*original(j,1) + RM[r][2]*original(j,2) + t[r] );
+			}
+			for( int r = 0 ; r < 3 ; ++r)
+				new_vtxs(j ,r) = acc[r];
+		}
+		logMatrix( "new_vtxs", new_vtxs);
+		return new_vtxs;
+	}
 
+	bool m_verbose;
 };
\ No newline at end of file